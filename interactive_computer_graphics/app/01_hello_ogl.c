@@ -13,7 +13,9 @@
 #include <icg/glad.h>
 #include <icg/glsl.h>
 #include <icg/glfw.h>
+#include <icg/headless.h>
 #include <icg/common.h>
+#include <icg/log.h>
 #include <linmath.h>
 
 // vars
@@ -23,6 +25,11 @@ float r_bg, g_bg, b_bg;
 
 GLFWwindow* window;
 
+// headless mode, frames rendered offscreen w/o a window, 0 is off
+unsigned int nr_frames;
+const char *dump_prefix;
+struct icg_headless headless;
+
 GLuint vbo = 0;
 GLuint vao = 0;
 
@@ -33,15 +40,31 @@ GLint nr_vertices;
 
 mat4x4 m, p, mvp;
 
+// headless frames have a fixed size and time step
+void framebuffer_size(int *w, int *h)
+{
+	if (nr_frames) {
+		*w = headless.width;
+		*h = headless.height;
+	} else {
+		glfwGetFramebufferSize(window, w, h);
+	}
+}
+
+double time_s()
+{
+	return nr_frames ? icg_headless_time(&headless) : glfwGetTime();
+}
+
 void glfw_on_framebuffer_resize(GLFWwindow*, int width, int height)
 {
-	printf("on_resize: w=%d h=%d\n", width, height);
+	icg_log_info("on_resize: w=%d h=%d\n", width, height);
 	glViewport(0, 0, width, height);
 }
 
 void glfw_on_key_action(GLFWwindow*, int key, int scancode, int action, int mods)
 {
-	printf("key=%d scancode=%d action=%d mods=%d\n", key, scancode, action, mods);
+	icg_log_debug("key=%d scancode=%d action=%d mods=%d\n", key, scancode, action, mods);
 
 	if (key == 257 && action == 1) {
 		dynamic_background_color = !dynamic_background_color;
@@ -54,7 +77,7 @@ void glfw_on_key_action(GLFWwindow*, int key, int scancode, int action, int mods
 
 void glfw_on_mouse_button(GLFWwindow*, int button, int action, int mods)
 {
-	printf("button=%d action=%d mods=%d\n", button, action, mods);
+	icg_log_debug("button=%d action=%d mods=%d\n", button, action, mods);
 }
 
 // no shader example, static coords of a triangle
@@ -107,7 +130,7 @@ void prepare_proj_1()
 {
 	int r;
 
-	r = shader_prog_create(GLSL_SHADER_SIMPLE_VERT, GLSL_SHADER_SIMPLE_FRAG, &prog);
+	r = shader_prog_load(GLSL_SHADER_SIMPLE_VERT, GLSL_SHADER_SIMPLE_FRAG, &prog);
 	if (r)
 		exit(EXIT_FAILURE);
 
@@ -123,7 +146,7 @@ void prepare_proj_1()
 	};
 
 	nr_vertices = ARRAY_SIZE(positions) / 3;
-	printf("nr_vertices: %d\n", nr_vertices);
+	icg_log_info("nr_vertices: %d\n", nr_vertices);
 
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
@@ -134,11 +157,11 @@ void prepare_proj_1()
 	glNamedBufferData(vbo, sizeof(positions), positions, GL_STATIC_DRAW);
 
 	pos_location = glGetAttribLocation(prog.prog, "pos");
-	printf("'pos' location=%d\n", pos_location);
+	icg_log_info("'pos' location=%d\n", pos_location);
 
 	// draw
 	mvp_location = glGetUniformLocation(prog.prog, "mvp");
-	printf("'mvp' location=%d\n", mvp_location);
+	icg_log_info("'mvp' location=%d\n", mvp_location);
 
 	// glEnableVertexAttribArray() can be used assuming vba implicitly
 	glEnableVertexArrayAttrib(vao, pos_location);
@@ -151,7 +174,7 @@ void prepare_proj_1()
 void render_proj_1()
 {
 	int width, height;
-	glfwGetFramebufferSize(window, &width, &height);
+	framebuffer_size(&width, &height);
 	const float ratio = width / (float) height;
 	// printf("ratio %f\n", ratio);
 
@@ -173,7 +196,7 @@ void render_proj_1()
 
 	mat4x4 m, p, mvp;
 	mat4x4_identity(m);
-	mat4x4_rotate_Z(m, m, (float) glfwGetTime());
+	mat4x4_rotate_Z(m, m, (float) time_s());
 	mat4x4_ortho(p, -ratio, ratio, -1.f, 1.f, 1.f, -1.f);
 	mat4x4_mul(mvp, p, m);
 
@@ -199,33 +222,73 @@ struct run {
 };
 
 
+void usage(const char *name)
+{
+	icg_log_error("usage: %s [-f headless_frames] [-o frame_prefix] [run]\n", name);
+	exit(EXIT_FAILURE);
+}
+
 int main(int argc, char *argv[])
 {
 	struct run *r = &run[0];
-
-	if (argc > 1) {
-		r = &run[atoi(argv[1])];
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:o:")) != -1) {
+		switch (opt) {
+		case 'f':
+			nr_frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			dump_prefix = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
 	}
 
-	glfw_init(NULL);
+	if (optind < argc) {
+		r = &run[atoi(argv[optind])];
+	}
 
-	window = glfw_window_init(640, 480, "Hello ogl");
-	if (!window) {
-		exit(EXIT_FAILURE);
+	if (dump_prefix && !nr_frames) {
+		icg_log_error("frames are dumped in headless mode only\n");
+		usage(argv[0]);
 	}
 
-	glfwSetFramebufferSizeCallback(window, glfw_on_framebuffer_resize);
-	glfwSetKeyCallback(window, glfw_on_key_action);
-	glfwSetMouseButtonCallback(window, glfw_on_mouse_button);
+	if (nr_frames) {
+		if (icg_headless_init(&headless, 640, 480, nr_frames, dump_prefix))
+			exit(EXIT_FAILURE);
+	} else {
+		glfw_init(NULL);
 
-	if (!glad_init()) {
-		fprintf(stderr, "glad_init() fail()\n");
-		exit(EXIT_FAILURE);
+		window = glfw_window_init(640, 480, "Hello ogl");
+		if (!window) {
+			exit(EXIT_FAILURE);
+		}
+
+		glfwSetFramebufferSizeCallback(window, glfw_on_framebuffer_resize);
+		glfwSetKeyCallback(window, glfw_on_key_action);
+		glfwSetMouseButtonCallback(window, glfw_on_mouse_button);
+
+		if (!glad_init()) {
+			icg_log_error("glad_init() fail()\n");
+			exit(EXIT_FAILURE);
+		}
 	}
 
 	r->prepare();
 
-	while (!glfwWindowShouldClose(window)) {
+	if (nr_frames) {
+		while (icg_headless_frame_begin(&headless)) {
+			r->render();
+			if (icg_headless_frame_end(&headless))
+				exit(EXIT_FAILURE);
+		}
+
+		icg_headless_report(&headless);
+	}
+
+	while (window && !glfwWindowShouldClose(window)) {
 		r->render();
 		glfwSwapBuffers(window);
 		glfwPollEvents();
@@ -234,7 +297,10 @@ int main(int argc, char *argv[])
 
 	r->clean();
 
-	glfwDestroyWindow(window);
+	if (window)
+		glfwDestroyWindow(window);
+
+	icg_headless_clean(&headless);
 
 	return 0;
 }
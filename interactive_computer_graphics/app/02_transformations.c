@@ -54,6 +54,9 @@ You can use GLFW instead of FreeGLUT, if you are having problems with GLUT/FreeG
 Mac OS X users can follow this tutorial for installing GLEW.
  */
 
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -62,7 +65,16 @@ Mac OS X users can follow this tutorial for installing GLEW.
 #include <icg/glad.h>
 #include <icg/glsl.h>
 #include <icg/glfw.h>
+#include <icg/headless.h>
 #include <icg/common.h>
+#include <icg/cull.h>
+#include <icg/frame_stats.h>
+#include <icg/gpu_cull.h>
+#include <icg/gpu_ring.h>
+#include <icg/gpu_timer.h>
+#include <icg/log.h>
+#include <icg/mdi.h>
+#include <icg/shader_reload.h>
 
 #include <linmath.h>
 #include <wavefront_obj.h>
@@ -71,12 +83,94 @@ GLFWwindow* window;
 int width, height;
 
 GLuint vbo = 0;
+GLuint ebo = 0;
 GLuint vao = 0;
 struct wf_obj obj;
+struct wf_mesh mesh;
 struct shader_prog prog;
 GLint pos_location;
-GLint mvp_location;
 int nr_vertices;
+int nr_indices;
+GLenum index_type;
+GLsizei vertex_stride;
+GLenum vertex_type = GL_FLOAT;
+GLboolean vertex_normalized = GL_FALSE;
+
+// quantized vertices, mesh units are restored by the dequantization matrix folded into mvp
+int quantize;
+unsigned int quant_flags;
+mat4x4 dequant;
+
+// levels of detail picked by the projected error in pixels, 0 is off
+float lod_pixel_error;
+struct wf_lods lods;
+size_t lod_offsets[WF_LOD_MAX];	// bytes in ebo
+unsigned int lod = 0;
+
+// picking by the middle button, the view projection of the last frame unprojects the cursor
+int pick_enabled;
+struct wf_bvh bvh;
+mat4x4 view_projection;
+
+// crowd mode, copies of the mesh on a grid culled against the frustum every frame, 0 is off
+unsigned int nr_instances;
+mat4x4 *instance_models;	// dequantization is folded in
+uint32_t *visible;
+struct icg_aabbs instance_bounds;
+
+// -g, the instances (of the scene meshes in turn) are culled by a compute pass which writes the draws
+int gpu_culling;
+struct icg_gpu_cull gpu_cull;
+
+// per frame uploads, the mvp block and the models of the visible instances
+struct icg_gpu_ring ring;
+
+// headless mode, frames rendered offscreen along one orbit around the mesh w/o a window, 0 is off
+unsigned int nr_frames;
+const char *dump_prefix;
+struct icg_headless headless;
+float orbit_radius;
+
+// frame instrumentation, a summary is printed at exit and -c writes every frame as csv
+struct icg_frame_stats frame_stats;
+struct icg_gpu_timer draw_timer;
+const char *stats_csv;
+
+// shader hot reload on a hidden window sharing the objects, headless only with -w
+int shader_watch;
+GLFWwindow* reload_window;
+
+// startup pipeline: the mesh is loaded on a thread while the context comes up, then copied to the
+// buffers in chunks through a staging ring between frames, so window frames show the part which arrived.
+// Headless frames are compared between builds, they wait for the whole mesh. Phases are ms since main()
+#define UPLOAD_CHUNK (8 << 20)	// bytes per frame
+
+double started_at;
+pthread_t loader;
+struct icg_gpu_ring staging;
+struct {
+	double context_at;	// context and shaders ready
+	double loaded_at;	// loader thread done
+	double waited_ms;	// main thread blocked on the loader
+	double prepared_at;
+	unsigned int nr_vertices;	// copied
+	unsigned int nr_indices;
+	unsigned int nr_needed;		// vertices referenced by the copied indices
+	unsigned int nr_frames;
+	int active;
+} upload;
+
+// streaming mode, memory limit of the loader in bytes, 0 is off
+const char *filename;
+size_t stream_limit;
+
+// scene mode, more than one file: the meshes are packed into shared buffers and a grid of them is drawn
+// by one multi draw, 0 is off
+unsigned int nr_scene_meshes;
+char **scene_files;
+struct wf_mesh *scene_meshes;	// until packed
+mat4x4 *scene_models;
+struct icg_mdi mdi;
 
 int left_pressed, right_pressed;
 float delta_time = 0.0f;
@@ -89,9 +183,25 @@ double last_x, last_y;
 
 vec3 eye = {0, 0, 30.0f}, center = {0, 0, -1}, up = {0.0f, 1.0f, 0.0f};
 
+// headless frames have a fixed size and time step
+void framebuffer_size(int *w, int *h)
+{
+	if (nr_frames) {
+		*w = headless.width;
+		*h = headless.height;
+	} else {
+		glfwGetFramebufferSize(window, w, h);
+	}
+}
+
+double time_s()
+{
+	return nr_frames ? icg_headless_time(&headless) : glfwGetTime();
+}
+
 void glfw_on_framebuffer_resize(GLFWwindow*, int w, int h)
 {
-	printf("on_resize: w=%d h=%d\n", w, h);
+	icg_log_info("on_resize: w=%d h=%d\n", w, h);
 	glViewport(0, 0, w, h);
 	width = w;
 	height = h;
@@ -104,7 +214,11 @@ void glfw_on_key_action(GLFWwindow*, int key, int scancode, int action, int mods
 	vec3 s;
 	float speed = 10.5f * delta_time;
 
-	printf("key=%d scancode=%d action=%d mods=%d\n", key, scancode, action, mods);
+	icg_log_debug("key=%d scancode=%d action=%d mods=%d\n", key, scancode, action, mods);
+
+	// the reload thread compiles, frames go on with the old program meanwhile
+	if (key == GLFW_KEY_F6 && action == GLFW_PRESS)
+		icg_shader_reload_request();
 
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
 		vec3_scale(s, center, speed);
@@ -131,12 +245,52 @@ void glfw_on_key_action(GLFWwindow*, int key, int scancode, int action, int mods
 	}
 }
 
+// ray from the near to the far plane under the cursor, the mesh is not moved by a model matrix
+void pick()
+{
+	struct wf_bvh_hit hit;
+	mat4x4 inv;
+	vec4 ndc, p[2];
+	vec3 origin, dir;
+	double x, y, us;
+	int w, h, r;
+
+	glfwGetCursorPos(window, &x, &y);
+	glfwGetWindowSize(window, &w, &h);
+	mat4x4_invert(inv, view_projection);
+
+	for (int i = 0; i < 2; i++) {
+		ndc[0] = 2.0f * x / w - 1.0f;
+		ndc[1] = 1.0f - 2.0f * y / h;
+		ndc[2] = i ? 1.0f : -1.0f;
+		ndc[3] = 1.0f;
+		mat4x4_mul_vec4(p[i], inv, ndc);
+	}
+
+	for (int k = 0; k < 3; k++) {
+		origin[k] = p[0][k] / p[0][3];
+		dir[k] = p[1][k] / p[1][3] - origin[k];
+	}
+
+	us = icg_time_ms();
+	r = wf_bvh_intersect(&bvh, &mesh, origin, dir, &hit);
+	us = (icg_time_ms() - us) * 1e3;
+
+	if (r)
+		icg_log_info("pick triangle=%d distance=%f in %.3fus\n", hit.triangle, hit.distance * vec3_len(dir), us);
+	else
+		icg_log_info("pick nothing in %.3fus\n", us);
+}
+
 void glfw_on_mouse_button(GLFWwindow*, int button, int action, int mods)
 {
-	printf("button=%d action=%d mods=%d\n", button, action, mods);
+	icg_log_debug("button=%d action=%d mods=%d\n", button, action, mods);
 
 	if (button == 0) {
 		left_pressed = action == 1;
+	} else if (button == 2) {
+		if (action == 1 && bvh.nr_nodes)
+			pick();
 	} else {
 		right_pressed = action == 1;
 	}
@@ -190,26 +344,425 @@ void glfw_on_cursor_position(GLFWwindow* w, double xpos, double ypos)
 {
 	if (left_pressed) {
 		glfwGetCursorPos(w, &xpos, &ypos);
-		printf("xpos=%f ypos=%f\n", xpos, ypos);
+		icg_log_debug("xpos=%f ypos=%f\n", xpos, ypos);
 		on_yaw_pitch_change(xpos, ypos);
 	}
 
 	if (right_pressed) {
 		glfwGetCursorPos(w, &xpos, &ypos);
-		printf("xpos=%f ypos=%f\n", xpos, ypos);
+		icg_log_debug("xpos=%f ypos=%f\n", xpos, ypos);
 		on_zoom(ypos);
 	}
 }
 
-void prepare()
+void upload_quantized()
+{
+	struct wf_qmesh q;
+	int r;
+
+	r = wf_mesh_quantize(&mesh, quant_flags, &q);
+	if (r)
+		exit(EXIT_FAILURE);
+
+	vertex_stride = q.stride;
+	vertex_type = q.flags & WF_QUANT_UNORM16 ? GL_UNSIGNED_SHORT : GL_SHORT;
+	vertex_normalized = GL_TRUE;
+	glNamedBufferData(vbo, (size_t)q.stride * q.nr_vertices, q.vertices, GL_STATIC_DRAW);
+
+	// position = attribute * scale + offset
+	mat4x4_translate(dequant, q.offset[0], q.offset[1], q.offset[2]);
+	mat4x4_scale_aniso(dequant, dequant, q.scale[0], q.scale[1], q.scale[2]);
+
+	icg_log_info("quantized size=%zu stride=%u position error=%g\n", (size_t)q.stride * q.nr_vertices, q.stride,
+	             q.position_error);
+
+	wf_qmesh_clean(&q);
+}
+
+// all levels one after another in the element buffer
+void upload_lods()
+{
+	size_t size = 0;
+
+	for (unsigned int i = 0; i < lods.nr_lods; i++) {
+		lod_offsets[i] = size;
+		size += (size_t)lods.index_size * lods.lods[i].nr_indices;
+	}
+
+	glNamedBufferData(ebo, size, NULL, GL_STATIC_DRAW);
+
+	for (unsigned int i = 0; i < lods.nr_lods; i++) {
+		glNamedBufferSubData(ebo, lod_offsets[i], (size_t)lods.index_size * lods.lods[i].nr_indices,
+				     lods.lods[i].indices);
+
+		icg_log_info("lod %u triangles=%u error=%g\n", i, lods.lods[i].nr_indices / 3, lods.lods[i].error);
+	}
+}
+
+// distance of the eye to the bounds center, the mesh is not moved by a model matrix
+unsigned int select_lod()
+{
+	vec3 c, d;
+	unsigned int l;
+
+	c[0] = (mesh.bounds_min.x + mesh.bounds_max.x) * 0.5f;
+	c[1] = (mesh.bounds_min.y + mesh.bounds_max.y) * 0.5f;
+	c[2] = (mesh.bounds_min.z + mesh.bounds_max.z) * 0.5f;
+	vec3_sub(d, c, eye);
+
+	l = wf_lods_select(&lods, vec3_len(d), degrees_to_radians(fov), height, lod_pixel_error);
+	if (l != lod)
+		icg_log_info("lod %u -> %u, %u triangles\n", lod, l, lods.lods[l].nr_indices / 3);
+
+	return l;
+}
+
+// grid of copies turned by the golden angle, instance i is of mesh i % nr_meshes, world bounds of a copy
+// enclose its turned mesh bounds
+void spawn_instances(const struct wf_mesh *meshes, unsigned int nr_meshes)
+{
+	unsigned int side = ceilf(sqrtf(nr_instances));
+	float spacing = 0, *bounds;
+	vec3 c, e, extent;
+	mat4x4 model;
+
+	instance_models = malloc(nr_instances * sizeof(*instance_models));
+	visible = malloc(nr_instances * sizeof(*visible));
+	bounds = malloc(nr_instances * 6 * sizeof(*bounds));
+	if (!instance_models || !visible || !bounds) {
+		icg_log_error("malloc() fail\n");
+		exit(EXIT_FAILURE);
+	}
+
+	instance_bounds = (struct icg_aabbs){
+		bounds, bounds + nr_instances, bounds + nr_instances * 2,
+		bounds + nr_instances * 3, bounds + nr_instances * 4, bounds + nr_instances * 5, nr_instances,
+	};
+
+	for (unsigned int i = 0; i < nr_meshes; i++) {
+		e[0] = (meshes[i].bounds_max.x - meshes[i].bounds_min.x) * 0.5f;
+		e[1] = (meshes[i].bounds_max.y - meshes[i].bounds_min.y) * 0.5f;
+		e[2] = (meshes[i].bounds_max.z - meshes[i].bounds_min.z) * 0.5f;
+		if (spacing < vec3_len(e) * 3.0f)
+			spacing = vec3_len(e) * 3.0f;
+	}
+
+	for (unsigned int i = 0; i < nr_instances; i++) {
+		const struct wf_mesh *m = &meshes[i % nr_meshes];
+
+		c[0] = (m->bounds_min.x + m->bounds_max.x) * 0.5f;
+		c[1] = (m->bounds_min.y + m->bounds_max.y) * 0.5f;
+		c[2] = (m->bounds_min.z + m->bounds_max.z) * 0.5f;
+		e[0] = (m->bounds_max.x - m->bounds_min.x) * 0.5f;
+		e[1] = (m->bounds_max.y - m->bounds_min.y) * 0.5f;
+		e[2] = (m->bounds_max.z - m->bounds_min.z) * 0.5f;
+
+		mat4x4_translate(model, ((int)(i % side) - (int)side / 2) * spacing, 0,
+				 -((int)(i / side) - (int)side / 2) * spacing);
+		mat4x4_rotate_Y(model, model, i * 2.39996f);
+		mat4x4_mul(instance_models[i], model, dequant);
+
+		// Arvo, "Transforming Axis-Aligned Bounding Boxes"
+		for (int r = 0; r < 3; r++) {
+			extent[r] = 0;
+			for (int k = 0; k < 3; k++)
+				extent[r] += fabsf(model[k][r]) * e[k];
+		}
+
+		instance_bounds.cx[i] = model[0][0] * c[0] + model[1][0] * c[1] + model[2][0] * c[2] + model[3][0];
+		instance_bounds.cy[i] = model[0][1] * c[0] + model[1][1] * c[1] + model[2][1] * c[2] + model[3][1];
+		instance_bounds.cz[i] = model[0][2] * c[0] + model[1][2] * c[1] + model[2][2] * c[2] + model[3][2];
+		instance_bounds.ex[i] = extent[0];
+		instance_bounds.ey[i] = extent[1];
+		instance_bounds.ez[i] = extent[2];
+	}
+
+	icg_log_info("instances=%u spacing=%f\n", nr_instances, spacing);
+}
+
+// next chunk of the staging ring into dst
+// \return 0 if the ring of this frame is full
+int upload_copy(GLuint dst, size_t dst_offset, const void *src, size_t size)
+{
+	GLintptr offset;
+	void *p = icg_gpu_ring_alloc(&staging, size, 0, &offset);
+
+	if (!p)
+		return 0;
+
+	memcpy(p, src, size);
+	glCopyNamedBufferSubData(staging.buffer, dst, offset, dst_offset, size);
+	return 1;
+}
+
+// one frame of the chunked upload: triangles become drawable once the vertices they reference are copied,
+// the optimized vertex order follows the triangles, so vertices and indices arrive side by side
+void upload_next()
+{
+	const size_t stride = mesh.stride, index_size = mesh.index_size;
+	const unsigned char *indices = mesh.indices;
+	size_t room, n;
+	uint32_t v;
+
+	icg_gpu_ring_begin(&staging);
+
+	for (;;) {
+		room = icg_gpu_ring_room(&staging, 0);
+
+		if (upload.nr_vertices < upload.nr_needed) {
+			n = upload.nr_needed - upload.nr_vertices;
+			if (n > room / stride)
+				n = room / stride;
+
+			if (!n || !upload_copy(vbo, upload.nr_vertices * stride,
+					       (const char *)mesh.vertices + upload.nr_vertices * stride, n * stride))
+				break;
+
+			upload.nr_vertices += n;
+			continue;
+		}
+
+		nr_indices = upload.nr_indices;
+		nr_vertices = upload.nr_vertices;
+
+		if (upload.nr_indices < mesh.nr_indices) {
+			n = mesh.nr_indices - upload.nr_indices;
+			if (n > room / index_size / 3 * 3)
+				n = room / index_size / 3 * 3;
+
+			if (!n || !upload_copy(ebo, upload.nr_indices * index_size, indices + upload.nr_indices * index_size,
+					       n * index_size))
+				break;
+
+			for (size_t i = upload.nr_indices; i < upload.nr_indices + n; i++) {
+				v = index_size == 2 ? ((const uint16_t *)indices)[i] : ((const uint32_t *)indices)[i];
+				if (upload.nr_needed <= v)
+					upload.nr_needed = v + 1;
+			}
+
+			upload.nr_indices += n;
+			continue;
+		}
+
+		// vertices of no triangle, all of a point cloud
+		if (upload.nr_vertices < mesh.nr_vertices) {
+			upload.nr_needed = mesh.nr_vertices;
+			continue;
+		}
+
+		upload.active = 0;
+		break;
+	}
+
+	icg_gpu_ring_end(&staging);
+	upload.nr_frames++;
+
+	if (!upload.active) {
+		icg_log_info("mesh uploaded in %u frames at %.3fms\n", upload.nr_frames, icg_time_ms() - started_at);
+		icg_gpu_ring_clean(&staging);
+	}
+}
+
+void upload_mesh()
+{
+	nr_vertices = mesh.nr_vertices;
+
+	// quantized and lod buffers are built from the whole mesh, they go up at once
+	if (!quantize && !lods.nr_lods) {
+		vertex_stride = mesh.stride;
+		index_type = mesh.index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+		glNamedBufferData(vbo, (size_t)mesh.stride * mesh.nr_vertices, NULL, GL_STATIC_DRAW);
+		glNamedBufferData(ebo, (size_t)mesh.index_size * mesh.nr_indices, NULL, GL_STATIC_DRAW);
+
+		if (icg_gpu_ring_init(&staging, UPLOAD_CHUNK))
+			exit(EXIT_FAILURE);
+
+		// nothing is drawn until the first chunk arrives
+		nr_vertices = 0;
+		nr_indices = 0;
+		upload.active = 1;
+
+		icg_log_info("size=%zu indices=%u size=%zu, %d bytes chunks\n", (size_t)mesh.stride * mesh.nr_vertices,
+			     mesh.nr_indices, (size_t)mesh.index_size * mesh.nr_indices, UPLOAD_CHUNK);
+		return;
+	}
+
+	if (quantize) {
+		upload_quantized();
+	} else {
+		vertex_stride = mesh.stride;
+		glNamedBufferData(vbo, (size_t)mesh.stride * mesh.nr_vertices, mesh.vertices, GL_STATIC_DRAW);
+
+		icg_log_info("size=%zu\n", (size_t)mesh.stride * mesh.nr_vertices);
+	}
+
+	nr_indices = mesh.nr_indices;
+	if (nr_indices) {
+		index_type = mesh.index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+		if (lods.nr_lods)
+			upload_lods();
+		else
+			glNamedBufferData(ebo, (size_t)mesh.index_size * mesh.nr_indices, mesh.indices, GL_STATIC_DRAW);
+
+		icg_log_info("indices=%d size=%zu\n", nr_indices, (size_t)mesh.index_size * mesh.nr_indices);
+	}
+}
+
+// positions and triangles only, buffers are sized by the count pass and filled batch by batch
+void upload_stream()
+{
+	struct wf_stream s;
+	GLuint *indices;
+	int r, nr_batches = 0;
+
+	r = wf_stream_open(filename, WF_OBJ_PRESIZE, stream_limit, &s);
+	if (r)
+		exit(EXIT_FAILURE);
+
+	indices = malloc(s.batch.cap_corners * sizeof(*indices));
+	if (!indices) {
+		icg_log_error("malloc() fail\n");
+		exit(EXIT_FAILURE);
+	}
+
+	nr_vertices = s.nr_vertices;
+	nr_indices = s.nr_corners;
+	index_type = GL_UNSIGNED_INT;
+	vertex_stride = sizeof(struct wf_vertex);
+
+	glNamedBufferData(vbo, sizeof(struct wf_vertex) * s.nr_vertices, NULL, GL_STATIC_DRAW);
+	glNamedBufferData(ebo, sizeof(*indices) * s.nr_corners, NULL, GL_STATIC_DRAW);
+
+	while (!(r = wf_stream_next(&s))) {
+		glNamedBufferSubData(vbo, sizeof(struct wf_vertex) * s.first_vertex,
+				     sizeof(struct wf_vertex) * s.batch.nr_vertices, s.batch.vertices);
+
+		for (unsigned int i = 0; i < s.batch.nr_corners; i++)
+			indices[i] = s.batch.corners[i].v;
+
+		glNamedBufferSubData(ebo, sizeof(*indices) * s.first_corner,
+				     sizeof(*indices) * s.batch.nr_corners, indices);
+
+		nr_batches++;
+	}
+
+	free(indices);
+	wf_stream_close(&s);
+
+	if (r != ENODATA)
+		exit(EXIT_FAILURE);
+
+	icg_log_info("streamed %d vertices %d indices in %d batches\n", nr_vertices, nr_indices, nr_batches);
+}
+
+// no mesh needed, runs while the loader thread works
+void prepare_shaders()
 {
 	int r;
 
-	r = shader_prog_create(GLSL_SHADER_PRJ_02_VERT, GLSL_SHADER_SIMPLE_FRAG, &prog);
+	if (nr_scene_meshes || gpu_culling)
+		r = shader_prog_load(GLSL_SHADER_MDI_VERT, GLSL_SHADER_SIMPLE_FRAG, &prog);
+	else if (nr_instances)
+		r = shader_prog_load(GLSL_SHADER_PRJ_02_INSTANCED_VERT, GLSL_SHADER_SIMPLE_FRAG, &prog);
+	else
+		r = shader_prog_load(GLSL_SHADER_PRJ_02_VERT, GLSL_SHADER_SIMPLE_FRAG, &prog);
 	if (r)
 		exit(EXIT_FAILURE);
 
 	shader_prog_bind(&prog);
+}
+
+// packed by the mdi renderer
+void scene_meshes_clean()
+{
+	for (unsigned int i = 0; i < nr_scene_meshes && scene_meshes; i++)
+		wf_mesh_clean(&scene_meshes[i]);
+
+	free(scene_meshes);
+	scene_meshes = NULL;
+}
+
+// shared buffers of all meshes, the meshes themselves are not needed after
+void prepare_scene()
+{
+	size_t draws = nr_scene_meshes * (sizeof(struct icg_mdi_command) + sizeof(mat4x4));
+
+	mat4x4_identity(dequant);
+
+	if (icg_mdi_init(&mdi, scene_meshes, nr_scene_meshes))
+		exit(EXIT_FAILURE);
+
+	scene_meshes_clean();
+
+	// the mvp block, commands and models and the alignment of each
+	if (icg_gpu_ring_init(&ring, 2048 + draws))
+		exit(EXIT_FAILURE);
+}
+
+// the instances go to the gpu once, the cpu copies are not needed after
+void prepare_gpu_cull()
+{
+	const struct wf_mesh *meshes = nr_scene_meshes ? scene_meshes : &mesh;
+	unsigned int n = nr_scene_meshes ? nr_scene_meshes : 1;
+	struct icg_gpu_cull_instance *instances;
+	int r;
+
+	mat4x4_identity(dequant);
+	spawn_instances(meshes, n);
+
+	if (icg_mdi_init(&mdi, meshes, n))
+		exit(EXIT_FAILURE);
+
+	scene_meshes_clean();
+
+	instances = malloc(nr_instances * sizeof(*instances));
+	if (!instances) {
+		icg_log_error("malloc() fail\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (unsigned int i = 0; i < nr_instances; i++) {
+		memcpy(instances[i].model, instance_models[i], sizeof(instances[i].model));
+		instances[i].center[0] = instance_bounds.cx[i];
+		instances[i].center[1] = instance_bounds.cy[i];
+		instances[i].center[2] = instance_bounds.cz[i];
+		instances[i].mesh = i % n;
+		instances[i].extent[0] = instance_bounds.ex[i];
+		instances[i].extent[1] = instance_bounds.ey[i];
+		instances[i].extent[2] = instance_bounds.ez[i];
+		instances[i].pad = 0;
+	}
+
+	r = icg_gpu_cull_init(&gpu_cull, &mdi, instances, nr_instances);
+	free(instances);
+	if (r)
+		exit(EXIT_FAILURE);
+
+	free(instance_models);
+	free(visible);
+	free(instance_bounds.cx);
+	instance_models = NULL;
+	visible = NULL;
+	memset(&instance_bounds, 0, sizeof(instance_bounds));
+
+	// the mvp block only
+	if (icg_gpu_ring_init(&ring, 1024))
+		exit(EXIT_FAILURE);
+}
+
+void prepare()
+{
+	if (gpu_culling) {
+		prepare_gpu_cull();
+		goto out;
+	}
+
+	if (nr_scene_meshes) {
+		prepare_scene();
+		goto out;
+	}
 
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
@@ -217,38 +770,159 @@ void prepare()
 	glGenBuffers(1, &vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
 
-	nr_vertices = obj.nr_vertices;
-	glNamedBufferData(vbo, sizeof(struct wf_vertex) * obj.nr_vertices, obj.vertices, GL_STATIC_DRAW);
+	// element buffer binding is a part of vao state
+	glGenBuffers(1, &ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
 
-	printf("size=%zu\n", sizeof(struct wf_vertex) * obj.nr_vertices);
+	mat4x4_identity(dequant);
 
-	pos_location = glGetAttribLocation(prog.prog, "pos");
-	printf("'pos' location=%d\n", pos_location);
+	if (stream_limit)
+		upload_stream();
+	else
+		upload_mesh();
 
-	mvp_location = glGetUniformLocation(prog.prog, "mvp");
-	printf("'mvp' location=%d\n", mvp_location);
+	pos_location = glGetAttribLocation(prog.prog, "pos");
+	icg_log_info("'pos' location=%d\n", pos_location);
 
+	// separate format and binding, a quantized buffer only changes the component type
 	glEnableVertexArrayAttrib(vao, pos_location);
-	glVertexAttribPointer(pos_location, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	glVertexAttribFormat(pos_location, 3, vertex_type, vertex_normalized, 0);
+	glVertexAttribBinding(pos_location, 0);
+	glBindVertexBuffer(0, vbo, 0, vertex_stride);
+
+	// a mat4 attribute takes 4 locations, one column each, advanced once per instance
+	if (nr_instances) {
+		GLint model_location = glGetAttribLocation(prog.prog, "model");
+
+		icg_log_info("'model' location=%d\n", model_location);
+
+		spawn_instances(&mesh, 1);
+
+		for (int i = 0; i < 4; i++) {
+			glEnableVertexArrayAttrib(vao, model_location + i);
+			glVertexAttribFormat(model_location + i, 4, GL_FLOAT, GL_FALSE, i * sizeof(vec4));
+			glVertexAttribBinding(model_location + i, 1);
+		}
 
-	glfwGetFramebufferSize(window, &width, &height);
+		// the buffer is bound every frame, the models are in the ring
+		glVertexBindingDivisor(1, 1);
+	}
+
+	// room for the mvp block and its alignment
+	if (icg_gpu_ring_init(&ring, 1024 + nr_instances * sizeof(mat4x4)))
+		exit(EXIT_FAILURE);
+
+out:
+	glEnable(GL_DEPTH_TEST);
+
+	icg_gpu_timer_init(&draw_timer);
+
+	framebuffer_size(&width, &height);
 
 	last_x = width / 2;
 	last_y = height / 2;
 	last_zoom_y = height / 2;
 
-	printf("widdows w=%d h=%d\n", width, height);
+	icg_log_info("widdows w=%d h=%d\n", width, height);
+}
+
+// mvp block of the frame, binding 0 of the shaders
+int bind_frame_data(mat4x4 mvp)
+{
+	GLintptr offset;
+	mat4x4 *data = icg_gpu_ring_alloc(&ring, sizeof(mat4x4), 0, &offset);
+
+	if (!data)
+		return ENOSPC;
+
+	mat4x4_dup(*data, mvp);
+	glBindBufferRange(GL_UNIFORM_BUFFER, 0, ring.buffer, offset, sizeof(mat4x4));
+	return 0;
+}
+
+// survivors of the frustum test are drawn by one instanced call, mvp is the view projection
+void render_instances(mat4x4 vp, GLsizei count, size_t offset)
+{
+	float planes[6][4];
+	size_t nr_visible;
+	GLintptr models_offset;
+	mat4x4 *models;
+	double us;
+
+	us = icg_time_ms();
+	icg_frustum_planes(planes, vp);
+	nr_visible = icg_cull_aabbs(planes, &instance_bounds, visible);
+	us = (icg_time_ms() - us) * 1e3;
+
+	// survivors go straight to the mapping, no staging copy
+	models = icg_gpu_ring_alloc(&ring, nr_visible * sizeof(mat4x4), sizeof(vec4), &models_offset);
+	if (!models || bind_frame_data(vp))
+		return;
+
+	for (size_t i = 0; i < nr_visible; i++)
+		mat4x4_dup(models[i], instance_models[visible[i]]);
+
+	glBindVertexBuffer(1, ring.buffer, models_offset, sizeof(mat4x4));
+
+	icg_log_debug("instances drawn=%zu culled=%zu cull=%.3fus (%d wide)\n", nr_visible, nr_instances - nr_visible, us,
+	             ICG_CULL_WIDTH);
+
+	if (count)
+		glDrawElementsInstanced(GL_TRIANGLES, count, index_type, (const void *)offset, nr_visible);
+	else if (!mesh.nr_indices)
+		glDrawArraysInstanced(GL_POINTS, 0, nr_vertices, nr_visible);
+}
+
+// the compute pass culls and writes the draws, the cpu neither touches an instance nor waits for the count
+void render_gpu_cull(mat4x4 vp)
+{
+	float planes[6][4];
+
+	if (bind_frame_data(vp))
+		return;
+
+	icg_frustum_planes(planes, vp);
+	icg_gpu_cull_dispatch(&gpu_cull, planes);
+
+	shader_prog_bind(&prog);
+	icg_gpu_cull_draw(&gpu_cull, &mdi);
+}
+
+// every mesh of the scene is a draw of one multi draw, mvp is the view projection
+void render_scene(mat4x4 vp)
+{
+	if (bind_frame_data(vp) || icg_mdi_begin(&mdi, &ring, nr_scene_meshes))
+		return;
+
+	for (unsigned int i = 0; i < nr_scene_meshes; i++)
+		icg_mdi_add(&mdi, i, (const float *)scene_models[i]);
+
+	icg_mdi_submit(&mdi);
 }
 
 void render()
 {
-	mat4x4 v, p, mvp;
-	float current_frame_at = glfwGetTime();
+	mat4x4 v, p, vp, mvp;
+	GLsizei count;
+	size_t offset = 0;
+	float current_frame_at = time_s();
 	delta_time = current_frame_at - last_frame_at;
 	last_frame_at = current_frame_at;
 	const float ratio = width / (float) height;
 
-	glfwGetFramebufferSize(window, &width, &height);
+	framebuffer_size(&width, &height);
+
+	// bindings are fixed in the shaders, a reloaded program only needs to be used
+	if (icg_shader_reload_poll())
+		shader_prog_bind(&prog);
+
+	// waits only if the gpu is frames behind
+	icg_gpu_ring_begin(&ring);
+
+	if (upload.active)
+		upload_next();
+
+	count = nr_indices;
 
 	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
@@ -270,72 +944,440 @@ void render()
 	vec3 d = {0, 0, 0};
 	vec3_add(d, eye, center);
 
-	printf("eye (%f %f %f) dir (%f %f %f) up (%f %f %f)\n", eye[0], eye[1], eye[2], d[0], d[1], d[2], up[0], up[1], up[2]);
+	icg_log_debug("eye (%f %f %f) dir (%f %f %f) up (%f %f %f)\n", eye[0], eye[1], eye[2], d[0], d[1], d[2], up[0], up[1], up[2]);
 	mat4x4_look_at(v, eye, d, up);
 
 	mat4x4_identity(p);
 	mat4x4_perspective(p, degrees_to_radians(fov), ratio, 1.f, 100.0f);
 	//mat4x4_ortho(p, -ratio, ratio, -ratio, ratio, -1.f, 100.f);
 
-	mat4x4_mul(mvp, p, v);
+	mat4x4_mul(vp, p, v);
+	mat4x4_dup(view_projection, vp);
+	mat4x4_mul(mvp, vp, dequant);
+
+	if (lods.nr_lods) {
+		lod = select_lod();
+		count = lods.lods[lod].nr_indices;
+		offset = lod_offsets[lod];
+	}
+
+	icg_gpu_timer_begin(&draw_timer, icg_frame_stats_frame(&frame_stats));
+
+	if (gpu_culling) {
+		render_gpu_cull(vp);
+	} else if (nr_scene_meshes) {
+		render_scene(vp);
+	} else if (nr_instances) {
+		render_instances(vp, count, offset);
+	} else if (!bind_frame_data(mvp)) {
+		// a file w/o faces is drawn as a point cloud, a mesh w/o uploaded triangles not at all
+		if (count)
+			glDrawElements(GL_TRIANGLES, count, index_type, (const void *)offset);
+		else if (!mesh.nr_indices)
+			glDrawArrays(GL_POINTS, 0, nr_vertices);
+	}
+
+	icg_gpu_timer_end(&draw_timer);
+	icg_gpu_ring_end(&ring);
+}
+
+// headless camera, one orbit around the bounds center (the origin for a stream) over all frames at the
+// distance of the start eye
+void camera_path()
+{
+	vec3 target = {0, 0, 0}, d;
+	float a = 2.0f * M_PI * headless.frame / headless.nr_frames;
+
+	if (mesh.nr_vertices) {
+		target[0] = (mesh.bounds_min.x + mesh.bounds_max.x) * 0.5f;
+		target[1] = (mesh.bounds_min.y + mesh.bounds_max.y) * 0.5f;
+		target[2] = (mesh.bounds_min.z + mesh.bounds_max.z) * 0.5f;
+	}
+
+	if (!orbit_radius) {
+		vec3_sub(d, eye, target);
+		orbit_radius = vec3_len(d);
+	}
+
+	eye[0] = target[0] + sinf(a) * orbit_radius;
+	eye[1] = target[1];
+	eye[2] = target[2] + cosf(a) * orbit_radius;
+
+	vec3_sub(d, target, eye);
+	vec3_norm(center, d);
+}
+
+// one cell of a grid per mesh, as wide as the largest mesh, mesh centers at the cell centers
+// \return 0 or an errno code
+int load_scene()
+{
+	unsigned int side = ceilf(sqrtf(nr_scene_meshes));
+	float spacing = 0;
+	struct wf_obj o;
+	vec3 e;
+	int r;
+
+	scene_meshes = calloc(nr_scene_meshes, sizeof(*scene_meshes));
+	scene_models = malloc(nr_scene_meshes * sizeof(*scene_models));
+	if (!scene_meshes || !scene_models) {
+		icg_log_error("malloc() fail\n");
+		return ENOMEM;
+	}
+
+	for (unsigned int i = 0; i < nr_scene_meshes; i++) {
+		struct wf_mesh *m = &scene_meshes[i];
+
+		// a mesh does not need its obj
+		wf_obj_init(&o);
+		o.flags |= WF_OBJ_CACHE | WF_OBJ_OPTIMIZE;
+		r = wf_mesh_load(scene_files[i], &o, m);
+		wf_obj_clean(&o);
+
+		if (r) {
+			icg_log_error("could not load mesh from '%s': %s (%d)\n", scene_files[i], strerror(r), r);
+			return r;
+		}
+
+		e[0] = (m->bounds_max.x - m->bounds_min.x) * 0.5f;
+		e[1] = (m->bounds_max.y - m->bounds_min.y) * 0.5f;
+		e[2] = (m->bounds_max.z - m->bounds_min.z) * 0.5f;
+		if (spacing < vec3_len(e) * 3.0f)
+			spacing = vec3_len(e) * 3.0f;
+	}
+
+	for (unsigned int i = 0; i < nr_scene_meshes; i++) {
+		const struct wf_mesh *m = &scene_meshes[i];
+
+		mat4x4_translate(scene_models[i],
+				 ((int)(i % side) - (int)side / 2) * spacing - (m->bounds_min.x + m->bounds_max.x) * 0.5f,
+				 -(m->bounds_min.y + m->bounds_max.y) * 0.5f,
+				 -((int)(i / side) - (int)side / 2) * spacing - (m->bounds_min.z + m->bounds_max.z) * 0.5f);
+	}
+
+	icg_log_info("scene %u meshes loaded in %.3fms, spacing=%f\n", nr_scene_meshes, icg_time_ms() - started_at,
+		     spacing);
+	return 0;
+}
+
+// everything which needs the mesh but no context
+// \return 0 or an errno code
+void *load_mesh(void *arg)
+{
+	intptr_t r;
+
+	(void)arg;
+
+	if (nr_scene_meshes) {
+		r = load_scene();
+		upload.loaded_at = icg_time_ms() - started_at;
+		return (void *)r;
+	}
+
+	r = wf_mesh_load(filename, &obj, &mesh);
+	if (r) {
+		icg_log_error("could not load mesh from '%s': %s (%d)\n", filename, strerror(r), (int)r);
+		return (void *)r;
+	}
+
+	icg_log_info("mesh %u vertices %u indices loaded in %.3fms (%s)\n", mesh.nr_vertices, mesh.nr_indices,
+		     icg_time_ms() - started_at, mesh.mapping ? "cache" : "obj");
+	// wf_obj_dump(&obj);
+
+	if (lod_pixel_error > 0) {
+		r = wf_mesh_build_lods(&mesh, 0.5f, 64, &lods);
+		if (r)
+			return (void *)r;
+	}
+
+	if (pick_enabled) {
+		double t = icg_time_ms();
+
+		r = wf_mesh_build_bvh(&mesh, sysconf(_SC_NPROCESSORS_ONLN), &bvh);
+		if (r)
+			return (void *)r;
+
+		icg_log_info("bvh %u nodes built in %.3fms\n", bvh.nr_nodes, icg_time_ms() - t);
+	}
 
-	glUniformMatrix4fv(mvp_location, 1, GL_FALSE, (const GLfloat*) &mvp);
-	glDrawArrays(GL_POINTS, 0, nr_vertices);
+	upload.loaded_at = icg_time_ms() - started_at;
+	return NULL;
+}
+
+// make the shared context current on the reload thread
+int bind_reload_window(void *ctx)
+{
+	glfwMakeContextCurrent(ctx);
+	return 0;
+}
+
+int bind_reload_headless(void *ctx)
+{
+	return icg_headless_make_current(&headless, ctx ? ctx : EGL_NO_CONTEXT);
+}
+
+// the program keeps working w/o reload, fails are logged only
+void shader_reload_init()
+{
+	int r;
+
+	if (nr_frames) {
+		if (!shader_watch || icg_headless_shared_context(&headless))
+			return;
+
+		r = icg_shader_reload_init(bind_reload_headless, headless.shared);
+	} else {
+		reload_window = glfw_shared_context_init(window);
+		if (!reload_window)
+			return;
+
+		r = icg_shader_reload_init(bind_reload_window, reload_window);
+	}
+
+	// attribute locations are fixed in the shaders, a reloaded program fits the vao
+	if (r)
+		return;
+
+	if (nr_scene_meshes || gpu_culling)
+		icg_shader_reload_watch(&prog, "mdi.vert", "simple.frag");
+	else
+		icg_shader_reload_watch(&prog, nr_instances ? "prj_02_instanced.vert" : "prj_02.vert", "simple.frag");
 }
 
 void clean()
 {
+	icg_shader_reload_clean();
 	shader_prog_clean(&prog);
 	glDeleteVertexArrays(1, &vao);
 	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ebo);
+	icg_gpu_ring_clean(&ring);
+	icg_gpu_timer_clean(&draw_timer);
+
+	icg_gpu_cull_clean(&gpu_cull);
+	icg_mdi_clean(&mdi);
+
+	free(instance_models);
+	free(visible);
+	free(instance_bounds.cx);
+	free(scene_models);
+}
+
+void usage(const char *name)
+{
+	icg_log_error("usage: %s [-s stream_limit_mb] [-q snorm16|unorm16] [-l lod_pixel_error] [-p] [-n instances] [-g] [-f headless_frames] [-o frame_prefix] [-c stats.csv] [-w] file.obj...\n", name);
+	exit(EXIT_FAILURE);
 }
 
 int main(int argc, char *argv[])
 {
-	int r;
+	int r, opt, first_frame = 1;
+	double frame_at, swap_at;
+	void *status;
+
+	started_at = icg_time_ms();
+
+	while ((opt = getopt(argc, argv, "s:q:l:pn:gf:o:c:w")) != -1) {
+		switch (opt) {
+		case 's':
+			stream_limit = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'f':
+			nr_frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			dump_prefix = optarg;
+			break;
+		case 'c':
+			stats_csv = optarg;
+			break;
+		case 'n':
+			nr_instances = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			gpu_culling = 1;
+			break;
+		case 'p':
+			pick_enabled = 1;
+			break;
+		case 'w':
+			shader_watch = 1;
+			break;
+		case 'l':
+			lod_pixel_error = atof(optarg);
+			break;
+		case 'q':
+			quantize = 1;
+			if (!strcmp(optarg, "unorm16"))
+				quant_flags = WF_QUANT_UNORM16;
+			else if (strcmp(optarg, "snorm16"))
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
 
-	if (argc < 2) {
-		fprintf(stderr, "enter *.obj filename\n");
-		exit(EXIT_FAILURE);
+	if (optind >= argc) {
+		icg_log_error("enter *.obj filename\n");
+		usage(argv[0]);
 	}
 
-	wf_obj_init(&obj);
-	r = wf_obj_load(argv[1], &obj);
-	if (r) {
-		fprintf(stderr, "could not load vertices from '%s': %s (%d)\n", argv[1], strerror(r), r);
-		exit(EXIT_FAILURE);
+	filename = argv[optind];
+
+	if (argc - optind > 1) {
+		nr_scene_meshes = argc - optind;
+		scene_files = argv + optind;
 	}
 
-	printf("loaded %d vertices\n", obj.nr_vertices);
-	// wf_obj_dump(&obj);
+	if (dump_prefix && !nr_frames) {
+		icg_log_error("frames are dumped in headless mode only\n");
+		usage(argv[0]);
+	}
 
-	glfw_init(NULL);
+	// scene meshes go to the shared buffers as they are
+	if (nr_scene_meshes && (stream_limit || quantize || lod_pixel_error > 0 || (nr_instances && !gpu_culling) ||
+				pick_enabled)) {
+		icg_log_error("a scene of several files is drawn w/o -s, -q, -l, -n (but with -g) and -p\n");
+		usage(argv[0]);
+	}
 
-	window = glfw_window_init(640, 480, "Transformation");
-	if (!window) {
-		exit(EXIT_FAILURE);
+	// gpu culled instances are drawn from the shared buffers of the mdi renderer too
+	if (gpu_culling && (!nr_instances || stream_limit || quantize || lod_pixel_error > 0 || pick_enabled)) {
+		icg_log_error("-g culls -n instances, w/o -s, -q, -l and -p\n");
+		usage(argv[0]);
 	}
 
-	glfwSetFramebufferSizeCallback(window, glfw_on_framebuffer_resize);
-	glfwSetKeyCallback(window, glfw_on_key_action);
-	glfwSetMouseButtonCallback(window, glfw_on_mouse_button);
-	glfwSetCursorPosCallback(window, glfw_on_cursor_position);
+	// instances are placed by the mesh bounds, which the streaming loader does not keep
+	if (stream_limit && nr_instances) {
+		icg_log_error("instances need a loaded mesh, not a stream\n");
+		usage(argv[0]);
+	}
 
-	if (!glad_init()) {
-		fprintf(stderr, "glad_init() fail()\n");
-		exit(EXIT_FAILURE);
+	// the ray is cast against the bvh of the mesh, the instance transforms are not applied
+	if (pick_enabled && nr_instances) {
+		icg_log_error("picking works on a single mesh, not with -n instances\n");
+		usage(argv[0]);
+	}
+
+	// the binary sidecar <file>.wfb skips parsing and optimization on subsequent runs
+	wf_obj_init(&obj);
+	obj.flags |= WF_OBJ_CACHE | WF_OBJ_OPTIMIZE;
+
+	if (!stream_limit) {
+		r = pthread_create(&loader, NULL, load_mesh, NULL);
+		if (r) {
+			icg_log_error("pthread_create() fail: %s (%d)\n", strerror(r), r);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (nr_frames) {
+		if (icg_headless_init(&headless, 640, 480, nr_frames, dump_prefix))
+			exit(EXIT_FAILURE);
+	} else {
+		glfw_init(NULL);
+
+		window = glfw_window_init(640, 480, "Transformation");
+		if (!window) {
+			exit(EXIT_FAILURE);
+		}
+
+		glfwSetFramebufferSizeCallback(window, glfw_on_framebuffer_resize);
+		glfwSetKeyCallback(window, glfw_on_key_action);
+		glfwSetMouseButtonCallback(window, glfw_on_mouse_button);
+		glfwSetCursorPosCallback(window, glfw_on_cursor_position);
+
+		if (!glad_init()) {
+			icg_log_error("glad_init() fail()\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	prepare_shaders();
+	upload.context_at = icg_time_ms() - started_at;
+
+	if (!stream_limit) {
+		pthread_join(loader, &status);
+		if (status)
+			exit(EXIT_FAILURE);
+
+		upload.waited_ms = icg_time_ms() - started_at - upload.context_at;
 	}
 
 	prepare();
+	shader_reload_init();
+	icg_frame_stats_init(&frame_stats);
+
+	// a stream is loaded by prepare()
+	upload.prepared_at = icg_time_ms() - started_at;
+	if (stream_limit)
+		icg_log_info("startup context %.3fms prepared %.3fms\n", upload.context_at, upload.prepared_at);
+	else
+		icg_log_info("startup context %.3fms mesh %.3fms (waited %.3fms) prepared %.3fms\n", upload.context_at,
+			     upload.loaded_at, upload.waited_ms, upload.prepared_at);
+
+	if (nr_frames) {
+		while (upload.active)
+			upload_next();
+
+		while (icg_headless_frame_begin(&headless)) {
+			frame_at = icg_time_ms();
+			camera_path();
+			render();
+			swap_at = icg_time_ms();
+			if (icg_headless_frame_end(&headless))
+				exit(EXIT_FAILURE);
+
+			// no swap, the frame end waits for the gpu
+			icg_frame_stats_push(&frame_stats, frame_at, swap_at - frame_at, NAN);
+			icg_gpu_timer_poll(&draw_timer, &frame_stats, ICG_STAT_GPU);
+
+			if (first_frame) {
+				icg_log_info("first frame at %.3fms\n", icg_time_ms() - started_at);
+				first_frame = 0;
+			}
+		}
+
+		icg_headless_report(&headless);
+	}
 
-	while (!glfwWindowShouldClose(window)) {
+	while (window && !glfwWindowShouldClose(window)) {
+		frame_at = icg_time_ms();
 		render();
+		swap_at = icg_time_ms();
 		glfwSwapBuffers(window);
+		icg_frame_stats_push(&frame_stats, frame_at, swap_at - frame_at, icg_time_ms() - swap_at);
+		icg_gpu_timer_poll(&draw_timer, &frame_stats, ICG_STAT_GPU);
+
+		if (first_frame) {
+			icg_log_info("first frame at %.3fms\n", icg_time_ms() - started_at);
+			first_frame = 0;
+		}
+
 		glfwPollEvents();
 	}
 
+	// results of the last frames
+	glFinish();
+	icg_gpu_timer_poll(&draw_timer, &frame_stats, ICG_STAT_GPU);
+	icg_frame_stats_report(&frame_stats);
+	icg_gpu_ring_report(&ring);
+
+	if (stats_csv && icg_frame_stats_csv(&frame_stats, stats_csv))
+		exit(EXIT_FAILURE);
+
 	clean();
-	glfwDestroyWindow(window);
+
+	if (reload_window)
+		glfwDestroyWindow(reload_window);
+
+	if (window)
+		glfwDestroyWindow(window);
+
+	icg_headless_clean(&headless);
+	wf_lods_clean(&lods);
+	wf_bvh_clean(&bvh);
+	wf_mesh_clean(&mesh);
 	wf_obj_clean(&obj);
 
 	return 0;
@@ -0,0 +1,1265 @@
+// microbenchmark suite: obj loader, linmath.h, shader program setup (compiled and from the binary cache),
+// buffer uploads, draw submission and instance culling on the cpu and the gpu
+//
+// every case runs warmup times untimed, then runs times; median and median absolute deviation (mad) of
+// the runs are reported per operation, they are robust to the odd slow run of a preempted process.
+// Case names are stable so results of two commits can be compared: write csv with -f csv -o base.csv
+// on one commit and pass it with -c base.csv on the other.
+//
+// usage: bench [-w warmup] [-r runs] [-f text|csv|json] [-o file] [-c base.csv] [-b filter] [-g]
+//              [-s nr_vertices]... [file.obj]...
+//   -b filter       run cases whose name contains filter
+//   -g              no gl cases (shader, upload, draw and cull need a headless egl context)
+//   -s nr_vertices  loader case of a synthetic obj file (default 10000, 100000 and 1000000)
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <icg/common.h>
+#include <icg/glad.h>
+#include <icg/glsl.h>
+#include <icg/cull.h>
+#include <icg/gpu_cull.h>
+#include <icg/gpu_ring.h>
+#include <icg/headless.h>
+#include <icg/mdi.h>
+#include <linmath.h>
+#include <wavefront_obj.h>
+
+#define MAX_RESULTS 128
+#define MAX_RUNS 1000
+
+// a significant change is outside this many mads of both sides
+#define SIGNIFICANT_MADS 3
+
+// operations per run of the linmath cases
+#define MATH_OPS 100000
+
+struct result {
+	char name[96];
+	unsigned int ops;	// operations per run
+	unsigned int runs;
+	double median_ns;	// per operation
+	double mad_ns;
+	double min_ns;
+	double max_ns;
+};
+
+struct baseline {
+	char name[96];
+	double median_ns;
+	double mad_ns;
+};
+
+static unsigned int nr_warmup = 3, nr_runs = 15;
+static const char *filter;
+static struct result results[MAX_RESULTS];
+static unsigned int nr_results;
+
+// keeps results of math cases alive
+static volatile float sink;
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double median(double *v, unsigned int n)
+{
+	qsort(v, n, sizeof(*v), cmp_double);
+	return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// run a case, fn does ops operations per call
+// \return 0 or the error of fn
+static int measure(const char *name, unsigned int ops, int (*fn)(void *arg), void *arg)
+{
+	double t[MAX_RUNS], dev[MAX_RUNS], m;
+	struct result *res;
+	int r;
+
+	if (filter && !strstr(name, filter))
+		return 0;
+
+	if (nr_results == MAX_RESULTS) {
+		fprintf(stderr, "more than %d cases, '%s' skipped\n", MAX_RESULTS, name);
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < nr_warmup; i++) {
+		r = fn(arg);
+		if (r)
+			return r;
+	}
+
+	for (unsigned int i = 0; i < nr_runs; i++) {
+		t[i] = icg_time_ms();
+		r = fn(arg);
+		t[i] = (icg_time_ms() - t[i]) * 1e6 / ops;
+
+		if (r)
+			return r;
+	}
+
+	res = &results[nr_results++];
+	snprintf(res->name, sizeof(res->name), "%s", name);
+	res->ops = ops;
+	res->runs = nr_runs;
+
+	m = median(t, nr_runs);
+	for (unsigned int i = 0; i < nr_runs; i++)
+		dev[i] = fabs(t[i] - m);
+
+	res->median_ns = m;
+	res->mad_ns = median(dev, nr_runs);
+	res->min_ns = t[0];
+	res->max_ns = t[nr_runs - 1];
+
+	// progress, the report is written at the end
+	fprintf(stderr, "%s %.1fns\n", name, m);
+	return 0;
+}
+
+// loader
+
+// grid of vertices with a face per quad, lines of a real exporter format
+static int generate(const char *filename, unsigned int nr_vertices)
+{
+	unsigned int side = (unsigned int)sqrt(nr_vertices), i;
+	FILE *f;
+
+	if (side < 2)
+		side = 2;
+
+	f = fopen(filename, "w");
+	if (!f) {
+		fprintf(stderr, "fopen('%s') fail: %s (%d)\n", filename, strerror(errno), errno);
+		return errno;
+	}
+
+	fprintf(f, "# synthetic grid %u vertices\n", nr_vertices);
+
+	for (i = 0; i < nr_vertices; i++)
+		fprintf(f, "v %f %f %f\n", (i % side) * 0.01f - 10.0f, sinf(i * 0.001f), (i / side) * -0.01f);
+
+	for (i = 0; i + side + 1 < nr_vertices; i++) {
+		if (i % side == side - 1)
+			continue;
+
+		fprintf(f, "f %u %u %u %u\n", i + 1, i + 2, i + side + 2, i + side + 1);
+	}
+
+	if (fclose(f)) {
+		fprintf(stderr, "write('%s') fail\n", filename);
+		return EIO;
+	}
+
+	return 0;
+}
+
+static int run_load(void *arg)
+{
+	struct wf_obj o;
+	int r;
+
+	wf_obj_init(&o);
+	r = wf_obj_load(arg, &o);
+	wf_obj_clean(&o);
+
+	return r;
+}
+
+static int bench_load(const char *name, const char *filename)
+{
+	char case_name[96];
+
+	snprintf(case_name, sizeof(case_name), "wf_obj_load/%s", name);
+	return measure(case_name, 1, run_load, (void *)filename);
+}
+
+static int bench_load_grid(unsigned int nr_vertices)
+{
+	char filename[] = "/tmp/icg_bench_XXXXXX", name[32], case_name[96];
+	int fd, r;
+
+	// no file for a filtered case
+	snprintf(name, sizeof(name), "grid_%u", nr_vertices);
+	snprintf(case_name, sizeof(case_name), "wf_obj_load/%s", name);
+	if (filter && !strstr(case_name, filter))
+		return 0;
+
+	fd = mkstemp(filename);
+	if (fd < 0) {
+		fprintf(stderr, "mkstemp() fail: %s (%d)\n", strerror(errno), errno);
+		return errno;
+	}
+
+	close(fd);
+
+	r = generate(filename, nr_vertices);
+	if (!r)
+		r = bench_load(name, filename);
+
+	unlink(filename);
+	return r;
+}
+
+// linmath.h, operands cycle through a set of matrices so nothing is hoisted out of the loop
+
+#define MATH_SET 64
+
+static mat4x4 mats[MATH_SET];
+static vec4 vecs[MATH_SET];
+static quat quats[MATH_SET];
+
+static void math_init(void)
+{
+	unsigned int seed = 1;
+
+	for (int i = 0; i < MATH_SET; i++) {
+		for (int k = 0; k < 16; k++) {
+			seed = seed * 1664525u + 1013904223u;
+			mats[i][k / 4][k % 4] = (seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+		}
+
+		// invertible
+		for (int k = 0; k < 4; k++)
+			mats[i][k][k] += 4.0f;
+
+		for (int k = 0; k < 4; k++) {
+			vecs[i][k] = mats[i][k][0];
+			quats[i][k] = mats[i][0][k];
+		}
+	}
+}
+
+static int run_mat4x4_mul(void *arg)
+{
+	mat4x4 m;
+
+	(void)arg;
+
+	for (unsigned int i = 0; i < MATH_OPS; i++) {
+		mat4x4_mul(m, mats[i % MATH_SET], mats[(i + 1) % MATH_SET]);
+		sink += m[i % 4][0];
+	}
+
+	return 0;
+}
+
+static int run_mat4x4_mul_vec4(void *arg)
+{
+	vec4 v;
+
+	(void)arg;
+
+	for (unsigned int i = 0; i < MATH_OPS; i++) {
+		mat4x4_mul_vec4(v, mats[i % MATH_SET], vecs[(i + 1) % MATH_SET]);
+		sink += v[i % 4];
+	}
+
+	return 0;
+}
+
+static int run_mat4x4_invert(void *arg)
+{
+	mat4x4 m;
+
+	(void)arg;
+
+	for (unsigned int i = 0; i < MATH_OPS; i++) {
+		mat4x4_invert(m, mats[i % MATH_SET]);
+		sink += m[i % 4][0];
+	}
+
+	return 0;
+}
+
+static int run_mat4x4_rotate(void *arg)
+{
+	mat4x4 m;
+
+	(void)arg;
+
+	for (unsigned int i = 0; i < MATH_OPS; i++) {
+		mat4x4_rotate(m, mats[i % MATH_SET], 1, 1, 0, i * 1e-3f);
+		sink += m[i % 4][0];
+	}
+
+	return 0;
+}
+
+static int run_mat4x4_look_at(void *arg)
+{
+	vec3 up = {0, 1, 0};
+	mat4x4 m;
+
+	(void)arg;
+
+	for (unsigned int i = 0; i < MATH_OPS; i++) {
+		mat4x4_look_at(m, vecs[i % MATH_SET], vecs[(i + 1) % MATH_SET], up);
+		sink += m[i % 4][0];
+	}
+
+	return 0;
+}
+
+static int run_mat4x4_perspective(void *arg)
+{
+	mat4x4 m;
+
+	(void)arg;
+
+	for (unsigned int i = 0; i < MATH_OPS; i++) {
+		mat4x4_perspective(m, 0.5f + i % MATH_SET * 1e-2f, 1.5f, 0.1f, 100.0f);
+		sink += m[i % 4][0];
+	}
+
+	return 0;
+}
+
+static int run_quat_mul(void *arg)
+{
+	quat q;
+
+	(void)arg;
+
+	for (unsigned int i = 0; i < MATH_OPS; i++) {
+		quat_mul(q, quats[i % MATH_SET], quats[(i + 1) % MATH_SET]);
+		sink += q[i % 4];
+	}
+
+	return 0;
+}
+
+static int bench_math(void)
+{
+	static const struct {
+		const char *name;
+		int (*fn)(void *arg);
+	} cases[] = {
+		{"linmath/mat4x4_mul", run_mat4x4_mul},
+		{"linmath/mat4x4_mul_vec4", run_mat4x4_mul_vec4},
+		{"linmath/mat4x4_invert", run_mat4x4_invert},
+		{"linmath/mat4x4_rotate", run_mat4x4_rotate},
+		{"linmath/mat4x4_look_at", run_mat4x4_look_at},
+		{"linmath/mat4x4_perspective", run_mat4x4_perspective},
+		{"linmath/quat_mul", run_quat_mul},
+	};
+	int r;
+
+	math_init();
+
+	for (size_t i = 0; i < ARRAY_SIZE(cases); i++) {
+		r = measure(cases[i].name, MATH_OPS, cases[i].fn, NULL);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+// gl, every run waits for the driver with glFinish()
+
+struct shader_case {
+	const char *vertex_code;
+	const char *fragment_code;
+};
+
+static int run_shader(void *arg)
+{
+	struct shader_case *c = arg;
+	struct shader_prog prog;
+	int r;
+
+	r = shader_prog_create(c->vertex_code, c->fragment_code, &prog);
+	glFinish();
+	shader_prog_clean(&prog);
+
+	return r;
+}
+
+static int run_shader_warm(void *arg)
+{
+	struct shader_case *c = arg;
+	struct shader_prog prog;
+	int r;
+
+	r = shader_prog_load(c->vertex_code, c->fragment_code, &prog);
+	glFinish();
+	shader_prog_clean(&prog);
+
+	return r;
+}
+
+// compile, link and store the binary
+static int run_shader_cold(void *arg)
+{
+	struct shader_case *c = arg;
+	char path[4096];
+
+	if (shader_cache_path(shader_cache_key(c->vertex_code, c->fragment_code), path, sizeof(path)))
+		unlink(path);
+
+	return run_shader_warm(arg);
+}
+
+// program binary cache in a directory of its own
+static int bench_shader_cache(struct shader_case *c)
+{
+	char dir[] = "/tmp/icg_bench_shaders_XXXXXX", path[4096];
+	int r;
+
+	if (!mkdtemp(dir)) {
+		fprintf(stderr, "mkdtemp() fail: %s (%d)\n", strerror(errno), errno);
+		return errno;
+	}
+
+	setenv("ICG_SHADER_CACHE", dir, 1);
+
+	r = measure("shader_prog_load/prj_02_cold", 1, run_shader_cold, c);
+	if (!r)
+		r = measure("shader_prog_load/prj_02_warm", 1, run_shader_warm, c);
+
+	if (shader_cache_path(shader_cache_key(c->vertex_code, c->fragment_code), path, sizeof(path)))
+		unlink(path);
+
+	rmdir(dir);
+	unsetenv("ICG_SHADER_CACHE");
+	return r;
+}
+
+struct upload_case {
+	GLuint buffer;
+	void *data;
+	void *mapping;
+	size_t size;
+	struct icg_gpu_ring ring;
+};
+
+static int run_buffer_data(void *arg)
+{
+	struct upload_case *c = arg;
+
+	glNamedBufferData(c->buffer, c->size, c->data, GL_STATIC_DRAW);
+	glFinish();
+
+	return glGetError();
+}
+
+static int run_buffer_sub_data(void *arg)
+{
+	struct upload_case *c = arg;
+
+	glNamedBufferSubData(c->buffer, 0, c->size, c->data);
+	glFinish();
+
+	return glGetError();
+}
+
+static int run_map_persistent(void *arg)
+{
+	struct upload_case *c = arg;
+
+	memcpy(c->mapping, c->data, c->size);
+	glFinish();
+
+	return 0;
+}
+
+// no glFinish(), the cost of a frame on the cpu: the copy and a wait if the gpu is behind
+static int run_ring(void *arg)
+{
+	struct upload_case *c = arg;
+	GLintptr offset;
+	void *p;
+	int r = 0;
+
+	icg_gpu_ring_begin(&c->ring);
+	p = icg_gpu_ring_alloc(&c->ring, c->size, 0, &offset);
+	if (!p) {
+		r = ENOSPC;
+		goto out;
+	}
+
+	memcpy(p, c->data, c->size);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, c->ring.buffer, offset, c->size);
+
+out:
+	icg_gpu_ring_end(&c->ring);
+	return r;
+}
+
+static int bench_upload(size_t size)
+{
+	const GLbitfield map = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	struct upload_case c = {0, NULL, NULL, size, {0}};
+	char name[96];
+	int r = 0;
+
+	c.data = malloc(size);
+	if (!c.data) {
+		fprintf(stderr, "malloc() fail\n");
+		return ENOMEM;
+	}
+
+	for (size_t i = 0; i < size; i++)
+		((unsigned char *)c.data)[i] = i * 31;
+
+	glCreateBuffers(1, &c.buffer);
+	snprintf(name, sizeof(name), "upload/buffer_data/%zuk", size >> 10);
+	r = measure(name, 1, run_buffer_data, &c);
+	if (r)
+		goto out;
+
+	snprintf(name, sizeof(name), "upload/buffer_sub_data/%zuk", size >> 10);
+	r = measure(name, 1, run_buffer_sub_data, &c);
+	if (r)
+		goto out;
+
+	// immutable storage needs a new buffer
+	glDeleteBuffers(1, &c.buffer);
+	glCreateBuffers(1, &c.buffer);
+	glNamedBufferStorage(c.buffer, size, NULL, map);
+
+	c.mapping = glMapNamedBufferRange(c.buffer, 0, size, map);
+	if (!c.mapping) {
+		r = glGetError();
+		fprintf(stderr, "glMapNamedBufferRange() fail: 0x%x\n", r);
+		goto out;
+	}
+
+	snprintf(name, sizeof(name), "upload/map_persistent/%zuk", size >> 10);
+	r = measure(name, 1, run_map_persistent, &c);
+
+	glUnmapNamedBuffer(c.buffer);
+	if (r)
+		goto out;
+
+	r = icg_gpu_ring_init(&c.ring, size);
+	if (r)
+		goto out;
+
+	snprintf(name, sizeof(name), "upload/ring/%zuk", size >> 10);
+	r = measure(name, 1, run_ring, &c);
+
+	icg_gpu_ring_clean(&c.ring);
+
+out:
+	glDeleteBuffers(1, &c.buffer);
+	free(c.data);
+	return r;
+}
+
+// draw submission: nr_meshes small unique meshes (grids of 1..8 quads a side) in cells of the viewport,
+// drawn per object (a vao, a uniform and a draw call each) or by one multi draw indirect; ns per draw
+struct draw_case {
+	unsigned int nr_meshes;
+	struct wf_mesh *meshes;
+	mat4x4 *models;
+	GLuint *vaos;
+	GLuint *buffers;	// vertices and indices of each mesh
+	struct shader_prog simple;
+	struct shader_prog mdi_prog;
+	GLint mvp_location;
+	struct icg_mdi mdi;
+	struct icg_gpu_ring ring;
+};
+
+static int run_draw_per_object(void *arg)
+{
+	struct draw_case *c = arg;
+
+	glClear(GL_COLOR_BUFFER_BIT);
+	glUseProgram(c->simple.prog);
+
+	// the view projection is the identity, mvp is the model
+	for (unsigned int i = 0; i < c->nr_meshes; i++) {
+		glBindVertexArray(c->vaos[i]);
+		glUniformMatrix4fv(c->mvp_location, 1, GL_FALSE, (const float *)c->models[i]);
+		glDrawElements(GL_TRIANGLES, c->meshes[i].nr_indices, GL_UNSIGNED_SHORT, NULL);
+	}
+
+	glFinish();
+	return glGetError();
+}
+
+static int run_draw_mdi(void *arg)
+{
+	struct draw_case *c = arg;
+	mat4x4 vp;
+	GLintptr offset;
+	void *p;
+	int r;
+
+	glClear(GL_COLOR_BUFFER_BIT);
+	glUseProgram(c->mdi_prog.prog);
+
+	icg_gpu_ring_begin(&c->ring);
+
+	mat4x4_identity(vp);
+	p = icg_gpu_ring_alloc(&c->ring, sizeof(vp), 0, &offset);
+	r = icg_mdi_begin(&c->mdi, &c->ring, c->nr_meshes);
+	if (!p || r) {
+		r = ENOSPC;
+		goto out;
+	}
+
+	memcpy(p, vp, sizeof(vp));
+	glBindBufferRange(GL_UNIFORM_BUFFER, 0, c->ring.buffer, offset, sizeof(vp));
+
+	for (unsigned int i = 0; i < c->nr_meshes; i++)
+		icg_mdi_add(&c->mdi, i, (const float *)c->models[i]);
+
+	icg_mdi_submit(&c->mdi);
+
+out:
+	icg_gpu_ring_end(&c->ring);
+	if (r)
+		return r;
+
+	glFinish();
+	return glGetError();
+}
+
+// grid of side quads at z 0 in [0, 1], a height per mesh so no two are the same
+static int draw_mesh(struct wf_mesh *mesh, unsigned int side, float height)
+{
+	uint16_t *ix;
+	float *v;
+
+	memset(mesh, 0, sizeof(*mesh));
+	mesh->nr_vertices = (side + 1) * (side + 1);
+	mesh->nr_indices = side * side * 6;
+	mesh->stride = 3 * sizeof(float);
+	mesh->index_size = 2;
+	mesh->vertices = malloc(mesh->nr_vertices * mesh->stride);
+	mesh->indices = malloc(mesh->nr_indices * sizeof(*ix));
+	if (!mesh->vertices || !mesh->indices) {
+		fprintf(stderr, "malloc() fail\n");
+		return ENOMEM;
+	}
+
+	v = mesh->vertices;
+	for (unsigned int y = 0; y <= side; y++) {
+		for (unsigned int x = 0; x <= side; x++) {
+			*v++ = (float)x / side;
+			*v++ = (float)y / side;
+			*v++ = height * x * y / (side * side);
+		}
+	}
+
+	ix = mesh->indices;
+	for (unsigned int y = 0; y < side; y++) {
+		for (unsigned int x = 0; x < side; x++) {
+			uint16_t a = y * (side + 1) + x, b = a + side + 1;
+
+			*ix++ = a;
+			*ix++ = a + 1;
+			*ix++ = b + 1;
+			*ix++ = a;
+			*ix++ = b + 1;
+			*ix++ = b;
+		}
+	}
+
+	return 0;
+}
+
+static void draw_case_clean(struct draw_case *c)
+{
+	icg_gpu_ring_clean(&c->ring);
+	icg_mdi_clean(&c->mdi);
+	shader_prog_clean(&c->mdi_prog);
+	shader_prog_clean(&c->simple);
+
+	if (c->vaos)
+		glDeleteVertexArrays(c->nr_meshes, c->vaos);
+	if (c->buffers)
+		glDeleteBuffers(c->nr_meshes * 2, c->buffers);
+
+	for (unsigned int i = 0; c->meshes && i < c->nr_meshes; i++) {
+		free(c->meshes[i].vertices);
+		free(c->meshes[i].indices);
+	}
+
+	free(c->buffers);
+	free(c->vaos);
+	free(c->models);
+	free(c->meshes);
+}
+
+// both ways render the same image, a frame of each is compared before the timed runs
+static int draw_compare(struct draw_case *c)
+{
+	static unsigned char a[64 * 64 * 4], b[64 * 64 * 4];
+	int r;
+
+	r = run_draw_per_object(c);
+	glReadPixels(0, 0, 64, 64, GL_RGBA, GL_UNSIGNED_BYTE, a);
+	if (!r)
+		r = run_draw_mdi(c);
+	glReadPixels(0, 0, 64, 64, GL_RGBA, GL_UNSIGNED_BYTE, b);
+
+	if (!r && memcmp(a, b, sizeof(a))) {
+		fprintf(stderr, "draw: multi draw and per object images of %u meshes differ\n", c->nr_meshes);
+		r = EIO;
+	}
+
+	return r;
+}
+
+static int bench_draw(unsigned int nr_meshes)
+{
+	unsigned int cols = (unsigned int)ceil(sqrt(nr_meshes));
+	float cell = 2.0f / cols;
+	struct draw_case c;
+	char name[96];
+	int r;
+
+	memset(&c, 0, sizeof(c));
+	c.nr_meshes = nr_meshes;
+	c.meshes = calloc(nr_meshes, sizeof(*c.meshes));
+	c.models = malloc(nr_meshes * sizeof(*c.models));
+	c.vaos = calloc(nr_meshes, sizeof(*c.vaos));
+	c.buffers = calloc(nr_meshes * 2, sizeof(*c.buffers));
+	if (!c.meshes || !c.models || !c.vaos || !c.buffers) {
+		fprintf(stderr, "malloc() fail\n");
+		r = ENOMEM;
+		goto out;
+	}
+
+	glCreateVertexArrays(nr_meshes, c.vaos);
+	glCreateBuffers(nr_meshes * 2, c.buffers);
+
+	for (unsigned int i = 0; i < nr_meshes; i++) {
+		struct wf_mesh *mesh = &c.meshes[i];
+		GLuint vbo = c.buffers[i * 2], ebo = c.buffers[i * 2 + 1];
+
+		r = draw_mesh(mesh, 1 + i % 8, (float)(i % 13) / 13);
+		if (r)
+			goto out;
+
+		// a margin of a tenth of the cell between meshes
+		mat4x4_translate(c.models[i], -1 + cell * (i % cols + 0.05f), -1 + cell * (i / cols + 0.05f), 0);
+		mat4x4_scale_aniso(c.models[i], c.models[i], cell * 0.9f, cell * 0.9f, cell * 0.9f);
+
+		glNamedBufferStorage(vbo, mesh->nr_vertices * mesh->stride, mesh->vertices, 0);
+		glNamedBufferStorage(ebo, mesh->nr_indices * sizeof(uint16_t), mesh->indices, 0);
+		glEnableVertexArrayAttrib(c.vaos[i], 0);
+		glVertexArrayAttribFormat(c.vaos[i], 0, 3, GL_FLOAT, GL_FALSE, 0);
+		glVertexArrayAttribBinding(c.vaos[i], 0, 0);
+		glVertexArrayVertexBuffer(c.vaos[i], 0, vbo, 0, mesh->stride);
+		glVertexArrayElementBuffer(c.vaos[i], ebo);
+	}
+
+	r = shader_prog_create(GLSL_SHADER_SIMPLE_VERT, GLSL_SHADER_SIMPLE_FRAG, &c.simple);
+	if (!r)
+		r = shader_prog_create(GLSL_SHADER_MDI_VERT, GLSL_SHADER_SIMPLE_FRAG, &c.mdi_prog);
+	if (!r)
+		r = icg_mdi_init(&c.mdi, c.meshes, nr_meshes);
+	if (!r)
+		r = icg_gpu_ring_init(&c.ring, 1024 + nr_meshes * (sizeof(struct icg_mdi_command) + sizeof(mat4x4)));
+	if (r)
+		goto out;
+
+	c.mvp_location = glGetUniformLocation(c.simple.prog, "mvp");
+
+	r = draw_compare(&c);
+	if (r)
+		goto out;
+
+	snprintf(name, sizeof(name), "draw/per_object/%u", nr_meshes);
+	r = measure(name, nr_meshes, run_draw_per_object, &c);
+	if (r)
+		goto out;
+
+	snprintf(name, sizeof(name), "draw/mdi/%u", nr_meshes);
+	r = measure(name, nr_meshes, run_draw_mdi, &c);
+
+out:
+	draw_case_clean(&c);
+	return r;
+}
+
+// culling of nr_instances instances of 8 grid meshes scattered around the origin: the cpu reference
+// icg_cull_aabbs() against the compute pass of gpu_cull, ns per instance. Before the timed runs the
+// visible sets of both are compared for a few views, boxes on a plane may go either way
+#define CULL_MESHES 8
+#define CULL_VIEWS 4
+#define CULL_TIE 1e-3f
+
+struct cull_case {
+	unsigned int nr_instances;
+	struct icg_aabbs bounds;
+	struct icg_gpu_cull_instance *instances;
+	uint32_t *visible;
+	uint32_t *gpu_visible;
+	float planes[6][4];
+	struct icg_mdi mdi;
+	struct icg_gpu_cull gpu;
+};
+
+static int run_cull_cpu(void *arg)
+{
+	struct cull_case *c = arg;
+
+	sink = icg_cull_aabbs(c->planes, &c->bounds, c->visible);
+	return 0;
+}
+
+static int run_cull_gpu(void *arg)
+{
+	struct cull_case *c = arg;
+
+	icg_gpu_cull_dispatch(&c->gpu, c->planes);
+	glFinish();
+
+	return glGetError();
+}
+
+static int cmp_uint32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+// least distance over the planes of the corner farthest along their normals, negative outside
+static float cull_margin(const float planes[6][4], const struct icg_aabbs *b, size_t i)
+{
+	float m = INFINITY, d;
+
+	for (int j = 0; j < 6; j++) {
+		d = planes[j][0] * b->cx[i] + planes[j][1] * b->cy[i] + planes[j][2] * b->cz[i] + planes[j][3] +
+		    fabsf(planes[j][0]) * b->ex[i] + fabsf(planes[j][1]) * b->ey[i] + fabsf(planes[j][2]) * b->ez[i];
+		if (m > d)
+			m = d;
+	}
+
+	return m;
+}
+
+// \return 0 or EIO if an instance is missing, repeated or surplus and not on a plane
+static int cull_compare(struct cull_case *c, unsigned int view)
+{
+	size_t nr_cpu = icg_cull_aabbs(c->planes, &c->bounds, c->visible), nr_gpu, i = 0, k = 0;
+	unsigned int nr_ties = 0, nr_fails = 0;
+	uint32_t id;
+
+	icg_gpu_cull_dispatch(&c->gpu, c->planes);
+	nr_gpu = icg_gpu_cull_read(&c->gpu, c->gpu_visible);
+	qsort(c->gpu_visible, nr_gpu, sizeof(*c->gpu_visible), cmp_uint32);
+
+	// both sorted, the cpu reference is in instance order
+	while (i < nr_cpu || k < nr_gpu) {
+		if (k && k < nr_gpu && c->gpu_visible[k] == c->gpu_visible[k - 1]) {
+			fprintf(stderr, "cull: view %u instance %u drawn twice\n", view, c->gpu_visible[k]);
+			nr_fails++;
+			k++;
+			continue;
+		}
+
+		if (i < nr_cpu && k < nr_gpu && c->visible[i] == c->gpu_visible[k]) {
+			i++;
+			k++;
+			continue;
+		}
+
+		if (k == nr_gpu || (i < nr_cpu && c->visible[i] < c->gpu_visible[k]))
+			id = c->visible[i++];
+		else
+			id = c->gpu_visible[k++];
+
+		if (fabsf(cull_margin(c->planes, &c->bounds, id)) < CULL_TIE) {
+			nr_ties++;
+		} else {
+			fprintf(stderr, "cull: view %u instance %u margin %f differs\n", view, id,
+				cull_margin(c->planes, &c->bounds, id));
+			nr_fails++;
+		}
+	}
+
+	fprintf(stderr, "cull: view %u cpu %zu gpu %zu visible, %u ties\n", view, nr_cpu, nr_gpu, nr_ties);
+	return nr_fails ? EIO : 0;
+}
+
+// view i of CULL_VIEWS, from the origin turned around y and down a little
+static void cull_view(struct cull_case *c, unsigned int i)
+{
+	vec3 eye = {0, 0, 0}, center = {sinf(i * 1.7f), -0.3f, cosf(i * 1.7f)}, up = {0, 1, 0};
+	mat4x4 v, p, vp;
+
+	mat4x4_look_at(v, eye, center, up);
+	mat4x4_perspective(p, 45.0f * M_PI / 180.0f, 4.0f / 3.0f, 1.0f, 100.0f);
+	mat4x4_mul(vp, p, v);
+	icg_frustum_planes(c->planes, vp);
+}
+
+static int bench_cull(unsigned int nr_instances)
+{
+	struct wf_mesh meshes[CULL_MESHES];
+	struct cull_case c;
+	unsigned int seed = 1;
+	float *bounds;
+	char name[96];
+	int r = 0;
+
+	memset(&c, 0, sizeof(c));
+	memset(meshes, 0, sizeof(meshes));
+	c.nr_instances = nr_instances;
+	c.instances = malloc(nr_instances * sizeof(*c.instances));
+	c.visible = malloc(nr_instances * sizeof(*c.visible));
+	c.gpu_visible = malloc(nr_instances * sizeof(*c.gpu_visible));
+	bounds = malloc(nr_instances * 6 * sizeof(*bounds));
+	if (!c.instances || !c.visible || !c.gpu_visible || !bounds) {
+		fprintf(stderr, "malloc() fail\n");
+		r = ENOMEM;
+		goto out;
+	}
+
+	c.bounds = (struct icg_aabbs){
+		bounds, bounds + nr_instances, bounds + nr_instances * 2,
+		bounds + nr_instances * 3, bounds + nr_instances * 4, bounds + nr_instances * 5, nr_instances,
+	};
+
+	for (unsigned int i = 0; i < CULL_MESHES && !r; i++)
+		r = draw_mesh(&meshes[i], 1 + i, (float)i / CULL_MESHES);
+	if (!r)
+		r = icg_mdi_init(&c.mdi, meshes, CULL_MESHES);
+	if (r)
+		goto out;
+
+	// scaled up to 3 and turned around y, world bounds enclose the turned grid
+	for (unsigned int i = 0; i < nr_instances; i++) {
+		struct icg_gpu_cull_instance *o = &c.instances[i];
+		float h = (float)(i % CULL_MESHES) / CULL_MESHES, t[3], s;
+		mat4x4 model;
+
+		for (int k = 0; k < 3; k++) {
+			seed = seed * 1664525u + 1013904223u;
+			t[k] = ((seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f) * 100.0f;
+		}
+
+		s = 1.0f + (i % 5) * 0.5f;
+		mat4x4_translate(model, t[0], t[1], t[2]);
+		mat4x4_rotate_Y(model, model, i * 2.39996f);
+		mat4x4_scale_aniso(model, model, s, s, s);
+		memcpy(o->model, model, sizeof(model));
+		o->mesh = i % CULL_MESHES;
+
+		for (int k = 0; k < 3; k++) {
+			o->center[k] = model[0][k] * 0.5f + model[1][k] * 0.5f + model[2][k] * h * 0.5f + model[3][k];
+			o->extent[k] = fabsf(model[0][k]) * 0.5f + fabsf(model[1][k]) * 0.5f + fabsf(model[2][k]) * h * 0.5f;
+		}
+
+		c.bounds.cx[i] = o->center[0];
+		c.bounds.cy[i] = o->center[1];
+		c.bounds.cz[i] = o->center[2];
+		c.bounds.ex[i] = o->extent[0];
+		c.bounds.ey[i] = o->extent[1];
+		c.bounds.ez[i] = o->extent[2];
+	}
+
+	r = icg_gpu_cull_init(&c.gpu, &c.mdi, c.instances, nr_instances);
+	if (r)
+		goto out;
+
+	for (unsigned int i = 0; i < CULL_VIEWS && !r; i++) {
+		cull_view(&c, i);
+		r = cull_compare(&c, i);
+	}
+
+	if (r)
+		goto out;
+
+	snprintf(name, sizeof(name), "cull/cpu/%u", nr_instances);
+	r = measure(name, nr_instances, run_cull_cpu, &c);
+	if (r)
+		goto out;
+
+	snprintf(name, sizeof(name), "cull/gpu/%u", nr_instances);
+	r = measure(name, nr_instances, run_cull_gpu, &c);
+
+out:
+	icg_gpu_cull_clean(&c.gpu);
+	icg_mdi_clean(&c.mdi);
+
+	for (unsigned int i = 0; i < CULL_MESHES; i++) {
+		free(meshes[i].vertices);
+		free(meshes[i].indices);
+	}
+
+	free(bounds);
+	free(c.gpu_visible);
+	free(c.visible);
+	free(c.instances);
+	return r;
+}
+
+static int bench_gl(void)
+{
+	struct shader_case simple = {GLSL_SHADER_SIMPLE_VERT, GLSL_SHADER_SIMPLE_FRAG};
+	struct shader_case prj_02 = {GLSL_SHADER_PRJ_02_VERT, GLSL_SHADER_SIMPLE_FRAG};
+	struct shader_case instanced = {GLSL_SHADER_PRJ_02_INSTANCED_VERT, GLSL_SHADER_SIMPLE_FRAG};
+	const size_t sizes[] = {64 << 10, 1 << 20, 16 << 20};
+	const unsigned int nr_draws[] = {1000, 10000};
+	const unsigned int nr_culled[] = {10000, 100000, 1000000};
+	struct icg_headless h;
+	int r;
+
+	r = icg_headless_init(&h, 64, 64, 0, NULL);
+	if (r) {
+		fprintf(stderr, "no gl context, gl cases skipped\n");
+		return 0;
+	}
+
+	r = measure("shader_prog_create/simple", 1, run_shader, &simple);
+	if (!r)
+		r = measure("shader_prog_create/prj_02", 1, run_shader, &prj_02);
+	if (!r)
+		r = measure("shader_prog_create/prj_02_instanced", 1, run_shader, &instanced);
+	if (!r)
+		r = bench_shader_cache(&prj_02);
+
+	for (size_t i = 0; i < ARRAY_SIZE(sizes) && !r; i++)
+		r = bench_upload(sizes[i]);
+
+	// draws render to the framebuffer of the context, there are no frames
+	glBindFramebuffer(GL_FRAMEBUFFER, h.fbo);
+	glViewport(0, 0, h.width, h.height);
+
+	for (size_t i = 0; i < ARRAY_SIZE(nr_draws) && !r; i++)
+		r = bench_draw(nr_draws[i]);
+
+	for (size_t i = 0; i < ARRAY_SIZE(nr_culled) && !r; i++)
+		r = bench_cull(nr_culled[i]);
+
+	icg_headless_clean(&h);
+	return r;
+}
+
+// reports
+
+static void report_text(FILE *f)
+{
+	fprintf(f, "%-40s %8s %5s %14s %12s %7s %14s %14s\n", "case", "ops", "runs", "median ns/op", "mad ns/op",
+		"mad %", "min ns/op", "max ns/op");
+
+	for (unsigned int i = 0; i < nr_results; i++) {
+		const struct result *res = &results[i];
+
+		fprintf(f, "%-40s %8u %5u %14.3f %12.3f %7.2f %14.3f %14.3f\n", res->name, res->ops, res->runs,
+			res->median_ns, res->mad_ns, res->median_ns > 0 ? res->mad_ns / res->median_ns * 100 : 0.0,
+			res->min_ns, res->max_ns);
+	}
+}
+
+static void report_csv(FILE *f)
+{
+	fprintf(f, "name,ops,runs,median_ns,mad_ns,min_ns,max_ns\n");
+
+	for (unsigned int i = 0; i < nr_results; i++) {
+		const struct result *res = &results[i];
+
+		fprintf(f, "%s,%u,%u,%.4f,%.4f,%.4f,%.4f\n", res->name, res->ops, res->runs, res->median_ns,
+			res->mad_ns, res->min_ns, res->max_ns);
+	}
+}
+
+static void report_json(FILE *f)
+{
+	fprintf(f, "{\n  \"warmup\": %u,\n  \"runs\": %u,\n  \"results\": [\n", nr_warmup, nr_runs);
+
+	for (unsigned int i = 0; i < nr_results; i++) {
+		const struct result *res = &results[i];
+
+		fprintf(f, "    {\"name\": \"%s\", \"ops\": %u, \"runs\": %u, \"median_ns\": %.4f, \"mad_ns\": %.4f, "
+			"\"min_ns\": %.4f, \"max_ns\": %.4f}%s\n", res->name, res->ops, res->runs, res->median_ns,
+			res->mad_ns, res->min_ns, res->max_ns, i + 1 < nr_results ? "," : "");
+	}
+
+	fprintf(f, "  ]\n}\n");
+}
+
+// compare with the csv of an earlier run, cases missing on either side are not shown
+static int compare(const char *filename, FILE *out)
+{
+	struct baseline *base = NULL, *b;
+	unsigned int nr_base = 0, nr_changed = 0;
+	char line[512];
+	double delta;
+	FILE *f;
+
+	f = fopen(filename, "r");
+	if (!f) {
+		fprintf(stderr, "fopen('%s') fail: %s (%d)\n", filename, strerror(errno), errno);
+		return errno;
+	}
+
+	base = calloc(MAX_RESULTS, sizeof(*base));
+	if (!base) {
+		fprintf(stderr, "malloc() fail\n");
+		fclose(f);
+		return ENOMEM;
+	}
+
+	while (fgets(line, sizeof(line), f) && nr_base < MAX_RESULTS) {
+		b = &base[nr_base];
+
+		// header and malformed lines do not scan
+		if (sscanf(line, "%95[^,],%*u,%*u,%lf,%lf", b->name, &b->median_ns, &b->mad_ns) == 3)
+			nr_base++;
+	}
+
+	fclose(f);
+
+	fprintf(out, "%-40s %14s %14s %9s\n", "case", "base ns/op", "ns/op", "change");
+
+	for (unsigned int i = 0; i < nr_results; i++) {
+		const struct result *res = &results[i];
+
+		for (b = base; b < base + nr_base && strcmp(b->name, res->name); b++)
+			;
+
+		if (b == base + nr_base || b->median_ns <= 0)
+			continue;
+
+		delta = res->median_ns - b->median_ns;
+
+		fprintf(out, "%-40s %14.3f %14.3f %+8.1f%%", res->name, b->median_ns, res->median_ns,
+			delta / b->median_ns * 100);
+
+		if (fabs(delta) > SIGNIFICANT_MADS * (res->mad_ns + b->mad_ns)) {
+			fprintf(out, " %s", delta > 0 ? "slower" : "faster");
+			nr_changed++;
+		}
+
+		fprintf(out, "\n");
+	}
+
+	fprintf(out, "%u of %u cases changed beyond %d mads\n", nr_changed, nr_results, SIGNIFICANT_MADS);
+
+	free(base);
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-w warmup] [-r runs] [-f text|csv|json] [-o file] [-c base.csv] [-b filter] [-g] "
+		"[-s nr_vertices]... [file.obj]...\n", name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int sizes[16] = {10000, 100000, 1000000};
+	const char *format = "text", *output = NULL, *base = NULL;
+	int nr_sizes = 0, gl = 1, stdout_fd, opt, r = 0;
+	FILE *report, *f;
+
+	while ((opt = getopt(argc, argv, "w:r:f:o:c:b:gs:")) != -1) {
+		switch (opt) {
+		case 'w':
+			nr_warmup = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			nr_runs = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			format = optarg;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'c':
+			base = optarg;
+			break;
+		case 'b':
+			filter = optarg;
+			break;
+		case 'g':
+			gl = 0;
+			break;
+		case 's':
+			if (nr_sizes < (int)ARRAY_SIZE(sizes))
+				sizes[nr_sizes++] = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (strcmp(format, "text") && strcmp(format, "csv") && strcmp(format, "json"))
+		usage(argv[0]);
+
+	if (nr_runs < 1)
+		nr_runs = 1;
+	if (nr_runs > MAX_RUNS)
+		nr_runs = MAX_RUNS;
+
+	if (!nr_sizes)
+		nr_sizes = 3;
+
+	// libraries log to stdout, it goes to stderr and the original stdout gets the report alone
+	fflush(stdout);
+	stdout_fd = dup(STDOUT_FILENO);
+	if (stdout_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0 || !(report = fdopen(stdout_fd, "w"))) {
+		fprintf(stderr, "dup() fail: %s (%d)\n", strerror(errno), errno);
+		return EXIT_FAILURE;
+	}
+
+	f = report;
+
+	for (int i = 0; i < nr_sizes && !r; i++)
+		r = bench_load_grid(sizes[i]);
+
+	for (int i = optind; i < argc && !r; i++)
+		r = bench_load(argv[i], argv[i]);
+
+	if (!r)
+		r = bench_math();
+
+	if (!r && gl)
+		r = bench_gl();
+
+	if (r) {
+		fprintf(stderr, "bench fail: %d\n", r);
+		return EXIT_FAILURE;
+	}
+
+	if (output) {
+		f = fopen(output, "w");
+		if (!f) {
+			fprintf(stderr, "fopen('%s') fail: %s (%d)\n", output, strerror(errno), errno);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!strcmp(format, "csv"))
+		report_csv(f);
+	else if (!strcmp(format, "json"))
+		report_json(f);
+	else
+		report_text(f);
+
+	if (output && fclose(f)) {
+		fprintf(stderr, "write('%s') fail\n", output);
+		return EXIT_FAILURE;
+	}
+
+	if (base && compare(base, report))
+		r = EIO;
+
+	if (fclose(report))
+		r = EIO;
+
+	return r ? EXIT_FAILURE : EXIT_SUCCESS;
+}
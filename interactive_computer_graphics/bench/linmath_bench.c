@@ -0,0 +1,200 @@
+// linmath benchmark: simd versions of mat4x4_mul, mat4x4_mul_vec4, mat4x4_invert and quat_mul against
+// the scalar ones
+//
+// random well conditioned matrices (rotation, scale, translation and a perspective) and quaternions are
+// checked first, the simd results have to be within MAX_ULP of the largest scalar result element
+// (0 without fma contraction)
+//
+// usage: linmath_bench [-i iterations]
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <icg/common.h>
+#include <linmath.h>
+
+#define NR_INPUTS 1024
+#define MAX_ULP 4
+
+static unsigned int nr_iterations = 1000000;
+
+static mat4x4 ma[NR_INPUTS], mb[NR_INPUTS];
+static vec4 va[NR_INPUTS];
+static quat qa[NR_INPUTS], qb[NR_INPUTS];
+
+// results are accumulated so the calls can not be dropped
+static volatile float sink;
+
+static float frand(unsigned int *seed)
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return (*seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+}
+
+static void random_quat(quat q, unsigned int *seed)
+{
+	for (int k = 0; k < 4; k++)
+		q[k] = frand(seed);
+
+	quat_norm(q, q);
+}
+
+static void random_matrix(mat4x4 m, unsigned int *seed, int perspective)
+{
+	mat4x4 r;
+	quat q;
+
+	random_quat(q, seed);
+	mat4x4_from_quat(r, q);
+	mat4x4_identity(m);
+	mat4x4_translate_in_place(m, frand(seed) * 10, frand(seed) * 10, frand(seed) * 10);
+	mat4x4_mul_scalar(m, m, r);
+	mat4x4_scale_aniso(m, m, 0.5f + fabsf(frand(seed)), 0.5f + fabsf(frand(seed)), 0.5f + fabsf(frand(seed)));
+
+	if (perspective) {
+		mat4x4_perspective(r, 0.5f + fabsf(frand(seed)), 1.0f + fabsf(frand(seed)), 0.1f, 100.0f);
+		mat4x4_mul_scalar(m, r, m);
+	}
+}
+
+// difference in units in the last place of the largest element, elements which cancel out to almost 0
+// would give huge ulp distances for the same absolute error (fma contraction of one side only)
+static uint32_t max_ulp(const float *a, const float *b, int n)
+{
+	float scale = 0, d = 0;
+
+	for (int k = 0; k < n; k++) {
+		scale = fabsf(b[k]) > scale ? fabsf(b[k]) : scale;
+		d = fabsf(a[k] - b[k]) > d ? fabsf(a[k] - b[k]) : d;
+	}
+
+	if (d == 0)
+		return 0;
+
+	return scale > 0 ? ceilf(d / (scale * FLT_EPSILON)) : UINT32_MAX;
+}
+
+static int check(void)
+{
+	uint32_t d_mul = 0, d_vec = 0, d_inv = 0, d_quat = 0, d;
+	mat4x4 r, s;
+	vec4 rv, sv;
+
+	for (int i = 0; i < NR_INPUTS; i++) {
+		mat4x4_mul(r, ma[i], mb[i]);
+		mat4x4_mul_scalar(s, ma[i], mb[i]);
+		d = max_ulp(r[0], s[0], 16);
+		d_mul = d > d_mul ? d : d_mul;
+
+		// aliased output
+		mat4x4_dup(r, ma[i]);
+		mat4x4_mul(r, r, mb[i]);
+		d = max_ulp(r[0], s[0], 16);
+		d_mul = d > d_mul ? d : d_mul;
+
+		mat4x4_mul_vec4(rv, ma[i], va[i]);
+		mat4x4_mul_vec4_scalar(sv, ma[i], va[i]);
+		d = max_ulp(rv, sv, 4);
+		d_vec = d > d_vec ? d : d_vec;
+
+		mat4x4_invert(r, ma[i]);
+		mat4x4_invert_scalar(s, ma[i]);
+		d = max_ulp(r[0], s[0], 16);
+		d_inv = d > d_inv ? d : d_inv;
+
+		quat_mul(rv, qa[i], qb[i]);
+		quat_mul_scalar(sv, qa[i], qb[i]);
+		d = max_ulp(rv, sv, 4);
+		d_quat = d > d_quat ? d : d_quat;
+	}
+
+	printf("%-16s %10s\n", "function", "max ulp");
+	printf("%-16s %10u\n", "mat4x4_mul", d_mul);
+	printf("%-16s %10u\n", "mat4x4_mul_vec4", d_vec);
+	printf("%-16s %10u\n", "mat4x4_invert", d_inv);
+	printf("%-16s %10u\n", "quat_mul", d_quat);
+
+	if (d_mul > MAX_ULP || d_vec > MAX_ULP || d_inv > MAX_ULP || d_quat > MAX_ULP) {
+		fprintf(stderr, "simd results differ by more than %d ulp\n", MAX_ULP);
+		return 1;
+	}
+
+	return 0;
+}
+
+#define BENCH(name, call)                                                          \
+	static double name(void)                                                   \
+	{                                                                          \
+		mat4x4 r;                                                          \
+		double t = icg_time_ms();                                          \
+		unsigned int i;                                                    \
+                                                                                   \
+		for (i = 0; i < nr_iterations; i++) {                              \
+			unsigned int j = i & (NR_INPUTS - 1);                      \
+			call;                                                      \
+			sink += r[0][0];                                           \
+		}                                                                  \
+                                                                                   \
+		return nr_iterations ? (icg_time_ms() - t) * 1e6 / nr_iterations : 0; \
+	}
+
+BENCH(bench_mul, mat4x4_mul(r, ma[j], mb[j]))
+BENCH(bench_mul_scalar, mat4x4_mul_scalar(r, ma[j], mb[j]))
+BENCH(bench_vec, mat4x4_mul_vec4(r[0], ma[j], va[j]))
+BENCH(bench_vec_scalar, mat4x4_mul_vec4_scalar(r[0], ma[j], va[j]))
+BENCH(bench_inv, mat4x4_invert(r, ma[j]))
+BENCH(bench_inv_scalar, mat4x4_invert_scalar(r, ma[j]))
+BENCH(bench_quat, quat_mul(r[0], qa[j], qb[j]))
+BENCH(bench_quat_scalar, quat_mul_scalar(r[0], qa[j], qb[j]))
+
+int main(int argc, char *argv[])
+{
+	unsigned int seed = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:")) != -1) {
+		switch (opt) {
+		case 'i':
+			nr_iterations = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-i iterations]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (int i = 0; i < NR_INPUTS; i++) {
+		random_matrix(ma[i], &seed, i & 1);
+		random_matrix(mb[i], &seed, 0);
+		random_quat(qa[i], &seed);
+		random_quat(qb[i], &seed);
+
+		for (int k = 0; k < 4; k++)
+			va[i][k] = frand(&seed) * 10;
+	}
+
+#if defined(LINMATH_SIMD) && defined(__AVX__)
+	printf("simd: avx\n");
+#elif defined(LINMATH_SIMD) && defined(__ARM_NEON)
+	printf("simd: neon\n");
+#elif defined(LINMATH_SIMD)
+	printf("simd: sse\n");
+#else
+	printf("simd: none\n");
+#endif
+
+	if (check())
+		return EXIT_FAILURE;
+
+	printf("\n%-16s %10s %10s\n", "function", "scalar ns", "simd ns");
+	printf("%-16s %10.2f %10.2f\n", "mat4x4_mul", bench_mul_scalar(), bench_mul());
+	printf("%-16s %10.2f %10.2f\n", "mat4x4_mul_vec4", bench_vec_scalar(), bench_vec());
+	printf("%-16s %10.2f %10.2f\n", "mat4x4_invert", bench_inv_scalar(), bench_inv());
+	printf("%-16s %10.2f %10.2f\n", "quat_mul", bench_quat_scalar(), bench_quat());
+
+	return EXIT_SUCCESS;
+}
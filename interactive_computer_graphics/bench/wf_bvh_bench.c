@@ -0,0 +1,212 @@
+// bvh benchmark: build time, tree quality and ray query time of wavefront_obj bvh
+//
+// rays start on the bounding sphere and aim at random points of the bounds, the first rays are checked
+// against a brute force test of all triangles
+//
+// usage: wf_bvh_bench [-t threads] [-r rays] file.obj...
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <icg/common.h>
+#include <wavefront_obj.h>
+
+// rays checked by brute force
+#define CHECKED_RAYS 256
+
+static unsigned int nr_threads;
+static unsigned int nr_rays = 100000;
+
+static float frand(unsigned int *seed)
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return (*seed >> 8) / (float)(1 << 24);
+}
+
+static float area(const struct wf_bvh_node *n)
+{
+	float e[3];
+
+	for (int k = 0; k < 3; k++)
+		e[k] = n->max[k] - n->min[k];
+
+	return e[0] * e[1] + e[1] * e[2] + e[2] * e[0];
+}
+
+// expected cost of a random ray, node traversal and triangle test cost the same
+static float sah_cost(const struct wf_bvh *b, unsigned int *nr_leaves)
+{
+	float cost = 0, root = area(&b->nodes[0]);
+
+	*nr_leaves = 0;
+
+	for (unsigned int i = 0; i < b->nr_nodes; i++) {
+		// node 1 is the unused half of the root pair
+		if (i == 1)
+			continue;
+
+		if (b->nodes[i].count) {
+			cost += area(&b->nodes[i]) * b->nodes[i].count;
+			(*nr_leaves)++;
+		} else {
+			cost += area(&b->nodes[i]);
+		}
+	}
+
+	return root > 0 ? cost / root : 0;
+}
+
+static int brute_force(const struct wf_mesh *m, const float o[3], const float d[3], struct wf_bvh_hit *hit)
+{
+	struct wf_bvh b = {0};
+	struct wf_bvh_node node;
+	unsigned int t;
+	struct wf_bvh_hit h;
+	int found = 0;
+
+	// a single leaf per triangle reuses the library triangle test
+	b.nodes = &node;
+	b.nr_nodes = 1;
+	b.triangles = &t;
+	b.nr_triangles = 1;
+	node.count = 1;
+	node.first = 0;
+
+	for (int k = 0; k < 3; k++) {
+		node.min[k] = -FLT_MAX;
+		node.max[k] = FLT_MAX;
+	}
+
+	hit->triangle = -1;
+	hit->distance = FLT_MAX;
+
+	for (t = 0; t < m->nr_indices / 3; t++) {
+		if (wf_bvh_intersect(&b, m, o, d, &h) && h.distance < hit->distance) {
+			*hit = h;
+			found = 1;
+		}
+	}
+
+	return found;
+}
+
+static int report(const char *filename)
+{
+	struct wf_obj o;
+	struct wf_mesh m;
+	struct wf_bvh b;
+	struct wf_bvh_hit hit, ref;
+	float center[3], radius = 0, origin[3], dir[3], l, cost;
+	unsigned int seed = 1, nr_hits = 0, nr_leaves, nr_wrong = 0;
+	double t1, tn, tq;
+	int r;
+
+	wf_obj_init(&o);
+
+	r = wf_obj_load(filename, &o);
+	if (!r)
+		r = wf_mesh_build(&o, &m);
+
+	wf_obj_clean(&o);
+
+	if (r)
+		return r;
+
+	t1 = icg_time_ms();
+	r = wf_mesh_build_bvh(&m, 1, &b);
+	t1 = icg_time_ms() - t1;
+	if (r)
+		goto out;
+
+	wf_bvh_clean(&b);
+
+	tn = icg_time_ms();
+	r = wf_mesh_build_bvh(&m, nr_threads, &b);
+	tn = icg_time_ms() - tn;
+	if (r)
+		goto out;
+
+	cost = sah_cost(&b, &nr_leaves);
+
+	for (int k = 0; k < 3; k++) {
+		center[k] = ((&m.bounds_min.x)[k] + (&m.bounds_max.x)[k]) * 0.5f;
+		radius += powf((&m.bounds_max.x)[k] - center[k], 2);
+	}
+
+	radius = sqrtf(radius);
+
+	tq = 0;
+
+	for (unsigned int i = 0; i < nr_rays; i++) {
+		l = 0;
+
+		for (int k = 0; k < 3; k++) {
+			origin[k] = frand(&seed) * 2.0f - 1.0f;
+			l += origin[k] * origin[k];
+		}
+
+		l = sqrtf(l);
+
+		for (int k = 0; k < 3; k++) {
+			origin[k] = center[k] + origin[k] / l * radius * 1.5f;
+			dir[k] = (&m.bounds_min.x)[k] + frand(&seed) * ((&m.bounds_max.x)[k] - (&m.bounds_min.x)[k]) -
+				 origin[k];
+		}
+
+		double t = icg_time_ms();
+
+		nr_hits += wf_bvh_intersect(&b, &m, origin, dir, &hit);
+		tq += icg_time_ms() - t;
+
+		if (i < CHECKED_RAYS) {
+			brute_force(&m, origin, dir, &ref);
+
+			if (ref.triangle != hit.triangle && fabsf(ref.distance - hit.distance) > 1e-5f * ref.distance)
+				nr_wrong++;
+		}
+	}
+
+	printf("%s: %u triangles, %u nodes, %u leaves, %.1f triangles per leaf, sah cost %.2f\n", filename,
+	       m.nr_indices / 3, b.nr_nodes, nr_leaves, nr_leaves ? (float)b.nr_triangles / nr_leaves : 0.0f, cost);
+	printf("  build %.3fms (1 thread), %.3fms (%u threads)\n", t1, tn, nr_threads);
+	printf("  %u rays, %u hits, %.3fus per ray, %u of %u wrong\n", nr_rays, nr_hits,
+	       nr_rays ? tq * 1e3 / nr_rays : 0.0, nr_wrong, nr_rays < CHECKED_RAYS ? nr_rays : CHECKED_RAYS);
+
+	if (nr_wrong)
+		r = 1;
+
+	wf_bvh_clean(&b);
+
+out:
+	wf_mesh_clean(&m);
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, r = 0;
+
+	nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((opt = getopt(argc, argv, "t:r:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'r':
+			nr_rays = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-r rays] file.obj...\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (int i = optind; i < argc && !r; i++)
+		r = report(argv[i]);
+
+	return r ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,317 @@
+// load to first frame benchmark: 02_transformations on generated meshes of growing size
+//
+// for every size wf_obj_gen writes an obj file, then the app renders one headless frame of it, cold
+// (no .wfb sidecar, the obj is parsed, optimized and cached) and warm (the sidecar is mapped). The wall
+// time is taken from fork() to the first frame after the "mesh uploaded" line of the app, a frame of the
+// complete mesh, so exec, dynamic linking, context creation and the whole upload are included; the log
+// writer adds up to a millisecond. The app's own numbers (from main()) are shown next to it. ns/vertex
+// over the sizes shows the asymptotic behaviour.
+//
+// usage: wf_first_frame_bench [-a app] [-g wf_obj_gen] [-m grid|sphere|teapot] [-t] [-r runs] [-d dir] [-k]
+//                             [-s nr_vertices]...
+//   -r runs          cold and warm runs per size, medians are shown (default 3)
+//   -d dir           directory of the generated files (default /tmp)
+//   -k               keep generated files
+//   -s nr_vertices   size, 1e7 notation works (default 1e4 1e5 1e6 1e7)
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <icg/common.h>
+
+#ifndef ICG_APP
+#define ICG_APP "./02_transformations"
+#endif
+
+#ifndef ICG_OBJ_GEN
+#define ICG_OBJ_GEN "./wf_obj_gen"
+#endif
+
+#define MAX_RUNS 64
+
+struct run {
+	double wall_ms;		// fork() to first complete frame
+	double app_ms;		// main() to first frame, reported by the app
+	double load_ms;		// main() to loaded mesh, reported by the app
+	double upload_ms;	// main() to uploaded mesh, reported by the app
+	unsigned int nr_vertices;
+};
+
+static const char *app = ICG_APP, *generator = ICG_OBJ_GEN;
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+// \return 0 or an errno code, child fails are EPROTO
+static int wait_child(pid_t pid, const char *name)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		fprintf(stderr, "waitpid() fail: %s (%d)\n", strerror(errno), errno);
+		return errno;
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		fprintf(stderr, "%s fail: status 0x%x\n", name, status);
+		return EPROTO;
+	}
+
+	return 0;
+}
+
+static int generate(const char *filename, const char *shape, int triangles, uint64_t nr_vertices)
+{
+	char n[32];
+	const char *args[] = {generator, "-m", shape, "-n", n, filename, NULL, NULL};
+	pid_t pid;
+
+	snprintf(n, sizeof(n), "%llu", (unsigned long long)nr_vertices);
+
+	if (triangles) {
+		args[5] = "-t";
+		args[6] = filename;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		fprintf(stderr, "fork() fail: %s (%d)\n", strerror(errno), errno);
+		return errno;
+	}
+
+	if (!pid) {
+		execv(generator, (char *const *)args);
+		fprintf(stderr, "exec('%s') fail: %s (%d)\n", generator, strerror(errno), errno);
+		_exit(127);
+	}
+
+	return wait_child(pid, generator);
+}
+
+// one headless frame, the output of the app is parsed and dropped
+static int render(const char *filename, struct run *run)
+{
+	double started_at, complete_at = 0, first_ms;
+	unsigned int nr_frames;
+	char line[512];
+	int fds[2], r;
+	FILE *f;
+	pid_t pid;
+
+	memset(run, 0, sizeof(*run));
+
+	if (pipe(fds)) {
+		fprintf(stderr, "pipe() fail: %s (%d)\n", strerror(errno), errno);
+		return errno;
+	}
+
+	started_at = icg_time_ms();
+
+	pid = fork();
+	if (pid < 0) {
+		fprintf(stderr, "fork() fail: %s (%d)\n", strerror(errno), errno);
+		close(fds[0]);
+		close(fds[1]);
+		return errno;
+	}
+
+	if (!pid) {
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execl(app, app, "-f", "1", filename, (char *)NULL);
+		fprintf(stderr, "exec('%s') fail: %s (%d)\n", app, strerror(errno), errno);
+		_exit(127);
+	}
+
+	close(fds[1]);
+
+	f = fdopen(fds[0], "r");
+	if (!f) {
+		fprintf(stderr, "fdopen() fail: %s (%d)\n", strerror(errno), errno);
+		close(fds[0]);
+		wait_child(pid, app);
+		return ENOMEM;
+	}
+
+	// frames before the upload is done show a part of the mesh
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "first frame at %lfms", &first_ms) == 1) {
+			run->app_ms = first_ms;
+			if (!complete_at && run->upload_ms)
+				complete_at = icg_time_ms();
+		} else if (sscanf(line, "mesh uploaded in %u frames at %lfms", &nr_frames, &run->upload_ms) != 2) {
+			sscanf(line, "mesh %u vertices %*u indices loaded in %lfms", &run->nr_vertices, &run->load_ms);
+		}
+	}
+
+	fclose(f);
+
+	r = wait_child(pid, app);
+	if (r)
+		return r;
+
+	if (!complete_at) {
+		fprintf(stderr, "no complete frame of '%s'\n", filename);
+		return EPROTO;
+	}
+
+	run->wall_ms = complete_at - started_at;
+	return 0;
+}
+
+static double median_of(double *v, unsigned int n)
+{
+	qsort(v, n, sizeof(*v), cmp_double);
+	return v[n / 2];
+}
+
+// median of the runs field by field
+static void median(const struct run *runs, unsigned int nr, struct run *m)
+{
+	double wall[MAX_RUNS], app_ms[MAX_RUNS], load[MAX_RUNS], upload[MAX_RUNS];
+
+	for (unsigned int i = 0; i < nr; i++) {
+		wall[i] = runs[i].wall_ms;
+		app_ms[i] = runs[i].app_ms;
+		load[i] = runs[i].load_ms;
+		upload[i] = runs[i].upload_ms;
+	}
+
+	m->wall_ms = median_of(wall, nr);
+	m->app_ms = median_of(app_ms, nr);
+	m->load_ms = median_of(load, nr);
+	m->upload_ms = median_of(upload, nr);
+	m->nr_vertices = runs[0].nr_vertices;
+}
+
+static int bench(const char *dir, const char *shape, int triangles, uint64_t nr_vertices, unsigned int nr_runs,
+		 int keep)
+{
+	char filename[4096], sidecar[4096 + 8];
+	struct run cold[MAX_RUNS], warm[MAX_RUNS], c, w;
+	struct stat st;
+	double gen_ms;
+	int r;
+
+	snprintf(filename, sizeof(filename), "%s/icg_first_frame_%s%s_%llu.obj", dir, shape, triangles ? "_t" : "",
+		 (unsigned long long)nr_vertices);
+	snprintf(sidecar, sizeof(sidecar), "%s.wfb", filename);
+
+	gen_ms = icg_time_ms();
+	r = generate(filename, shape, triangles, nr_vertices);
+	gen_ms = icg_time_ms() - gen_ms;
+
+	if (r)
+		goto out;
+
+	if (stat(filename, &st)) {
+		r = errno;
+		fprintf(stderr, "stat('%s') fail: %s (%d)\n", filename, strerror(r), r);
+		goto out;
+	}
+
+	for (unsigned int i = 0; i < nr_runs && !r; i++) {
+		unlink(sidecar);
+
+		r = render(filename, &cold[i]);
+		if (!r)
+			r = render(filename, &warm[i]);
+	}
+
+	if (r)
+		goto out;
+
+	median(cold, nr_runs, &c);
+	median(warm, nr_runs, &w);
+
+	printf("%-8s %10u %9.1f %9.1f | %11.1f %10.1f %10.1f %10.1f %8.1f | %11.1f %10.1f %10.1f %8.1f\n", shape,
+	       c.nr_vertices, st.st_size / 1e6, gen_ms, c.wall_ms, c.app_ms, c.load_ms, c.upload_ms,
+	       c.nr_vertices ? c.wall_ms * 1e6 / c.nr_vertices : 0.0, w.wall_ms, w.app_ms, w.upload_ms,
+	       w.nr_vertices ? w.wall_ms * 1e6 / w.nr_vertices : 0.0);
+	fflush(stdout);
+
+out:
+	if (!keep) {
+		unlink(filename);
+		unlink(sidecar);
+	}
+
+	return r;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-a app] [-g wf_obj_gen] [-m grid|sphere|teapot] [-t] [-r runs] [-d dir] [-k] "
+		"[-s nr_vertices]...\n", name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t sizes[16] = {10000, 100000, 1000000, 10000000};
+	const char *dir = "/tmp", *shape = "teapot";
+	int nr_sizes = 0, triangles = 0, keep = 0, opt, r = 0;
+	unsigned int nr_runs = 3;
+
+	while ((opt = getopt(argc, argv, "a:g:m:tr:d:ks:")) != -1) {
+		switch (opt) {
+		case 'a':
+			app = optarg;
+			break;
+		case 'g':
+			generator = optarg;
+			break;
+		case 'm':
+			shape = optarg;
+			break;
+		case 't':
+			triangles = 1;
+			break;
+		case 'r':
+			nr_runs = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 'k':
+			keep = 1;
+			break;
+		case 's':
+			if (nr_sizes < (int)ARRAY_SIZE(sizes))
+				sizes[nr_sizes++] = (uint64_t)strtod(optarg, NULL);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (nr_runs < 1)
+		nr_runs = 1;
+	if (nr_runs > MAX_RUNS)
+		nr_runs = MAX_RUNS;
+
+	if (!nr_sizes)
+		nr_sizes = 4;
+
+	printf("%-8s %10s %9s %9s | %11s %10s %10s %10s %8s | %11s %10s %10s %8s\n", "", "", "", "", "cold", "", "", "",
+	       "", "warm", "", "", "");
+	printf("%-8s %10s %9s %9s | %11s %10s %10s %10s %8s | %11s %10s %10s %8s\n", "shape", "vertices", "MB",
+	       "gen ms", "complete ms", "app ms", "load ms", "upload ms", "ns/vert", "complete ms", "app ms", "upload ms",
+	       "ns/vert");
+
+	for (int i = 0; i < nr_sizes && !r; i++)
+		r = bench(dir, shape, triangles, sizes[i], nr_runs, keep);
+
+	return r ? EXIT_FAILURE : EXIT_SUCCESS;
+}
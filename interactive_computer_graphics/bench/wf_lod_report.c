@@ -0,0 +1,89 @@
+// level of detail report: triangles and quadric error of every level of wavefront_obj simplification
+//
+// usage: wf_lod_report [-r ratio] [-m min_triangles] file.obj...
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <icg/common.h>
+#include <wavefront_obj.h>
+
+static float ratio = 0.5f;
+static unsigned int min_triangles = 64;
+
+static int report(const char *filename)
+{
+	struct wf_obj o;
+	struct wf_mesh m;
+	struct wf_lods l;
+	float diagonal = 0, d;
+	double t;
+	int r;
+
+	wf_obj_init(&o);
+
+	r = wf_obj_load(filename, &o);
+	if (!r)
+		r = wf_mesh_build(&o, &m);
+
+	wf_obj_clean(&o);
+
+	if (r)
+		return r;
+
+	for (int k = 0; k < 3; k++) {
+		d = (&m.bounds_max.x)[k] - (&m.bounds_min.x)[k];
+		diagonal += d * d;
+	}
+
+	diagonal = sqrtf(diagonal);
+
+	t = icg_time_ms();
+	r = wf_mesh_build_lods(&m, ratio, min_triangles, &l);
+	t = icg_time_ms() - t;
+
+	if (r) {
+		wf_mesh_clean(&m);
+		return r;
+	}
+
+	printf("%s: %u triangles %u vertices, %u locked, %u levels in %.3fms\n", filename, m.nr_indices / 3,
+	       m.nr_vertices, l.nr_locked, l.nr_lods, t);
+	printf("  %-5s %10s %8s %12s %12s\n", "lod", "triangles", "kept", "error", "error rel");
+
+	for (unsigned int i = 0; i < l.nr_lods; i++) {
+		printf("  %-5u %10u %7.1f%% %12.4g %12.4g\n", i, l.lods[i].nr_indices / 3,
+		       (float)l.lods[i].nr_indices / m.nr_indices * 100.0f, l.lods[i].error,
+		       diagonal > 0 ? l.lods[i].error / diagonal : 0.0f);
+	}
+
+	wf_lods_clean(&l);
+	wf_mesh_clean(&m);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, r = 0;
+
+	while ((opt = getopt(argc, argv, "r:m:")) != -1) {
+		switch (opt) {
+		case 'r':
+			ratio = atof(optarg);
+			break;
+		case 'm':
+			min_triangles = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-r ratio] [-m min_triangles] file.obj...\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (int i = optind; i < argc && !r; i++)
+		r = report(argv[i]);
+
+	return r ? EXIT_FAILURE : EXIT_SUCCESS;
+}
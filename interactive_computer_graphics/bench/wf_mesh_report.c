@@ -0,0 +1,132 @@
+// mesh processing report: vertex cache, overdraw and vertex fetch optimizations of wavefront_obj
+//
+// the overdraw order may cost OVERDRAW_THRESHOLD times the acmr of the vertex cache order at most, a
+// mesh over it fails the report
+//
+// usage: wf_mesh_report [-c cache_size] file.obj...
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <icg/common.h>
+#include <wavefront_obj.h>
+
+#define OVERDRAW_THRESHOLD 1.05f
+
+static unsigned int cache_size = WF_MESH_CACHE_SIZE;
+
+static int optimize_none(struct wf_mesh *)
+{
+	return 0;
+}
+
+static int optimize_vertex_cache(struct wf_mesh *m)
+{
+	return wf_mesh_optimize_vertex_cache(m, cache_size);
+}
+
+static int optimize_overdraw(struct wf_mesh *m)
+{
+	return wf_mesh_optimize_overdraw(m, cache_size, OVERDRAW_THRESHOLD);
+}
+
+static int optimize_all(struct wf_mesh *m)
+{
+	int r = optimize_overdraw(m);
+
+	return r ? r : wf_mesh_optimize_vertex_fetch(m);
+}
+
+// checked stages are held to the acmr of the vcache stage
+struct stage {
+	const char *name;
+	int (*run)(struct wf_mesh *m);
+	int checked;
+} stages[] = {
+	{"original", optimize_none, 0},
+	{"vcache", optimize_vertex_cache, 0},
+	{"overdraw", optimize_overdraw, 1},
+	{"vfetch", wf_mesh_optimize_vertex_fetch, 0},
+	{"all", optimize_all, 1},
+};
+
+static int report(const char *filename)
+{
+	struct wf_obj o;
+	struct wf_mesh m;
+	struct wf_mesh_stats s;
+	float base = 0, vcache = 0;
+	double t;
+	int r;
+
+	wf_obj_init(&o);
+
+	r = wf_obj_load(filename, &o);
+	if (r)
+		return r;
+
+	printf("%s: %u triangles, cache %u\n", filename, o.nr_corners / 3, cache_size);
+	printf("  %-10s %10s %8s %8s %10s %10s %10s\n", "stage", "time ms", "acmr", "atvr", "overfetch", "shaded", "saved");
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(stages); i++) {
+		r = wf_mesh_build(&o, &m);
+		if (r)
+			break;
+
+		t = icg_time_ms();
+		r = stages[i].run(&m);
+		t = icg_time_ms() - t;
+
+		if (r) {
+			wf_mesh_clean(&m);
+			break;
+		}
+
+		wf_mesh_analyze(&m, cache_size, &s);
+
+		if (!i)
+			base = s.acmr;
+
+		if (stages[i].run == optimize_vertex_cache)
+			vcache = s.acmr;
+
+		printf("  %-10s %10.3f %8.3f %8.3f %10.3f %10.0f %9.1f%%\n", stages[i].name, t, s.acmr, s.atvr, s.overfetch,
+		       s.acmr * (m.nr_indices / 3), base > 0 ? (1.0f - s.acmr / base) * 100.0f : 0.0f);
+
+		wf_mesh_clean(&m);
+
+		if (stages[i].checked && s.acmr > vcache * OVERDRAW_THRESHOLD) {
+			fprintf(stderr, "%s: %s acmr %.3f over %.2f x vcache acmr %.3f\n", filename, stages[i].name, s.acmr,
+				OVERDRAW_THRESHOLD, vcache);
+			r = ERANGE;
+			break;
+		}
+	}
+
+	wf_obj_clean(&o);
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, r = 0;
+
+	while ((opt = getopt(argc, argv, "c:")) != -1) {
+		switch (opt) {
+		case 'c':
+			cache_size = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-c cache_size] file.obj...\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (int i = optind; i < argc && !r; i++)
+		r = report(argv[i]);
+
+	return r ? EXIT_FAILURE : EXIT_SUCCESS;
+}
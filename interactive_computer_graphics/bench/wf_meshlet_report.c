@@ -0,0 +1,208 @@
+// meshlet report: cluster sizes, build time and culling rate of wavefront_obj meshlets
+//
+// every build is checked: the same meshlets for 1 and N threads, meshlets cover the index buffer in
+// order within the limits, spheres contain their vertices and cones contain their triangle normals
+//
+// usage: wf_meshlet_report [-t threads] [-n] file.obj...
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <icg/common.h>
+#include <wavefront_obj.h>
+
+// relative tolerance of the bounds checks
+#define EPS 1e-4f
+
+static unsigned int nr_threads;
+static int optimize = 1;
+
+static const float *position(const struct wf_mesh *m, unsigned int v)
+{
+	return (const float *)((const char *)m->vertices + (size_t)v * m->stride);
+}
+
+static unsigned int index_at(const struct wf_mesh *m, size_t i)
+{
+	return m->index_size == 2 ? ((const unsigned short *)m->indices)[i] : ((const unsigned int *)m->indices)[i];
+}
+
+static int same(const struct wf_meshlets *a, const struct wf_meshlets *b)
+{
+	return a->nr_meshlets == b->nr_meshlets && a->nr_vertices == b->nr_vertices &&
+	       a->nr_triangles == b->nr_triangles &&
+	       !memcmp(a->meshlets, b->meshlets, a->nr_meshlets * sizeof(*a->meshlets)) &&
+	       !memcmp(a->vertices, b->vertices, a->nr_vertices * sizeof(*a->vertices)) &&
+	       !memcmp(a->triangles, b->triangles, (size_t)a->nr_triangles * 3);
+}
+
+static const char *check(const struct wf_mesh *m, const struct wf_meshlets *ml, float diagonal)
+{
+	const struct wf_meshlet *c;
+	const unsigned int *vertices;
+	const unsigned char *triangles;
+	const float *p[3];
+	float d, n[3], l, min_dot;
+	size_t t = 0;
+
+	for (unsigned int i = 0; i < ml->nr_meshlets; i++) {
+		c = &ml->meshlets[i];
+		vertices = ml->vertices + c->vertex_offset;
+		triangles = ml->triangles + (size_t)c->triangle_offset * 3;
+
+		if (!c->nr_triangles || c->nr_vertices > WF_MESHLET_MAX_VERTICES ||
+		    c->nr_triangles > WF_MESHLET_MAX_TRIANGLES)
+			return "limits";
+
+		if (c->triangle_offset != t)
+			return "coverage";
+
+		for (unsigned int v = 0; v < c->nr_vertices; v++) {
+			d = 0;
+			for (int k = 0; k < 3; k++)
+				d += powf(position(m, vertices[v])[k] - c->center[k], 2);
+
+			if (sqrtf(d) > c->radius + EPS * diagonal)
+				return "sphere";
+		}
+
+		min_dot = c->cone_cutoff < 1.0f ? sqrtf(1.0f - c->cone_cutoff * c->cone_cutoff) : -1.0f;
+
+		for (unsigned int j = 0; j < c->nr_triangles; j++, t++) {
+			for (int k = 0; k < 3; k++) {
+				if (triangles[j * 3 + k] >= c->nr_vertices ||
+				    vertices[triangles[j * 3 + k]] != index_at(m, t * 3 + k))
+					return "coverage";
+
+				p[k] = position(m, vertices[triangles[j * 3 + k]]);
+			}
+
+			n[0] = (p[1][1] - p[0][1]) * (p[2][2] - p[0][2]) - (p[1][2] - p[0][2]) * (p[2][1] - p[0][1]);
+			n[1] = (p[1][2] - p[0][2]) * (p[2][0] - p[0][0]) - (p[1][0] - p[0][0]) * (p[2][2] - p[0][2]);
+			n[2] = (p[1][0] - p[0][0]) * (p[2][1] - p[0][1]) - (p[1][1] - p[0][1]) * (p[2][0] - p[0][0]);
+			l = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+			if (l > 0 && (n[0] * c->cone_axis[0] + n[1] * c->cone_axis[1] + n[2] * c->cone_axis[2]) / l <
+			    min_dot - EPS * 10)
+				return "cone";
+		}
+	}
+
+	return t == m->nr_indices / 3 ? "ok" : "coverage";
+}
+
+// back facing meshlets seen from the 6 axis directions at a distance of the bounds diagonal
+static float cone_culled(const struct wf_mesh *m, const struct wf_meshlets *ml, float diagonal)
+{
+	float camera[3];
+	size_t culled = 0;
+
+	for (int axis = 0; axis < 6; axis++) {
+		for (int k = 0; k < 3; k++)
+			camera[k] = ((&m->bounds_min.x)[k] + (&m->bounds_max.x)[k]) * 0.5f;
+
+		camera[axis % 3] += axis < 3 ? diagonal : -diagonal;
+
+		for (unsigned int i = 0; i < ml->nr_meshlets; i++)
+			culled += wf_meshlet_cull(&ml->meshlets[i], camera, NULL, 0);
+	}
+
+	return ml->nr_meshlets ? (float)culled / (6 * ml->nr_meshlets) * 100.0f : 0.0f;
+}
+
+static int report(const char *filename)
+{
+	struct wf_obj o;
+	struct wf_mesh m;
+	struct wf_meshlets ml, ml_mt;
+	float diagonal = 0, d;
+	double t, t_mt;
+	int r;
+
+	wf_obj_init(&o);
+
+	r = wf_obj_load(filename, &o);
+	if (!r)
+		r = wf_mesh_build(&o, &m);
+
+	wf_obj_clean(&o);
+
+	if (r)
+		return r;
+
+	if (optimize) {
+		r = wf_mesh_optimize(&m);
+		if (r)
+			goto out;
+	}
+
+	for (int k = 0; k < 3; k++) {
+		d = (&m.bounds_max.x)[k] - (&m.bounds_min.x)[k];
+		diagonal += d * d;
+	}
+
+	diagonal = sqrtf(diagonal);
+
+	t = icg_time_ms();
+	r = wf_mesh_build_meshlets(&m, 1, &ml);
+	t = icg_time_ms() - t;
+	if (r)
+		goto out;
+
+	t_mt = icg_time_ms();
+	r = wf_mesh_build_meshlets(&m, nr_threads, &ml_mt);
+	t_mt = icg_time_ms() - t_mt;
+	if (r) {
+		wf_meshlets_clean(&ml);
+		goto out;
+	}
+
+	printf("%s: %u triangles %u vertices%s\n", filename, m.nr_indices / 3, m.nr_vertices,
+	       optimize ? ", optimized" : "");
+	printf("  %10s %10s %10s %10s %10s %12s %12s %10s %10s\n", "meshlets", "avg vtx", "avg tri", "vtx/tri",
+	       "culled", "1 thread ms", "threads ms", "threads", "check");
+	printf("  %10u %10.1f %10.1f %10.3f %9.1f%% %12.3f %12.3f %10u %10s\n", ml.nr_meshlets,
+	       ml.nr_meshlets ? (float)ml.nr_vertices / ml.nr_meshlets : 0.0f,
+	       ml.nr_meshlets ? (float)ml.nr_triangles / ml.nr_meshlets : 0.0f,
+	       ml.nr_triangles ? (float)ml.nr_vertices / ml.nr_triangles : 0.0f, cone_culled(&m, &ml, diagonal),
+	       t, t_mt, nr_threads, same(&ml, &ml_mt) ? check(&m, &ml, diagonal) : "threads");
+
+	if (strcmp(check(&m, &ml, diagonal), "ok") || !same(&ml, &ml_mt))
+		r = 1;
+
+	wf_meshlets_clean(&ml);
+	wf_meshlets_clean(&ml_mt);
+
+out:
+	wf_mesh_clean(&m);
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, r = 0;
+
+	nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((opt = getopt(argc, argv, "t:n")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'n':
+			optimize = 0;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-n] file.obj...\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (int i = optind; i < argc && !r; i++)
+		r = report(argv[i]);
+
+	return r ? EXIT_FAILURE : EXIT_SUCCESS;
+}
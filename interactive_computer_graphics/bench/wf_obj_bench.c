@@ -0,0 +1,273 @@
+// wavefront obj loader benchmark: mmap/in-place parser vs fgets/sscanf reference,
+// allocation counters of the last run are printed for every loader
+//
+// usage: wf_obj_bench [-r runs] [-t max_threads] [-s nr_vertices]... [file.obj]...
+//   -r runs         number of measured runs per loader (default 5)
+//   -t max_threads  parallel parse is measured for 2, 4, 8 ... up to max_threads (default number of cores)
+//   -s nr_vertices  generate a synthetic obj file with nr_vertices vertices (can be repeated)
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <icg/common.h>
+#include <wavefront_obj.h>
+
+typedef int (*loader_t)(const char *filename, struct wf_obj *o);
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+// grid of vertices with a face per quad, lines of a real exporter format
+static int generate(const char *filename, unsigned int nr_vertices)
+{
+	unsigned int side = (unsigned int)sqrt(nr_vertices), i;
+	FILE *f;
+
+	if (side < 2)
+		side = 2;
+
+	f = fopen(filename, "w");
+	if (!f) {
+		fprintf(stderr, "fopen('%s') fail: %s (%d)\n", filename, strerror(errno), errno);
+		return errno;
+	}
+
+	fprintf(f, "# synthetic grid %u vertices\n", nr_vertices);
+
+	for (i = 0; i < nr_vertices; i++) {
+		fprintf(f, "v %f %f %f\n", (i % side) * 0.01f - 10.0f, sinf(i * 0.001f), (i / side) * -0.01f);
+	}
+
+	for (i = 0; i + side + 1 < nr_vertices; i++) {
+		if (i % side == side - 1)
+			continue;
+
+		fprintf(f, "f %u %u %u %u\n", i + 1, i + 2, i + side + 2, i + side + 1);
+	}
+
+	fclose(f);
+	return 0;
+}
+
+static int max_threads;
+
+static int measure(const char *name, loader_t load, unsigned int flags, unsigned int nr_threads,
+		   const char *filename, int runs, off_t size, struct wf_obj *o)
+{
+	double t[runs];
+	int r;
+
+	o->flags = flags;
+	o->nr_threads = nr_threads;
+
+	for (int i = 0; i < runs; i++) {
+		wf_obj_clean(o);
+
+		t[i] = icg_time_ms();
+		r = load(filename, o);
+		t[i] = icg_time_ms() - t[i];
+
+		if (r)
+			return r;
+	}
+
+	qsort(t, runs, sizeof(*t), cmp_double);
+
+	printf("  %-8s vertices=%u min=%.3fms median=%.3fms %.1fMB/s allocs=%lu reserved=%zu\n",
+	       name, o->nr_vertices, t[0], t[runs / 2], size / 1e3 / t[runs / 2],
+	       o->stats.nr_allocs, o->stats.bytes);
+
+	return 0;
+}
+
+// cold: parse, build and write the sidecar, warm: map the sidecar
+static int measure_cache(const char *filename, int runs)
+{
+	char path[4096];
+	struct wf_obj o;
+	struct wf_mesh m;
+	double cold, t[runs];
+	int r;
+
+	snprintf(path, sizeof(path), "%s.wfb", filename);
+	unlink(path);
+
+	wf_obj_init(&o);
+	o.flags |= WF_OBJ_CACHE;
+
+	cold = icg_time_ms();
+	r = wf_mesh_load(filename, &o, &m);
+	cold = icg_time_ms() - cold;
+	wf_mesh_clean(&m);
+	wf_obj_clean(&o);
+
+	if (r)
+		return r;
+
+	for (int i = 0; i < runs; i++) {
+		t[i] = icg_time_ms();
+		r = wf_mesh_load(filename, &o, &m);
+		t[i] = icg_time_ms() - t[i];
+
+		if (!r && !m.mapping)
+			printf("  cache miss on a warm run\n");
+
+		wf_mesh_clean(&m);
+		wf_obj_clean(&o);
+
+		if (r)
+			goto out;
+	}
+
+	qsort(t, runs, sizeof(*t), cmp_double);
+
+	printf("  %-8s cold=%.3fms warm min=%.3fms median=%.3fms\n", "cache", cold, t[0], t[runs / 2]);
+
+out:
+	unlink(path);
+	return r;
+}
+
+static void compare(struct wf_obj *a, struct wf_obj *b)
+{
+	unsigned int mismatches = 0;
+	float diff = 0.0f;
+
+	if (a->nr_vertices != b->nr_vertices) {
+		printf("  vertex count differs %u vs %u\n", a->nr_vertices, b->nr_vertices);
+		return;
+	}
+
+	for (unsigned int i = 0; i < a->nr_vertices; i++) {
+		const float *x = &a->vertices[i].x, *y = &b->vertices[i].x;
+
+		for (int k = 0; k < 3; k++) {
+			if (x[k] != y[k]) {
+				mismatches++;
+				diff = fmaxf(diff, fabsf(x[k] - y[k]));
+			}
+		}
+	}
+
+	// faces are not parsed by the stdio reference
+	if (a->nr_corners && b->nr_corners) {
+		if (a->nr_corners != b->nr_corners ||
+		    memcmp(a->corners, b->corners, a->nr_corners * sizeof(*a->corners)))
+			printf("  faces differ\n");
+	}
+
+	printf("  mismatched components=%u max diff=%g\n", mismatches, diff);
+}
+
+static int bench(const char *filename, int runs)
+{
+	struct wf_obj stdio_obj, mmap_obj, mt_obj;
+	struct stat st;
+	char name[32];
+	int r;
+
+	if (stat(filename, &st)) {
+		fprintf(stderr, "stat('%s') fail: %s (%d)\n", filename, strerror(errno), errno);
+		return errno;
+	}
+
+	printf("%s (%.1f MB)\n", filename, st.st_size / 1e6);
+
+	wf_obj_init(&stdio_obj);
+	wf_obj_init(&mmap_obj);
+	wf_obj_init(&mt_obj);
+
+	r = measure("stdio", wf_obj_load_stdio, 0, 1, filename, runs, st.st_size, &stdio_obj);
+	if (r)
+		goto out;
+
+	r = measure("presize", wf_obj_load, WF_OBJ_PRESIZE, 1, filename, runs, st.st_size, &mmap_obj);
+	if (r)
+		goto out;
+
+	r = measure("mmap", wf_obj_load, 0, 1, filename, runs, st.st_size, &mmap_obj);
+	if (r)
+		goto out;
+
+	compare(&stdio_obj, &mmap_obj);
+
+	for (int n = 2; n <= max_threads; n *= 2) {
+		snprintf(name, sizeof(name), "mt %d", n);
+
+		r = measure(name, wf_obj_load, 0, n, filename, runs, st.st_size, &mt_obj);
+		if (r)
+			goto out;
+
+		compare(&mmap_obj, &mt_obj);
+	}
+
+	r = measure_cache(filename, runs);
+
+out:
+	wf_obj_clean(&stdio_obj);
+	wf_obj_clean(&mmap_obj);
+	wf_obj_clean(&mt_obj);
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int sizes[16];
+	int runs = 5, nr_sizes = 0, opt, r = 0;
+	char filename[] = "/tmp/wf_obj_bench_XXXXXX";
+
+	max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((opt = getopt(argc, argv, "r:t:s:")) != -1) {
+		switch (opt) {
+		case 'r':
+			runs = atoi(optarg);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 's':
+			if (nr_sizes < (int)ARRAY_SIZE(sizes))
+				sizes[nr_sizes++] = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-r runs] [-t max_threads] [-s nr_vertices]... [file.obj]...\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (runs < 1)
+		runs = 1;
+
+	for (int i = optind; i < argc && !r; i++)
+		r = bench(argv[i], runs);
+
+	for (int i = 0; i < nr_sizes && !r; i++) {
+		int fd = mkstemp(filename);
+
+		if (fd < 0) {
+			fprintf(stderr, "mkstemp() fail: %s (%d)\n", strerror(errno), errno);
+			exit(EXIT_FAILURE);
+		}
+
+		close(fd);
+
+		r = generate(filename, sizes[i]);
+		if (!r)
+			r = bench(filename, runs);
+
+		unlink(filename);
+		strcpy(filename, "/tmp/wf_obj_bench_XXXXXX");
+	}
+
+	return r ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,516 @@
+// procedural stress meshes: obj files of any size with v/vt/vn/f records
+//
+// shapes are made of quads, written as quads or split into triangles:
+//   grid    side x side vertices of a height field
+//   sphere  uv sphere, 2 segments per ring, the seam and the poles have own vertices
+//   teapot  every triangle of the base mesh is split into 3 quads (corner, edge midpoints and centroid)
+//           and every quad into n x n quads; the smallest level writes the base triangles
+// Vertices are computed from their index and written pass by pass, the memory use does not depend on
+// the size. Vertex counts are rounded to the next shape, the written counts are printed to stderr.
+//
+// usage: wf_obj_gen [-m grid|sphere|teapot] [-n nr_vertices] [-t] [-i base.obj] [out.obj]
+//   -n nr_vertices  approximate vertex count, 1e7 notation works (default 1e5)
+//   -t              triangles instead of quads
+//   -i base.obj     base mesh of the teapot (default resource/teapot.obj)
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <wavefront_obj.h>
+
+#ifndef ICG_TEAPOT_OBJ
+#define ICG_TEAPOT_OBJ "resource/teapot.obj"
+#endif
+
+#define WRITER_SIZE (1 << 20)
+
+// longest record
+#define RECORD_MAX 256
+
+struct shape {
+	uint64_t nr_vertices;
+	uint64_t nr_faces;
+	int nr_corners;		// of every face
+	uint64_t side;		// vertices per row of the grid and the sphere, level of the teapot
+	struct wf_obj *base;
+
+	void (*vertex)(const struct shape *s, uint64_t i, float p[3], float t[2], float n[3]);
+	void (*face)(const struct shape *s, uint64_t i, uint64_t c[4]);
+};
+
+// formatting of printf() is the bottleneck of 1e8 vertices
+struct writer {
+	FILE *f;
+	size_t n;
+	char buf[WRITER_SIZE];
+};
+
+static int writer_flush(struct writer *w)
+{
+	if (w->n && fwrite(w->buf, w->n, 1, w->f) != 1) {
+		fprintf(stderr, "write() fail: %s (%d)\n", strerror(errno), errno);
+		return EIO;
+	}
+
+	w->n = 0;
+	return 0;
+}
+
+// room for a record
+static int writer_reserve(struct writer *w)
+{
+	return w->n + RECORD_MAX > WRITER_SIZE ? writer_flush(w) : 0;
+}
+
+static void put_str(struct writer *w, const char *s)
+{
+	while (*s)
+		w->buf[w->n++] = *s++;
+}
+
+static void put_u64(struct writer *w, uint64_t x)
+{
+	char digits[20];
+	int n = 0;
+
+	do {
+		digits[n++] = '0' + x % 10;
+		x /= 10;
+	} while (x);
+
+	while (n)
+		w->buf[w->n++] = digits[--n];
+}
+
+// %f
+static void put_float(struct writer *w, float x)
+{
+	double v = fabs(x);
+	uint64_t scaled, frac;
+
+	if (!(v < 1e12)) {
+		w->n += snprintf(w->buf + w->n, RECORD_MAX / 4, "%f", x);
+		return;
+	}
+
+	scaled = (uint64_t)(v * 1e6 + 0.5);
+	if (x < 0 && scaled)
+		w->buf[w->n++] = '-';
+
+	put_u64(w, scaled / 1000000);
+	w->buf[w->n++] = '.';
+
+	frac = scaled % 1000000;
+	for (int k = 5; k >= 0; k--, frac /= 10)
+		w->buf[w->n + k] = '0' + frac % 10;
+
+	w->n += 6;
+}
+
+// grid
+
+static void grid_vertex(const struct shape *s, uint64_t i, float p[3], float t[2], float n[3])
+{
+	float u = (float)(i % s->side) / (s->side - 1), v = (float)(i / s->side) / (s->side - 1);
+	const float size = 100.0f, height = 2.0f, waves = 8.0f * 2.0f * (float)M_PI;
+	float dx, dz, len;
+
+	p[0] = (u - 0.5f) * size;
+	p[1] = height * sinf(u * waves) * cosf(v * waves);
+	p[2] = (v - 0.5f) * size;
+
+	t[0] = u;
+	t[1] = v;
+
+	// gradient of the height field
+	dx = height * waves / size * cosf(u * waves) * cosf(v * waves);
+	dz = -height * waves / size * sinf(u * waves) * sinf(v * waves);
+	len = sqrtf(dx * dx + 1 + dz * dz);
+
+	n[0] = -dx / len;
+	n[1] = 1 / len;
+	n[2] = -dz / len;
+}
+
+static void grid_face(const struct shape *s, uint64_t i, uint64_t c[4])
+{
+	uint64_t row = i / (s->side - 1), col = i % (s->side - 1), v = row * s->side + col;
+
+	// counter clockwise seen from +y
+	c[0] = v;
+	c[1] = v + s->side;
+	c[2] = v + s->side + 1;
+	c[3] = v + 1;
+}
+
+static void grid_init(struct shape *s, uint64_t nr_vertices)
+{
+	s->side = (uint64_t)ceil(sqrt((double)nr_vertices));
+	if (s->side < 2)
+		s->side = 2;
+
+	s->nr_vertices = s->side * s->side;
+	s->nr_faces = (s->side - 1) * (s->side - 1);
+	s->nr_corners = 4;
+	s->vertex = grid_vertex;
+	s->face = grid_face;
+}
+
+// sphere, side is segments + 1
+
+static void sphere_vertex(const struct shape *s, uint64_t i, float p[3], float t[2], float n[3])
+{
+	uint64_t segments = s->side - 1, rings = segments / 2;
+	uint64_t ring = i / s->side, segment = i % s->side;
+	double theta = M_PI * ring / rings, phi = 2 * M_PI * segment / segments;
+
+	n[0] = sin(theta) * cos(phi);
+	n[1] = cos(theta);
+	n[2] = sin(theta) * sin(phi);
+
+	for (int k = 0; k < 3; k++)
+		p[k] = n[k] * 10.0f;
+
+	t[0] = (float)segment / segments;
+	t[1] = 1.0f - (float)ring / rings;
+}
+
+static void sphere_face(const struct shape *s, uint64_t i, uint64_t c[4])
+{
+	uint64_t segments = s->side - 1, ring = i / segments, segment = i % segments;
+	uint64_t v = ring * s->side + segment;
+
+	// counter clockwise seen from outside
+	c[0] = v;
+	c[1] = v + 1;
+	c[2] = v + s->side + 1;
+	c[3] = v + s->side;
+}
+
+static void sphere_init(struct shape *s, uint64_t nr_vertices)
+{
+	uint64_t rings = (uint64_t)llround(sqrt(nr_vertices / 2.0));
+
+	if (rings < 2)
+		rings = 2;
+
+	s->side = 2 * rings + 1;
+	s->nr_vertices = (rings + 1) * s->side;
+	s->nr_faces = rings * 2 * rings;
+	s->nr_corners = 4;
+	s->vertex = sphere_vertex;
+	s->face = sphere_face;
+}
+
+// teapot, side is the level
+
+// barycentric corners of the 3 quads of a triangle
+static const float teapot_quads[3][4][3] = {
+	{{1, 0, 0}, {0.5f, 0.5f, 0}, {1 / 3.0f, 1 / 3.0f, 1 / 3.0f}, {0.5f, 0, 0.5f}},
+	{{0, 1, 0}, {0, 0.5f, 0.5f}, {1 / 3.0f, 1 / 3.0f, 1 / 3.0f}, {0.5f, 0.5f, 0}},
+	{{0, 0, 1}, {0.5f, 0, 0.5f}, {1 / 3.0f, 1 / 3.0f, 1 / 3.0f}, {0, 0.5f, 0.5f}},
+};
+
+static void teapot_interpolate(const struct shape *s, uint64_t triangle, const float w[3], float p[3], float t[2],
+			       float n[3])
+{
+	const struct wf_index *c = &s->base->corners[triangle * 3];
+	const struct wf_vertex *v[3];
+	float e1[3], e2[3], len;
+
+	for (int k = 0; k < 3; k++)
+		v[k] = &s->base->vertices[c[k].v];
+
+	p[0] = w[0] * v[0]->x + w[1] * v[1]->x + w[2] * v[2]->x;
+	p[1] = w[0] * v[0]->y + w[1] * v[1]->y + w[2] * v[2]->y;
+	p[2] = w[0] * v[0]->z + w[1] * v[1]->z + w[2] * v[2]->z;
+
+	t[0] = t[1] = 0;
+	if (c[0].vt >= 0 && c[1].vt >= 0 && c[2].vt >= 0) {
+		for (int k = 0; k < 3; k++) {
+			t[0] += w[k] * s->base->texcoords[c[k].vt].u;
+			t[1] += w[k] * s->base->texcoords[c[k].vt].v;
+		}
+	}
+
+	if (c[0].vn >= 0 && c[1].vn >= 0 && c[2].vn >= 0) {
+		n[0] = n[1] = n[2] = 0;
+
+		for (int k = 0; k < 3; k++) {
+			n[0] += w[k] * s->base->normals[c[k].vn].x;
+			n[1] += w[k] * s->base->normals[c[k].vn].y;
+			n[2] += w[k] * s->base->normals[c[k].vn].z;
+		}
+	} else {
+		// face normal
+		e1[0] = v[1]->x - v[0]->x;
+		e1[1] = v[1]->y - v[0]->y;
+		e1[2] = v[1]->z - v[0]->z;
+		e2[0] = v[2]->x - v[0]->x;
+		e2[1] = v[2]->y - v[0]->y;
+		e2[2] = v[2]->z - v[0]->z;
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+
+	len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	if (len > 0) {
+		for (int k = 0; k < 3; k++)
+			n[k] /= len;
+	}
+}
+
+static void teapot_vertex(const struct shape *s, uint64_t i, float p[3], float t[2], float n[3])
+{
+	uint64_t level = s->side, row = level + 1, per_quad = row * row, triangle, quad, a, b;
+	const float (*q)[3];
+	float w[3], u, v;
+
+	if (!level) {
+		w[0] = i % 3 == 0;
+		w[1] = i % 3 == 1;
+		w[2] = i % 3 == 2;
+		teapot_interpolate(s, i / 3, w, p, t, n);
+		return;
+	}
+
+	triangle = i / (3 * per_quad);
+	quad = i / per_quad % 3;
+	a = i % per_quad % row;
+	b = i % per_quad / row;
+	u = (float)a / level;
+	v = (float)b / level;
+	q = teapot_quads[quad];
+
+	// bilinear in the quad, the quad corners are barycentric points of the triangle
+	for (int k = 0; k < 3; k++)
+		w[k] = (1 - u) * (1 - v) * q[0][k] + u * (1 - v) * q[1][k] + u * v * q[2][k] + (1 - u) * v * q[3][k];
+
+	teapot_interpolate(s, triangle, w, p, t, n);
+}
+
+static void teapot_face(const struct shape *s, uint64_t i, uint64_t c[4])
+{
+	uint64_t level = s->side, row = level + 1, per_quad = level * level, quad, a, b, v;
+
+	if (!level) {
+		c[0] = i * 3;
+		c[1] = i * 3 + 1;
+		c[2] = i * 3 + 2;
+		return;
+	}
+
+	// first vertex of the grid of the quad, corners keep the winding of the triangle
+	quad = i / per_quad;
+	a = i % per_quad % level;
+	b = i % per_quad / level;
+	v = quad * row * row + b * row + a;
+
+	c[0] = v;
+	c[1] = v + 1;
+	c[2] = v + row + 1;
+	c[3] = v + row;
+}
+
+static int teapot_init(struct shape *s, uint64_t nr_vertices, const char *filename, struct wf_obj *o)
+{
+	uint64_t nr_triangles, level;
+	int r;
+
+	wf_obj_init(o);
+
+	r = wf_obj_load(filename, o);
+	if (r)
+		return r;
+
+	nr_triangles = o->nr_corners / 3;
+	if (!nr_triangles) {
+		fprintf(stderr, "no faces in '%s'\n", filename);
+		return EINVAL;
+	}
+
+	for (unsigned int i = 0; i < o->nr_corners; i++) {
+		const struct wf_index *c = &o->corners[i];
+
+		if (c->v < 0 || (unsigned int)c->v >= o->nr_vertices || c->vt >= (int)o->nr_texcoords ||
+		    c->vn >= (int)o->nr_normals) {
+			fprintf(stderr, "face index out of range: %d/%d/%d\n", c->v + 1, c->vt + 1, c->vn + 1);
+			return EINVAL;
+		}
+	}
+
+	// 3 (level + 1)^2 vertices per triangle
+	level = (uint64_t)fmax(0, llround(sqrt((double)nr_vertices / (3 * nr_triangles)) - 1));
+
+	s->base = o;
+	s->side = level;
+	s->nr_vertices = level ? nr_triangles * 3 * (level + 1) * (level + 1) : nr_triangles * 3;
+	s->nr_faces = level ? nr_triangles * 3 * level * level : nr_triangles;
+	s->nr_corners = level ? 4 : 3;
+	s->vertex = teapot_vertex;
+	s->face = teapot_face;
+
+	return 0;
+}
+
+// faces written, quads are split in 2 triangles
+static uint64_t nr_written_faces(const struct shape *s, int triangles)
+{
+	return triangles && s->nr_corners == 4 ? 2 * s->nr_faces : s->nr_faces;
+}
+
+static int write_obj(const struct shape *s, int triangles, const char *name, struct writer *w)
+{
+	static const char *const prefixes[] = {"v ", "vt ", "vn "};
+	// corners of a face, of the 2 triangles of a quad split along the 0-2 diagonal
+	static const int orders[3][4] = {{0, 1, 2, 3}, {0, 1, 2}, {0, 2, 3}};
+	int split = triangles && s->nr_corners == 4, nr = split ? 3 : s->nr_corners, r;
+	float attr[3][3];
+	uint64_t c[4];
+
+	w->n = snprintf(w->buf, RECORD_MAX, "# %s %llu vertices %llu faces\n", name,
+			(unsigned long long)s->nr_vertices, (unsigned long long)nr_written_faces(s, triangles));
+
+	// a pass per record type, readers handle any order but exporters write this one
+	for (int k = 0; k < 3; k++) {
+		for (uint64_t i = 0; i < s->nr_vertices; i++) {
+			r = writer_reserve(w);
+			if (r)
+				return r;
+
+			s->vertex(s, i, attr[0], attr[1], attr[2]);
+
+			put_str(w, prefixes[k]);
+			for (int j = 0; j < (k == 1 ? 2 : 3); j++) {
+				if (j)
+					w->buf[w->n++] = ' ';
+				put_float(w, attr[k][j]);
+			}
+			w->buf[w->n++] = '\n';
+		}
+	}
+
+	for (uint64_t i = 0; i < s->nr_faces; i++) {
+		r = writer_reserve(w);
+		if (r)
+			return r;
+
+		s->face(s, i, c);
+
+		for (int f = split; f <= 2 * split; f++) {
+			put_str(w, "f");
+
+			for (int j = 0; j < nr; j++) {
+				w->buf[w->n++] = ' ';
+
+				// v/vt/vn share the index
+				for (int a = 0; a < 3; a++) {
+					if (a)
+						w->buf[w->n++] = '/';
+					put_u64(w, c[orders[f][j]] + 1);
+				}
+			}
+
+			w->buf[w->n++] = '\n';
+		}
+	}
+
+	return writer_flush(w);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-m grid|sphere|teapot] [-n nr_vertices] [-t] [-i base.obj] [out.obj]\n", name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *mode = "grid", *base_filename = ICG_TEAPOT_OBJ, *filename = NULL;
+	uint64_t nr_vertices = 100000;
+	int triangles = 0, opt, r = 0;
+	struct writer *w;
+	struct wf_obj base;
+	struct shape s;
+
+	while ((opt = getopt(argc, argv, "m:n:ti:")) != -1) {
+		switch (opt) {
+		case 'm':
+			mode = optarg;
+			break;
+		case 'n':
+			nr_vertices = (uint64_t)strtod(optarg, NULL);
+			break;
+		case 't':
+			triangles = 1;
+			break;
+		case 'i':
+			base_filename = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind < argc)
+		filename = argv[optind];
+
+	memset(&s, 0, sizeof(s));
+	wf_obj_init(&base);
+
+	if (!strcmp(mode, "grid"))
+		grid_init(&s, nr_vertices);
+	else if (!strcmp(mode, "sphere"))
+		sphere_init(&s, nr_vertices);
+	else if (!strcmp(mode, "teapot"))
+		r = teapot_init(&s, nr_vertices, base_filename, &base);
+	else
+		usage(argv[0]);
+
+	// obj indices are parsed as int
+	if (!r && s.nr_vertices > INT32_MAX) {
+		fprintf(stderr, "%llu vertices do not fit obj indices\n", (unsigned long long)s.nr_vertices);
+		r = EINVAL;
+	}
+
+	if (r)
+		goto out;
+
+	w = malloc(sizeof(*w));
+	if (!w) {
+		fprintf(stderr, "malloc() fail\n");
+		r = ENOMEM;
+		goto out;
+	}
+
+	w->f = filename ? fopen(filename, "w") : stdout;
+	if (!w->f) {
+		r = errno;
+		fprintf(stderr, "fopen('%s') fail: %s (%d)\n", filename, strerror(r), r);
+		free(w);
+		goto out;
+	}
+
+	r = write_obj(&s, triangles, mode, w);
+
+	if (filename && fclose(w->f) && !r) {
+		fprintf(stderr, "write('%s') fail\n", filename);
+		r = EIO;
+	}
+
+	if (!r)
+		fprintf(stderr, "%s: %llu vertices %llu %s\n", mode, (unsigned long long)s.nr_vertices,
+			(unsigned long long)nr_written_faces(&s, triangles), triangles ? "triangles" : "faces");
+
+	free(w);
+
+out:
+	wf_obj_clean(&base);
+	return r ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+// vertex quantization report: bytes per vertex and max decode error of wavefront_obj meshes
+//
+// usage: wf_quant_report file.obj...
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <icg/common.h>
+#include <wavefront_obj.h>
+
+struct format {
+	const char *name;
+	unsigned int flags;
+} formats[] = {
+	{"snorm16", 0},
+	{"unorm16", WF_QUANT_UNORM16},
+};
+
+static int report(const char *filename)
+{
+	struct wf_obj o;
+	struct wf_mesh m;
+	struct wf_qmesh q;
+	float diagonal = 0, d;
+	int r;
+
+	wf_obj_init(&o);
+
+	r = wf_obj_load(filename, &o);
+	if (!r)
+		r = wf_mesh_build(&o, &m);
+
+	wf_obj_clean(&o);
+
+	if (r)
+		return r;
+
+	for (int k = 0; k < 3; k++) {
+		d = (&m.bounds_max.x)[k] - (&m.bounds_min.x)[k];
+		diagonal += d * d;
+	}
+
+	diagonal = sqrtf(diagonal);
+
+	printf("%s: %u vertices, attribs%s%s, bounds diagonal %g\n", filename, m.nr_vertices,
+	       m.attribs & WF_MESH_TEXCOORD ? " texcoord" : "", m.attribs & WF_MESH_NORMAL ? " normal" : "", diagonal);
+	printf("  %-8s %8s %12s %8s %12s %12s %12s %12s\n", "format", "B/vertex", "vb bytes", "saved",
+	       "pos error", "pos rel", "uv error", "normal deg");
+	printf("  %-8s %8u %12zu %8s %12s %12s %12s %12s\n", "float", m.stride, (size_t)m.stride * m.nr_vertices,
+	       "-", "0", "0", "0", "0");
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(formats); i++) {
+		r = wf_mesh_quantize(&m, formats[i].flags, &q);
+		if (r)
+			break;
+
+		printf("  %-8s %8u %12zu %7.1f%% %12.3g %12.3g %12.3g %12.3g\n", formats[i].name, q.stride,
+		       (size_t)q.stride * q.nr_vertices, (1.0f - (float)q.stride / m.stride) * 100.0f,
+		       q.position_error, diagonal > 0 ? q.position_error / diagonal : 0.0f,
+		       q.texcoord_error, q.normal_error);
+
+		wf_qmesh_clean(&q);
+	}
+
+	wf_mesh_clean(&m);
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	int r = 0;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s file.obj...\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	for (int i = 1; i < argc && !r; i++)
+		r = report(argv[i]);
+
+	return r ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,208 @@
+// structure of arrays benchmark: throughput of the wavefront_obj batch kernels in vertices per second
+//
+// random positions (or the vertices of obj files) are transformed by the soa kernels and by
+// mat4x4_mul_vec4() per vertex of an array of struct wf_vertex, the results of both are compared
+//
+// usage: wf_soa_bench [-t threads] [-n vertices] [file.obj...]
+//        without files 1M and 10M random vertices are used, -n sets one count (e.g. 100000000)
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <icg/common.h>
+#include <linmath.h>
+#include <wavefront_obj.h>
+
+// relative tolerance of transformed positions, fma contraction of one side only
+#define EPS 1e-5f
+
+static unsigned int nr_threads;
+
+static float frand(unsigned int *seed)
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return (*seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+}
+
+static double rate(size_t count, double ms)
+{
+	return ms > 0 ? count / ms * 1e3 : 0;
+}
+
+static int bench(const char *name, const struct wf_soa *s)
+{
+	struct wf_vertex *aos;
+	struct wf_soa out;
+	mat4x4 m, n;
+	vec4 p, q;
+	float min[3], max[3], center[3], radius, e = 0, scale = 1;
+	double t_aos, t_points, t_dirs, t_bounds, t_sphere;
+	int r;
+
+	aos = malloc(s->count * sizeof(*aos));
+	if (!aos) {
+		fprintf(stderr, "malloc() fail\n");
+		return ENOMEM;
+	}
+
+	r = wf_soa_init(&out, s->count);
+	if (r) {
+		free(aos);
+		return r;
+	}
+
+	for (size_t i = 0; i < s->count; i++)
+		aos[i] = (struct wf_vertex){s->x[i], s->y[i], s->z[i]};
+
+	mat4x4_identity(m);
+	mat4x4_translate(m, 1, 2, 3);
+	mat4x4_rotate(n, m, 1, 1, 0, 0.7f);
+	mat4x4_scale_aniso(m, n, 2, 0.5f, 1.5f);
+
+	t_aos = icg_time_ms();
+
+	for (size_t i = 0; i < s->count; i++) {
+		p[0] = aos[i].x;
+		p[1] = aos[i].y;
+		p[2] = aos[i].z;
+		p[3] = 1;
+		mat4x4_mul_vec4(q, m, p);
+		aos[i] = (struct wf_vertex){q[0], q[1], q[2]};
+	}
+
+	t_aos = icg_time_ms() - t_aos;
+
+	// first writes of out fault its pages in
+	wf_soa_transform_points(s, (const float (*)[4])m, nr_threads, &out);
+
+	t_dirs = icg_time_ms();
+	wf_soa_transform_directions(s, (const float (*)[4])m, nr_threads, &out);
+	t_dirs = icg_time_ms() - t_dirs;
+
+	// points last, they are compared and reduced
+	t_points = icg_time_ms();
+	wf_soa_transform_points(s, (const float (*)[4])m, nr_threads, &out);
+	t_points = icg_time_ms() - t_points;
+
+	t_bounds = icg_time_ms();
+	wf_soa_bounds(&out, nr_threads, min, max);
+	t_bounds = icg_time_ms() - t_bounds;
+
+	t_sphere = icg_time_ms();
+	wf_soa_sphere(&out, nr_threads, center, &radius);
+	t_sphere = icg_time_ms() - t_sphere;
+
+	for (int k = 0; k < 3; k++)
+		scale = fmaxf(scale, fmaxf(fabsf(min[k]), fabsf(max[k])));
+
+	for (size_t i = 0; i < s->count; i++) {
+		e = fmaxf(e, fabsf(out.x[i] - aos[i].x));
+		e = fmaxf(e, fabsf(out.y[i] - aos[i].y));
+		e = fmaxf(e, fabsf(out.z[i] - aos[i].z));
+
+		if (out.x[i] < min[0] || out.y[i] < min[1] || out.z[i] < min[2] || out.x[i] > max[0] ||
+		    out.y[i] > max[1] || out.z[i] > max[2] ||
+		    sqrtf(powf(out.x[i] - center[0], 2) + powf(out.y[i] - center[1], 2) +
+			  powf(out.z[i] - center[2], 2)) > radius * (1 + EPS))
+			e = INFINITY;
+	}
+
+	printf("%s: %zu vertices, %u threads\n", name, s->count, nr_threads);
+	printf("  %-22s %10s %14s\n", "kernel", "ms", "vertices/s");
+	printf("  %-22s %10.3f %14.4g\n", "aos mat4x4_mul_vec4", t_aos, rate(s->count, t_aos));
+	printf("  %-22s %10.3f %14.4g\n", "transform points", t_points, rate(s->count, t_points));
+	printf("  %-22s %10.3f %14.4g\n", "transform directions", t_dirs, rate(s->count, t_dirs));
+	printf("  %-22s %10.3f %14.4g\n", "bounds", t_bounds, rate(s->count, t_bounds));
+	printf("  %-22s %10.3f %14.4g\n", "sphere", t_sphere, rate(s->count, t_sphere));
+	printf("  check %s\n", e <= EPS * scale ? "ok" : "failed");
+
+	if (e > EPS * scale)
+		r = 1;
+
+	wf_soa_clean(&out);
+	free(aos);
+	return r;
+}
+
+static int bench_random(size_t count)
+{
+	struct wf_soa s;
+	unsigned int seed = 1;
+	int r;
+
+	r = wf_soa_init(&s, count);
+	if (r)
+		return r;
+
+	for (size_t i = 0; i < count; i++) {
+		s.x[i] = frand(&seed) * 100;
+		s.y[i] = frand(&seed) * 100;
+		s.z[i] = frand(&seed) * 100;
+	}
+
+	r = bench("random", &s);
+
+	wf_soa_clean(&s);
+	return r;
+}
+
+static int bench_file(const char *filename)
+{
+	struct wf_obj o;
+	struct wf_soa s;
+	int r;
+
+	wf_obj_init(&o);
+
+	r = wf_obj_load(filename, &o);
+	if (!r)
+		r = wf_obj_soa(&o, &s);
+
+	wf_obj_clean(&o);
+
+	if (r)
+		return r;
+
+	r = bench(filename, &s);
+
+	wf_soa_clean(&s);
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t count = 0;
+	int opt, r = 0;
+
+	nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-n vertices] [file.obj...]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (count) {
+		r = bench_random(count);
+	} else if (optind == argc) {
+		r = bench_random(1000000);
+		if (!r)
+			r = bench_random(10000000);
+	}
+
+	for (int i = optind; i < argc && !r; i++)
+		r = bench_file(argv[i]);
+
+	return r ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+// frustum culling of many axis aligned boxes, boxes are kept as separate arrays (structure of arrays)
+// so 8 (avx) or 4 (sse) boxes are tested against a plane by one instruction sequence
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// boxes by center and half extents
+struct icg_aabbs {
+	float *cx, *cy, *cz;
+	float *ex, *ey, *ez;
+	size_t count;
+};
+
+// frustum planes of a column major matrix in the space the matrix maps from, world space for a view
+// projection (Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection
+// Matrix"), normals point inside and are unit
+static inline void icg_frustum_planes(float planes[6][4], const float m[4][4])
+{
+	float l;
+
+	for (int i = 0; i < 3; i++) {
+		for (int k = 0; k < 4; k++) {
+			planes[i * 2][k] = m[k][3] + m[k][i];
+			planes[i * 2 + 1][k] = m[k][3] - m[k][i];
+		}
+	}
+
+	for (int i = 0; i < 6; i++) {
+		l = sqrtf(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+
+		for (int k = 0; k < 4 && l > 0; k++)
+			planes[i][k] /= l;
+	}
+}
+
+// box is outside if its corner farthest along the normal of a plane is behind it
+static inline int icg_cull_aabb(const float planes[6][4], const struct icg_aabbs *b, size_t i)
+{
+	const float *p;
+
+	for (int j = 0; j < 6; j++) {
+		p = planes[j];
+
+		if (p[0] * b->cx[i] + p[1] * b->cy[i] + p[2] * b->cz[i] + p[3] +
+		    fabsf(p[0]) * b->ex[i] + fabsf(p[1]) * b->ey[i] + fabsf(p[2]) * b->ez[i] < 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+#if defined(__AVX__)
+
+#define ICG_CULL_WIDTH 8
+
+static inline size_t icg_cull_aabbs_simd(const float planes[6][4], const struct icg_aabbs *b, uint32_t *visible)
+{
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	__m256 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6], d, cx, cy, cz, ex, ey, ez;
+	size_t i, nr = 0;
+	unsigned int mask;
+
+	for (int j = 0; j < 6; j++) {
+		px[j] = _mm256_set1_ps(planes[j][0]);
+		py[j] = _mm256_set1_ps(planes[j][1]);
+		pz[j] = _mm256_set1_ps(planes[j][2]);
+		pw[j] = _mm256_set1_ps(planes[j][3]);
+		ax[j] = _mm256_andnot_ps(sign, px[j]);
+		ay[j] = _mm256_andnot_ps(sign, py[j]);
+		az[j] = _mm256_andnot_ps(sign, pz[j]);
+	}
+
+	for (i = 0; i + ICG_CULL_WIDTH <= b->count; i += ICG_CULL_WIDTH) {
+		cx = _mm256_loadu_ps(b->cx + i);
+		cy = _mm256_loadu_ps(b->cy + i);
+		cz = _mm256_loadu_ps(b->cz + i);
+		ex = _mm256_loadu_ps(b->ex + i);
+		ey = _mm256_loadu_ps(b->ey + i);
+		ez = _mm256_loadu_ps(b->ez + i);
+		mask = 0;
+
+		// negative distances mark culled boxes, -0 is not negative as in icg_cull_aabb()
+		for (int j = 0; j < 6; j++) {
+			d = _mm256_add_ps(_mm256_mul_ps(px[j], cx), _mm256_mul_ps(py[j], cy));
+			d = _mm256_add_ps(d, _mm256_add_ps(_mm256_mul_ps(pz[j], cz), pw[j]));
+			d = _mm256_add_ps(d, _mm256_mul_ps(ax[j], ex));
+			d = _mm256_add_ps(d, _mm256_add_ps(_mm256_mul_ps(ay[j], ey), _mm256_mul_ps(az[j], ez)));
+			mask |= _mm256_movemask_ps(_mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ));
+		}
+
+		for (mask = ~mask & 0xff; mask; mask &= mask - 1)
+			visible[nr++] = i + __builtin_ctz(mask);
+	}
+
+	for (; i < b->count; i++) {
+		if (!icg_cull_aabb(planes, b, i))
+			visible[nr++] = i;
+	}
+
+	return nr;
+}
+
+#elif defined(__SSE2__)
+
+#define ICG_CULL_WIDTH 4
+
+static inline size_t icg_cull_aabbs_simd(const float planes[6][4], const struct icg_aabbs *b, uint32_t *visible)
+{
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	__m128 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6], d, cx, cy, cz, ex, ey, ez;
+	size_t i, nr = 0;
+	unsigned int mask;
+
+	for (int j = 0; j < 6; j++) {
+		px[j] = _mm_set1_ps(planes[j][0]);
+		py[j] = _mm_set1_ps(planes[j][1]);
+		pz[j] = _mm_set1_ps(planes[j][2]);
+		pw[j] = _mm_set1_ps(planes[j][3]);
+		ax[j] = _mm_andnot_ps(sign, px[j]);
+		ay[j] = _mm_andnot_ps(sign, py[j]);
+		az[j] = _mm_andnot_ps(sign, pz[j]);
+	}
+
+	for (i = 0; i + ICG_CULL_WIDTH <= b->count; i += ICG_CULL_WIDTH) {
+		cx = _mm_loadu_ps(b->cx + i);
+		cy = _mm_loadu_ps(b->cy + i);
+		cz = _mm_loadu_ps(b->cz + i);
+		ex = _mm_loadu_ps(b->ex + i);
+		ey = _mm_loadu_ps(b->ey + i);
+		ez = _mm_loadu_ps(b->ez + i);
+		mask = 0;
+
+		// negative distances mark culled boxes, -0 is not negative as in icg_cull_aabb()
+		for (int j = 0; j < 6; j++) {
+			d = _mm_add_ps(_mm_mul_ps(px[j], cx), _mm_mul_ps(py[j], cy));
+			d = _mm_add_ps(d, _mm_add_ps(_mm_mul_ps(pz[j], cz), pw[j]));
+			d = _mm_add_ps(d, _mm_mul_ps(ax[j], ex));
+			d = _mm_add_ps(d, _mm_add_ps(_mm_mul_ps(ay[j], ey), _mm_mul_ps(az[j], ez)));
+			mask |= _mm_movemask_ps(_mm_cmplt_ps(d, _mm_setzero_ps()));
+		}
+
+		for (mask = ~mask & 0xf; mask; mask &= mask - 1)
+			visible[nr++] = i + __builtin_ctz(mask);
+	}
+
+	for (; i < b->count; i++) {
+		if (!icg_cull_aabb(planes, b, i))
+			visible[nr++] = i;
+	}
+
+	return nr;
+}
+
+#else
+
+#define ICG_CULL_WIDTH 1
+
+static inline size_t icg_cull_aabbs_simd(const float planes[6][4], const struct icg_aabbs *b, uint32_t *visible)
+{
+	size_t nr = 0;
+
+	for (size_t i = 0; i < b->count; i++) {
+		if (!icg_cull_aabb(planes, b, i))
+			visible[nr++] = i;
+	}
+
+	return nr;
+}
+
+#endif
+
+// indices of boxes which intersect the frustum
+// \return number of visible boxes
+static inline size_t icg_cull_aabbs(const float planes[6][4], const struct icg_aabbs *b, uint32_t *visible)
+{
+	return icg_cull_aabbs_simd(planes, b, visible);
+}
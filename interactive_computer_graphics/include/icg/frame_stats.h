@@ -0,0 +1,180 @@
+#pragma once
+
+// frame time statistics of the last frames
+//
+// the render thread is the only writer: it fills the slot of the current frame, then publishes it by
+// advancing the frame counter with release order, so readers (a report at exit or another thread) see
+// whole frames w/o locks. Readers cover the last ICG_STATS_FRAMES - 1 frames, the remaining slot is the
+// one of the frame being rendered. Late values like gpu timer results go to the slot of their frame as
+// long as it is in the ring.
+
+#include <errno.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <icg/log.h>
+
+// frames kept, power of 2
+#define ICG_STATS_FRAMES 4096
+
+enum icg_stat {
+	ICG_STAT_INTERVAL,	// start to start of consecutive frames, the pacing seen by the user
+	ICG_STAT_CPU,		// cpu time of the frame w/o swap
+	ICG_STAT_SWAP,		// buffer swap, blocks on vsync or a full gpu queue
+	ICG_STAT_GPU,		// gpu time of the timed passes
+	ICG_STAT_COUNT,
+};
+
+static const char *const icg_stat_names[ICG_STAT_COUNT] = {"interval", "cpu", "swap", "gpu"};
+
+// milliseconds, nan if unknown
+struct icg_frame_stats {
+	float ms[ICG_STATS_FRAMES][ICG_STAT_COUNT];
+	double last_at;
+	atomic_uint_least64_t frame;	// frames published
+};
+
+static inline void icg_frame_stats_init(struct icg_frame_stats *s)
+{
+	for (size_t i = 0; i < ICG_STATS_FRAMES; i++) {
+		for (int k = 0; k < ICG_STAT_COUNT; k++)
+			s->ms[i][k] = NAN;
+	}
+
+	s->last_at = 0;
+	atomic_init(&s->frame, 0);
+}
+
+// number of the frame being rendered
+static inline uint64_t icg_frame_stats_frame(struct icg_frame_stats *s)
+{
+	return atomic_load_explicit(&s->frame, memory_order_relaxed);
+}
+
+// value of an older frame, dropped if the frame left the ring
+static inline void icg_frame_stats_set(struct icg_frame_stats *s, uint64_t frame, enum icg_stat stat, float ms)
+{
+	if (frame + ICG_STATS_FRAMES > icg_frame_stats_frame(s))
+		s->ms[frame & (ICG_STATS_FRAMES - 1)][stat] = ms;
+}
+
+// publish the current frame, started_at is its start time (icg_time_ms())
+static inline void icg_frame_stats_push(struct icg_frame_stats *s, double started_at, float cpu_ms, float swap_ms)
+{
+	uint64_t frame = icg_frame_stats_frame(s);
+	float *ms = s->ms[frame & (ICG_STATS_FRAMES - 1)];
+
+	ms[ICG_STAT_INTERVAL] = s->last_at ? started_at - s->last_at : NAN;
+	ms[ICG_STAT_CPU] = cpu_ms;
+	ms[ICG_STAT_SWAP] = swap_ms;
+	s->last_at = started_at;
+
+	atomic_store_explicit(&s->frame, frame + 1, memory_order_release);
+
+	// the next frame may not get a gpu time
+	s->ms[(frame + 1) & (ICG_STATS_FRAMES - 1)][ICG_STAT_GPU] = NAN;
+}
+
+static inline int icg_frame_stats_cmp(const void *a, const void *b)
+{
+	float x = *(const float *)a, y = *(const float *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+// nearest rank percentile of sorted values
+static inline float icg_frame_stats_percentile(const float *v, size_t n, unsigned int p)
+{
+	size_t rank = (n * p + 99) / 100;
+
+	return v[rank ? rank - 1 : 0];
+}
+
+// mean, p50, p95, p99 and max of every series over the frames in the ring
+static inline void icg_frame_stats_report(struct icg_frame_stats *s)
+{
+	uint64_t end = atomic_load_explicit(&s->frame, memory_order_acquire);
+	uint64_t begin = end > ICG_STATS_FRAMES - 1 ? end - (ICG_STATS_FRAMES - 1) : 0;
+	float v[ICG_STATS_FRAMES], x;
+	double sum;
+	size_t n;
+
+	icg_log_info("frame stats of %llu frames, last %llu:\n", (unsigned long long)end,
+	             (unsigned long long)(end - begin));
+	icg_log_info("  %-10s %8s %10s %10s %10s %10s %10s\n", "ms", "frames", "mean", "p50", "p95", "p99", "max");
+
+	for (int k = 0; k < ICG_STAT_COUNT; k++) {
+		n = 0;
+		sum = 0;
+
+		for (uint64_t f = begin; f < end; f++) {
+			x = s->ms[f & (ICG_STATS_FRAMES - 1)][k];
+			if (!isnan(x)) {
+				v[n++] = x;
+				sum += x;
+			}
+		}
+
+		if (!n) {
+			icg_log_info("  %-10s %8zu\n", icg_stat_names[k], n);
+			continue;
+		}
+
+		qsort(v, n, sizeof(*v), icg_frame_stats_cmp);
+		icg_log_info("  %-10s %8zu %10.3f %10.3f %10.3f %10.3f %10.3f\n", icg_stat_names[k], n, sum / n,
+		             icg_frame_stats_percentile(v, n, 50), icg_frame_stats_percentile(v, n, 95),
+		             icg_frame_stats_percentile(v, n, 99), v[n - 1]);
+	}
+}
+
+// one row per frame in the ring, unknown values are empty
+// \return 0 or an errno code
+static inline int icg_frame_stats_csv(struct icg_frame_stats *s, const char *filename)
+{
+	uint64_t end = atomic_load_explicit(&s->frame, memory_order_acquire);
+	uint64_t begin = end > ICG_STATS_FRAMES - 1 ? end - (ICG_STATS_FRAMES - 1) : 0;
+	const float *ms;
+	FILE *f;
+	int r = 0;
+
+	f = fopen(filename, "w");
+	if (!f) {
+		r = errno;
+		icg_log_error("fopen(%s) fail: %s (%d)\n", filename, strerror(r), r);
+		return r;
+	}
+
+	fprintf(f, "frame");
+	for (int k = 0; k < ICG_STAT_COUNT; k++)
+		fprintf(f, ",%s_ms", icg_stat_names[k]);
+	fprintf(f, "\n");
+
+	for (uint64_t i = begin; i < end; i++) {
+		ms = s->ms[i & (ICG_STATS_FRAMES - 1)];
+		fprintf(f, "%llu", (unsigned long long)i);
+
+		for (int k = 0; k < ICG_STAT_COUNT; k++) {
+			if (isnan(ms[k]))
+				fprintf(f, ",");
+			else
+				fprintf(f, ",%.4f", ms[k]);
+		}
+
+		fprintf(f, "\n");
+	}
+
+	if (ferror(f))
+		r = EIO;
+
+	if (fclose(f) && !r)
+		r = EIO;
+
+	if (r)
+		icg_log_error("write(%s) fail\n", filename);
+
+	return r;
+}
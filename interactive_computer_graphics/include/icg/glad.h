@@ -1,15 +1,24 @@
 #pragma once
 
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <glad/gl.h>
 #include <GLFW/glfw3.h>
+#include <icg/common.h>
+#include <icg/hash.h>
+#include <icg/log.h>
 
 struct shader_prog {
 	GLuint prog;
 	GLuint vs;
 	GLuint fs;
+	GLuint cs;	// compute programs have no other stage
 };
 
 // \return a glad version or 0 on fail
@@ -29,14 +38,14 @@ static inline int shader_create(int typ, const char *shader_code, GLuint *shader
 	s = glCreateShader(typ);
 	if (s == 0) {
 		r = glGetError();
-		fprintf(stderr, "glCreateShader() fail: %d\n", r);
+		icg_log_error("glCreateShader() fail: %d\n", r);
 		return r;
 	}
 
 	glShaderSource(s, 1, &shader_code, NULL);
 	r = glGetError();
 	if (r) {
-		fprintf(stderr, "glShaderSource() fail: %d\n", r);
+		icg_log_error("glShaderSource() fail: %d\n", r);
 		goto fail;
 	}
 
@@ -45,7 +54,7 @@ static inline int shader_create(int typ, const char *shader_code, GLuint *shader
 	// superflous???
 	r = glGetError();
 	if (r) {
-		fprintf(stderr, "glCompileShader() fail: %d\n", r);
+		icg_log_error("glCompileShader() fail: %d\n", r);
 		goto fail;
 	}
 
@@ -60,15 +69,15 @@ static inline int shader_create(int typ, const char *shader_code, GLuint *shader
 				glGetShaderInfoLog(s, log_len, NULL, log);
 				log[log_len] = 0;
 				// message has newline (always???)
-				fprintf(stderr, "glCompileShader() fail: %s", log);
+				icg_log_error("glCompileShader() fail: %s", log);
 				free(log);
 				goto fail;
 			} else {
-				fprintf(stderr, "malloc(%u) fail\n", log_len + 1);
+				icg_log_error("malloc(%u) fail\n", log_len + 1);
 			}
 		}
 
-		fprintf(stderr, "glCompileShader() fail: unknown\n");
+		icg_log_error("glCompileShader() fail: unknown\n");
 		goto fail;
 	}
 
@@ -91,6 +100,9 @@ static inline void shader_prog_clean(struct shader_prog *prog)
 	if (prog->fs)
 		glDeleteShader(prog->fs);
 
+	if (prog->cs)
+		glDeleteShader(prog->cs);
+
 	memset(prog, 0, sizeof(*prog));
 }
 
@@ -104,7 +116,7 @@ static inline int shader_prog_create(const char *vertex_code, const char *fragme
 	prog->prog = glCreateProgram();
 	if (!prog->prog) {
 		r = glGetError();
-		fprintf(stderr, "glCreateProgram() fail: %d\n", r);
+		icg_log_error("glCreateProgram() fail: %d\n", r);
 		goto fail;
 	}
 
@@ -122,20 +134,24 @@ static inline int shader_prog_create(const char *vertex_code, const char *fragme
 
 	glAttachShader(prog->prog, prog->vs);
 	if ((r = glGetError())) {
-		fprintf(stderr, "glAttachShader(vs) fail: %d", r);
+		icg_log_error("glAttachShader(vs) fail: %d", r);
 		goto fail;
 	}
 
 	glAttachShader(prog->prog, prog->fs);
 	if ((r = glGetError())) {
-		fprintf(stderr, "glAttachShader(fs) fail: %d", r);
+		icg_log_error("glAttachShader(fs) fail: %d", r);
 		goto fail;
 	}
 
+	// the linked program may be stored by shader_prog_load()
+	glProgramParameteri(prog->prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
 	glLinkProgram(prog->prog);
 	glGetProgramiv(prog->prog, GL_LINK_STATUS, &val);
 	if (val == GL_FALSE) {
-		fprintf(stderr, "glLinkProgram() fail: %d", r);
+		r = GL_INVALID_OPERATION;
+		icg_log_error("glLinkProgram() fail: %d\n", r);
 		goto fail;
 	}
 
@@ -146,6 +162,259 @@ fail:
 	return r;
 }
 
+static inline int shader_prog_compute(const char *compute_code, struct shader_prog *prog)
+{
+	int r;
+	GLint val;
+
+	memset(prog, 0, sizeof(*prog));
+
+	prog->prog = glCreateProgram();
+	if (!prog->prog) {
+		r = glGetError();
+		icg_log_error("glCreateProgram() fail: %d\n", r);
+		goto fail;
+	}
+
+	r = shader_create(GL_COMPUTE_SHADER, compute_code, &prog->cs);
+	if (r)
+		goto fail;
+
+	glAttachShader(prog->prog, prog->cs);
+	if ((r = glGetError())) {
+		icg_log_error("glAttachShader(cs) fail: %d", r);
+		goto fail;
+	}
+
+	glLinkProgram(prog->prog);
+	glGetProgramiv(prog->prog, GL_LINK_STATUS, &val);
+	if (val == GL_FALSE) {
+		r = GL_INVALID_OPERATION;
+		icg_log_error("glLinkProgram() fail: %d\n", r);
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	shader_prog_clean(prog);
+	return r;
+}
+
+// program binary cache: <dir>/<key>.glbin holds the glGetProgramBinary() output of a linked program, the
+// key hashes both sources and the vendor, renderer and version strings, so a driver update is a miss.
+// dir is $ICG_SHADER_CACHE (empty disables the cache), $XDG_CACHE_HOME/icg or $HOME/.cache/icg
+
+#define SHADER_CACHE_MAGIC "ICGP"
+#define SHADER_CACHE_VERSION 1
+#define SHADER_CACHE_SUFFIX ".glbin"
+
+struct shader_cache_header {
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint32_t format;	// GLenum of glProgramBinary()
+	uint32_t size;		// bytes after the header
+};
+
+// \return 0 if there is no cache directory
+static inline int shader_cache_path(uint64_t key, char *path, size_t size)
+{
+	const char *env = getenv("ICG_SHADER_CACHE"), *base;
+	char dir[4096];
+	int n;
+
+	if (env) {
+		if (!*env)
+			return 0;
+
+		n = snprintf(dir, sizeof(dir), "%s", env);
+	} else if ((base = getenv("XDG_CACHE_HOME")) && *base) {
+		n = snprintf(dir, sizeof(dir), "%s/icg", base);
+	} else if ((base = getenv("HOME")) && *base) {
+		// mkdir() is not recursive
+		snprintf(dir, sizeof(dir), "%s/.cache", base);
+		mkdir(dir, 0755);
+		n = snprintf(dir, sizeof(dir), "%s/.cache/icg", base);
+	} else {
+		return 0;
+	}
+
+	if (n <= 0 || (size_t)n >= sizeof(dir))
+		return 0;
+
+	if (mkdir(dir, 0755) && errno != EEXIST) {
+		icg_log_warn("mkdir('%s') fail: %s (%d), shader cache disabled\n", dir, strerror(errno), errno);
+		return 0;
+	}
+
+	n = snprintf(path, size, "%s/%016llx" SHADER_CACHE_SUFFIX, dir, (unsigned long long)key);
+	return n > 0 && (size_t)n < size;
+}
+
+static inline uint64_t shader_cache_key(const char *vertex_code, const char *fragment_code)
+{
+	const char *parts[] = {
+		vertex_code ? vertex_code : "",
+		fragment_code ? fragment_code : "",
+		(const char *)glGetString(GL_VENDOR),
+		(const char *)glGetString(GL_RENDERER),
+		(const char *)glGetString(GL_VERSION),
+	};
+	uint64_t key = SHADER_CACHE_VERSION;
+
+	// lengths are hashed too, "ab" + "c" and "a" + "bc" differ
+	for (size_t i = 0; i < ARRAY_SIZE(parts); i++)
+		key = icg_hash64(parts[i], parts[i] ? strlen(parts[i]) : 0, key);
+
+	return key;
+}
+
+// \return 0 if prog is linked from the cache
+static inline int shader_cache_read(const char *path, uint64_t key, struct shader_prog *prog)
+{
+	struct shader_cache_header h;
+	void *binary = NULL;
+	GLint val = GL_FALSE;
+	FILE *f;
+	int r = ENOENT;
+
+	f = fopen(path, "rb");
+	if (!f)
+		return r;
+
+	if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, SHADER_CACHE_MAGIC, 4) ||
+	    h.version != SHADER_CACHE_VERSION || h.key != key)
+		goto out;
+
+	binary = malloc(h.size);
+	if (!binary) {
+		icg_log_error("malloc() fail\n");
+		r = ENOMEM;
+		goto out;
+	}
+
+	if (fread(binary, h.size, 1, f) != 1)
+		goto out;
+
+	memset(prog, 0, sizeof(*prog));
+	prog->prog = glCreateProgram();
+	glProgramBinary(prog->prog, h.format, binary, h.size);
+
+	// a driver rejects binaries of another build or hardware with a link error
+	glGetProgramiv(prog->prog, GL_LINK_STATUS, &val);
+	if (val == GL_TRUE) {
+		r = 0;
+	} else {
+		icg_log_warn("shader cache '%s' rejected by the driver\n", path);
+		shader_prog_clean(prog);
+		unlink(path);
+	}
+
+out:
+	free(binary);
+	fclose(f);
+
+	// a short or foreign file is replaced by the next write
+	return r;
+}
+
+static inline int shader_cache_write(const char *path, uint64_t key, struct shader_prog *prog)
+{
+	struct shader_cache_header h = {SHADER_CACHE_MAGIC, SHADER_CACHE_VERSION, key, 0, 0};
+	char tmp[4096 + 16];
+	GLint size = 0;
+	GLenum format;
+	void *binary;
+	FILE *f;
+	int fd, r = 0;
+
+	glGetProgramiv(prog->prog, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0)
+		return ENOTSUP;
+
+	binary = malloc(size);
+	if (!binary) {
+		icg_log_error("malloc() fail\n");
+		return ENOMEM;
+	}
+
+	glGetProgramBinary(prog->prog, size, &size, &format, binary);
+	h.format = format;
+	h.size = size;
+
+	// a unique temp file per writer, threads or processes storing the same key each rename a whole binary
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		r = errno;
+		icg_log_error("mkstemp('%s') fail: %s (%d)\n", tmp, strerror(r), r);
+		free(binary);
+		return r;
+	}
+
+	f = fdopen(fd, "wb");
+	if (!f) {
+		r = errno;
+		icg_log_error("fdopen('%s') fail: %s (%d)\n", tmp, strerror(r), r);
+		close(fd);
+		unlink(tmp);
+		free(binary);
+		return r;
+	}
+
+	if (fwrite(&h, sizeof(h), 1, f) != 1 || fwrite(binary, h.size, 1, f) != 1)
+		r = EIO;
+
+	if (fclose(f) && !r)
+		r = EIO;
+
+	if (!r && rename(tmp, path))
+		r = errno;
+
+	if (r) {
+		icg_log_error("shader cache '%s' write fail: %s (%d)\n", path, strerror(r), r);
+		unlink(tmp);
+	}
+
+	free(binary);
+	return r;
+}
+
+// shader_prog_create() through the program binary cache, a missing, stale or rejected binary is compiled
+// from source and stored
+static inline int shader_prog_load(const char *vertex_code, const char *fragment_code, struct shader_prog *prog)
+{
+	double started_at = icg_time_ms();
+	GLint nr_formats = 0;
+	char path[4096];
+	uint64_t key;
+	int r;
+
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nr_formats);
+
+	key = shader_cache_key(vertex_code, fragment_code);
+	if (!nr_formats || !shader_cache_path(key, path, sizeof(path)))
+		return shader_prog_create(vertex_code, fragment_code, prog);
+
+	if (!shader_cache_read(path, key, prog)) {
+		icg_log_info("shader program %016llx from cache in %.3fms\n", (unsigned long long)key,
+			     icg_time_ms() - started_at);
+		return 0;
+	}
+
+	r = shader_prog_create(vertex_code, fragment_code, prog);
+	if (r)
+		return r;
+
+	icg_log_info("shader program %016llx compiled in %.3fms\n", (unsigned long long)key, icg_time_ms() - started_at);
+
+	// the program works w/o a cache
+	shader_cache_write(path, key, prog);
+	return 0;
+}
+
 static inline int shader_prog_bind(struct shader_prog *prog)
 {
 	glUseProgram(prog->prog);
@@ -5,3 +5,7 @@ void glfw_init(GLFWerrorfun on_error);
 
 /// main window create (context)
 GLFWwindow* glfw_window_init(int w, int h, const char *title);
+
+/// hidden window with a context sharing objects with the one of window, for a background thread, call on
+/// the main thread, glfwMakeContextCurrent() works on any
+GLFWwindow* glfw_shared_context_init(GLFWwindow *window);
@@ -1,6 +1,9 @@
 #pragma once
 
 // build-in shaders
+extern const char *GLSL_SHADER_GPU_CULL_COMP;
+extern const char *GLSL_SHADER_MDI_VERT;
 extern const char *GLSL_SHADER_PRJ_02_VERT;
+extern const char *GLSL_SHADER_PRJ_02_INSTANCED_VERT;
 extern const char *GLSL_SHADER_SIMPLE_FRAG;
 extern const char *GLSL_SHADER_SIMPLE_VERT;
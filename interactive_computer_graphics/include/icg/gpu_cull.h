@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <icg/glad.h>
+#include <icg/mdi.h>
+
+// gpu driven culling of instances of the meshes of a multi draw indirect renderer
+//
+// instances (a mesh, a model matrix and world bounds) stay in a storage buffer. A compute pass
+// (gpu_cull.comp) tests them against the frustum and writes a command and the model of every survivor
+// plus their count, glMultiDrawElementsIndirectCount() draws that many with mdi.vert; the cpu neither
+// reads the instances nor knows the count. Occlusion is not tested. The command of a draw keeps its
+// instance in base_instance, icg_gpu_cull_read() returns them to check against icg_cull_aabbs().
+
+#define ICG_GPU_CULL_GROUP 64	// local size of gpu_cull.comp
+
+// std430 instance of gpu_cull.comp, bounds by center and half extents
+struct icg_gpu_cull_instance {
+	float model[16];	// column major
+	float center[3];
+	uint32_t mesh;		// of the mdi renderer
+	float extent[3];
+	float pad;
+};
+
+struct icg_gpu_cull {
+	struct shader_prog prog;
+	GLint planes_location;
+	GLuint meshes;		// icg_mdi_mesh of every mesh
+	GLuint instances;
+	GLuint draws;		// the draw count, then a command per instance
+	GLuint models;		// a model per draw
+	unsigned int nr_instances;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// copy instances of the meshes of m to gpu buffers; needs gl 4.6 or GL_ARB_indirect_parameters
+/// \return 0 or an errno code
+int icg_gpu_cull_init(struct icg_gpu_cull *c, const struct icg_mdi *m, const struct icg_gpu_cull_instance *instances,
+		      unsigned int nr_instances);
+
+/// cull against the planes of icg_frustum_planes() and write the draws, leaves the cull program bound
+void icg_gpu_cull_dispatch(struct icg_gpu_cull *c, const float planes[6][4]);
+
+/// draw the survivors of the last dispatch by the meshes of m, a program of mdi.vert has to be bound
+void icg_gpu_cull_draw(struct icg_gpu_cull *c, const struct icg_mdi *m);
+
+/// wait for the last dispatch and read back the instances of its draws in the order of the draws, for
+/// checks only
+/// \return number of draws
+unsigned int icg_gpu_cull_read(struct icg_gpu_cull *c, uint32_t *visible);
+
+void icg_gpu_cull_clean(struct icg_gpu_cull *c);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,166 @@
+#pragma once
+
+// per frame upload ring: one persistently mapped buffer of ICG_GPU_RING_FRAMES regions
+//
+// a frame writes its uniform blocks, storage buffers and streamed vertices through sub-allocations of its
+// region and binds them by offset, a fence after its draws guards the region. The region comes around
+// again ICG_GPU_RING_FRAMES frames later; only if the gpu is still reading it then the cpu waits, such
+// waits are counted as stalls. The mapping is coherent, writes need no flush.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <glad/gl.h>
+#include <icg/common.h>
+#include <icg/log.h>
+
+// frames in flight, the cpu may run this many frames ahead of the gpu minus one
+#define ICG_GPU_RING_FRAMES 3
+
+struct icg_gpu_ring {
+	GLuint buffer;
+	unsigned char *data;		// mapping of the whole buffer
+	size_t region_size;		// bytes of a frame
+	size_t head;			// next free byte of the current region, buffer offset
+	size_t end;			// end of the current region
+	GLint alignment;		// binding offsets of uniform and storage buffers
+	GLsync fences[ICG_GPU_RING_FRAMES];
+	uint64_t frame;
+
+	// counters
+	uint64_t nr_stalls;		// frames which waited for their region
+	double stall_ms;
+	uint64_t nr_overflows;		// allocations which did not fit
+	size_t peak;			// most bytes of a frame
+};
+
+static inline size_t icg_gpu_ring_align(size_t n, size_t alignment)
+{
+	return (n + alignment - 1) / alignment * alignment;
+}
+
+// \return 0 or a gl error
+static inline int icg_gpu_ring_init(struct icg_gpu_ring *r, size_t region_size)
+{
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	GLint storage_alignment = 1;
+	int err;
+
+	memset(r, 0, sizeof(*r));
+
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &r->alignment);
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_alignment);
+	if (r->alignment < storage_alignment)
+		r->alignment = storage_alignment;
+	if (r->alignment < 16)
+		r->alignment = 16;
+
+	r->region_size = icg_gpu_ring_align(region_size, r->alignment);
+
+	glCreateBuffers(1, &r->buffer);
+	glNamedBufferStorage(r->buffer, r->region_size * ICG_GPU_RING_FRAMES, NULL, flags);
+	r->data = glMapNamedBufferRange(r->buffer, 0, r->region_size * ICG_GPU_RING_FRAMES, flags);
+	if (!r->data) {
+		err = glGetError();
+		icg_log_error("glMapNamedBufferRange(%zu) fail: 0x%x\n", r->region_size * ICG_GPU_RING_FRAMES, err);
+		glDeleteBuffers(1, &r->buffer);
+		memset(r, 0, sizeof(*r));
+		return err ? err : GL_OUT_OF_MEMORY;
+	}
+
+	return 0;
+}
+
+// take the region of the next frame, waits only if the gpu has not finished the frame which used it last
+static inline void icg_gpu_ring_begin(struct icg_gpu_ring *r)
+{
+	unsigned int region = r->frame % ICG_GPU_RING_FRAMES;
+	GLsync fence = r->fences[region];
+	double started_at;
+	GLenum status;
+
+	if (fence) {
+		status = glClientWaitSync(fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			started_at = icg_time_ms();
+
+			// the fence may still be queued, the flush makes sure it is ever signaled
+			do
+				status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			while (status == GL_TIMEOUT_EXPIRED);
+
+			r->nr_stalls++;
+			r->stall_ms += icg_time_ms() - started_at;
+		}
+
+		if (status == GL_WAIT_FAILED)
+			icg_log_error("glClientWaitSync() fail: 0x%x\n", glGetError());
+
+		glDeleteSync(fence);
+		r->fences[region] = NULL;
+	}
+
+	r->head = region * r->region_size;
+	r->end = r->head + r->region_size;
+}
+
+// sub-allocation of the current frame, alignment 0 is the one of buffer bindings
+// \return the mapping to write to (offset is its buffer offset) or NULL if the region is full
+static inline void *icg_gpu_ring_alloc(struct icg_gpu_ring *r, size_t size, size_t alignment, GLintptr *offset)
+{
+	size_t at = icg_gpu_ring_align(r->head, alignment ? alignment : (size_t)r->alignment), used;
+
+	if (at + size > r->end) {
+		r->nr_overflows++;
+		return NULL;
+	}
+
+	r->head = at + size;
+	used = r->head + r->region_size - r->end;
+	if (r->peak < used)
+		r->peak = used;
+
+	*offset = at;
+	return r->data + at;
+}
+
+// bytes an allocation of the current frame can take, alignment 0 is the one of buffer bindings
+static inline size_t icg_gpu_ring_room(const struct icg_gpu_ring *r, size_t alignment)
+{
+	size_t at = icg_gpu_ring_align(r->head, alignment ? alignment : (size_t)r->alignment);
+
+	return at < r->end ? r->end - at : 0;
+}
+
+// after the last draw reading the current region
+static inline void icg_gpu_ring_end(struct icg_gpu_ring *r)
+{
+	r->fences[r->frame % ICG_GPU_RING_FRAMES] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	r->frame++;
+}
+
+static inline void icg_gpu_ring_report(const struct icg_gpu_ring *r)
+{
+	if (!r->buffer)
+		return;
+
+	icg_log_info("gpu ring %zu bytes x %d, frames=%llu peak=%zu bytes stalls=%llu stall=%.3fms overflows=%llu\n",
+		     r->region_size, ICG_GPU_RING_FRAMES, (unsigned long long)r->frame, r->peak,
+		     (unsigned long long)r->nr_stalls, r->stall_ms, (unsigned long long)r->nr_overflows);
+}
+
+static inline void icg_gpu_ring_clean(struct icg_gpu_ring *r)
+{
+	for (int i = 0; i < ICG_GPU_RING_FRAMES; i++) {
+		if (r->fences[i])
+			glDeleteSync(r->fences[i]);
+	}
+
+	if (r->buffer) {
+		glUnmapNamedBuffer(r->buffer);
+		glDeleteBuffers(1, &r->buffer);
+	}
+
+	memset(r, 0, sizeof(*r));
+}
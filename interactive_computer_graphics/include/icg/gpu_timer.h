@@ -0,0 +1,79 @@
+#pragma once
+
+// gpu time of a render pass by GL_TIME_ELAPSED queries
+//
+// a query result is ready a few frames later, so queries are taken from a ring and results are polled
+// w/o waiting. If all queries are still in flight the frame is not timed instead of stalling. Only one
+// GL_TIME_ELAPSED query can be active, timed passes must not overlap.
+
+#include <stdint.h>
+
+#include <glad/gl.h>
+#include <icg/frame_stats.h>
+
+// queries in flight, frames of latency which can be tolerated
+#define ICG_GPU_TIMER_QUERIES 8
+
+struct icg_gpu_timer {
+	GLuint queries[ICG_GPU_TIMER_QUERIES];
+	uint64_t frames[ICG_GPU_TIMER_QUERIES];	// frame of a query
+	unsigned int issued;
+	unsigned int done;
+	int active;
+};
+
+static inline void icg_gpu_timer_init(struct icg_gpu_timer *t)
+{
+	memset(t, 0, sizeof(*t));
+	glGenQueries(ICG_GPU_TIMER_QUERIES, t->queries);
+}
+
+static inline void icg_gpu_timer_begin(struct icg_gpu_timer *t, uint64_t frame)
+{
+	if (t->issued - t->done == ICG_GPU_TIMER_QUERIES)
+		return;
+
+	t->frames[t->issued % ICG_GPU_TIMER_QUERIES] = frame;
+	glBeginQuery(GL_TIME_ELAPSED, t->queries[t->issued % ICG_GPU_TIMER_QUERIES]);
+	t->active = 1;
+}
+
+static inline void icg_gpu_timer_end(struct icg_gpu_timer *t)
+{
+	if (!t->active)
+		return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	t->issued++;
+	t->active = 0;
+}
+
+// move ready results in issue order to the stat of their frames, passes of one frame add up
+static inline void icg_gpu_timer_poll(struct icg_gpu_timer *t, struct icg_frame_stats *s, enum icg_stat stat)
+{
+	GLuint query;
+	GLint ready;
+	GLuint64 ns;
+	uint64_t frame;
+	float *ms;
+
+	while (t->done != t->issued) {
+		query = t->queries[t->done % ICG_GPU_TIMER_QUERIES];
+
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &ready);
+		if (!ready)
+			break;
+
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+		frame = t->frames[t->done % ICG_GPU_TIMER_QUERIES];
+		ms = &s->ms[frame & (ICG_STATS_FRAMES - 1)][stat];
+		icg_frame_stats_set(s, frame, stat, isnan(*ms) ? ns / 1e6f : *ms + ns / 1e6f);
+		t->done++;
+	}
+}
+
+static inline void icg_gpu_timer_clean(struct icg_gpu_timer *t)
+{
+	glDeleteQueries(ICG_GPU_TIMER_QUERIES, t->queries);
+	memset(t, 0, sizeof(*t));
+}
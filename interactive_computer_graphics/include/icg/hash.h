@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// 64-bit non cryptographic hash, four independent multiply-rotate lanes (xxh64 like),
+// it is used to identify cached data, not to protect it
+
+#define ICG_HASH_P1 0x9e3779b185ebca87ull
+#define ICG_HASH_P2 0xc2b2ae3d27d4eb4full
+#define ICG_HASH_P3 0x165667b19e3779f9ull
+
+static inline uint64_t icg_hash_rotl(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t icg_hash_round(uint64_t acc, uint64_t w)
+{
+	acc += w * ICG_HASH_P2;
+	acc = icg_hash_rotl(acc, 31);
+	return acc * ICG_HASH_P1;
+}
+
+static inline uint64_t icg_hash_load(const unsigned char *p)
+{
+	uint64_t w;
+
+	memcpy(&w, p, sizeof(w));
+	return w;
+}
+
+static inline uint64_t icg_hash64(const void *data, size_t size, uint64_t seed)
+{
+	const unsigned char *p = data, *end = p + size;
+	uint64_t v[4] = {seed + ICG_HASH_P1 + ICG_HASH_P2, seed + ICG_HASH_P2, seed, seed - ICG_HASH_P1};
+	uint64_t h;
+
+	for (; end - p >= 32; p += 32) {
+		v[0] = icg_hash_round(v[0], icg_hash_load(p));
+		v[1] = icg_hash_round(v[1], icg_hash_load(p + 8));
+		v[2] = icg_hash_round(v[2], icg_hash_load(p + 16));
+		v[3] = icg_hash_round(v[3], icg_hash_load(p + 24));
+	}
+
+	h = icg_hash_rotl(v[0], 1) + icg_hash_rotl(v[1], 7) + icg_hash_rotl(v[2], 12) + icg_hash_rotl(v[3], 18);
+	h += size;
+
+	for (; end - p >= 8; p += 8)
+		h = icg_hash_rotl(h ^ icg_hash_round(0, icg_hash_load(p)), 27) * ICG_HASH_P1 + ICG_HASH_P3;
+
+	for (; p < end; p++)
+		h = icg_hash_rotl(h ^ (*p * ICG_HASH_P3), 11) * ICG_HASH_P1;
+
+	h ^= h >> 33;
+	h *= ICG_HASH_P2;
+	h ^= h >> 29;
+	h *= ICG_HASH_P3;
+	h ^= h >> 32;
+
+	return h;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+// no x11 types in the egl headers
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <glad/gl.h>
+
+/// fixed time step of headless frames, frames per second
+#define ICG_HEADLESS_FPS 60
+
+/// offscreen rendering w/o a window system: surfaceless egl context (mesa llvmpipe works), frames go
+/// to a framebuffer object of a fixed size
+struct icg_headless {
+	EGLDisplay display;
+	EGLContext context;
+	EGLContext shared;		// second context of the same objects, for a background thread
+	EGLConfig config;
+	GLuint fbo;
+	GLuint color;
+	GLuint depth;
+	int width;
+	int height;
+
+	unsigned int frame;
+	unsigned int nr_frames;
+	const char *dump_prefix;	// frames are written to <dump_prefix>NNNNN.ppm if set
+	double started_at;
+	double *frame_ms;		// render time of every frame, glFinish() included
+	unsigned char *pixels;		// dump buffer
+};
+
+/// create context, load gl functions and the framebuffer
+/// \return 0 or an errno code
+int icg_headless_init(struct icg_headless *h, int width, int height, unsigned int nr_frames, const char *dump_prefix);
+
+/// create the shared context, it is current nowhere
+/// \return 0 or an errno code
+int icg_headless_shared_context(struct icg_headless *h);
+
+/// make ctx (the context, the shared one or EGL_NO_CONTEXT) current on the calling thread
+/// \return 0 or an errno code
+int icg_headless_make_current(struct icg_headless *h, EGLContext ctx);
+
+/// bind framebuffer and start the next frame
+/// \return 0 when all frames are rendered
+int icg_headless_frame_begin(struct icg_headless *h);
+
+/// wait for the frame, measure and dump it
+int icg_headless_frame_end(struct icg_headless *h);
+
+/// time of the current frame, seconds, advances by the fixed time step so animations are reproducible
+double icg_headless_time(const struct icg_headless *h);
+
+/// print frame time statistics
+void icg_headless_report(const struct icg_headless *h);
+
+void icg_headless_clean(struct icg_headless *h);
@@ -0,0 +1,43 @@
+#pragma once
+
+// asynchronous logging
+//
+// a call copies its format pointer and arguments into a binary record of a per thread ring and returns,
+// a background thread formats records and writes them (error and warn to stderr, others to stdout).
+// Levels above ICG_LOG_LEVEL compile to nothing, their arguments are type checked but never evaluated.
+// The format must be a string literal, it is kept by pointer. Records of a full ring are dropped
+// (error and warn wait for space instead), rings are drained at exit.
+
+#define ICG_LOG_ERROR 0
+#define ICG_LOG_WARN 1
+#define ICG_LOG_INFO 2
+#define ICG_LOG_DEBUG 3
+
+#ifndef ICG_LOG_LEVEL
+#define ICG_LOG_LEVEL ICG_LOG_INFO
+#endif
+
+#define ICG_LOG(level, ...)                             \
+	do {                                            \
+		if ((level) <= ICG_LOG_LEVEL)           \
+			icg_log_write(level, __VA_ARGS__); \
+	} while (0)
+
+#define icg_log_error(...) ICG_LOG(ICG_LOG_ERROR, __VA_ARGS__)
+#define icg_log_warn(...) ICG_LOG(ICG_LOG_WARN, __VA_ARGS__)
+#define icg_log_info(...) ICG_LOG(ICG_LOG_INFO, __VA_ARGS__)
+#define icg_log_debug(...) ICG_LOG(ICG_LOG_DEBUG, __VA_ARGS__)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// queue a record, the first call starts the writer thread
+void icg_log_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/// wait until records queued so far are written
+void icg_log_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
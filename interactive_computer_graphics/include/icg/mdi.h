@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <glad/gl.h>
+#include <icg/gpu_ring.h>
+#include <wavefront_obj.h>
+
+// multi draw indirect renderer
+//
+// meshes are packed into one position buffer and one 32 bit index buffer at init, every mesh is a range
+// of both. A frame appends draws (a mesh and its model matrix) to a command array and a per draw array,
+// both sub-allocated in the upload ring, and submits them with one glMultiDrawElementsIndirect(). The
+// vertex shader (mdi.vert) reads the model of its draw by gl_DrawIDARB from the storage buffer at
+// ICG_MDI_DRAW_BINDING, so draws need no state changes in between.
+
+#define ICG_MDI_DRAW_BINDING 1
+
+// DrawElementsIndirectCommand of the gl spec
+struct icg_mdi_command {
+	uint32_t count;
+	uint32_t instance_count;
+	uint32_t first_index;
+	int32_t base_vertex;
+	uint32_t base_instance;
+};
+
+struct icg_mdi_mesh {
+	uint32_t first_index;
+	uint32_t nr_indices;
+	int32_t base_vertex;
+};
+
+struct icg_mdi {
+	GLuint vao;
+	GLuint vbo;		// float positions
+	GLuint ebo;		// uint32 indices, relative to the base vertex of a mesh
+	struct icg_mdi_mesh *meshes;
+	unsigned int nr_meshes;
+	unsigned int nr_vertices;
+	unsigned int nr_indices;
+
+	// draws of the current frame, mappings of the ring
+	struct icg_gpu_ring *ring;
+	struct icg_mdi_command *commands;
+	float (*models)[16];
+	GLintptr commands_offset;
+	GLintptr models_offset;
+	unsigned int nr_draws;
+	unsigned int max_draws;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// pack meshes (positions and triangles, other attributes are dropped) into the shared buffers
+/// \return 0 or an errno code
+int icg_mdi_init(struct icg_mdi *m, const struct wf_mesh *meshes, unsigned int nr_meshes);
+
+/// start the draws of a frame between icg_gpu_ring_begin() and icg_gpu_ring_end() of ring
+/// \return 0 or ENOSPC if the ring has no room for max_draws
+int icg_mdi_begin(struct icg_mdi *m, struct icg_gpu_ring *ring, unsigned int max_draws);
+
+/// model is a column major 4x4 matrix (a mat4x4 of linmath.h)
+/// \return 0 or ENOSPC after max_draws draws
+int icg_mdi_add(struct icg_mdi *m, unsigned int mesh, const float *model);
+
+/// all draws of the frame, binds the vao of m, the indirect buffer and the per draw storage buffer
+void icg_mdi_submit(struct icg_mdi *m);
+
+void icg_mdi_clean(struct icg_mdi *m);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <icg/glad.h>
+
+// shader hot reload
+//
+// a background thread watches the shader directory (inotify) and rebuilds the programs of changed files on
+// a second context sharing objects with the render context; F6 of the apps rebuilds all of them. The render
+// thread never waits for a compiler: icg_shader_reload_poll() swaps in a program only once it is linked
+// and its fence is signaled. A program which fails to compile or link is logged and dropped, the working
+// one stays. GL_KHR_parallel_shader_compile is used if the driver has it.
+
+/// shader sources, ICG_SHADER_DIR of the environment overrides the build time path
+#ifndef ICG_SHADER_DIR
+#define ICG_SHADER_DIR "lib/shader"
+#endif
+
+/// make the shared context current on the calling thread (the reload thread), NULL releases it
+typedef int (*icg_shader_reload_bind)(void *ctx);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// start the reload thread, ctx is passed to bind, it is made current on the reload thread
+/// \return 0 or an errno code
+int icg_shader_reload_init(icg_shader_reload_bind bind, void *ctx);
+
+/// rebuild prog from <dir>/<vertex_name> and <dir>/<fragment_name> when one of them changes, the names are
+/// kept by pointer
+/// \return 0 or an errno code
+int icg_shader_reload_watch(struct shader_prog *prog, const char *vertex_name, const char *fragment_name);
+
+/// rebuild all watched programs, safe to call from input callbacks
+void icg_shader_reload_request(void);
+
+/// swap in rebuilt programs, render thread, once per frame; a swapped program is not bound and its uniform
+/// locations may differ
+/// \return number of programs swapped
+int icg_shader_reload_poll(void);
+
+/// stop the thread, pending programs are deleted
+void icg_shader_reload_clean(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,6 +15,43 @@
 #define LINMATH_H_FUNC static inline
 #endif
 
+// simd versions of mat4x4_mul, mat4x4_mul_vec4, mat4x4_invert and quat_mul are selected at compile time
+// (sse is a part of x86_64, -mavx adds 8 wide mat4x4_mul, neon on arm), LINMATH_NO_SIMD keeps scalar code.
+// They do the scalar operations in the scalar order, so w/o fma contraction results are bit exact,
+// the *_scalar versions stay available for reference.
+#if !defined(LINMATH_NO_SIMD) && (defined(__SSE__) || defined(_M_X64))
+#define LINMATH_SIMD
+#include <immintrin.h>
+typedef __m128 linmath_v4;
+#define linmath_v4_load(p) _mm_loadu_ps(p)
+#define linmath_v4_store(p, v) _mm_storeu_ps(p, v)
+#define linmath_v4_set1(x) _mm_set1_ps(x)
+#define linmath_v4_add(a, b) _mm_add_ps(a, b)
+#define linmath_v4_sub(a, b) _mm_sub_ps(a, b)
+#define linmath_v4_mul(a, b) _mm_mul_ps(a, b)
+#define linmath_v4_yzx(v) _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1))
+#define linmath_v4_zxy(v) _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2))
+#define linmath_v4_yxwz(v) _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1))
+#elif !defined(LINMATH_NO_SIMD) && defined(__ARM_NEON)
+#define LINMATH_SIMD
+#include <arm_neon.h>
+typedef float32x4_t linmath_v4;
+#define linmath_v4_load(p) vld1q_f32(p)
+#define linmath_v4_store(p, v) vst1q_f32(p, v)
+#define linmath_v4_set1(x) vdupq_n_f32(x)
+#define linmath_v4_add(a, b) vaddq_f32(a, b)
+#define linmath_v4_sub(a, b) vsubq_f32(a, b)
+#define linmath_v4_mul(a, b) vmulq_f32(a, b)
+#if defined(__clang__)
+#define linmath_v4_shuffle(v, x, y, z, w) __builtin_shufflevector(v, v, x, y, z, w)
+#else
+#define linmath_v4_shuffle(v, x, y, z, w) __builtin_shuffle(v, (uint32x4_t){x, y, z, w})
+#endif
+#define linmath_v4_yzx(v) linmath_v4_shuffle(v, 1, 2, 0, 3)
+#define linmath_v4_zxy(v) linmath_v4_shuffle(v, 2, 0, 1, 3)
+#define linmath_v4_yxwz(v) linmath_v4_shuffle(v, 1, 0, 3, 2)
+#endif
+
 LINMATH_H_FUNC float degrees_to_radians(float degrees)
 {
 	return degrees * (M_PI / 180.0);
@@ -177,7 +214,7 @@ LINMATH_H_FUNC void mat4x4_scale_aniso(mat4x4 M, mat4x4 const a, float x, float
 	vec4_scale(M[2], a[2], z);
 	vec4_dup(M[3], a[3]);
 }
-LINMATH_H_FUNC void mat4x4_mul(mat4x4 M, mat4x4 const a, mat4x4 const b)
+LINMATH_H_FUNC void mat4x4_mul_scalar(mat4x4 M, mat4x4 const a, mat4x4 const b)
 {
 	mat4x4 temp;
 	int k, r, c;
@@ -188,7 +225,41 @@ LINMATH_H_FUNC void mat4x4_mul(mat4x4 M, mat4x4 const a, mat4x4 const b)
 	}
 	mat4x4_dup(M, temp);
 }
-LINMATH_H_FUNC void mat4x4_mul_vec4(vec4 r, mat4x4 const M, vec4 const v)
+LINMATH_H_FUNC void mat4x4_mul(mat4x4 M, mat4x4 const a, mat4x4 const b)
+{
+#if defined(LINMATH_SIMD) && defined(__AVX__)
+	// two columns of the result per register, columns of a are repeated in both halves
+	__m256 a0 = _mm256_broadcast_ps((const __m128 *)a[0]), a1 = _mm256_broadcast_ps((const __m128 *)a[1]);
+	__m256 a2 = _mm256_broadcast_ps((const __m128 *)a[2]), a3 = _mm256_broadcast_ps((const __m128 *)a[3]);
+	__m256 r[2];
+	int c;
+	for(c=0; c<2; ++c) {
+		r[c] = _mm256_mul_ps(a0, _mm256_set_m128(_mm_set1_ps(b[c*2+1][0]), _mm_set1_ps(b[c*2][0])));
+		r[c] = _mm256_add_ps(r[c], _mm256_mul_ps(a1, _mm256_set_m128(_mm_set1_ps(b[c*2+1][1]), _mm_set1_ps(b[c*2][1]))));
+		r[c] = _mm256_add_ps(r[c], _mm256_mul_ps(a2, _mm256_set_m128(_mm_set1_ps(b[c*2+1][2]), _mm_set1_ps(b[c*2][2]))));
+		r[c] = _mm256_add_ps(r[c], _mm256_mul_ps(a3, _mm256_set_m128(_mm_set1_ps(b[c*2+1][3]), _mm_set1_ps(b[c*2][3]))));
+	}
+	_mm256_storeu_ps(M[0], r[0]);
+	_mm256_storeu_ps(M[2], r[1]);
+#elif defined(LINMATH_SIMD)
+	// column c of the result is the sum of columns of a scaled by column c of b
+	linmath_v4 a0 = linmath_v4_load(a[0]), a1 = linmath_v4_load(a[1]);
+	linmath_v4 a2 = linmath_v4_load(a[2]), a3 = linmath_v4_load(a[3]);
+	linmath_v4 r[4];
+	int c;
+	for(c=0; c<4; ++c) {
+		r[c] = linmath_v4_mul(a0, linmath_v4_set1(b[c][0]));
+		r[c] = linmath_v4_add(r[c], linmath_v4_mul(a1, linmath_v4_set1(b[c][1])));
+		r[c] = linmath_v4_add(r[c], linmath_v4_mul(a2, linmath_v4_set1(b[c][2])));
+		r[c] = linmath_v4_add(r[c], linmath_v4_mul(a3, linmath_v4_set1(b[c][3])));
+	}
+	for(c=0; c<4; ++c)
+		linmath_v4_store(M[c], r[c]);
+#else
+	mat4x4_mul_scalar(M, a, b);
+#endif
+}
+LINMATH_H_FUNC void mat4x4_mul_vec4_scalar(vec4 r, mat4x4 const M, vec4 const v)
 {
 	int i, j;
 	for(j=0; j<4; ++j) {
@@ -197,6 +268,18 @@ LINMATH_H_FUNC void mat4x4_mul_vec4(vec4 r, mat4x4 const M, vec4 const v)
 			r[j] += M[i][j] * v[i];
 	}
 }
+LINMATH_H_FUNC void mat4x4_mul_vec4(vec4 r, mat4x4 const M, vec4 const v)
+{
+#if defined(LINMATH_SIMD)
+	linmath_v4 t = linmath_v4_mul(linmath_v4_load(M[0]), linmath_v4_set1(v[0]));
+	t = linmath_v4_add(t, linmath_v4_mul(linmath_v4_load(M[1]), linmath_v4_set1(v[1])));
+	t = linmath_v4_add(t, linmath_v4_mul(linmath_v4_load(M[2]), linmath_v4_set1(v[2])));
+	t = linmath_v4_add(t, linmath_v4_mul(linmath_v4_load(M[3]), linmath_v4_set1(v[3])));
+	linmath_v4_store(r, t);
+#else
+	mat4x4_mul_vec4_scalar(r, M, v);
+#endif
+}
 LINMATH_H_FUNC void mat4x4_translate(mat4x4 T, float x, float y, float z)
 {
 	mat4x4_identity(T);
@@ -290,7 +373,7 @@ LINMATH_H_FUNC void mat4x4_rotate_Z(mat4x4 Q, mat4x4 const M, float angle)
 	};
 	mat4x4_mul(Q, M, R);
 }
-LINMATH_H_FUNC void mat4x4_invert(mat4x4 T, mat4x4 const M)
+LINMATH_H_FUNC void mat4x4_invert_scalar(mat4x4 T, mat4x4 const M)
 {
 	float s[6];
 	float c[6];
@@ -331,6 +414,61 @@ LINMATH_H_FUNC void mat4x4_invert(mat4x4 T, mat4x4 const M)
 	T[3][2] = (-M[3][0] * s[3] + M[3][1] * s[1] - M[3][2] * s[0]) * idet;
 	T[3][3] = ( M[2][0] * s[3] - M[2][1] * s[1] + M[2][2] * s[0]) * idet;
 }
+LINMATH_H_FUNC void mat4x4_invert(mat4x4 T, mat4x4 const M)
+{
+#if defined(LINMATH_SIMD)
+	// a column of T is (+ - + -) or (- + - +) times three rows of M, lanes swapped in pairs, scaled by
+	// (c c s s) vectors of 2x2 determinants, the same terms as mat4x4_invert_scalar() in the same order
+	float s[6], c[6], idet;
+	linmath_v4 r[4], cs[6], t[4], sign;
+	int i;
+
+	s[0] = M[0][0]*M[1][1] - M[1][0]*M[0][1];
+	s[1] = M[0][0]*M[1][2] - M[1][0]*M[0][2];
+	s[2] = M[0][0]*M[1][3] - M[1][0]*M[0][3];
+	s[3] = M[0][1]*M[1][2] - M[1][1]*M[0][2];
+	s[4] = M[0][1]*M[1][3] - M[1][1]*M[0][3];
+	s[5] = M[0][2]*M[1][3] - M[1][2]*M[0][3];
+
+	c[0] = M[2][0]*M[3][1] - M[3][0]*M[2][1];
+	c[1] = M[2][0]*M[3][2] - M[3][0]*M[2][2];
+	c[2] = M[2][0]*M[3][3] - M[3][0]*M[2][3];
+	c[3] = M[2][1]*M[3][2] - M[3][1]*M[2][2];
+	c[4] = M[2][1]*M[3][3] - M[3][1]*M[2][3];
+	c[5] = M[2][2]*M[3][3] - M[3][2]*M[2][3];
+
+	/* Assumes it is invertible */
+	idet = 1.0f/( s[0]*c[5]-s[1]*c[4]+s[2]*c[3]+s[3]*c[2]-s[4]*c[1]+s[5]*c[0] );
+
+	for(i=0; i<4; ++i) {
+		vec4 row = {M[1][i], M[0][i], M[3][i], M[2][i]};
+		r[i] = linmath_v4_load(row);
+	}
+
+	for(i=0; i<6; ++i) {
+		vec4 v = {c[i], c[i], s[i], s[i]};
+		cs[i] = linmath_v4_load(v);
+	}
+
+	t[0] = linmath_v4_add(linmath_v4_sub(linmath_v4_mul(r[1], cs[5]), linmath_v4_mul(r[2], cs[4])), linmath_v4_mul(r[3], cs[3]));
+	t[1] = linmath_v4_add(linmath_v4_sub(linmath_v4_mul(r[0], cs[5]), linmath_v4_mul(r[2], cs[2])), linmath_v4_mul(r[3], cs[1]));
+	t[2] = linmath_v4_add(linmath_v4_sub(linmath_v4_mul(r[0], cs[4]), linmath_v4_mul(r[1], cs[2])), linmath_v4_mul(r[3], cs[0]));
+	t[3] = linmath_v4_add(linmath_v4_sub(linmath_v4_mul(r[0], cs[3]), linmath_v4_mul(r[1], cs[1])), linmath_v4_mul(r[2], cs[0]));
+
+	// negation is exact, so the sign can be applied with the determinant
+	{
+		vec4 v = {idet, -idet, idet, -idet};
+		sign = linmath_v4_load(v);
+	}
+
+	linmath_v4_store(T[0], linmath_v4_mul(t[0], sign));
+	linmath_v4_store(T[1], linmath_v4_mul(t[1], linmath_v4_yxwz(sign)));
+	linmath_v4_store(T[2], linmath_v4_mul(t[2], sign));
+	linmath_v4_store(T[3], linmath_v4_mul(t[3], linmath_v4_yxwz(sign)));
+#else
+	mat4x4_invert_scalar(T, M);
+#endif
+}
 LINMATH_H_FUNC void mat4x4_orthonormalize(mat4x4 R, mat4x4 const M)
 {
 	mat4x4_dup(R, M);
@@ -466,7 +604,7 @@ LINMATH_H_FUNC void quat_identity(quat q)
 	q[0] = q[1] = q[2] = 0.f;
 	q[3] = 1.f;
 }
-LINMATH_H_FUNC void quat_mul(quat r, quat const p, quat const q)
+LINMATH_H_FUNC void quat_mul_scalar(quat r, quat const p, quat const q)
 {
 	vec3 w, tmp;
 
@@ -479,6 +617,22 @@ LINMATH_H_FUNC void quat_mul(quat r, quat const p, quat const q)
 	vec3_dup(r, tmp);
 	r[3] = p[3]*q[3] - vec3_mul_inner(p, q);
 }
+LINMATH_H_FUNC void quat_mul(quat r, quat const p, quat const q)
+{
+#if defined(LINMATH_SIMD)
+	// xyz = p x q + p q.w + q p.w, w lane is replaced by the scalar product
+	linmath_v4 a = linmath_v4_load(p), b = linmath_v4_load(q), t;
+	float w = p[3]*q[3] - vec3_mul_inner(p, q);
+
+	t = linmath_v4_sub(linmath_v4_mul(linmath_v4_yzx(a), linmath_v4_zxy(b)), linmath_v4_mul(linmath_v4_zxy(a), linmath_v4_yzx(b)));
+	t = linmath_v4_add(t, linmath_v4_mul(a, linmath_v4_set1(q[3])));
+	t = linmath_v4_add(t, linmath_v4_mul(b, linmath_v4_set1(p[3])));
+	linmath_v4_store(r, t);
+	r[3] = w;
+#else
+	quat_mul_scalar(r, p, q);
+#endif
+}
 LINMATH_H_FUNC void quat_conj(quat r, quat const q)
 {
 	int i;
@@ -1,5 +1,6 @@
 #include <GLFW/glfw3.h>
 #include <icg/glfw.h>
+#include <icg/log.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,7 +8,7 @@
 
 static void glfw_on_error(int error, const char* description)
 {
-	fprintf(stderr, "glfw error: %s (%d)\n", description, error);
+	icg_log_error("glfw error: %s (%d)\n", description, error);
 }
 
 void glfw_init(GLFWerrorfun on_error)
@@ -15,13 +16,13 @@ void glfw_init(GLFWerrorfun on_error)
 	int r;
 
 	if (!glfwInit()) {
-		fprintf(stderr, "glfwInit() fail\n");
+		icg_log_error("glfwInit() fail\n");
 		exit(EXIT_FAILURE);
 	}
 
 	r = atexit(glfwTerminate);
 	if (r) {
-		fprintf(stderr, "atexit(glfwTerminate) fail: %s (%d)\n", strerror(r), r);
+		icg_log_error("atexit(glfwTerminate) fail: %s (%d)\n", strerror(r), r);
 	}
 
 	if (on_error)
@@ -34,7 +35,7 @@ GLFWwindow* glfw_window_init(int w, int h, const char *title)
 {
 	GLFWwindow* window = glfwCreateWindow(w, h, title, NULL, NULL);
 	if (!window) {
-		fprintf(stderr, "glfwCreateWindow() fail");
+		icg_log_error("glfwCreateWindow() fail");
 		return NULL;
 	}
 
@@ -43,3 +44,20 @@ GLFWwindow* glfw_window_init(int w, int h, const char *title)
 
 	return window;
 }
+
+GLFWwindow* glfw_shared_context_init(GLFWwindow *window)
+{
+	GLFWwindow* shared;
+
+	// a hidden 1x1 window, only its context is used
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	shared = glfwCreateWindow(1, 1, "", NULL, window);
+	glfwDefaultWindowHints();
+
+	if (!shared) {
+		icg_log_error("glfwCreateWindow(shared) fail\n");
+		return NULL;
+	}
+
+	return shared;
+}
@@ -0,0 +1,140 @@
+#include <icg/gpu_cull.h>
+#include <icg/glsl.h>
+#include <icg/log.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// bindings of gpu_cull.comp
+#define MESH_BINDING 0
+#define INSTANCE_BINDING 1
+#define DRAW_COMMAND_BINDING 2
+#define DRAW_MODEL_BINDING 3
+
+// commands follow the draw count
+#define COMMANDS_OFFSET sizeof(uint32_t)
+
+int icg_gpu_cull_init(struct icg_gpu_cull *c, const struct icg_mdi *m, const struct icg_gpu_cull_instance *instances,
+		      unsigned int nr_instances)
+{
+	GLint max_groups = 0;
+	int r;
+
+	memset(c, 0, sizeof(*c));
+
+	if (!GLAD_GL_VERSION_4_6 && !GLAD_GL_ARB_indirect_parameters) {
+		icg_log_error("gpu cull: no glMultiDrawElementsIndirectCount()\n");
+		return ENOTSUP;
+	}
+
+	glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &max_groups);
+	if (!nr_instances || (nr_instances + ICG_GPU_CULL_GROUP - 1) / ICG_GPU_CULL_GROUP > (unsigned int)max_groups) {
+		icg_log_error("gpu cull: %u instances do not fit %d groups\n", nr_instances, max_groups);
+		return EOVERFLOW;
+	}
+
+	for (unsigned int i = 0; i < nr_instances; i++) {
+		if (instances[i].mesh >= m->nr_meshes) {
+			icg_log_error("gpu cull: instance %u of mesh %u, %u meshes\n", i, instances[i].mesh, m->nr_meshes);
+			return EINVAL;
+		}
+	}
+
+	r = shader_prog_compute(GLSL_SHADER_GPU_CULL_COMP, &c->prog);
+	if (r)
+		return r;
+
+	c->planes_location = glGetUniformLocation(c->prog.prog, "planes");
+	glProgramUniform1ui(c->prog.prog, glGetUniformLocation(c->prog.prog, "nr_instances"), nr_instances);
+	c->nr_instances = nr_instances;
+
+	// written by the gpu alone
+	glCreateBuffers(1, &c->meshes);
+	glNamedBufferStorage(c->meshes, m->nr_meshes * sizeof(*m->meshes), m->meshes, 0);
+	glCreateBuffers(1, &c->instances);
+	glNamedBufferStorage(c->instances, nr_instances * sizeof(*instances), instances, 0);
+	glCreateBuffers(1, &c->draws);
+	glNamedBufferStorage(c->draws, COMMANDS_OFFSET + nr_instances * sizeof(struct icg_mdi_command), NULL, 0);
+	glCreateBuffers(1, &c->models);
+	glNamedBufferStorage(c->models, nr_instances * sizeof(*m->models), NULL, 0);
+
+	r = glGetError();
+	if (r) {
+		icg_log_error("gpu cull buffers fail: 0x%x\n", r);
+		icg_gpu_cull_clean(c);
+		return r;
+	}
+
+	icg_log_info("gpu cull %u instances of %u meshes\n", nr_instances, m->nr_meshes);
+	return 0;
+}
+
+void icg_gpu_cull_dispatch(struct icg_gpu_cull *c, const float planes[6][4])
+{
+	const GLuint zero = 0;
+
+	glClearNamedBufferSubData(c->draws, GL_R32UI, 0, sizeof(zero), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+	glUseProgram(c->prog.prog);
+	glProgramUniform4fv(c->prog.prog, c->planes_location, 6, &planes[0][0]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MESH_BINDING, c->meshes);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, c->instances);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_COMMAND_BINDING, c->draws);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_MODEL_BINDING, c->models);
+
+	glDispatchCompute((c->nr_instances + ICG_GPU_CULL_GROUP - 1) / ICG_GPU_CULL_GROUP, 1, 1);
+
+	// the draws read the commands and the count as indirect parameters, the models from the storage buffer
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void icg_gpu_cull_draw(struct icg_gpu_cull *c, const struct icg_mdi *m)
+{
+	glBindVertexArray(m->vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, c->draws);
+	glBindBuffer(GL_PARAMETER_BUFFER, c->draws);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ICG_MDI_DRAW_BINDING, c->models);
+
+	// the same entry point, core since 4.6
+	if (GLAD_GL_VERSION_4_6)
+		glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *)COMMANDS_OFFSET, 0,
+						 c->nr_instances, 0);
+	else
+		glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *)COMMANDS_OFFSET, 0,
+						    c->nr_instances, 0);
+}
+
+unsigned int icg_gpu_cull_read(struct icg_gpu_cull *c, uint32_t *visible)
+{
+	struct icg_mdi_command commands[256];
+	uint32_t nr_draws = 0, n;
+
+	// the read of a buffer written by a shader
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glGetNamedBufferSubData(c->draws, 0, sizeof(nr_draws), &nr_draws);
+	if (nr_draws > c->nr_instances) {
+		icg_log_error("gpu cull: %u draws of %u instances\n", nr_draws, c->nr_instances);
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < nr_draws; i += n) {
+		n = nr_draws - i < ARRAY_SIZE(commands) ? nr_draws - i : ARRAY_SIZE(commands);
+		glGetNamedBufferSubData(c->draws, COMMANDS_OFFSET + i * sizeof(*commands), n * sizeof(*commands),
+					commands);
+
+		for (uint32_t k = 0; k < n; k++)
+			visible[i + k] = commands[k].base_instance;
+	}
+
+	return nr_draws;
+}
+
+void icg_gpu_cull_clean(struct icg_gpu_cull *c)
+{
+	GLuint buffers[] = {c->meshes, c->instances, c->draws, c->models};
+
+	glDeleteBuffers(ARRAY_SIZE(buffers), buffers);
+	shader_prog_clean(&c->prog);
+	memset(c, 0, sizeof(*c));
+}
@@ -0,0 +1,307 @@
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <icg/common.h>
+#include <icg/headless.h>
+#include <icg/log.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the apps use direct state access
+#define ICG_HEADLESS_GL_MAJOR 4
+#define ICG_HEADLESS_GL_MINOR 5
+
+static const EGLint icg_headless_context_attribs[] = {
+	EGL_CONTEXT_MAJOR_VERSION, ICG_HEADLESS_GL_MAJOR,
+	EGL_CONTEXT_MINOR_VERSION, ICG_HEADLESS_GL_MINOR,
+	EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+	EGL_NONE
+};
+
+static EGLDisplay icg_headless_display()
+{
+	const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+	// no window system at all, the default display may need X or wayland
+	if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless"))
+		return eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static int icg_headless_context(struct icg_headless *h)
+{
+	const EGLint config_attribs[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_SURFACE_TYPE, 0,	// any, nothing is drawn to an egl surface
+		EGL_NONE
+	};
+	EGLint major, minor, n = 0;
+
+	h->display = icg_headless_display();
+	if (h->display == EGL_NO_DISPLAY) {
+		icg_log_error("eglGetDisplay() fail: 0x%x\n", eglGetError());
+		return ENODEV;
+	}
+
+	if (!eglInitialize(h->display, &major, &minor)) {
+		icg_log_error("eglInitialize() fail: 0x%x\n", eglGetError());
+		h->display = EGL_NO_DISPLAY;
+		return ENODEV;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		icg_log_error("eglBindAPI() fail: 0x%x\n", eglGetError());
+		return ENODEV;
+	}
+
+	// EGL_KHR_no_config_context is used if there is no config
+	if (!eglChooseConfig(h->display, config_attribs, &h->config, 1, &n) || !n)
+		h->config = EGL_NO_CONFIG_KHR;
+
+	h->context = eglCreateContext(h->display, h->config, EGL_NO_CONTEXT, icg_headless_context_attribs);
+	if (h->context == EGL_NO_CONTEXT) {
+		icg_log_error("eglCreateContext() fail: 0x%x\n", eglGetError());
+		return ENODEV;
+	}
+
+	// EGL_KHR_surfaceless_context
+	if (!eglMakeCurrent(h->display, EGL_NO_SURFACE, EGL_NO_SURFACE, h->context)) {
+		icg_log_error("eglMakeCurrent() fail: 0x%x\n", eglGetError());
+		return ENODEV;
+	}
+
+	icg_log_info("headless egl %d.%d\n", major, minor);
+	return 0;
+}
+
+static int icg_headless_framebuffer(struct icg_headless *h)
+{
+	GLenum status;
+
+	glCreateRenderbuffers(1, &h->color);
+	glNamedRenderbufferStorage(h->color, GL_RGBA8, h->width, h->height);
+	glCreateRenderbuffers(1, &h->depth);
+	glNamedRenderbufferStorage(h->depth, GL_DEPTH24_STENCIL8, h->width, h->height);
+
+	glCreateFramebuffers(1, &h->fbo);
+	glNamedFramebufferRenderbuffer(h->fbo, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, h->color);
+	glNamedFramebufferRenderbuffer(h->fbo, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, h->depth);
+
+	status = glCheckNamedFramebufferStatus(h->fbo, GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		icg_log_error("glCheckNamedFramebufferStatus() fail: 0x%x\n", status);
+		return EINVAL;
+	}
+
+	return 0;
+}
+
+int icg_headless_init(struct icg_headless *h, int width, int height, unsigned int nr_frames, const char *dump_prefix)
+{
+	int r;
+
+	memset(h, 0, sizeof(*h));
+	h->display = EGL_NO_DISPLAY;
+	h->context = EGL_NO_CONTEXT;
+	h->shared = EGL_NO_CONTEXT;
+	h->config = EGL_NO_CONFIG_KHR;
+	h->width = width;
+	h->height = height;
+	h->nr_frames = nr_frames;
+	h->dump_prefix = dump_prefix;
+
+	h->frame_ms = calloc(nr_frames + 1, sizeof(*h->frame_ms));
+	if (dump_prefix)
+		h->pixels = malloc((size_t)width * height * 3);
+
+	if (!h->frame_ms || (dump_prefix && !h->pixels)) {
+		icg_log_error("malloc() fail\n");
+		r = ENOMEM;
+		goto fail;
+	}
+
+	r = icg_headless_context(h);
+	if (r)
+		goto fail;
+
+	if (!gladLoadGL((GLADloadfunc)eglGetProcAddress)) {
+		icg_log_error("gladLoadGL() fail\n");
+		r = ENODEV;
+		goto fail;
+	}
+
+	icg_log_info("headless %s, %s, %dx%d, %u frames\n", (const char *)glGetString(GL_RENDERER),
+	             (const char *)glGetString(GL_VERSION), width, height, nr_frames);
+
+	r = icg_headless_framebuffer(h);
+	if (r)
+		goto fail;
+
+	return 0;
+
+fail:
+	icg_headless_clean(h);
+	return r;
+}
+
+int icg_headless_shared_context(struct icg_headless *h)
+{
+	if (h->shared != EGL_NO_CONTEXT)
+		return 0;
+
+	h->shared = eglCreateContext(h->display, h->config, h->context, icg_headless_context_attribs);
+	if (h->shared == EGL_NO_CONTEXT) {
+		icg_log_error("eglCreateContext(shared) fail: 0x%x\n", eglGetError());
+		return ENODEV;
+	}
+
+	return 0;
+}
+
+int icg_headless_make_current(struct icg_headless *h, EGLContext ctx)
+{
+	if (!eglMakeCurrent(h->display, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx)) {
+		icg_log_error("eglMakeCurrent() fail: 0x%x\n", eglGetError());
+		return ENODEV;
+	}
+
+	return 0;
+}
+
+int icg_headless_frame_begin(struct icg_headless *h)
+{
+	if (h->frame >= h->nr_frames)
+		return 0;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, h->fbo);
+	glViewport(0, 0, h->width, h->height);
+	h->started_at = icg_time_ms();
+
+	return 1;
+}
+
+// binary rgb, rows from the top
+static int icg_headless_dump(struct icg_headless *h)
+{
+	char filename[4096];
+	size_t row = (size_t)h->width * 3;
+	FILE *f;
+	int r = 0;
+
+	snprintf(filename, sizeof(filename), "%s%05u.ppm", h->dump_prefix, h->frame);
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, h->width, h->height, GL_RGB, GL_UNSIGNED_BYTE, h->pixels);
+
+	f = fopen(filename, "wb");
+	if (!f) {
+		r = errno;
+		icg_log_error("fopen(%s) fail: %s (%d)\n", filename, strerror(r), r);
+		return r;
+	}
+
+	fprintf(f, "P6\n%d %d\n255\n", h->width, h->height);
+
+	for (int y = h->height - 1; y >= 0 && !r; y--) {
+		if (fwrite(h->pixels + y * row, row, 1, f) != 1)
+			r = EIO;
+	}
+
+	if (fclose(f) && !r)
+		r = EIO;
+
+	if (r)
+		icg_log_error("write(%s) fail\n", filename);
+
+	return r;
+}
+
+int icg_headless_frame_end(struct icg_headless *h)
+{
+	int r = 0;
+
+	glFinish();
+	h->frame_ms[h->frame] = icg_time_ms() - h->started_at;
+
+	// not measured, reading back would dominate the frame time of small scenes
+	if (h->dump_prefix)
+		r = icg_headless_dump(h);
+
+	h->frame++;
+	return r;
+}
+
+double icg_headless_time(const struct icg_headless *h)
+{
+	return (double)h->frame / ICG_HEADLESS_FPS;
+}
+
+static int icg_headless_cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+void icg_headless_report(const struct icg_headless *h)
+{
+	double *sorted, total = 0;
+	unsigned int n = h->frame;
+
+	if (!n)
+		return;
+
+	sorted = malloc(n * sizeof(*sorted));
+	if (!sorted) {
+		icg_log_error("malloc() fail\n");
+		return;
+	}
+
+	memcpy(sorted, h->frame_ms, n * sizeof(*sorted));
+	qsort(sorted, n, sizeof(*sorted), icg_headless_cmp);
+
+	for (unsigned int i = 0; i < n; i++)
+		total += sorted[i];
+
+	// drivers compile shader variants and upload buffers on the first draw, the median is the steady state
+	icg_log_info("headless frames=%u total=%.3fms first=%.3fms min=%.3fms median=%.3fms p95=%.3fms max=%.3fms fps=%.1f\n",
+	             n, total, h->frame_ms[0], sorted[0], sorted[n / 2], sorted[n * 95 / 100], sorted[n - 1],
+	             total > 0 ? n / total * 1e3 : 0.0);
+
+	free(sorted);
+}
+
+void icg_headless_clean(struct icg_headless *h)
+{
+	// gl objects exist only if gl functions were loaded
+	if (h->fbo)
+		glDeleteFramebuffers(1, &h->fbo);
+
+	if (h->color)
+		glDeleteRenderbuffers(1, &h->color);
+
+	if (h->depth)
+		glDeleteRenderbuffers(1, &h->depth);
+
+	// not current anywhere, the thread which used it is done
+	if (h->shared != EGL_NO_CONTEXT)
+		eglDestroyContext(h->display, h->shared);
+
+	if (h->context != EGL_NO_CONTEXT) {
+		eglMakeCurrent(h->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(h->display, h->context);
+	}
+
+	if (h->display != EGL_NO_DISPLAY)
+		eglTerminate(h->display);
+
+	free(h->frame_ms);
+	free(h->pixels);
+	memset(h, 0, sizeof(*h));
+	h->display = EGL_NO_DISPLAY;
+	h->context = EGL_NO_CONTEXT;
+	h->shared = EGL_NO_CONTEXT;
+}
@@ -0,0 +1,565 @@
+// asynchronous logging
+//
+// record: header, then 8 byte slots of the arguments in format order, a string is its length slot and
+// its bytes padded to a slot. Formatting parses the format again and feeds every conversion with its
+// slots to snprintf(). A ring has a single producer (its thread) and a single consumer (the writer).
+
+#include <icg/log.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// bytes of a thread ring, power of 2
+#define ICG_LOG_RING_SIZE (1 << 16)
+
+// longest record and formatted line, longer strings are cut
+#define ICG_LOG_RECORD_MAX 1024
+#define ICG_LOG_LINE_MAX 4096
+
+// idle writer sleep
+#define ICG_LOG_POLL_NS 1000000
+
+// header level of the unused end of a ring
+#define ICG_LOG_PAD -1
+
+struct icg_log_record {
+	uint32_t size;		// header included, multiple of 8
+	int32_t level;
+	const char *fmt;
+};
+
+struct icg_log_ring {
+	unsigned char *data;
+	atomic_uint_least64_t head;	// written by the producer
+	atomic_uint_least64_t tail;	// written by the consumer
+	atomic_ulong dropped;
+	unsigned long reported;		// drops already reported by the consumer
+	atomic_int retired;		// its thread exited, freed by the consumer once drained
+	struct icg_log_ring *next;
+};
+
+// conversion of a format
+struct icg_log_spec {
+	const char *begin;	// '%'
+	const char *end;	// after the conversion character
+	int star_width;
+	int star_precision;
+	char length[3];
+	char conversion;
+};
+
+static pthread_once_t icg_log_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t icg_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t icg_log_writer;
+static pthread_key_t icg_log_key;
+static atomic_int icg_log_running;
+static atomic_int icg_log_stopping;
+static struct icg_log_ring *icg_log_rings;
+static _Thread_local struct icg_log_ring *icg_log_ring;
+
+// next conversion of fmt
+// \return 0 at the end of fmt
+static int icg_log_next_spec(const char **fmt, struct icg_log_spec *s)
+{
+	const char *p = *fmt;
+	int n = 0;
+
+	for (;;) {
+		p = strchr(p, '%');
+		if (!p)
+			return 0;
+
+		if (p[1] != '%')
+			break;
+
+		p += 2;
+	}
+
+	memset(s, 0, sizeof(*s));
+	s->begin = p++;
+
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+
+	if (*p == '*') {
+		s->star_width = 1;
+		p++;
+	}
+
+	while (*p >= '0' && *p <= '9')
+		p++;
+
+	if (*p == '.') {
+		p++;
+
+		if (*p == '*') {
+			s->star_precision = 1;
+			p++;
+		}
+
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+
+	while (*p && strchr("hlLzjtq", *p) && n < 2)
+		s->length[n++] = *p++;
+
+	s->conversion = *p;
+	s->end = *p ? p + 1 : p;
+	*fmt = s->end;
+
+	return *p != 0;
+}
+
+static int icg_log_is_signed(char c)
+{
+	return c == 'd' || c == 'i';
+}
+
+static int icg_log_is_float(char c)
+{
+	return strchr("fFeEgGaA", c) != NULL;
+}
+
+// read an integer argument of the length modifier
+static uint64_t icg_log_int_arg(const struct icg_log_spec *s, va_list *ap)
+{
+	const char *l = s->length;
+	int sign = icg_log_is_signed(s->conversion);
+
+	if (!strcmp(l, "l"))
+		return sign ? (uint64_t)va_arg(*ap, long) : va_arg(*ap, unsigned long);
+
+	if (!strcmp(l, "ll") || !strcmp(l, "q"))
+		return sign ? (uint64_t)va_arg(*ap, long long) : va_arg(*ap, unsigned long long);
+
+	if (!strcmp(l, "z"))
+		return va_arg(*ap, size_t);
+
+	if (!strcmp(l, "j"))
+		return sign ? (uint64_t)va_arg(*ap, intmax_t) : va_arg(*ap, uintmax_t);
+
+	if (!strcmp(l, "t"))
+		return (uint64_t)va_arg(*ap, ptrdiff_t);
+
+	// char and short are promoted
+	return sign ? (uint64_t)(int64_t)va_arg(*ap, int) : va_arg(*ap, unsigned int);
+}
+
+static size_t icg_log_put_slot(unsigned char *rec, size_t size, const void *v)
+{
+	if (size + 8 > ICG_LOG_RECORD_MAX)
+		return size;
+
+	memcpy(rec + size, v, 8);
+	return size + 8;
+}
+
+static size_t icg_log_put_string(unsigned char *rec, size_t size, const char *str)
+{
+	uint64_t len;
+
+	if (!str)
+		str = "(null)";
+
+	len = strlen(str);
+
+	// a slot for the length and one for the rest of the record at least
+	if (size + 16 > ICG_LOG_RECORD_MAX)
+		return size;
+
+	if (len > ICG_LOG_RECORD_MAX - size - 8)
+		len = ICG_LOG_RECORD_MAX - size - 8;
+
+	memcpy(rec + size, &len, 8);
+	memcpy(rec + size + 8, str, len);
+
+	return size + 8 + (len + 7) / 8 * 8;
+}
+
+static size_t icg_log_serialize(unsigned char *rec, const char *fmt, va_list *ap)
+{
+	struct icg_log_spec s;
+	size_t size = sizeof(struct icg_log_record);
+	uint64_t u;
+	double d;
+	int64_t i;
+
+	while (icg_log_next_spec(&fmt, &s)) {
+		if (s.star_width) {
+			i = va_arg(*ap, int);
+			size = icg_log_put_slot(rec, size, &i);
+		}
+
+		if (s.star_precision) {
+			i = va_arg(*ap, int);
+			size = icg_log_put_slot(rec, size, &i);
+		}
+
+		if (icg_log_is_float(s.conversion)) {
+			d = !strcmp(s.length, "L") ? (double)va_arg(*ap, long double) : va_arg(*ap, double);
+			size = icg_log_put_slot(rec, size, &d);
+		} else if (s.conversion == 's') {
+			size = icg_log_put_string(rec, size, va_arg(*ap, const char *));
+		} else if (s.conversion == 'p') {
+			u = (uintptr_t)va_arg(*ap, void *);
+			size = icg_log_put_slot(rec, size, &u);
+		} else if (s.conversion == 'n') {
+			// nothing is written back
+			(void)va_arg(*ap, void *);
+		} else {
+			u = icg_log_int_arg(&s, ap);
+			size = icg_log_put_slot(rec, size, &u);
+		}
+	}
+
+	return size;
+}
+
+static void icg_log_stop(void)
+{
+	atomic_store(&icg_log_stopping, 1);
+
+	if (atomic_load(&icg_log_running))
+		pthread_join(icg_log_writer, NULL);
+
+	// later records are written at once
+	atomic_store(&icg_log_running, 0);
+}
+
+static void *icg_log_thread(void *arg);
+
+// thread exit, the ring of a thread does not outlive it
+static void icg_log_retire(void *arg)
+{
+	struct icg_log_ring *r = arg;
+
+	icg_log_ring = NULL;
+	atomic_store_explicit(&r->retired, 1, memory_order_release);
+}
+
+static void icg_log_start(void)
+{
+	if (pthread_key_create(&icg_log_key, icg_log_retire))
+		return;
+
+	if (pthread_create(&icg_log_writer, NULL, icg_log_thread, NULL))
+		return;
+
+	atomic_store(&icg_log_running, 1);
+	atexit(icg_log_stop);
+}
+
+static struct icg_log_ring *icg_log_ring_get(void)
+{
+	struct icg_log_ring *r = icg_log_ring;
+
+	if (r)
+		return r;
+
+	r = calloc(1, sizeof(*r));
+	if (r)
+		r->data = malloc(ICG_LOG_RING_SIZE);
+
+	if (!r || !r->data) {
+		free(r);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&icg_log_lock);
+	r->next = icg_log_rings;
+	icg_log_rings = r;
+	pthread_mutex_unlock(&icg_log_lock);
+
+	icg_log_ring = r;
+	pthread_setspecific(icg_log_key, r);
+	return r;
+}
+
+// \return 0 if the ring is full
+static int icg_log_push(struct icg_log_ring *r, const unsigned char *rec, size_t size)
+{
+	uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	uint64_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+	size_t at = head & (ICG_LOG_RING_SIZE - 1), pad = 0;
+	struct icg_log_record padding = {0, ICG_LOG_PAD, NULL};
+
+	// records are contiguous, the end of the ring is skipped if a record does not fit
+	if (at + size > ICG_LOG_RING_SIZE)
+		pad = ICG_LOG_RING_SIZE - at;
+
+	if (head + pad + size - tail > ICG_LOG_RING_SIZE)
+		return 0;
+
+	// the pad may be a slot only, the consumer reads no more than size and level of it
+	if (pad) {
+		padding.size = pad;
+		memcpy(r->data + at, &padding, offsetof(struct icg_log_record, fmt));
+		at = 0;
+	}
+
+	memcpy(r->data + at, rec, size);
+	atomic_store_explicit(&r->head, head + pad + size, memory_order_release);
+
+	return 1;
+}
+
+void icg_log_write(int level, const char *fmt, ...)
+{
+	_Alignas(8) unsigned char rec[ICG_LOG_RECORD_MAX];
+	struct icg_log_record h = {0, level, fmt};
+	struct icg_log_ring *r;
+	va_list ap;
+
+	pthread_once(&icg_log_once, icg_log_start);
+
+	r = atomic_load(&icg_log_running) ? icg_log_ring_get() : NULL;
+	if (!r) {
+		va_start(ap, fmt);
+		vfprintf(level <= ICG_LOG_WARN ? stderr : stdout, fmt, ap);
+		va_end(ap);
+		return;
+	}
+
+	va_start(ap, fmt);
+	h.size = icg_log_serialize(rec, fmt, &ap);
+	va_end(ap);
+
+	memcpy(rec, &h, sizeof(h));
+
+	while (!icg_log_push(r, rec, h.size)) {
+		if (level > ICG_LOG_WARN || !atomic_load(&icg_log_running)) {
+			atomic_fetch_add(&r->dropped, 1);
+			return;
+		}
+
+		sched_yield();
+	}
+}
+
+// snprintf() of one conversion with its slots
+// \return bytes read from the record
+static size_t icg_log_format_spec(const struct icg_log_spec *s, const unsigned char *p, const unsigned char *end,
+				  char *out, size_t n, size_t *len)
+{
+	char spec[32];
+	int64_t star[2] = {0, 0}, i;
+	int nr_star = 0, w, pr, r = 0;
+	const unsigned char *begin = p;
+	uint64_t u = 0, slen;
+	double d = 0;
+	const char *l = s->length;
+
+	*len = 0;
+
+	if ((size_t)(s->end - s->begin) >= sizeof(spec))
+		return 0;
+
+	memcpy(spec, s->begin, s->end - s->begin);
+	spec[s->end - s->begin] = 0;
+
+	for (int k = 0; k < s->star_width + s->star_precision && p + 8 <= end; k++, p += 8)
+		memcpy(&star[nr_star++], p, 8);
+
+	w = star[0];
+	pr = s->star_width ? star[1] : star[0];
+
+#define ICG_LOG_EMIT(v)                                                             \
+	(s->star_width && s->star_precision ? snprintf(out, n, spec, w, pr, v) :   \
+	 s->star_width			  ? snprintf(out, n, spec, w, v) :          \
+	 s->star_precision		  ? snprintf(out, n, spec, pr, v) :         \
+					    snprintf(out, n, spec, v))
+
+	if (s->conversion == 'n' || (s->conversion != 's' && p + 8 > end))
+		return p - begin;
+
+	if (icg_log_is_float(s->conversion)) {
+		memcpy(&d, p, 8);
+		p += 8;
+		r = !strcmp(l, "L") ? ICG_LOG_EMIT((long double)d) : ICG_LOG_EMIT(d);
+	} else if (s->conversion == 's') {
+		char str[ICG_LOG_RECORD_MAX];
+
+		slen = 0;
+		if (p + 8 <= end) {
+			memcpy(&slen, p, 8);
+			p += 8;
+		}
+
+		if (slen > (size_t)(end - p))
+			slen = end - p;
+
+		memcpy(str, p, slen);
+		str[slen] = 0;
+		p += (slen + 7) / 8 * 8;
+		r = ICG_LOG_EMIT(str);
+	} else if (s->conversion == 'p') {
+		memcpy(&u, p, 8);
+		p += 8;
+		r = ICG_LOG_EMIT((void *)(uintptr_t)u);
+	} else {
+		memcpy(&u, p, 8);
+		p += 8;
+		i = (int64_t)u;
+
+		if (!strcmp(l, "l"))
+			r = icg_log_is_signed(s->conversion) ? ICG_LOG_EMIT((long)i) : ICG_LOG_EMIT((unsigned long)u);
+		else if (!strcmp(l, "ll") || !strcmp(l, "q"))
+			r = icg_log_is_signed(s->conversion) ? ICG_LOG_EMIT((long long)i) :
+							       ICG_LOG_EMIT((unsigned long long)u);
+		else if (!strcmp(l, "z"))
+			r = ICG_LOG_EMIT((size_t)u);
+		else if (!strcmp(l, "j"))
+			r = icg_log_is_signed(s->conversion) ? ICG_LOG_EMIT((intmax_t)i) : ICG_LOG_EMIT((uintmax_t)u);
+		else if (!strcmp(l, "t"))
+			r = ICG_LOG_EMIT((ptrdiff_t)i);
+		else
+			r = icg_log_is_signed(s->conversion) || s->conversion == 'c' ? ICG_LOG_EMIT((int)i) :
+										       ICG_LOG_EMIT((unsigned int)u);
+	}
+
+#undef ICG_LOG_EMIT
+
+	*len = r < 0 ? 0 : (size_t)r < n ? (size_t)r : n ? n - 1 : 0;
+	return p - begin;
+}
+
+// format a record like printf() would have
+static void icg_log_format(const struct icg_log_record *h, const unsigned char *payload, FILE *f)
+{
+	const unsigned char *end = (const unsigned char *)h + h->size;
+	const char *fmt = h->fmt, *text = fmt;
+	struct icg_log_spec s;
+	char line[ICG_LOG_LINE_MAX];
+	size_t n = 0, len;
+
+	while (icg_log_next_spec(&fmt, &s)) {
+		// literal text, %% pairs are written as one %
+		for (const char *c = text; c < s.begin && n + 1 < sizeof(line); c++) {
+			line[n++] = *c;
+			if (c[0] == '%' && c + 1 < s.begin && c[1] == '%')
+				c++;
+		}
+
+		payload += icg_log_format_spec(&s, payload, end, line + n, sizeof(line) - n, &len);
+		n += len;
+		text = s.end;
+	}
+
+	for (const char *c = text; *c && n + 1 < sizeof(line); c++) {
+		line[n++] = *c;
+		if (c[0] == '%' && c[1] == '%')
+			c++;
+	}
+
+	fwrite(line, 1, n, f);
+}
+
+// \return number of records written
+static size_t icg_log_drain_ring(struct icg_log_ring *r)
+{
+	uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+	const struct icg_log_record *h;
+	unsigned long dropped;
+	size_t nr = 0;
+
+	while (tail != head) {
+		h = (const struct icg_log_record *)(r->data + (tail & (ICG_LOG_RING_SIZE - 1)));
+
+		if (h->level != ICG_LOG_PAD) {
+			icg_log_format(h, (const unsigned char *)(h + 1), h->level <= ICG_LOG_WARN ? stderr : stdout);
+			nr++;
+		}
+
+		tail += h->size;
+	}
+
+	atomic_store_explicit(&r->tail, tail, memory_order_release);
+
+	dropped = atomic_load(&r->dropped);
+	if (dropped != r->reported) {
+		fprintf(stderr, "log: %lu records dropped\n", dropped - r->reported);
+		r->reported = dropped;
+	}
+
+	return nr;
+}
+
+static size_t icg_log_drain(void)
+{
+	struct icg_log_ring *r, **p;
+	size_t nr = 0;
+	int retired;
+
+	pthread_mutex_lock(&icg_log_lock);
+
+	for (p = &icg_log_rings; (r = *p);) {
+		// read first, all records of a retired ring are pushed before
+		retired = atomic_load_explicit(&r->retired, memory_order_acquire);
+		nr += icg_log_drain_ring(r);
+
+		if (retired) {
+			*p = r->next;
+			free(r->data);
+			free(r);
+		} else {
+			p = &r->next;
+		}
+	}
+
+	pthread_mutex_unlock(&icg_log_lock);
+
+	if (nr) {
+		fflush(stdout);
+		fflush(stderr);
+	}
+
+	return nr;
+}
+
+static void *icg_log_thread(void *arg)
+{
+	const struct timespec idle = {0, ICG_LOG_POLL_NS};
+
+	(void)arg;
+
+	while (!atomic_load(&icg_log_stopping)) {
+		if (!icg_log_drain())
+			nanosleep(&idle, NULL);
+	}
+
+	icg_log_drain();
+	return NULL;
+}
+
+void icg_log_flush(void)
+{
+	const struct timespec idle = {0, ICG_LOG_POLL_NS / 10};
+	int pending = 1;
+
+	while (pending && atomic_load(&icg_log_running)) {
+		pending = 0;
+
+		pthread_mutex_lock(&icg_log_lock);
+
+		for (struct icg_log_ring *r = icg_log_rings; r; r = r->next)
+			pending |= atomic_load(&r->head) != atomic_load(&r->tail);
+
+		pthread_mutex_unlock(&icg_log_lock);
+
+		if (pending)
+			nanosleep(&idle, NULL);
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+}
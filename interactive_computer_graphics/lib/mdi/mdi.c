@@ -0,0 +1,157 @@
+#include <icg/mdi.h>
+#include <icg/log.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+int icg_mdi_init(struct icg_mdi *m, const struct wf_mesh *meshes, unsigned int nr_meshes)
+{
+	size_t nr_vertices = 0, nr_indices = 0;
+	float *positions;
+	uint32_t *indices;
+	int r = 0;
+
+	memset(m, 0, sizeof(*m));
+
+	for (unsigned int i = 0; i < nr_meshes; i++) {
+		nr_vertices += meshes[i].nr_vertices;
+		nr_indices += meshes[i].nr_indices;
+	}
+
+	// first_index and base_vertex are 32 bit
+	if (nr_vertices > INT32_MAX || nr_indices > UINT32_MAX) {
+		icg_log_error("mdi: %zu vertices %zu indices do not fit\n", nr_vertices, nr_indices);
+		return EOVERFLOW;
+	}
+
+	m->meshes = malloc(nr_meshes * sizeof(*m->meshes));
+	positions = malloc(nr_vertices * 3 * sizeof(*positions));
+	indices = malloc(nr_indices * sizeof(*indices));
+	if (!m->meshes || !positions || !indices) {
+		icg_log_error("malloc() fail\n");
+		r = ENOMEM;
+		goto out;
+	}
+
+	for (unsigned int i = 0; i < nr_meshes; i++) {
+		const struct wf_mesh *mesh = &meshes[i];
+		struct icg_mdi_mesh *d = &m->meshes[i];
+		float *p = positions + (size_t)m->nr_vertices * 3;
+		uint32_t *ix = indices + m->nr_indices;
+
+		d->first_index = m->nr_indices;
+		d->nr_indices = mesh->nr_indices;
+		d->base_vertex = m->nr_vertices;
+
+		// the position is the first attribute of a vertex
+		for (unsigned int v = 0; v < mesh->nr_vertices; v++)
+			memcpy(p + v * 3, (const char *)mesh->vertices + (size_t)v * mesh->stride, 3 * sizeof(*p));
+
+		if (mesh->index_size == 2) {
+			for (unsigned int k = 0; k < mesh->nr_indices; k++)
+				ix[k] = ((const uint16_t *)mesh->indices)[k];
+		} else {
+			memcpy(ix, mesh->indices, (size_t)mesh->nr_indices * sizeof(*ix));
+		}
+
+		m->nr_vertices += mesh->nr_vertices;
+		m->nr_indices += mesh->nr_indices;
+	}
+
+	m->nr_meshes = nr_meshes;
+
+	// immutable, the meshes never change; a byte more, empty storage is an error
+	glCreateBuffers(1, &m->vbo);
+	glNamedBufferStorage(m->vbo, nr_vertices * 3 * sizeof(*positions) + 1, positions, 0);
+	glCreateBuffers(1, &m->ebo);
+	glNamedBufferStorage(m->ebo, nr_indices * sizeof(*indices) + 1, indices, 0);
+
+	glCreateVertexArrays(1, &m->vao);
+	glEnableVertexArrayAttrib(m->vao, 0);
+	glVertexArrayAttribFormat(m->vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+	glVertexArrayAttribBinding(m->vao, 0, 0);
+	glVertexArrayVertexBuffer(m->vao, 0, m->vbo, 0, 3 * sizeof(*positions));
+	glVertexArrayElementBuffer(m->vao, m->ebo);
+
+	r = glGetError();
+	if (r)
+		icg_log_error("mdi buffers fail: 0x%x\n", r);
+
+	icg_log_info("mdi %u meshes %u vertices %u indices\n", m->nr_meshes, m->nr_vertices, m->nr_indices);
+out:
+	free(positions);
+	free(indices);
+
+	if (r)
+		icg_mdi_clean(m);
+
+	return r;
+}
+
+int icg_mdi_begin(struct icg_mdi *m, struct icg_gpu_ring *ring, unsigned int max_draws)
+{
+	m->ring = ring;
+	m->nr_draws = 0;
+	m->max_draws = 0;
+
+	// the command array needs 4 byte alignment, the storage buffer the one of bindings
+	m->commands = icg_gpu_ring_alloc(ring, max_draws * sizeof(*m->commands), sizeof(uint32_t),
+					 &m->commands_offset);
+	m->models = icg_gpu_ring_alloc(ring, max_draws * sizeof(*m->models), 0, &m->models_offset);
+	if (!m->commands || !m->models)
+		return ENOSPC;
+
+	m->max_draws = max_draws;
+	return 0;
+}
+
+int icg_mdi_add(struct icg_mdi *m, unsigned int mesh, const float *model)
+{
+	const struct icg_mdi_mesh *d = &m->meshes[mesh];
+	struct icg_mdi_command *c;
+
+	if (m->nr_draws == m->max_draws)
+		return ENOSPC;
+
+	// the mapping may be write combined, every field is written once and in order
+	c = &m->commands[m->nr_draws];
+	c->count = d->nr_indices;
+	c->instance_count = 1;
+	c->first_index = d->first_index;
+	c->base_vertex = d->base_vertex;
+	c->base_instance = 0;
+
+	memcpy(m->models[m->nr_draws], model, sizeof(*m->models));
+	m->nr_draws++;
+
+	return 0;
+}
+
+void icg_mdi_submit(struct icg_mdi *m)
+{
+	if (!m->nr_draws)
+		return;
+
+	glBindVertexArray(m->vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m->ring->buffer);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, ICG_MDI_DRAW_BINDING, m->ring->buffer, m->models_offset,
+			  m->nr_draws * sizeof(*m->models));
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *)m->commands_offset, m->nr_draws, 0);
+}
+
+void icg_mdi_clean(struct icg_mdi *m)
+{
+	if (m->vao)
+		glDeleteVertexArrays(1, &m->vao);
+
+	if (m->vbo)
+		glDeleteBuffers(1, &m->vbo);
+
+	if (m->ebo)
+		glDeleteBuffers(1, &m->ebo);
+
+	free(m->meshes);
+	memset(m, 0, sizeof(*m));
+}
@@ -2,11 +2,131 @@
 
 #include <icg/glsl.h>
 
-const char *GLSL_SHADER_PRJ_02_VERT = "#version 460 core\n \
+const char *GLSL_SHADER_GPU_CULL_COMP = "#version 450 core\n \
+\n \
+// frustum culling of instances, an invocation each. Survivors are compacted into the commands of a multi\n \
+// draw indirect count: a workgroup counts its survivors in shared memory and reserves their slots by one\n \
+// atomic on the draw count\n \
+layout(local_size_x=64) in;\n \
+\n \
+struct mesh {\n \
+	uint first_index;\n \
+	uint nr_indices;\n \
+	int base_vertex;\n \
+};\n \
+\n \
+struct instance {\n \
+	mat4 model;\n \
+	vec3 center;\n \
+	uint mesh;\n \
+	vec3 extent;\n \
+};\n \
+\n \
+// DrawElementsIndirectCommand, base_instance is the instance\n \
+struct command {\n \
+	uint count;\n \
+	uint instance_count;\n \
+	uint first_index;\n \
+	int base_vertex;\n \
+	uint base_instance;\n \
+};\n \
+\n \
+layout(std430, binding=0) readonly buffer mesh_data {\n \
+	mesh meshes[];\n \
+};\n \
+\n \
+layout(std430, binding=1) readonly buffer instance_data {\n \
+	instance instances[];\n \
+};\n \
+\n \
+// the parameter buffer of the draw count, the indirect buffer of the commands\n \
+layout(std430, binding=2) buffer draw_commands {\n \
+	uint nr_draws;\n \
+	command commands[];\n \
+};\n \
+\n \
+// per draw data of mdi.vert\n \
+layout(std430, binding=3) writeonly buffer draw_data {\n \
+	mat4 models[];\n \
+};\n \
+\n \
+// world space frustum of icg_frustum_planes(), normals point inside\n \
+uniform vec4 planes[6];\n \
+uniform uint nr_instances;\n \
+\n \
+shared uint group_count;\n \
+shared uint group_first;\n \
+\n \
+void main()\n \
+{\n \
+	uint i = gl_GlobalInvocationID.x, slot = 0;\n \
+	bool visible = i < nr_instances;\n \
+	mesh m;\n \
+\n \
+	if (gl_LocalInvocationIndex == 0)\n \
+		group_count = 0;\n \
+\n \
+	barrier();\n \
+\n \
+	// box is outside if its corner farthest along the normal of a plane is behind it\n \
+	for (int j = 0; j < 6 && visible; j++)\n \
+		visible = dot(planes[j].xyz, instances[i].center) + planes[j].w +\n \
+			  dot(abs(planes[j].xyz), instances[i].extent) >= 0;\n \
+\n \
+	if (visible)\n \
+		slot = atomicAdd(group_count, 1);\n \
+\n \
+	barrier();\n \
+\n \
+	if (gl_LocalInvocationIndex == 0)\n \
+		group_first = atomicAdd(nr_draws, group_count);\n \
+\n \
+	barrier();\n \
+\n \
+	if (!visible)\n \
+		return;\n \
+\n \
+	slot += group_first;\n \
+	m = meshes[instances[i].mesh];\n \
+\n \
+	commands[slot].count = m.nr_indices;\n \
+	commands[slot].instance_count = 1;\n \
+	commands[slot].first_index = m.first_index;\n \
+	commands[slot].base_vertex = m.base_vertex;\n \
+	commands[slot].base_instance = i;\n \
+	models[slot] = instances[i].model;\n \
+}\n \
+";
+
+const char *GLSL_SHADER_MDI_VERT = "#version 450 core\n \
+#extension GL_ARB_shader_draw_parameters : require\n \
 \n \
 layout(location=0) in vec3 pos;\n \
 \n \
-uniform mat4 mvp;\n \
+// per frame data, a range of the upload ring\n \
+layout(std140, binding=0) uniform frame_data {\n \
+	mat4 mvp;\n \
+};\n \
+\n \
+// per draw data of a multi draw, ICG_MDI_DRAW_BINDING\n \
+layout(std430, binding=1) readonly buffer draw_data {\n \
+	mat4 models[];\n \
+};\n \
+\n \
+void main()\n \
+{\n \
+	// mvp is the view projection here, every draw brings its model matrix\n \
+	gl_Position = mvp * models[gl_DrawIDARB] * vec4(pos, 1);\n \
+}";
+
+const char *GLSL_SHADER_PRJ_02_VERT = "#version 450 core\n \
+\n \
+layout(location=0) in vec3 pos;\n \
+\n \
+// per frame data, a range of the upload ring\n \
+layout(std140, binding=0) uniform frame_data {\n \
+	mat4 mvp;\n \
+};\n \
 \n \
 void main()\n \
 {\n \
@@ -17,7 +137,23 @@ void main()\n \
 	gl_Position = mvp * vec4(pos, 1);\n \
 }";
 
-const char *GLSL_SHADER_SIMPLE_FRAG = "#version 460 core\n \
+const char *GLSL_SHADER_PRJ_02_INSTANCED_VERT = "#version 450 core\n \
+\n \
+layout(location=0) in vec3 pos;\n \
+layout(location=1) in mat4 model;\n \
+\n \
+// per frame data, a range of the upload ring\n \
+layout(std140, binding=0) uniform frame_data {\n \
+	mat4 mvp;\n \
+};\n \
+\n \
+void main()\n \
+{\n \
+	// mvp is the view projection here, every instance brings its model matrix\n \
+	gl_Position = mvp * model * vec4(pos, 1);\n \
+}";
+
+const char *GLSL_SHADER_SIMPLE_FRAG = "#version 450 core\n \
 \n \
 layout(location = 0) out vec4 color;\n \
 \n \
@@ -26,7 +162,7 @@ void main()\n \
 	color = vec4(1, 0, 0, 1);\n \
 }";
 
-const char *GLSL_SHADER_SIMPLE_VERT = "#version 460 core\n \
+const char *GLSL_SHADER_SIMPLE_VERT = "#version 450 core\n \
 \n \
 layout(location=0) in vec3 pos;\n \
 \n \
@@ -0,0 +1,20 @@
+#version 450 core
+#extension GL_ARB_shader_draw_parameters : require
+
+layout(location=0) in vec3 pos;
+
+// per frame data, a range of the upload ring
+layout(std140, binding=0) uniform frame_data {
+	mat4 mvp;
+};
+
+// per draw data of a multi draw, ICG_MDI_DRAW_BINDING
+layout(std430, binding=1) readonly buffer draw_data {
+	mat4 models[];
+};
+
+void main()
+{
+	// mvp is the view projection here, every draw brings its model matrix
+	gl_Position = mvp * models[gl_DrawIDARB] * vec4(pos, 1);
+}
\ No newline at end of file
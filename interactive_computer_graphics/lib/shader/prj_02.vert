@@ -1,8 +1,11 @@
-#version 460 core
+#version 450 core
 
 layout(location=0) in vec3 pos;
 
-uniform mat4 mvp;
+// per frame data, a range of the upload ring
+layout(std140, binding=0) uniform frame_data {
+	mat4 mvp;
+};
 
 void main()
 {
@@ -0,0 +1,15 @@
+#version 450 core
+
+layout(location=0) in vec3 pos;
+layout(location=1) in mat4 model;
+
+// per frame data, a range of the upload ring
+layout(std140, binding=0) uniform frame_data {
+	mat4 mvp;
+};
+
+void main()
+{
+	// mvp is the view projection here, every instance brings its model matrix
+	gl_Position = mvp * model * vec4(pos, 1);
+}
\ No newline at end of file
@@ -0,0 +1,491 @@
+// shader hot reload
+//
+// the reload thread sleeps in poll() on an inotify descriptor of the shader directory and a pipe (requests
+// and stop). Events are collected until the directory is quiet for a moment, editors write a file in
+// several steps. A rebuilt program is published with a fence of the reload context, the render thread
+// takes it under the lock once the fence is signaled, so it never sees a half linked program.
+
+#include <icg/shader_reload.h>
+#include <icg/log.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define ICG_SHADER_RELOAD_MAX 16
+
+// quiet time of the directory before a rebuild, ms
+#define ICG_SHADER_RELOAD_DEBOUNCE_MS 50
+
+// completion poll of a parallel compile, ns
+#define ICG_SHADER_RELOAD_POLL_NS 1000000
+
+// pipe commands
+#define ICG_SHADER_RELOAD_CMD_ALL 'r'
+#define ICG_SHADER_RELOAD_CMD_STOP 'q'
+
+struct icg_shader_reload_entry {
+	struct shader_prog *prog;
+	const char *vertex_name;
+	const char *fragment_name;
+	int dirty;		// reload thread only
+
+	// published by the reload thread, taken by the render thread, under the lock
+	GLuint pending;
+	GLsync fence;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_t thread;
+	int running;
+	int inotify;
+	int wake[2];
+	const char *dir;
+	icg_shader_reload_bind bind;
+	void *ctx;
+
+	struct icg_shader_reload_entry entries[ICG_SHADER_RELOAD_MAX];
+	unsigned int nr_entries;
+	atomic_int nr_pending;
+} icg_reload = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.inotify = -1,
+	.wake = {-1, -1},
+};
+
+// \return the file as a string or NULL
+static char *icg_shader_reload_read(const char *name)
+{
+	char path[4096];
+	struct stat st;
+	char *code = NULL;
+	ssize_t n = 0, r;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", icg_reload.dir, name);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		icg_log_error("open('%s') fail: %s (%d)\n", path, strerror(errno), errno);
+		return NULL;
+	}
+
+	if (fstat(fd, &st)) {
+		icg_log_error("fstat('%s') fail: %s (%d)\n", path, strerror(errno), errno);
+		goto out;
+	}
+
+	code = malloc(st.st_size + 1);
+	if (!code) {
+		icg_log_error("malloc() fail\n");
+		goto out;
+	}
+
+	while (n < st.st_size) {
+		r = read(fd, code + n, st.st_size - n);
+		if (r <= 0)
+			break;
+		n += r;
+	}
+
+	code[n] = 0;
+out:
+	close(fd);
+	return code;
+}
+
+static void icg_shader_reload_info_log(GLuint object, const char *name)
+{
+	GLint len = 0;
+	GLchar *log;
+
+	if (glIsShader(object))
+		glGetShaderiv(object, GL_INFO_LOG_LENGTH, &len);
+	else
+		glGetProgramiv(object, GL_INFO_LOG_LENGTH, &len);
+
+	if (len <= 0) {
+		icg_log_error("%s: unknown\n", name);
+		return;
+	}
+
+	log = malloc(len + 1);
+	if (!log) {
+		icg_log_error("malloc(%d) fail\n", len + 1);
+		return;
+	}
+
+	if (glIsShader(object))
+		glGetShaderInfoLog(object, len, NULL, log);
+	else
+		glGetProgramInfoLog(object, len, NULL, log);
+
+	// a shader log ends with a newline, a program log may not
+	log[len] = 0;
+	while (len > 0 && (!log[len - 1] || log[len - 1] == '\n'))
+		log[--len] = 0;
+
+	icg_log_error("%s: %s\n", name, log);
+	free(log);
+}
+
+// both shaders are compiled and the program is linked before any status is asked for, a driver with
+// GL_KHR_parallel_shader_compile works on them in its own threads meanwhile
+// \return a linked program or 0
+static GLuint icg_shader_reload_build(const char *vertex_code, const char *fragment_code,
+				      const struct icg_shader_reload_entry *e)
+{
+	const struct timespec ts = {0, ICG_SHADER_RELOAD_POLL_NS};
+	GLuint vs, fs, prog;
+	GLint val = GL_FALSE;
+
+	vs = glCreateShader(GL_VERTEX_SHADER);
+	fs = glCreateShader(GL_FRAGMENT_SHADER);
+	prog = glCreateProgram();
+
+	glShaderSource(vs, 1, &vertex_code, NULL);
+	glShaderSource(fs, 1, &fragment_code, NULL);
+	glCompileShader(vs);
+	glCompileShader(fs);
+
+	glAttachShader(prog, vs);
+	glAttachShader(prog, fs);
+	glLinkProgram(prog);
+
+	if (GLAD_GL_KHR_parallel_shader_compile) {
+		while (glGetProgramiv(prog, GL_COMPLETION_STATUS_KHR, &val), val == GL_FALSE)
+			nanosleep(&ts, NULL);
+	}
+
+	glGetProgramiv(prog, GL_LINK_STATUS, &val);
+	if (val == GL_FALSE) {
+		glGetShaderiv(vs, GL_COMPILE_STATUS, &val);
+		if (val == GL_FALSE)
+			icg_shader_reload_info_log(vs, e->vertex_name);
+
+		glGetShaderiv(fs, GL_COMPILE_STATUS, &val);
+		if (val == GL_FALSE)
+			icg_shader_reload_info_log(fs, e->fragment_name);
+
+		icg_shader_reload_info_log(prog, "glLinkProgram() fail");
+		glDeleteProgram(prog);
+		prog = 0;
+	}
+
+	// a linked program does not need its shaders
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	return prog;
+}
+
+static void icg_shader_reload_rebuild(struct icg_shader_reload_entry *e)
+{
+	double started_at = icg_time_ms();
+	char *vertex_code, *fragment_code;
+	GLuint prog = 0;
+	GLsync fence;
+
+	vertex_code = icg_shader_reload_read(e->vertex_name);
+	fragment_code = icg_shader_reload_read(e->fragment_name);
+
+	if (vertex_code && fragment_code)
+		prog = icg_shader_reload_build(vertex_code, fragment_code, e);
+
+	free(vertex_code);
+	free(fragment_code);
+
+	if (!prog) {
+		icg_log_warn("shader reload %s + %s fail, program kept\n", e->vertex_name, e->fragment_name);
+		return;
+	}
+
+	// commands of this context reach the gpu, the render context waits for the fence w/o a flush
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+
+	pthread_mutex_lock(&icg_reload.lock);
+
+	// a program not taken yet is outdated
+	if (e->pending) {
+		glDeleteProgram(e->pending);
+		glDeleteSync(e->fence);
+	} else {
+		atomic_fetch_add(&icg_reload.nr_pending, 1);
+	}
+
+	e->pending = prog;
+	e->fence = fence;
+
+	pthread_mutex_unlock(&icg_reload.lock);
+
+	icg_log_info("shader reload %s + %s built in %.3fms\n", e->vertex_name, e->fragment_name,
+		     icg_time_ms() - started_at);
+}
+
+// mark the programs of a changed file
+static void icg_shader_reload_events(void)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	ssize_t n;
+
+	while ((n = read(icg_reload.inotify, buf, sizeof(buf))) > 0) {
+		for (char *p = buf; p < buf + n; p += sizeof(*ev) + ev->len) {
+			ev = (const struct inotify_event *)p;
+			if (!ev->len)
+				continue;
+
+			pthread_mutex_lock(&icg_reload.lock);
+
+			for (unsigned int i = 0; i < icg_reload.nr_entries; i++) {
+				struct icg_shader_reload_entry *e = &icg_reload.entries[i];
+
+				if (!strcmp(ev->name, e->vertex_name) || !strcmp(ev->name, e->fragment_name))
+					e->dirty = 1;
+			}
+
+			pthread_mutex_unlock(&icg_reload.lock);
+		}
+	}
+}
+
+static void *icg_shader_reload_thread(void *arg)
+{
+	struct pollfd fds[2];
+	int dirty = 0, r;
+	unsigned int n;
+	char cmd;
+
+	(void)arg;
+
+	if (icg_reload.bind(icg_reload.ctx)) {
+		icg_log_error("shader reload context fail, reload is off\n");
+		return NULL;
+	}
+
+	// as many compiler threads as the driver likes
+	if (GLAD_GL_KHR_parallel_shader_compile)
+		glMaxShaderCompilerThreadsKHR(0xffffffff);
+
+	fds[0].fd = icg_reload.inotify;
+	fds[0].events = POLLIN;
+	fds[1].fd = icg_reload.wake[0];
+	fds[1].events = POLLIN;
+
+	for (;;) {
+		r = poll(fds, 2, dirty ? ICG_SHADER_RELOAD_DEBOUNCE_MS : -1);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+
+			icg_log_error("poll() fail: %s (%d)\n", strerror(errno), errno);
+			break;
+		}
+
+		if (fds[1].revents & POLLIN) {
+			if (read(icg_reload.wake[0], &cmd, 1) != 1 || cmd == ICG_SHADER_RELOAD_CMD_STOP)
+				break;
+
+			// a request does not wait for a quiet directory
+			pthread_mutex_lock(&icg_reload.lock);
+			for (unsigned int i = 0; i < icg_reload.nr_entries; i++)
+				icg_reload.entries[i].dirty = 1;
+			pthread_mutex_unlock(&icg_reload.lock);
+
+			r = 0;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			icg_shader_reload_events();
+			dirty = 1;
+			continue;
+		}
+
+		if (r)
+			continue;
+
+		// quiet, entries below the count taken under the lock are complete and stay, rebuilds happen w/o it
+		dirty = 0;
+
+		pthread_mutex_lock(&icg_reload.lock);
+		n = icg_reload.nr_entries;
+		pthread_mutex_unlock(&icg_reload.lock);
+
+		for (unsigned int i = 0; i < n; i++) {
+			struct icg_shader_reload_entry *e = &icg_reload.entries[i];
+
+			pthread_mutex_lock(&icg_reload.lock);
+			r = e->dirty;
+			e->dirty = 0;
+			pthread_mutex_unlock(&icg_reload.lock);
+
+			if (r)
+				icg_shader_reload_rebuild(e);
+		}
+	}
+
+	icg_reload.bind(NULL);
+	return NULL;
+}
+
+int icg_shader_reload_init(icg_shader_reload_bind bind, void *ctx)
+{
+	int r;
+
+	icg_reload.dir = getenv("ICG_SHADER_DIR");
+	if (!icg_reload.dir || !*icg_reload.dir)
+		icg_reload.dir = ICG_SHADER_DIR;
+
+	icg_reload.bind = bind;
+	icg_reload.ctx = ctx;
+
+	if (pipe(icg_reload.wake)) {
+		r = errno;
+		icg_log_error("pipe() fail: %s (%d)\n", strerror(r), r);
+		return r;
+	}
+
+	// w/o inotify reload still works on request
+	icg_reload.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (icg_reload.inotify < 0) {
+		icg_log_warn("inotify_init1() fail: %s (%d)\n", strerror(errno), errno);
+	} else if (inotify_add_watch(icg_reload.inotify, icg_reload.dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		icg_log_warn("inotify_add_watch('%s') fail: %s (%d)\n", icg_reload.dir, strerror(errno), errno);
+		close(icg_reload.inotify);
+		icg_reload.inotify = -1;
+	}
+
+	r = pthread_create(&icg_reload.thread, NULL, icg_shader_reload_thread, NULL);
+	if (r) {
+		icg_log_error("pthread_create() fail: %s (%d)\n", strerror(r), r);
+		icg_shader_reload_clean();
+		return r;
+	}
+
+	icg_reload.running = 1;
+	icg_log_info("shader reload watches '%s', F6 rebuilds\n", icg_reload.dir);
+	return 0;
+}
+
+int icg_shader_reload_watch(struct shader_prog *prog, const char *vertex_name, const char *fragment_name)
+{
+	struct icg_shader_reload_entry *e;
+	int r = 0;
+
+	pthread_mutex_lock(&icg_reload.lock);
+
+	if (icg_reload.nr_entries < ICG_SHADER_RELOAD_MAX) {
+		e = &icg_reload.entries[icg_reload.nr_entries];
+		memset(e, 0, sizeof(*e));
+		e->prog = prog;
+		e->vertex_name = vertex_name;
+		e->fragment_name = fragment_name;
+		icg_reload.nr_entries++;
+	} else {
+		icg_log_error("shader reload: more than %d programs\n", ICG_SHADER_RELOAD_MAX);
+		r = ENOSPC;
+	}
+
+	pthread_mutex_unlock(&icg_reload.lock);
+	return r;
+}
+
+void icg_shader_reload_request(void)
+{
+	char cmd = ICG_SHADER_RELOAD_CMD_ALL;
+
+	if (icg_reload.running && write(icg_reload.wake[1], &cmd, 1) != 1)
+		icg_log_error("shader reload request fail: %s (%d)\n", strerror(errno), errno);
+}
+
+int icg_shader_reload_poll(void)
+{
+	int nr_swapped = 0, nr_left = 0;
+	GLenum r;
+
+	// the usual frame, nothing pending, no lock
+	if (!atomic_load_explicit(&icg_reload.nr_pending, memory_order_acquire))
+		return 0;
+
+	pthread_mutex_lock(&icg_reload.lock);
+
+	for (unsigned int i = 0; i < icg_reload.nr_entries; i++) {
+		struct icg_shader_reload_entry *e = &icg_reload.entries[i];
+
+		if (!e->pending)
+			continue;
+
+		r = glClientWaitSync(e->fence, 0, 0);
+		if (r == GL_TIMEOUT_EXPIRED) {
+			nr_left++;
+			continue;
+		}
+
+		glDeleteSync(e->fence);
+
+		if (r == GL_WAIT_FAILED) {
+			icg_log_error("glClientWaitSync() fail: 0x%x\n", glGetError());
+			glDeleteProgram(e->pending);
+		} else {
+			// the shaders of the old program go with it, the new one has none attached
+			shader_prog_clean(e->prog);
+			e->prog->prog = e->pending;
+			nr_swapped++;
+		}
+
+		e->pending = 0;
+		e->fence = NULL;
+	}
+
+	atomic_store(&icg_reload.nr_pending, nr_left);
+	pthread_mutex_unlock(&icg_reload.lock);
+
+	return nr_swapped;
+}
+
+void icg_shader_reload_clean(void)
+{
+	char cmd = ICG_SHADER_RELOAD_CMD_STOP;
+
+	if (icg_reload.running) {
+		if (write(icg_reload.wake[1], &cmd, 1) != 1)
+			icg_log_error("shader reload stop fail: %s (%d)\n", strerror(errno), errno);
+		else
+			pthread_join(icg_reload.thread, NULL);
+		icg_reload.running = 0;
+	}
+
+	for (unsigned int i = 0; i < icg_reload.nr_entries; i++) {
+		struct icg_shader_reload_entry *e = &icg_reload.entries[i];
+
+		if (e->pending) {
+			glDeleteProgram(e->pending);
+			glDeleteSync(e->fence);
+		}
+	}
+
+	icg_reload.nr_entries = 0;
+	atomic_store(&icg_reload.nr_pending, 0);
+
+	if (icg_reload.inotify >= 0)
+		close(icg_reload.inotify);
+
+	for (int i = 0; i < 2; i++) {
+		if (icg_reload.wake[i] >= 0)
+			close(icg_reload.wake[i]);
+		icg_reload.wake[i] = -1;
+	}
+
+	icg_reload.inotify = -1;
+}
@@ -3,27 +3,639 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <icg/log.h>
+
 #include "wavefront_obj.h"
+#include "wf_obj_internal.h"
+#include "wf_scan.h"
+
+// first allocation of a stream, elements
+#define WF_OBJ_MIN_CAPACITY 1024
+
+// smallest text chunk worth a thread, bytes
+#define WF_OBJ_MIN_CHUNK (256 * 1024)
+
+static void *wf_default_realloc(void *, void *ptr, size_t size)
+{
+	if (!size) {
+		free(ptr);
+		return NULL;
+	}
+
+	return realloc(ptr, size);
+}
+
+static const struct wf_allocator wf_default_allocator = {
+	.realloc = wf_default_realloc,
+};
+
+// zeroed object (w/o wf_obj_init()) uses the default allocator
+static inline const struct wf_allocator *wf_obj_allocator(struct wf_obj *o)
+{
+	return o->allocator ? o->allocator : &wf_default_allocator;
+}
 
 // init obj file
 void wf_obj_init(struct wf_obj *o)
+{
+	wf_obj_init_allocator(o, &wf_default_allocator);
+}
+
+void wf_obj_init_allocator(struct wf_obj *o, const struct wf_allocator *allocator)
 {
 	memset(o, 0, sizeof(*o));
+	o->allocator = allocator ? allocator : &wf_default_allocator;
+}
+
+// resize stream to hold exactly nr elements, never shrinks
+static int wf_obj_reserve(struct wf_obj *o, void **stream, unsigned int *cap, size_t nr, size_t elem_size)
+{
+	const struct wf_allocator *a = wf_obj_allocator(o);
+	void *p;
+
+	if (nr <= *cap)
+		return 0;
+
+	if (nr > (unsigned int)-1) {
+		icg_log_error("stream overflow: %zu elements\n", nr);
+		return EOVERFLOW;
+	}
+
+	p = a->realloc(a->ctx, *stream, nr * elem_size);
+	if (!p) {
+		icg_log_error("realloc(%zu) fail\n", nr * elem_size);
+		return ENOMEM;
+	}
+
+	o->stats.nr_allocs++;
+	o->stats.bytes += (nr - *cap) * elem_size;
+
+	*stream = p;
+	*cap = nr;
+
+	return 0;
+}
+
+// capacity doubles so n pushes cost O(log n) allocations
+static int wf_obj_grow(struct wf_obj *o, void **stream, unsigned int *cap, size_t elem_size)
+{
+	size_t nr = *cap ? (size_t)*cap * 2 : WF_OBJ_MIN_CAPACITY;
+
+	if (o->flags & WF_OBJ_FIXED)
+		return EOVERFLOW;
+
+	if (nr > (unsigned int)-1 && *cap < (unsigned int)-1)
+		nr = (unsigned int)-1;
+
+	return wf_obj_reserve(o, stream, cap, nr, elem_size);
+}
+
+static void wf_obj_release(struct wf_obj *o, void *stream)
+{
+	const struct wf_allocator *a = wf_obj_allocator(o);
+
+	if (stream)
+		a->realloc(a->ctx, stream, 0);
+}
+
+// \return a new element at the end of a stream
+static inline int wf_obj_push(struct wf_obj *o, void **stream, unsigned int *nr, unsigned int *cap, size_t elem_size, void **elem)
+{
+	int r;
+
+	if (*nr == *cap) {
+		r = wf_obj_grow(o, stream, cap, elem_size);
+		if (r)
+			return r;
+	}
+
+	*elem = (char *)*stream + (size_t)(*nr)++ * elem_size;
+	return 0;
+}
+
+#define WF_OBJ_PUSH(o, stream, nr, cap, elem) \
+	wf_obj_push((o), (void **)&(o)->stream, &(o)->nr, &(o)->cap, sizeof(*(o)->stream), (void **)(elem))
+
+// a part of the text starting at a line boundary, parsed by a thread
+struct wf_obj_chunk {
+	const char *begin, *end;
+	struct wf_obj_counts counts;	// records of the chunk
+	struct wf_obj_counts base;	// records of all previous chunks
+	struct wf_obj view;		// the chunk slots in the final streams
+	struct wf_obj_error err;
+	int r;
+};
+
+enum wf_obj_record {
+	WF_OBJ_RECORD_NONE,
+	WF_OBJ_RECORD_V,
+	WF_OBJ_RECORD_VT,
+	WF_OBJ_RECORD_VN,
+	WF_OBJ_RECORD_F,
+};
+
+// record type of a line, p points to the first non blank character, args is set after the keyword
+static inline enum wf_obj_record wf_obj_record(const char *p, const char *end, const char **args)
+{
+	if (end - p < 2)
+		return WF_OBJ_RECORD_NONE;
+
+	if (p[0] == 'v') {
+		if (wf_scan_is_blank(p[1])) {
+			*args = p + 1;
+			return WF_OBJ_RECORD_V;
+		}
+
+		if (end - p < 3 || !wf_scan_is_blank(p[2]))
+			return WF_OBJ_RECORD_NONE;
+
+		*args = p + 2;
+
+		if (p[1] == 't')
+			return WF_OBJ_RECORD_VT;
+
+		if (p[1] == 'n')
+			return WF_OBJ_RECORD_VN;
+	} else if (p[0] == 'f' && wf_scan_is_blank(p[1])) {
+		*args = p + 1;
+		return WF_OBJ_RECORD_F;
+	}
+
+	return WF_OBJ_RECORD_NONE;
+}
+
+// number of triangle corners of a face after fan triangulation
+static inline size_t wf_obj_face_corners(size_t nr_tokens)
+{
+	return nr_tokens < 3 ? 0 : (nr_tokens - 2) * 3;
+}
+
+void wf_obj_count(const char *p, const char *end, struct wf_obj_counts *c)
+{
+	const char *args;
+	size_t nr_tokens;
+
+	memset(c, 0, sizeof(*c));
+
+	for (; p < end; p = wf_scan_next_line(p, end), c->nr_lines++) {
+		p = wf_scan_skip_blank(p, end);
+
+		switch (wf_obj_record(p, end, &args)) {
+		case WF_OBJ_RECORD_V:
+			c->nr_vertices++;
+			break;
+		case WF_OBJ_RECORD_VT:
+			c->nr_texcoords++;
+			break;
+		case WF_OBJ_RECORD_VN:
+			c->nr_normals++;
+			break;
+		case WF_OBJ_RECORD_F:
+			for (p = args, nr_tokens = 0; p < end && *p != '\n'; nr_tokens++) {
+				p = wf_scan_skip_blank(p, end);
+				if (p == end || *p == '\n')
+					break;
+
+				while (!wf_scan_is_token_end(p, end))
+					p++;
+			}
+
+			c->nr_corners += wf_obj_face_corners(nr_tokens);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+// parse min..max floats, missing optional ones are zero
+static const char *wf_obj_parse_floats(const char *p, const char *end, float *v, int min, int max)
+{
+	int i;
+
+	for (i = 0; i < max; i++) {
+		p = wf_scan_skip_blank(p, end);
+		if (i >= min && (p == end || *p == '\n'))
+			break;
+
+		p = wf_scan_float(p, end, &v[i]);
+		if (!p || !wf_scan_is_token_end(p, end))
+			return NULL;
+	}
+
+	for (; i < max; i++)
+		v[i] = 0.0f;
+
+	return p;
+}
+
+// 1-based absolute or negative (-1 is the last defined one) index to 0-based
+static inline int wf_obj_resolve(long i, size_t nr_defined, int *idx)
+{
+	if (i > 0 && i <= 0x7fffffffL) {
+		*idx = i - 1;
+		return 0;
+	}
+
+	if (i < 0 && (size_t)-i <= nr_defined) {
+		*idx = nr_defined + i;
+		return 0;
+	}
+
+	return EINVAL;
+}
+
+// parse "v", "v/vt", "v//vn" or "v/vt/vn" face corner, defined is records before the line
+static const char *wf_obj_parse_corner(const char *p, const char *end, const struct wf_obj_counts *defined, struct wf_index *c)
+{
+	long i;
+
+	c->vt = c->vn = -1;
+
+	p = wf_scan_int(p, end, &i);
+	if (!p || wf_obj_resolve(i, defined->nr_vertices, &c->v))
+		return NULL;
+
+	if (p < end && *p == '/') {
+		p++;
+		if (p < end && *p != '/') {
+			p = wf_scan_int(p, end, &i);
+			if (!p || wf_obj_resolve(i, defined->nr_texcoords, &c->vt))
+				return NULL;
+		}
+
+		if (p < end && *p == '/') {
+			p = wf_scan_int(p + 1, end, &i);
+			if (!p || wf_obj_resolve(i, defined->nr_normals, &c->vn))
+				return NULL;
+		}
+	}
+
+	return wf_scan_is_token_end(p, end) ? p : NULL;
+}
+
+// parse "f" record and triangulate it as a fan around the first corner
+static const char *wf_obj_parse_face(const char *p, const char *end, struct wf_obj *o, const struct wf_obj_counts *defined, int *r)
+{
+	struct wf_index first, prev, c, *t;
+	int n;
+
+	*r = EINVAL;
+
+	for (n = 0; ; n++) {
+		p = wf_scan_skip_blank(p, end);
+		if (p == end || *p == '\n')
+			break;
+
+		p = wf_obj_parse_corner(p, end, defined, &c);
+		if (!p)
+			return NULL;
+
+		if (n >= 2) {
+			*r = WF_OBJ_PUSH(o, corners, nr_corners, cap_corners, &t);
+			if (*r)
+				return NULL;
+
+			t[0] = first;
+
+			*r = WF_OBJ_PUSH(o, corners, nr_corners, cap_corners, &t);
+			if (*r)
+				return NULL;
+
+			t[0] = prev;
+
+			*r = WF_OBJ_PUSH(o, corners, nr_corners, cap_corners, &t);
+			if (*r)
+				return NULL;
+
+			t[0] = c;
+		} else if (!n) {
+			first = c;
+		}
+
+		prev = c;
+	}
+
+	*r = n < 3 ? EINVAL : 0;
+	return *r ? NULL : p;
+}
+
+int wf_obj_parse_range(const char **cursor, const char *end, struct wf_obj *o,
+		       const struct wf_obj_counts *base, struct wf_obj_error *err)
+{
+	struct wf_obj_counts defined = *base;
+	const char *p = *cursor, *line;
+	unsigned int nr_vertices, nr_texcoords, nr_normals, nr_corners;
+	struct wf_vertex *v;
+	struct wf_texcoord *vt;
+	struct wf_normal *vn;
+	const char *args;
+	int r = 0;
+
+	for (; p < end; p = wf_scan_next_line(p, end), err->line++) {
+		line = p;
+		p = wf_scan_skip_blank(p, end);
+
+		// a fixed view rolls the line back on overflow
+		nr_vertices = o->nr_vertices;
+		nr_texcoords = o->nr_texcoords;
+		nr_normals = o->nr_normals;
+		nr_corners = o->nr_corners;
+
+		switch (wf_obj_record(p, end, &args)) {
+		case WF_OBJ_RECORD_V:
+			err->what = "vertex";
+			r = WF_OBJ_PUSH(o, vertices, nr_vertices, cap_vertices, &v);
+			if (!r)
+				p = wf_obj_parse_floats(args, end, &v->x, 3, 3);
+			break;
+		case WF_OBJ_RECORD_VT:
+			err->what = "texcoord";
+			r = WF_OBJ_PUSH(o, texcoords, nr_texcoords, cap_texcoords, &vt);
+			if (!r)
+				p = wf_obj_parse_floats(args, end, &vt->u, 1, 2);
+			break;
+		case WF_OBJ_RECORD_VN:
+			err->what = "normal";
+			r = WF_OBJ_PUSH(o, normals, nr_normals, cap_normals, &vn);
+			if (!r)
+				p = wf_obj_parse_floats(args, end, &vn->x, 3, 3);
+			break;
+		case WF_OBJ_RECORD_F:
+			err->what = "face";
+			defined.nr_vertices = base->nr_vertices + o->nr_vertices;
+			defined.nr_texcoords = base->nr_texcoords + o->nr_texcoords;
+			defined.nr_normals = base->nr_normals + o->nr_normals;
+			p = wf_obj_parse_face(args, end, o, &defined, &r);
+			break;
+		default:
+			continue;
+		}
+
+		if (r == EOVERFLOW && (o->flags & WF_OBJ_FIXED)) {
+			o->nr_vertices = nr_vertices;
+			o->nr_texcoords = nr_texcoords;
+			o->nr_normals = nr_normals;
+			o->nr_corners = nr_corners;
+		}
+
+		if (r || !p) {
+			*cursor = line;
+			return r ? r : EINVAL;
+		}
+	}
+
+	*cursor = p;
+	return 0;
+}
+
+static void *wf_obj_count_worker(void *arg)
+{
+	struct wf_obj_chunk *c = arg;
+
+	wf_obj_count(c->begin, c->end, &c->counts);
+	return NULL;
+}
+
+static void *wf_obj_parse_worker(void *arg)
+{
+	struct wf_obj_chunk *c = arg;
+	const char *p = c->begin;
+
+	c->err.line = c->base.nr_lines + 1;
+	c->r = wf_obj_parse_range(&p, c->end, &c->view, &c->base, &c->err);
+	return NULL;
+}
+
+// run fn over all chunks, the first one on the calling thread
+static void wf_obj_run(struct wf_obj_chunk *chunks, unsigned int nr_chunks, void *(*fn)(void *))
+{
+	pthread_t threads[nr_chunks];
+	int started[nr_chunks];
+
+	for (unsigned int i = 1; i < nr_chunks; i++) {
+		started[i] = !pthread_create(&threads[i], NULL, fn, &chunks[i]);
+		if (!started[i])
+			fn(&chunks[i]);
+	}
+
+	fn(&chunks[0]);
+
+	for (unsigned int i = 1; i < nr_chunks; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+	}
+}
+
+// reserve all streams to hold exactly the counted records
+static int wf_obj_reserve_all(struct wf_obj *o, const struct wf_obj_counts *c)
+{
+	int r;
+
+	r = wf_obj_reserve(o, (void **)&o->vertices, &o->cap_vertices, c->nr_vertices, sizeof(*o->vertices));
+	if (r)
+		return r;
+
+	r = wf_obj_reserve(o, (void **)&o->texcoords, &o->cap_texcoords, c->nr_texcoords, sizeof(*o->texcoords));
+	if (r)
+		return r;
+
+	r = wf_obj_reserve(o, (void **)&o->normals, &o->cap_normals, c->nr_normals, sizeof(*o->normals));
+	if (r)
+		return r;
+
+	return wf_obj_reserve(o, (void **)&o->corners, &o->cap_corners, c->nr_corners, sizeof(*o->corners));
+}
+
+static void wf_obj_counts_add(struct wf_obj_counts *a, const struct wf_obj_counts *b)
+{
+	a->nr_lines += b->nr_lines;
+	a->nr_vertices += b->nr_vertices;
+	a->nr_texcoords += b->nr_texcoords;
+	a->nr_normals += b->nr_normals;
+	a->nr_corners += b->nr_corners;
+}
+
+static void wf_obj_counts_of(struct wf_obj_counts *c, const struct wf_obj *o)
+{
+	c->nr_lines = 0;
+	c->nr_vertices = o->nr_vertices;
+	c->nr_texcoords = o->nr_texcoords;
+	c->nr_normals = o->nr_normals;
+	c->nr_corners = o->nr_corners;
+}
+
+void wf_obj_print_error(int r, const struct wf_obj_error *err)
+{
+	if (r == EINVAL)
+		icg_log_error("wrong %s format at line=%zu\n", err->what, err->line);
+}
+
+// split at line boundaries, count records per chunk, prefix sum the counts
+// to reserve the streams once, then parse every chunk right into its slots
+static int wf_obj_parse_mt(const char *data, size_t size, struct wf_obj *o, unsigned int nr_chunks)
+{
+	struct wf_obj_chunk chunks[nr_chunks];
+	struct wf_obj_counts total;
+	const char *p = data, *end = data + size;
+	unsigned int i;
+	int r;
+
+	memset(chunks, 0, sizeof(chunks));
+
+	for (i = 0; i < nr_chunks; i++) {
+		chunks[i].begin = p;
+		p = i + 1 < nr_chunks ? data + size / nr_chunks * (i + 1) : end;
+		if (p < chunks[i].begin)
+			p = chunks[i].begin;
+		if (p > data && p < end && p[-1] != '\n')
+			p = wf_scan_next_line(p, end);
+		chunks[i].end = p;
+	}
+
+	wf_obj_run(chunks, nr_chunks, wf_obj_count_worker);
+
+	wf_obj_counts_of(&total, o);
+
+	for (i = 0; i < nr_chunks; i++) {
+		chunks[i].base = total;
+		wf_obj_counts_add(&total, &chunks[i].counts);
+	}
+
+	r = wf_obj_reserve_all(o, &total);
+	if (r)
+		return r;
+
+	for (i = 0; i < nr_chunks; i++) {
+		struct wf_obj *v = &chunks[i].view;
+		struct wf_obj_counts *b = &chunks[i].base, *c = &chunks[i].counts;
+
+		v->flags = WF_OBJ_FIXED;
+		v->vertices = o->vertices + b->nr_vertices;
+		v->cap_vertices = c->nr_vertices;
+		v->texcoords = o->texcoords + b->nr_texcoords;
+		v->cap_texcoords = c->nr_texcoords;
+		v->normals = o->normals + b->nr_normals;
+		v->cap_normals = c->nr_normals;
+		v->corners = o->corners + b->nr_corners;
+		v->cap_corners = c->nr_corners;
+	}
+
+	wf_obj_run(chunks, nr_chunks, wf_obj_parse_worker);
+
+	// report the first error in file order
+	for (i = 0; i < nr_chunks; i++) {
+		if (chunks[i].r) {
+			wf_obj_print_error(chunks[i].r, &chunks[i].err);
+			return chunks[i].r;
+		}
+	}
+
+	o->nr_vertices = total.nr_vertices;
+	o->nr_texcoords = total.nr_texcoords;
+	o->nr_normals = total.nr_normals;
+	o->nr_corners = total.nr_corners;
+
+	return 0;
+}
+
+int wf_obj_parse(const char *data, size_t size, struct wf_obj *o)
+{
+	struct wf_obj_counts base = {0}, counts, total;
+	unsigned int nr_chunks = o->nr_threads;
+	struct wf_obj_error err = {.line = 1};
+	const char *p = data;
+	int r;
+
+	if (nr_chunks > size / WF_OBJ_MIN_CHUNK)
+		nr_chunks = size / WF_OBJ_MIN_CHUNK;
+
+	if (nr_chunks > 1)
+		return wf_obj_parse_mt(data, size, o, nr_chunks);
+
+	if (o->flags & WF_OBJ_PRESIZE) {
+		wf_obj_count(data, data + size, &counts);
+		wf_obj_counts_of(&total, o);
+		wf_obj_counts_add(&total, &counts);
+
+		r = wf_obj_reserve_all(o, &total);
+		if (r)
+			return r;
+	}
+
+	r = wf_obj_parse_range(&p, data + size, o, &base, &err);
+	wf_obj_print_error(r, &err);
+
+	return r;
 }
 
 // load from obj file
 int wf_obj_load(const char *filename, struct wf_obj *o)
+{
+	int r = 0, fd;
+	struct stat st;
+	void *data = NULL;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		r = errno;
+		icg_log_error("open('%s') fail: %s (%d)\n", filename, strerror(r), r);
+		return r;
+	}
+
+	if (fstat(fd, &st)) {
+		r = errno;
+		icg_log_error("fstat('%s') fail: %s (%d)\n", filename, strerror(r), r);
+		goto out;
+	}
+
+	// nothing to map, an empty obj is a valid one
+	if (!st.st_size)
+		goto out;
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		r = errno;
+		data = NULL;
+		icg_log_error("mmap('%s') fail: %s (%d)\n", filename, strerror(r), r);
+		goto out;
+	}
+
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	r = wf_obj_parse(data, st.st_size, o);
+
+out:
+	if (data)
+		munmap(data, st.st_size);
+
+	close(fd);
+
+	if (r)
+		wf_obj_clean(o);
+
+	return r;
+}
+
+// legacy fgets/sscanf loader of vertices only, kept as a reference for the benchmark
+int wf_obj_load_stdio(const char *filename, struct wf_obj *o)
 {
 	int r = 0, l = 1, scan;
 	char line[256];
 	FILE *file;
 	float a, b, c;
-	void *p;
+	struct wf_vertex *v;
 
 	file = fopen(filename, "r");
 	if (!file) {
 		r = errno;
-		fprintf(stderr, "fopen('%s') fail: %s (%d)\n", filename, strerror(r), r);
+		icg_log_error("fopen('%s') fail: %s (%d)\n", filename, strerror(r), r);
 		return r;
 	}
 
@@ -31,29 +643,25 @@ int wf_obj_load(const char *filename, struct wf_obj *o)
 		if (strncmp(line, "v ", 2) == 0) {
 			scan = sscanf(line, "v %f %f %f", &a, &b, &c);
 			if (scan != 3) {
-				fprintf(stderr, "wrong vertex format at line=%d\n", l);
+				icg_log_error("wrong vertex format at line=%d\n", l);
 				r = EINVAL;
 				goto fail;
 			}
 
-			p = realloc(o->vertices, (o->nr_vertices + 1) * sizeof(*o->vertices));;
-			if (!p) {
-				fprintf(stderr, "realloc() fail\n");
-				r = ENOMEM;
+			r = WF_OBJ_PUSH(o, vertices, nr_vertices, cap_vertices, &v);
+			if (r)
 				goto fail;
-			}
 
-			o->vertices = p;
-			o->vertices[o->nr_vertices].x = a;
-			o->vertices[o->nr_vertices].y = b;
-			o->vertices[o->nr_vertices++].z = c;
+			v->x = a;
+			v->y = b;
+			v->z = c;
 		}
 
 		l++;
 	}
 
 	if (!feof(file) && ferror(file)) {
-		fprintf(stderr, "fgets() fail\n");
+		icg_log_error("fgets() fail\n");
 		r = ferror(file);
 		goto fail;
 	}
@@ -69,15 +677,43 @@ fail:
 
 void wf_obj_dump(struct wf_obj *o)
 {
+	struct wf_index *c;
+
 	for (unsigned int i = 0; i < o->nr_vertices; i++) {
 		printf("v %f %f %f\n", o->vertices[i].x, o->vertices[i].y, o->vertices[i].z);
 	}
+
+	for (unsigned int i = 0; i < o->nr_texcoords; i++) {
+		printf("vt %f %f\n", o->texcoords[i].u, o->texcoords[i].v);
+	}
+
+	for (unsigned int i = 0; i < o->nr_normals; i++) {
+		printf("vn %f %f %f\n", o->normals[i].x, o->normals[i].y, o->normals[i].z);
+	}
+
+	// triangles, absent attributes are printed as 0
+	for (unsigned int i = 0; i + 2 < o->nr_corners; i += 3) {
+		c = &o->corners[i];
+		printf("f %d/%d/%d %d/%d/%d %d/%d/%d\n",
+		       c[0].v + 1, c[0].vt + 1, c[0].vn + 1,
+		       c[1].v + 1, c[1].vt + 1, c[1].vn + 1,
+		       c[2].v + 1, c[2].vt + 1, c[2].vn + 1);
+	}
 }
 
 void wf_obj_clean(struct wf_obj *o)
 {
-	if (o->vertices)
-		free(o->vertices);
+	const struct wf_allocator *allocator = o->allocator;
+	unsigned int flags = o->flags;
+	unsigned int nr_threads = o->nr_threads;
+
+	wf_obj_release(o, o->vertices);
+	wf_obj_release(o, o->texcoords);
+	wf_obj_release(o, o->normals);
+	wf_obj_release(o, o->corners);
 
 	memset(o, 0, sizeof(*o));
+	o->allocator = allocator;
+	o->flags = flags;
+	o->nr_threads = nr_threads;
 }
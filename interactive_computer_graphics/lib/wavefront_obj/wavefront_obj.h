@@ -2,13 +2,228 @@
 
 // https://en.wikipedia.org/wiki/Wavefront_obj_file
 
+#include <stddef.h>
+
 struct wf_vertex {
 	float x, y, z;
 };
 
+struct wf_texcoord {
+	float u, v;
+};
+
+struct wf_normal {
+	float x, y, z;
+};
+
+// triangle corner of a face, 0-based indices of v/vt/vn records, -1 if absent
+struct wf_index {
+	int v, vt, vn;
+};
+
+// user allocator, realloc(ctx, ptr, 0) must free ptr and return NULL
+struct wf_allocator {
+	void *(*realloc)(void *ctx, void *ptr, size_t size);
+	void *ctx;
+};
+
+// allocation counters, reset by wf_obj_clean()
+struct wf_obj_stats {
+	unsigned long nr_allocs;	// allocator calls which (re)allocated a block
+	size_t bytes;			// bytes reserved by all streams
+};
+
+// load flags
+#define WF_OBJ_PRESIZE (1 << 0)	// count records before parsing and allocate streams once
+#define WF_OBJ_CACHE (1 << 1)	// wf_mesh_load() uses and writes the binary sidecar <filename>.wfb
+#define WF_OBJ_CACHE_VERIFY (1 << 2)	// always check the content hash of the source, not only size and mtime
+#define WF_OBJ_OPTIMIZE (1 << 3)	// wf_mesh_load() runs wf_mesh_optimize() on a built mesh
+
+// every attribute stream is one contiguous block growing geometrically
 struct wf_obj {
 	struct wf_vertex *vertices;
 	unsigned int nr_vertices;
+	unsigned int cap_vertices;
+
+	struct wf_texcoord *texcoords;
+	unsigned int nr_texcoords;
+	unsigned int cap_texcoords;
+
+	struct wf_normal *normals;
+	unsigned int nr_normals;
+	unsigned int cap_normals;
+
+	// faces are triangulated, 3 corners per triangle
+	struct wf_index *corners;
+	unsigned int nr_corners;
+	unsigned int cap_corners;
+
+	unsigned int flags;
+	unsigned int nr_threads;	// > 1 parses chunks of the file in parallel
+	const struct wf_allocator *allocator;
+	struct wf_obj_stats stats;
+};
+
+// mesh attributes
+#define WF_MESH_TEXCOORD (1 << 0)
+#define WF_MESH_NORMAL (1 << 1)
+
+// indexed triangles with deduplicated interleaved vertices: position [texcoord] [normal]
+struct wf_mesh {
+	float *vertices;
+	unsigned int nr_vertices;
+	unsigned int stride;		// bytes
+	unsigned int attribs;		// WF_MESH_*
+	unsigned int texcoord_offset;	// bytes, valid with WF_MESH_TEXCOORD
+	unsigned int normal_offset;	// bytes, valid with WF_MESH_NORMAL
+
+	void *indices;
+	unsigned int nr_indices;
+	unsigned int index_size;	// 2 or 4 bytes
+
+	struct wf_vertex bounds_min;
+	struct wf_vertex bounds_max;
+
+	// streams point into a read only mapping of the binary cache if set
+	void *mapping;
+	size_t mapping_size;
+};
+
+#define WF_QUANT_UNORM16 (1 << 0)	// positions as unorm16 of the bounds, snorm16 of the center otherwise
+
+// quantized vertices of a mesh, the mesh index buffer is used as is:
+// position 4 x (s|u)norm16 (w is padding), [texcoord 2 x half], [normal 2 x snorm16 octahedral]
+struct wf_qmesh {
+	void *vertices;
+	unsigned int nr_vertices;
+	unsigned int stride;		// bytes
+	unsigned int attribs;		// WF_MESH_*
+	unsigned int texcoord_offset;	// bytes, valid with WF_MESH_TEXCOORD
+	unsigned int normal_offset;	// bytes, valid with WF_MESH_NORMAL
+	unsigned int flags;		// WF_QUANT_*
+
+	// dequantization, position = normalized attribute * scale + offset
+	float scale[3];
+	float offset[3];
+
+	// max error of decoded vertices: position in mesh units, texcoord in uv units, normal in degrees
+	float position_error;
+	float texcoord_error;
+	float normal_error;
+};
+
+// meshlet limits, a typical mesh shader workgroup
+#define WF_MESHLET_MAX_VERTICES 64
+#define WF_MESHLET_MAX_TRIANGLES 124
+
+// cluster of consecutive triangles of the index buffer with its bounds in mesh space
+struct wf_meshlet {
+	unsigned int vertex_offset;	// first entry of wf_meshlets.vertices
+	unsigned int triangle_offset;	// first triangle of wf_meshlets.triangles
+	unsigned int nr_vertices;
+	unsigned int nr_triangles;
+
+	// bounding sphere of the vertices
+	float center[3];
+	float radius;
+
+	// normal cone, every triangle normal n has dot(n, cone_axis) >= cos of the cone angle,
+	// cone_cutoff is the sine of it and 1 if the cone is too wide to cull anything
+	float cone_axis[3];
+	float cone_cutoff;
+};
+
+struct wf_meshlets {
+	struct wf_meshlet *meshlets;
+	unsigned int nr_meshlets;
+
+	unsigned int *vertices;		// mesh vertex indices of all meshlets
+	unsigned int nr_vertices;
+
+	unsigned char *triangles;	// 3 meshlet local vertex indices per triangle
+	unsigned int nr_triangles;
+};
+
+// levels of detail of a mesh, all levels index the vertices of the mesh
+#define WF_LOD_MAX 16
+
+struct wf_lod {
+	void *indices;
+	unsigned int nr_indices;
+	float error;		// quadric distance to the source surface, mesh units
+};
+
+struct wf_lods {
+	struct wf_lod lods[WF_LOD_MAX];	// lods[0] is the source mesh
+	unsigned int nr_lods;
+	unsigned int index_size;	// of the mesh
+	unsigned int nr_locked;		// seam and border positions which never move
+};
+
+// bvh node, 32 bytes, children of an inner node are the pair nodes[first], nodes[first + 1]
+struct wf_bvh_node {
+	float min[3];
+	unsigned int first;	// left child of an inner node, first entry of wf_bvh.triangles of a leaf
+	float max[3];
+	unsigned int count;	// triangles of a leaf, 0 for an inner node
+};
+
+// bounding volume hierarchy over triangles of a mesh, nodes[0] is the root
+struct wf_bvh {
+	struct wf_bvh_node *nodes;
+	unsigned int nr_nodes;
+
+	unsigned int *triangles;	// mesh triangles in leaf order
+	unsigned int nr_triangles;
+};
+
+struct wf_bvh_hit {
+	int triangle;		// -1 if nothing is hit
+	float distance;		// in units of the ray direction
+	float u, v;		// barycentric coordinates of corners 1 and 2
+};
+
+// positions as structure of arrays, streams are 64 byte aligned and padded to whole cache lines
+struct wf_soa {
+	float *x, *y, *z;
+	size_t count;
+};
+
+// streaming loader, records are delivered in batches and memory is bounded by a limit
+struct wf_stream {
+	int fd;
+	unsigned int flags;
+
+	char *text;			// read buffer
+	size_t text_size;
+	size_t text_begin, text_end;	// not yet parsed bytes
+	int eof;
+	size_t line;			// line number at text_begin
+
+	// records of the current batch, faces keep indices of records in the whole file
+	struct wf_obj batch;
+	size_t first_vertex;
+	size_t first_texcoord;
+	size_t first_normal;
+	size_t first_corner;
+
+	// records of the whole file, counted by wf_stream_open() with WF_OBJ_PRESIZE
+	size_t nr_vertices;
+	size_t nr_texcoords;
+	size_t nr_normals;
+	size_t nr_corners;
+};
+
+typedef int (*wf_stream_fn)(void *ctx, const struct wf_stream *s);
+
+// typical post transform vertex cache, entries
+#define WF_MESH_CACHE_SIZE 16
+
+// vertex processing efficiency of an indexed mesh, fifo post transform cache simulation
+struct wf_mesh_stats {
+	float acmr;		// transformed vertices per triangle, 0.5 is the limit of a big regular grid
+	float atvr;		// transformed vertices per referenced vertex, 1 is ideal
+	float overfetch;	// bytes fetched in 64 byte lines per referenced vertex bytes, 1 is ideal
 };
 
 #ifdef __cplusplus
@@ -18,13 +233,124 @@ extern "C" {
 // init obj file
 void wf_obj_init(struct wf_obj *o);
 
-// load from obj file
+// init obj file with a user allocator, allocator must outlive the object
+void wf_obj_init_allocator(struct wf_obj *o, const struct wf_allocator *allocator);
+
+// load from obj file, the file is memory mapped and parsed in place
 int wf_obj_load(const char *filename, struct wf_obj *o);
 
+// load from obj file using fgets/sscanf (reference implementation, lines are limited by 256 bytes)
+int wf_obj_load_stdio(const char *filename, struct wf_obj *o);
+
+// parse obj text from memory, data is not required to be zero terminated
+int wf_obj_parse(const char *data, size_t size, struct wf_obj *o);
+
+// free all streams, flags and allocator are kept so the object can be loaded again
 void wf_obj_clean(struct wf_obj *o);
 
 void wf_obj_dump(struct wf_obj *o);
 
+// open obj file for streaming, memory_limit bounds the read buffer and all batch streams (bytes),
+// WF_OBJ_PRESIZE counts records of the whole file first, so consumers can allocate final storage
+int wf_stream_open(const char *filename, unsigned int flags, size_t memory_limit, struct wf_stream *s);
+
+// parse the next batch into s->batch
+// \return 0 on a batch, ENODATA at the end of file or an error
+int wf_stream_next(struct wf_stream *s);
+
+void wf_stream_close(struct wf_stream *s);
+
+// stream whole file calling on_batch for every batch, non zero return of on_batch stops and is returned
+int wf_stream_load(const char *filename, unsigned int flags, size_t memory_limit, wf_stream_fn on_batch, void *ctx);
+
+// build indexed mesh from triangulated faces, every unique v/vt/vn corner becomes one vertex,
+// a file w/o faces gives a non indexed point mesh
+int wf_mesh_build(const struct wf_obj *o, struct wf_mesh *m);
+
+// load mesh of obj file, with WF_OBJ_CACHE in o->flags a valid <filename>.wfb sidecar is mapped
+// instead of parsing and a new one is written otherwise, o is left empty on a cache hit
+int wf_mesh_load(const char *filename, struct wf_obj *o, struct wf_mesh *m);
+
+// write binary cache of mesh built from the source file w/o any WF_OBJ_* build flags
+int wf_mesh_cache_write(const char *filename, const struct wf_mesh *m);
+
+// reorder triangles for the post transform vertex cache (Tipsify)
+int wf_mesh_optimize_vertex_cache(struct wf_mesh *m, unsigned int cache_size);
+
+// vertex cache order split into clusters which are sorted to reduce overdraw,
+// threshold is the acceptable acmr degradation, e.g. 1.05
+int wf_mesh_optimize_overdraw(struct wf_mesh *m, unsigned int cache_size, float threshold);
+
+// reorder vertices by first use in the index buffer and remap indices, unused vertices are dropped
+int wf_mesh_optimize_vertex_fetch(struct wf_mesh *m);
+
+// overdraw (with vertex cache) and vertex fetch optimization with default parameters
+int wf_mesh_optimize(struct wf_mesh *m);
+
+void wf_mesh_analyze(const struct wf_mesh *m, unsigned int cache_size, struct wf_mesh_stats *s);
+
+// quantize mesh vertices relative to the mesh bounds, WF_QUANT_* flags, errors are measured
+// by decoding every vertex the way the GPU does
+int wf_mesh_quantize(const struct wf_mesh *m, unsigned int flags, struct wf_qmesh *q);
+
+void wf_qmesh_clean(struct wf_qmesh *q);
+
+// split triangles of an indexed mesh into meshlets in index order, blocks of the index buffer are
+// processed by up to nr_threads threads, the result does not depend on the number of threads
+int wf_mesh_build_meshlets(const struct wf_mesh *m, unsigned int nr_threads, struct wf_meshlets *ml);
+
+// \return non zero if the meshlet is back facing from camera (mesh space) or outside of any plane,
+// planes are (a, b, c, d) with unit normals pointing inside, NULL skips the frustum test
+int wf_meshlet_cull(const struct wf_meshlet *c, const float camera[3], const float (*planes)[4], unsigned int nr_planes);
+
+void wf_meshlets_clean(struct wf_meshlets *ml);
+
+// simplify mesh by quadric error edge collapses into a chain of levels, every level keeps ratio
+// triangles of the previous one, the chain stops at min_triangles or when only seams and borders are left
+int wf_mesh_build_lods(const struct wf_mesh *m, float ratio, unsigned int min_triangles, struct wf_lods *l);
+
+// coarsest level with a projected error under pixel_error for an object at distance,
+// fov is the vertical field of view (radians) and height the viewport height (pixels)
+unsigned int wf_lods_select(const struct wf_lods *l, float distance, float fov, unsigned int height, float pixel_error);
+
+void wf_lods_clean(struct wf_lods *l);
+
+// build bvh over mesh triangles by the binned surface area heuristic, subtrees are built by
+// up to nr_threads threads
+int wf_mesh_build_bvh(const struct wf_mesh *m, unsigned int nr_threads, struct wf_bvh *b);
+
+// nearest triangle of mesh hit by the ray, both faces of a triangle are hit
+// \return non zero on a hit
+int wf_bvh_intersect(const struct wf_bvh *b, const struct wf_mesh *m, const float origin[3], const float dir[3],
+		     struct wf_bvh_hit *hit);
+
+void wf_bvh_clean(struct wf_bvh *b);
+
+// allocate streams of count positions
+int wf_soa_init(struct wf_soa *s, size_t count);
+
+// positions of obj records or mesh vertices as structure of arrays
+int wf_obj_soa(const struct wf_obj *o, struct wf_soa *s);
+int wf_mesh_soa(const struct wf_mesh *m, struct wf_soa *s);
+
+// out = m * (p, 1) of every position, m is a column major mat4x4 (affine, no perspective divide),
+// out has at least in->count positions and may be in, batches are split over up to nr_threads threads
+void wf_soa_transform_points(const struct wf_soa *in, const float m[4][4], unsigned int nr_threads, struct wf_soa *out);
+
+// out = m * (d, 0), normals need the inverse transpose of m and are not normalized
+void wf_soa_transform_directions(const struct wf_soa *in, const float m[4][4], unsigned int nr_threads,
+				 struct wf_soa *out);
+
+// axis aligned bounds, min > max if there are no positions
+void wf_soa_bounds(const struct wf_soa *s, unsigned int nr_threads, float min[3], float max[3]);
+
+// bounding sphere around the center of the bounds
+void wf_soa_sphere(const struct wf_soa *s, unsigned int nr_threads, float center[3], float *radius);
+
+void wf_soa_clean(struct wf_soa *s);
+
+void wf_mesh_clean(struct wf_mesh *m);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,444 @@
+// bounding volume hierarchy over mesh triangles
+//
+// binned surface area heuristic (Wald, "On fast Construction of SAH-based Bounding Volume Hierarchies"),
+// children are allocated in pairs, so siblings share a cache line and an inner node only keeps the index
+// of its left child. Subtrees of the upper levels are built by their own threads.
+//
+// ray triangle test: Moller and Trumbore, "Fast, Minimum Storage Ray/Triangle Intersection"
+
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <icg/log.h>
+
+#include "wavefront_obj.h"
+#include "wf_mesh_internal.h"
+
+#define WF_BVH_BINS 16
+
+// largest leaf, a leaf is also made when no split is cheaper
+#define WF_BVH_MAX_LEAF 8
+
+// nodes are made leaves below this depth, so a query stack of that size never overflows
+#define WF_BVH_MAX_DEPTH 60
+
+// smallest subtree built by a new thread, triangles
+#define WF_BVH_MIN_TASK 65536
+
+struct wf_bvh_bin {
+	float min[3], max[3];
+	unsigned int count;
+};
+
+// triangle bounds of the build, kept together so a binning pass loads one line per triangle
+struct wf_bvh_prim {
+	float min[3], max[3];
+	float centroid[3];
+};
+
+struct wf_bvh_builder {
+	struct wf_bvh *b;
+	struct wf_bvh_prim *prims;
+	atomic_uint nr_nodes;
+	atomic_uint nr_tasks;	// threads which may still be started
+};
+
+struct wf_bvh_task {
+	struct wf_bvh_builder *builder;
+	unsigned int node;
+	unsigned int depth;
+	float cmin[3], cmax[3];
+};
+
+static void wf_bvh_build_node(struct wf_bvh_builder *bb, unsigned int node, unsigned int depth, const float cmin[3],
+			      const float cmax[3]);
+
+// fminf() and fmaxf() keep nan semantics and are library calls w/o -ffinite-math-only
+static inline float wf_minf(float a, float b)
+{
+	return a < b ? a : b;
+}
+
+static inline float wf_maxf(float a, float b)
+{
+	return a > b ? a : b;
+}
+
+static inline void wf_bounds_reset(float min[3], float max[3])
+{
+	for (int k = 0; k < 3; k++) {
+		min[k] = FLT_MAX;
+		max[k] = -FLT_MAX;
+	}
+}
+
+static inline void wf_bounds_grow(float min[3], float max[3], const float *bmin, const float *bmax)
+{
+	for (int k = 0; k < 3; k++) {
+		min[k] = wf_minf(min[k], bmin[k]);
+		max[k] = wf_maxf(max[k], bmax[k]);
+	}
+}
+
+static inline float wf_bounds_area(const float min[3], const float max[3])
+{
+	float e[3];
+
+	for (int k = 0; k < 3; k++)
+		e[k] = wf_maxf(max[k] - min[k], 0.0f);
+
+	return e[0] * e[1] + e[1] * e[2] + e[2] * e[0];
+}
+
+static void *wf_bvh_task(void *arg)
+{
+	struct wf_bvh_task *t = arg;
+
+	wf_bvh_build_node(t->builder, t->node, t->depth, t->cmin, t->cmax);
+	return NULL;
+}
+
+static inline unsigned int wf_bvh_bin_of(float c, float min, float scale)
+{
+	return wf_minf((c - min) * scale, WF_BVH_BINS - 1);
+}
+
+// best split of node triangles by binned centroids, all axes are binned in one pass
+// \return cost relative to the node area, FLT_MAX if the centroids do not spread
+static float wf_bvh_split(const struct wf_bvh_builder *bb, const struct wf_bvh_node *n, const float cmin[3],
+			  const float cmax[3], int *axis, unsigned int *bin)
+{
+	struct wf_bvh_bin bins[3][WF_BVH_BINS], *slot;
+	float lmin[3], lmax[3], rmin[3], rmax[3], left_area[WF_BVH_BINS], scale[3], cost, best = FLT_MAX;
+	unsigned int left_count[WF_BVH_BINS], count, i;
+	const struct wf_bvh_prim *p;
+
+	for (int k = 0; k < 3; k++) {
+		scale[k] = cmax[k] > cmin[k] ? WF_BVH_BINS / (cmax[k] - cmin[k]) : 0.0f;
+
+		for (i = 0; i < WF_BVH_BINS; i++) {
+			wf_bounds_reset(bins[k][i].min, bins[k][i].max);
+			bins[k][i].count = 0;
+		}
+	}
+
+	for (i = n->first; i < n->first + n->count; i++) {
+		p = &bb->prims[bb->b->triangles[i]];
+
+		for (int k = 0; k < 3; k++) {
+			slot = &bins[k][wf_bvh_bin_of(p->centroid[k], cmin[k], scale[k])];
+			wf_bounds_grow(slot->min, slot->max, p->min, p->max);
+			slot->count++;
+		}
+	}
+
+	for (int k = 0; k < 3; k++) {
+		if (!scale[k])
+			continue;
+
+		// left sweep keeps areas, the right sweep evaluates planes between bins
+		wf_bounds_reset(lmin, lmax);
+		count = 0;
+
+		for (i = 0; i < WF_BVH_BINS - 1; i++) {
+			wf_bounds_grow(lmin, lmax, bins[k][i].min, bins[k][i].max);
+			count += bins[k][i].count;
+			left_area[i] = wf_bounds_area(lmin, lmax);
+			left_count[i] = count;
+		}
+
+		wf_bounds_reset(rmin, rmax);
+		count = 0;
+
+		for (i = WF_BVH_BINS - 1; i > 0; i--) {
+			wf_bounds_grow(rmin, rmax, bins[k][i].min, bins[k][i].max);
+			count += bins[k][i].count;
+
+			if (!count || !left_count[i - 1])
+				continue;
+
+			cost = left_area[i - 1] * left_count[i - 1] + wf_bounds_area(rmin, rmax) * count;
+			if (cost < best) {
+				best = cost;
+				*axis = k;
+				*bin = i;
+			}
+		}
+	}
+
+	return best == FLT_MAX ? best : 1.0f + best / wf_bounds_area(n->min, n->max);
+}
+
+static void wf_bvh_build_node(struct wf_bvh_builder *bb, unsigned int node, unsigned int depth, const float cmin[3],
+			      const float cmax[3])
+{
+	struct wf_bvh *b = bb->b;
+	struct wf_bvh_node *n = &b->nodes[node], *l, *r;
+	float ccmin[2][3], ccmax[2][3], cost, scale;
+	unsigned int bin = 0, i, j, t, left, tasks;
+	const struct wf_bvh_prim *p;
+	struct wf_bvh_task task;
+	pthread_t thread;
+	int axis = 0, started = 0;
+
+	if (n->count <= 2 || depth >= WF_BVH_MAX_DEPTH)
+		return;
+
+	cost = wf_bvh_split(bb, n, cmin, cmax, &axis, &bin);
+
+	// traversal of a node costs as much as a triangle test
+	if (cost == FLT_MAX || (cost >= n->count && n->count <= WF_BVH_MAX_LEAF))
+		return;
+
+	scale = WF_BVH_BINS / (cmax[axis] - cmin[axis]);
+
+	for (i = n->first, j = n->first + n->count; i < j; ) {
+		t = b->triangles[i];
+
+		if (wf_bvh_bin_of(bb->prims[t].centroid[axis], cmin[axis], scale) < bin) {
+			i++;
+		} else {
+			b->triangles[i] = b->triangles[--j];
+			b->triangles[j] = t;
+		}
+	}
+
+	left = atomic_fetch_add(&bb->nr_nodes, 2);
+	l = &b->nodes[left];
+	r = &b->nodes[left + 1];
+
+	l->first = n->first;
+	l->count = i - n->first;
+	r->first = i;
+	r->count = n->count - l->count;
+
+	for (int c = 0; c < 2; c++) {
+		wf_bounds_reset(l[c].min, l[c].max);
+		wf_bounds_reset(ccmin[c], ccmax[c]);
+
+		for (i = l[c].first; i < l[c].first + l[c].count; i++) {
+			p = &bb->prims[b->triangles[i]];
+			wf_bounds_grow(l[c].min, l[c].max, p->min, p->max);
+			wf_bounds_grow(ccmin[c], ccmax[c], p->centroid, p->centroid);
+		}
+	}
+
+	n->first = left;
+	n->count = 0;
+
+	if (l->count >= WF_BVH_MIN_TASK && r->count >= WF_BVH_MIN_TASK) {
+		tasks = atomic_load(&bb->nr_tasks);
+
+		while (tasks && !atomic_compare_exchange_weak(&bb->nr_tasks, &tasks, tasks - 1))
+			;
+
+		if (tasks) {
+			task = (struct wf_bvh_task){bb, left, depth + 1, {0}, {0}};
+			memcpy(task.cmin, ccmin[0], sizeof(task.cmin));
+			memcpy(task.cmax, ccmax[0], sizeof(task.cmax));
+			started = !pthread_create(&thread, NULL, wf_bvh_task, &task);
+		}
+	}
+
+	if (!started)
+		wf_bvh_build_node(bb, left, depth + 1, ccmin[0], ccmax[0]);
+
+	wf_bvh_build_node(bb, left + 1, depth + 1, ccmin[1], ccmax[1]);
+
+	if (started)
+		pthread_join(thread, NULL);
+}
+
+int wf_mesh_build_bvh(const struct wf_mesh *m, unsigned int nr_threads, struct wf_bvh *b)
+{
+	unsigned int nr_triangles = m->nr_indices / 3;
+	struct wf_bvh_builder bb = {.b = b};
+	struct wf_bvh_prim *p;
+	float cmin[3], cmax[3];
+	const float *v;
+
+	memset(b, 0, sizeof(*b));
+
+	if (!nr_triangles)
+		return 0;
+
+	// a binary tree of n leaves has 2n - 1 nodes, one more keeps pairs aligned
+	b->nodes = malloc((2 * (size_t)nr_triangles) * sizeof(*b->nodes));
+	b->triangles = malloc(nr_triangles * sizeof(*b->triangles));
+	bb.prims = malloc(nr_triangles * sizeof(*bb.prims));
+	if (!b->nodes || !b->triangles || !bb.prims) {
+		icg_log_error("malloc() fail\n");
+		free(bb.prims);
+		wf_bvh_clean(b);
+		return ENOMEM;
+	}
+
+	b->nr_triangles = nr_triangles;
+
+	// node 1 is unused, so children pairs start at even indices
+	b->nodes[0].first = 0;
+	b->nodes[0].count = nr_triangles;
+	wf_bounds_reset(b->nodes[0].min, b->nodes[0].max);
+	wf_bounds_reset(cmin, cmax);
+
+	for (unsigned int t = 0; t < nr_triangles; t++) {
+		b->triangles[t] = t;
+		p = &bb.prims[t];
+		wf_bounds_reset(p->min, p->max);
+
+		for (int k = 0; k < 3; k++) {
+			v = wf_mesh_position(m, wf_mesh_index(m, (size_t)t * 3 + k));
+			wf_bounds_grow(p->min, p->max, v, v);
+		}
+
+		for (int k = 0; k < 3; k++)
+			p->centroid[k] = (p->min[k] + p->max[k]) * 0.5f;
+
+		wf_bounds_grow(b->nodes[0].min, b->nodes[0].max, p->min, p->max);
+		wf_bounds_grow(cmin, cmax, p->centroid, p->centroid);
+	}
+
+	atomic_init(&bb.nr_nodes, 2);
+	atomic_init(&bb.nr_tasks, nr_threads > 1 ? nr_threads - 1 : 0);
+
+	wf_bvh_build_node(&bb, 0, 0, cmin, cmax);
+
+	b->nr_nodes = atomic_load(&bb.nr_nodes);
+	free(bb.prims);
+
+	return 0;
+}
+
+static inline float wf_bvh_slab(const struct wf_bvh_node *n, const float o[3], const float inv[3], float t_max)
+{
+	float t0, t1, t_near = 0.0f, t_far = t_max;
+
+	for (int k = 0; k < 3; k++) {
+		t0 = (n->min[k] - o[k]) * inv[k];
+		t1 = (n->max[k] - o[k]) * inv[k];
+
+		t_near = wf_maxf(t_near, wf_minf(t0, t1));
+		t_far = wf_minf(t_far, wf_maxf(t0, t1));
+	}
+
+	return t_near <= t_far ? t_near : FLT_MAX;
+}
+
+static int wf_bvh_triangle(const struct wf_mesh *m, unsigned int t, const float o[3], const float d[3],
+			   struct wf_bvh_hit *hit)
+{
+	const float *a = wf_mesh_position(m, wf_mesh_index(m, (size_t)t * 3));
+	const float *b = wf_mesh_position(m, wf_mesh_index(m, (size_t)t * 3 + 1));
+	const float *c = wf_mesh_position(m, wf_mesh_index(m, (size_t)t * 3 + 2));
+	float e1[3], e2[3], p[3], s[3], q[3], det, inv, u, v, dist;
+
+	for (int k = 0; k < 3; k++) {
+		e1[k] = b[k] - a[k];
+		e2[k] = c[k] - a[k];
+		s[k] = o[k] - a[k];
+	}
+
+	p[0] = d[1] * e2[2] - d[2] * e2[1];
+	p[1] = d[2] * e2[0] - d[0] * e2[2];
+	p[2] = d[0] * e2[1] - d[1] * e2[0];
+
+	// both faces are hit, a picked triangle may be seen from behind
+	det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+	if (fabsf(det) < FLT_MIN)
+		return 0;
+
+	inv = 1.0f / det;
+
+	u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+	if (u < 0.0f || u > 1.0f)
+		return 0;
+
+	q[0] = s[1] * e1[2] - s[2] * e1[1];
+	q[1] = s[2] * e1[0] - s[0] * e1[2];
+	q[2] = s[0] * e1[1] - s[1] * e1[0];
+
+	v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv;
+	if (v < 0.0f || u + v > 1.0f)
+		return 0;
+
+	dist = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+	if (dist < 0.0f || dist >= hit->distance)
+		return 0;
+
+	hit->triangle = t;
+	hit->distance = dist;
+	hit->u = u;
+	hit->v = v;
+
+	return 1;
+}
+
+int wf_bvh_intersect(const struct wf_bvh *b, const struct wf_mesh *m, const float origin[3], const float dir[3],
+		     struct wf_bvh_hit *hit)
+{
+	unsigned int stack[WF_BVH_MAX_DEPTH + 4], nr = 0, node = 0;
+	const struct wf_bvh_node *n, *c;
+	float inv[3], t0, t1;
+	int found = 0;
+
+	hit->triangle = -1;
+	hit->distance = FLT_MAX;
+
+	if (!b->nr_nodes)
+		return 0;
+
+	for (int k = 0; k < 3; k++)
+		inv[k] = 1.0f / dir[k];
+
+	if (wf_bvh_slab(&b->nodes[0], origin, inv, FLT_MAX) == FLT_MAX)
+		return 0;
+
+	// nearest child first, the far one waits on the stack
+	for (;;) {
+		n = &b->nodes[node];
+
+		if (n->count) {
+			for (unsigned int i = n->first; i < n->first + n->count; i++)
+				found |= wf_bvh_triangle(m, b->triangles[i], origin, dir, hit);
+		} else {
+			c = &b->nodes[n->first];
+			t0 = wf_bvh_slab(c, origin, inv, hit->distance);
+			t1 = wf_bvh_slab(c + 1, origin, inv, hit->distance);
+
+			if (t0 != FLT_MAX || t1 != FLT_MAX) {
+				if (t0 <= t1) {
+					if (t1 != FLT_MAX)
+						stack[nr++] = n->first + 1;
+					node = n->first;
+				} else {
+					if (t0 != FLT_MAX)
+						stack[nr++] = n->first;
+					node = n->first + 1;
+				}
+
+				continue;
+			}
+		}
+
+		if (!nr)
+			break;
+
+		node = stack[--nr];
+	}
+
+	return found;
+}
+
+void wf_bvh_clean(struct wf_bvh *b)
+{
+	free(b->nodes);
+	free(b->triangles);
+	memset(b, 0, sizeof(*b));
+}
@@ -0,0 +1,381 @@
+// binary mesh cache, a sidecar <filename>.wfb holds the built mesh ready for upload
+//
+// layout: header | vertices | indices, every stream starts at a WF_CACHE_ALIGN boundary,
+// the cache is native endian and is rejected by a byte order mark mismatch
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <icg/hash.h>
+#include <icg/log.h>
+
+#include "wavefront_obj.h"
+
+#define WF_CACHE_MAGIC "WFB"
+#define WF_CACHE_VERSION 2	// 2: bounds of optimized meshes are tight
+#define WF_CACHE_BOM 0x01020304u
+#define WF_CACHE_ALIGN 64
+#define WF_CACHE_SUFFIX ".wfb"
+
+// flags which change the cached mesh, a cache built with other ones is a miss
+#define WF_CACHE_BUILD_FLAGS (WF_OBJ_OPTIMIZE)
+
+struct wf_cache_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t bom;
+	uint32_t header_size;
+
+	// source identity, size and mtime are the fast check, hash is the content one
+	uint64_t src_size;
+	int64_t src_mtime_sec;
+	int64_t src_mtime_nsec;
+	uint64_t src_hash;
+
+	struct wf_vertex bounds_min;
+	struct wf_vertex bounds_max;
+
+	uint32_t nr_vertices;
+	uint32_t stride;
+	uint32_t attribs;
+	uint32_t texcoord_offset;
+	uint32_t normal_offset;
+	uint32_t nr_indices;
+	uint32_t index_size;
+	uint32_t build_flags;		// WF_OBJ_* flags which changed the mesh
+
+	uint64_t vertices_offset;
+	uint64_t indices_offset;
+	uint64_t file_size;
+};
+
+static inline uint64_t wf_cache_align(uint64_t v)
+{
+	return (v + WF_CACHE_ALIGN - 1) & ~(uint64_t)(WF_CACHE_ALIGN - 1);
+}
+
+static int wf_cache_path(const char *filename, char *path, size_t size)
+{
+	if ((size_t)snprintf(path, size, "%s" WF_CACHE_SUFFIX, filename) >= size) {
+		icg_log_error("cache path of '%s' is too long\n", filename);
+		return ENAMETOOLONG;
+	}
+
+	return 0;
+}
+
+// content hash of the source file
+static int wf_cache_src_hash(const char *filename, uint64_t *hash)
+{
+	struct stat st;
+	void *data;
+	int r = 0, fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		r = errno;
+		icg_log_error("open('%s') fail: %s (%d)\n", filename, strerror(r), r);
+		return r;
+	}
+
+	if (fstat(fd, &st)) {
+		r = errno;
+		icg_log_error("fstat('%s') fail: %s (%d)\n", filename, strerror(r), r);
+		goto out;
+	}
+
+	if (!st.st_size) {
+		*hash = icg_hash64(NULL, 0, 0);
+		goto out;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		r = errno;
+		icg_log_error("mmap('%s') fail: %s (%d)\n", filename, strerror(r), r);
+		goto out;
+	}
+
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+	*hash = icg_hash64(data, st.st_size, 0);
+	munmap(data, st.st_size);
+
+out:
+	close(fd);
+	return r;
+}
+
+static int wf_cache_header_valid(const struct wf_cache_header *h, size_t size)
+{
+	uint64_t vertices_size, indices_size;
+
+	if (size < sizeof(*h) || memcmp(h->magic, WF_CACHE_MAGIC, sizeof(h->magic)) ||
+	    h->version != WF_CACHE_VERSION || h->bom != WF_CACHE_BOM ||
+	    h->header_size != sizeof(*h) || h->file_size != size)
+		return 0;
+
+	if ((h->index_size != 2 && h->index_size != 4) || h->stride < sizeof(struct wf_vertex))
+		return 0;
+
+	vertices_size = (uint64_t)h->nr_vertices * h->stride;
+	indices_size = (uint64_t)h->nr_indices * h->index_size;
+
+	return h->vertices_offset % WF_CACHE_ALIGN == 0 && h->indices_offset % WF_CACHE_ALIGN == 0 &&
+	       h->vertices_offset >= sizeof(*h) && h->vertices_offset + vertices_size <= size &&
+	       h->indices_offset >= h->vertices_offset + vertices_size && h->indices_offset + indices_size <= size;
+}
+
+// the source changed its mtime only, the new one goes to the header so later loads skip the hash. A
+// reader racing the write sees a stale mtime at worst and hashes again, a fail is harmless the same way
+static void wf_cache_touch(const char *path, const struct stat *src)
+{
+	int64_t mtime[2] = {src->st_mtim.tv_sec, src->st_mtim.tv_nsec};
+	int fd;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return;
+
+	if (pwrite(fd, mtime, sizeof(mtime), offsetof(struct wf_cache_header, src_mtime_sec)) != sizeof(mtime))
+		icg_log_debug("cache '%s' mtime not updated: %s (%d)\n", path, strerror(errno), errno);
+
+	close(fd);
+}
+
+// map a valid cache into m, \return ENOENT on any miss
+static int wf_cache_map(const char *filename, unsigned int flags, struct wf_mesh *m)
+{
+	char path[4096];
+	struct stat src, st;
+	struct wf_cache_header *h;
+	uint64_t hash;
+	void *data;
+	int r, fd;
+
+	r = wf_cache_path(filename, path, sizeof(path));
+	if (r)
+		return r;
+
+	if (stat(filename, &src)) {
+		r = errno;
+		icg_log_error("stat('%s') fail: %s (%d)\n", filename, strerror(r), r);
+		return r;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return ENOENT;
+
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(*h)) {
+		close(fd);
+		return ENOENT;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return ENOENT;
+
+	h = data;
+	r = ENOENT;
+
+	if (!wf_cache_header_valid(h, st.st_size) || h->src_size != (uint64_t)src.st_size ||
+	    h->build_flags != (flags & WF_CACHE_BUILD_FLAGS))
+		goto miss;
+
+	// touched or copied source keeps the cache as long as the content is the same
+	if ((flags & WF_OBJ_CACHE_VERIFY) ||
+	    h->src_mtime_sec != src.st_mtim.tv_sec || h->src_mtime_nsec != src.st_mtim.tv_nsec) {
+		if (wf_cache_src_hash(filename, &hash) || hash != h->src_hash)
+			goto miss;
+
+		if (h->src_mtime_sec != src.st_mtim.tv_sec || h->src_mtime_nsec != src.st_mtim.tv_nsec)
+			wf_cache_touch(path, &src);
+	}
+
+	memset(m, 0, sizeof(*m));
+	m->nr_vertices = h->nr_vertices;
+	m->stride = h->stride;
+	m->attribs = h->attribs;
+	m->texcoord_offset = h->texcoord_offset;
+	m->normal_offset = h->normal_offset;
+	m->nr_indices = h->nr_indices;
+	m->index_size = h->index_size;
+	m->bounds_min = h->bounds_min;
+	m->bounds_max = h->bounds_max;
+	m->vertices = (float *)((char *)data + h->vertices_offset);
+	m->indices = (char *)data + h->indices_offset;
+	m->mapping = data;
+	m->mapping_size = st.st_size;
+
+	return 0;
+
+miss:
+	munmap(data, st.st_size);
+	return r;
+}
+
+static int wf_cache_write_all(int fd, const void *data, size_t size)
+{
+	const char *p = data;
+	ssize_t n;
+
+	while (size) {
+		n = write(fd, p, size);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+
+		p += n;
+		size -= n;
+	}
+
+	return 0;
+}
+
+static int wf_cache_pad(int fd, uint64_t *pos, uint64_t to)
+{
+	static const char zero[WF_CACHE_ALIGN];
+	int r;
+
+	r = wf_cache_write_all(fd, zero, to - *pos);
+	*pos = to;
+
+	return r;
+}
+
+static int wf_mesh_cache_write_flags(const char *filename, const struct wf_mesh *m, unsigned int flags)
+{
+	char path[4096], tmp[4096 + 32];
+	struct wf_cache_header h;
+	struct stat src;
+	uint64_t pos, vertices_size, indices_size;
+	int r, fd;
+
+	r = wf_cache_path(filename, path, sizeof(path));
+	if (r)
+		return r;
+
+	if (stat(filename, &src)) {
+		r = errno;
+		icg_log_error("stat('%s') fail: %s (%d)\n", filename, strerror(r), r);
+		return r;
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, WF_CACHE_MAGIC, sizeof(h.magic));
+	h.version = WF_CACHE_VERSION;
+	h.bom = WF_CACHE_BOM;
+	h.header_size = sizeof(h);
+	h.src_size = src.st_size;
+	h.src_mtime_sec = src.st_mtim.tv_sec;
+	h.src_mtime_nsec = src.st_mtim.tv_nsec;
+	h.bounds_min = m->bounds_min;
+	h.bounds_max = m->bounds_max;
+	h.nr_vertices = m->nr_vertices;
+	h.stride = m->stride;
+	h.attribs = m->attribs;
+	h.texcoord_offset = m->texcoord_offset;
+	h.normal_offset = m->normal_offset;
+	h.nr_indices = m->nr_indices;
+	h.index_size = m->index_size ? m->index_size : sizeof(uint32_t);
+	h.build_flags = flags & WF_CACHE_BUILD_FLAGS;
+
+	r = wf_cache_src_hash(filename, &h.src_hash);
+	if (r)
+		return r;
+
+	vertices_size = (uint64_t)m->nr_vertices * m->stride;
+	indices_size = (uint64_t)m->nr_indices * m->index_size;
+
+	h.vertices_offset = wf_cache_align(sizeof(h));
+	h.indices_offset = wf_cache_align(h.vertices_offset + vertices_size);
+	h.file_size = h.indices_offset + indices_size;
+
+	// readers never see a partial file, it is renamed in place when complete
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		r = errno;
+		icg_log_error("open('%s') fail: %s (%d)\n", tmp, strerror(r), r);
+		return r;
+	}
+
+	pos = sizeof(h);
+	r = wf_cache_write_all(fd, &h, sizeof(h));
+	if (!r)
+		r = wf_cache_pad(fd, &pos, h.vertices_offset);
+	if (!r)
+		r = wf_cache_write_all(fd, m->vertices, vertices_size);
+	pos += vertices_size;
+	if (!r)
+		r = wf_cache_pad(fd, &pos, h.indices_offset);
+	if (!r)
+		r = wf_cache_write_all(fd, m->indices, indices_size);
+
+	if (close(fd) && !r)
+		r = errno;
+
+	if (!r && rename(tmp, path))
+		r = errno;
+
+	if (r) {
+		icg_log_error("cache '%s' write fail: %s (%d)\n", path, strerror(r), r);
+		unlink(tmp);
+	}
+
+	return r;
+}
+
+int wf_mesh_cache_write(const char *filename, const struct wf_mesh *m)
+{
+	return wf_mesh_cache_write_flags(filename, m, 0);
+}
+
+int wf_mesh_load(const char *filename, struct wf_obj *o, struct wf_mesh *m)
+{
+	int r;
+
+	memset(m, 0, sizeof(*m));
+
+	if (o->flags & WF_OBJ_CACHE) {
+		r = wf_cache_map(filename, o->flags, m);
+		if (r != ENOENT)
+			return r;
+	}
+
+	r = wf_obj_load(filename, o);
+	if (r)
+		return r;
+
+	r = wf_mesh_build(o, m);
+	if (r)
+		return r;
+
+	if (o->flags & WF_OBJ_OPTIMIZE) {
+		r = wf_mesh_optimize(m);
+		if (r) {
+			wf_mesh_clean(m);
+			return r;
+		}
+	}
+
+	// a read only directory is not an error, the mesh is just not cached
+	if (o->flags & WF_OBJ_CACHE)
+		wf_mesh_cache_write_flags(filename, m, o->flags);
+
+	return 0;
+}
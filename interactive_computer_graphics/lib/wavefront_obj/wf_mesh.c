@@ -0,0 +1,291 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <icg/log.h>
+
+#include "wavefront_obj.h"
+#include "wf_mesh_internal.h"
+
+// finalizer of murmur3, spreads corner indices over the whole table
+static inline uint32_t wf_mesh_hash(const struct wf_index *c)
+{
+	uint32_t h = (uint32_t)c->v * 0x9e3779b1u;
+
+	h ^= (uint32_t)c->vt * 0x85ebca77u;
+	h ^= (uint32_t)c->vn * 0xc2b2ae3du;
+
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+
+	return h;
+}
+
+static inline int wf_mesh_equal(const struct wf_index *a, const struct wf_index *b)
+{
+	return a->v == b->v && a->vt == b->vt && a->vn == b->vn;
+}
+
+static int wf_mesh_validate(const struct wf_obj *o, unsigned int *attribs)
+{
+	const struct wf_index *c;
+
+	*attribs = 0;
+
+	for (unsigned int i = 0; i < o->nr_corners; i++) {
+		c = &o->corners[i];
+
+		if (c->v < 0 || (unsigned int)c->v >= o->nr_vertices ||
+		    c->vt >= (int)o->nr_texcoords || c->vn >= (int)o->nr_normals) {
+			icg_log_error("face index out of range: %d/%d/%d\n", c->v + 1, c->vt + 1, c->vn + 1);
+			return EINVAL;
+		}
+
+		if (c->vt >= 0)
+			*attribs |= WF_MESH_TEXCOORD;
+
+		if (c->vn >= 0)
+			*attribs |= WF_MESH_NORMAL;
+	}
+
+	return 0;
+}
+
+void wf_mesh_bounds(struct wf_mesh *m)
+{
+	const float *v = m->vertices;
+	unsigned int nr_floats = m->stride / sizeof(float);
+	float *min = &m->bounds_min.x, *max = &m->bounds_max.x;
+
+	if (!m->nr_vertices)
+		return;
+
+	memcpy(min, v, sizeof(m->bounds_min));
+	memcpy(max, v, sizeof(m->bounds_max));
+
+	for (unsigned int i = 1; i < m->nr_vertices; i++) {
+		v += nr_floats;
+
+		for (int k = 0; k < 3; k++) {
+			if (v[k] < min[k])
+				min[k] = v[k];
+			if (v[k] > max[k])
+				max[k] = v[k];
+		}
+	}
+}
+
+static int wf_mesh_build_points(const struct wf_obj *o, struct wf_mesh *m)
+{
+	m->stride = sizeof(*o->vertices);
+	m->nr_vertices = o->nr_vertices;
+
+	if (!o->nr_vertices)
+		return 0;
+
+	m->vertices = malloc((size_t)o->nr_vertices * m->stride);
+	if (!m->vertices) {
+		icg_log_error("malloc() fail\n");
+		return ENOMEM;
+	}
+
+	memcpy(m->vertices, o->vertices, (size_t)o->nr_vertices * m->stride);
+	wf_mesh_bounds(m);
+
+	return 0;
+}
+
+static void wf_mesh_write_vertex(const struct wf_obj *o, const struct wf_index *c, unsigned int attribs, float *dst)
+{
+	static const struct wf_texcoord no_texcoord;
+	static const struct wf_normal no_normal;
+	const struct wf_texcoord *vt;
+	const struct wf_normal *vn;
+
+	memcpy(dst, &o->vertices[c->v], sizeof(struct wf_vertex));
+	dst += 3;
+
+	if (attribs & WF_MESH_TEXCOORD) {
+		vt = c->vt >= 0 ? &o->texcoords[c->vt] : &no_texcoord;
+		memcpy(dst, vt, sizeof(*vt));
+		dst += 2;
+	}
+
+	if (attribs & WF_MESH_NORMAL) {
+		vn = c->vn >= 0 ? &o->normals[c->vn] : &no_normal;
+		memcpy(dst, vn, sizeof(*vn));
+	}
+}
+
+int wf_mesh_build(const struct wf_obj *o, struct wf_mesh *m)
+{
+	uint32_t *table = NULL, *unique = NULL, *indices = NULL, h, mask, slot;
+	unsigned int nr_unique = 0, nr_floats = 3, cap = 16;
+	const struct wf_index *c;
+	uint16_t *indices16;
+	int r;
+
+	memset(m, 0, sizeof(*m));
+
+	if (!o->nr_corners)
+		return wf_mesh_build_points(o, m);
+
+	r = wf_mesh_validate(o, &m->attribs);
+	if (r)
+		return r;
+
+	if (m->attribs & WF_MESH_TEXCOORD) {
+		m->texcoord_offset = nr_floats * sizeof(float);
+		nr_floats += 2;
+	}
+
+	if (m->attribs & WF_MESH_NORMAL) {
+		m->normal_offset = nr_floats * sizeof(float);
+		nr_floats += 3;
+	}
+
+	m->stride = nr_floats * sizeof(float);
+
+	// load factor is kept under 0.5, so probe sequences stay short
+	while (cap < o->nr_corners * 2ull)
+		cap *= 2;
+
+	mask = cap - 1;
+
+	table = calloc(cap, sizeof(*table));
+	unique = malloc(o->nr_corners * sizeof(*unique));
+	indices = malloc(o->nr_corners * sizeof(*indices));
+	if (!table || !unique || !indices) {
+		icg_log_error("malloc() fail\n");
+		r = ENOMEM;
+		goto fail;
+	}
+
+	// slot keeps unique vertex index + 1, 0 is empty
+	for (unsigned int i = 0; i < o->nr_corners; i++) {
+		c = &o->corners[i];
+
+		for (h = wf_mesh_hash(c) & mask; ; h = (h + 1) & mask) {
+			slot = table[h];
+
+			if (!slot) {
+				table[h] = nr_unique + 1;
+				unique[nr_unique] = i;
+				indices[i] = nr_unique++;
+				break;
+			}
+
+			if (wf_mesh_equal(&o->corners[unique[slot - 1]], c)) {
+				indices[i] = slot - 1;
+				break;
+			}
+		}
+	}
+
+	free(table);
+	table = NULL;
+
+	m->vertices = malloc((size_t)nr_unique * m->stride);
+	if (!m->vertices) {
+		icg_log_error("malloc() fail\n");
+		r = ENOMEM;
+		goto fail;
+	}
+
+	for (unsigned int i = 0; i < nr_unique; i++)
+		wf_mesh_write_vertex(o, &o->corners[unique[i]], m->attribs, m->vertices + (size_t)i * nr_floats);
+
+	m->nr_vertices = nr_unique;
+	m->nr_indices = o->nr_corners;
+
+	// 16 bit indices halve the index buffer of small meshes
+	if (nr_unique <= 0x10000) {
+		indices16 = (uint16_t *)indices;
+		for (unsigned int i = 0; i < o->nr_corners; i++)
+			indices16[i] = indices[i];
+
+		m->index_size = sizeof(uint16_t);
+		m->indices = realloc(indices, o->nr_corners * sizeof(uint16_t));
+		if (!m->indices)
+			m->indices = indices;
+	} else {
+		m->index_size = sizeof(uint32_t);
+		m->indices = indices;
+	}
+
+	free(unique);
+	wf_mesh_bounds(m);
+
+	return 0;
+
+fail:
+	free(table);
+	free(unique);
+	free(indices);
+	wf_mesh_clean(m);
+	return r;
+}
+
+uint32_t *wf_mesh_indices32(const struct wf_mesh *m)
+{
+	uint32_t *indices;
+
+	indices = malloc(((size_t)m->nr_indices + 1) * sizeof(*indices));
+	if (!indices) {
+		icg_log_error("malloc() fail\n");
+		return NULL;
+	}
+
+	for (size_t i = 0; i < m->nr_indices; i++)
+		indices[i] = wf_mesh_index(m, i);
+
+	return indices;
+}
+
+int wf_mesh_own(struct wf_mesh *m)
+{
+	size_t vertices_size = (size_t)m->nr_vertices * m->stride;
+	size_t indices_size = (size_t)m->nr_indices * m->index_size;
+	void *vertices, *indices;
+
+	if (!m->mapping)
+		return 0;
+
+	vertices = malloc(vertices_size + 1);
+	indices = malloc(indices_size + 1);
+	if (!vertices || !indices) {
+		icg_log_error("malloc() fail\n");
+		free(vertices);
+		free(indices);
+		return ENOMEM;
+	}
+
+	memcpy(vertices, m->vertices, vertices_size);
+	memcpy(indices, m->indices, indices_size);
+	munmap(m->mapping, m->mapping_size);
+
+	m->vertices = vertices;
+	m->indices = indices;
+	m->mapping = NULL;
+	m->mapping_size = 0;
+
+	return 0;
+}
+
+void wf_mesh_clean(struct wf_mesh *m)
+{
+	if (m->mapping) {
+		munmap(m->mapping, m->mapping_size);
+	} else {
+		free(m->vertices);
+		free(m->indices);
+	}
+
+	memset(m, 0, sizeof(*m));
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// mesh helpers shared by the processing stages of the library
+
+#include <stdint.h>
+
+#include "wavefront_obj.h"
+
+static inline uint32_t wf_mesh_index(const struct wf_mesh *m, size_t i)
+{
+	return m->index_size == 2 ? ((const uint16_t *)m->indices)[i] : ((const uint32_t *)m->indices)[i];
+}
+
+static inline void wf_mesh_set_index(struct wf_mesh *m, size_t i, uint32_t v)
+{
+	if (m->index_size == 2)
+		((uint16_t *)m->indices)[i] = v;
+	else
+		((uint32_t *)m->indices)[i] = v;
+}
+
+static inline const float *wf_mesh_position(const struct wf_mesh *m, uint32_t v)
+{
+	return (const float *)((const char *)m->vertices + (size_t)v * m->stride);
+}
+
+// copy indices of mesh to a new 32 bit array
+uint32_t *wf_mesh_indices32(const struct wf_mesh *m);
+
+// bounds of the positions of all vertices
+void wf_mesh_bounds(struct wf_mesh *m);
+
+// move mapped (cached) streams to the heap, so the mesh can be changed in place
+int wf_mesh_own(struct wf_mesh *m);
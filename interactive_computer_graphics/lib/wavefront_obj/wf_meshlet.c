@@ -0,0 +1,368 @@
+// meshlets
+//
+// triangles are taken in index buffer order (vertex cache optimized meshes give compact clusters) and a
+// meshlet is closed when the next triangle exceeds the vertex or triangle limit. The index buffer is split
+// into fixed blocks which never share a meshlet, so threads only change which block is built where.
+//
+// cone culling: Zeux, "Meshlet cone culling" and the meshoptimizer cluster bounds
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <icg/log.h>
+
+#include "wavefront_obj.h"
+#include "wf_mesh_internal.h"
+
+// triangles of an index buffer block, a block is built by one thread
+#define WF_MESHLET_BLOCK (1 << 16)
+
+// smallest cos of the cone angle which is still worth culling, float error of wide cones
+#define WF_MESHLET_MIN_CONE 0.1f
+
+struct wf_meshlet_block {
+	const struct wf_mesh *m;
+	size_t first;			// triangle
+	size_t count;
+	struct wf_meshlets out;		// offsets are local to the block
+	int r;
+};
+
+struct wf_meshlet_worker {
+	struct wf_meshlet_block *blocks;
+	unsigned int nr_blocks;
+	unsigned int first;
+	unsigned int step;
+};
+
+static void wf_meshlet_sphere(const struct wf_mesh *m, const unsigned int *vertices, struct wf_meshlet *c)
+{
+	float min[3] = {INFINITY, INFINITY, INFINITY}, max[3] = {-INFINITY, -INFINITY, -INFINITY}, d, r = 0;
+	const float *p;
+
+	for (unsigned int i = 0; i < c->nr_vertices; i++) {
+		p = wf_mesh_position(m, vertices[i]);
+
+		for (int k = 0; k < 3; k++) {
+			min[k] = fminf(min[k], p[k]);
+			max[k] = fmaxf(max[k], p[k]);
+		}
+	}
+
+	for (int k = 0; k < 3; k++)
+		c->center[k] = (min[k] + max[k]) * 0.5f;
+
+	for (unsigned int i = 0; i < c->nr_vertices; i++) {
+		p = wf_mesh_position(m, vertices[i]);
+		d = 0;
+
+		for (int k = 0; k < 3; k++)
+			d += (p[k] - c->center[k]) * (p[k] - c->center[k]);
+
+		r = fmaxf(r, d);
+	}
+
+	c->radius = sqrtf(r);
+}
+
+// axis is the mean of unit triangle normals, degenerate triangles have no normal
+static void wf_meshlet_cone(const struct wf_mesh *m, const unsigned int *vertices, const unsigned char *triangles,
+			    struct wf_meshlet *c)
+{
+	float normals[WF_MESHLET_MAX_TRIANGLES][3], axis[3] = {0}, e1[3], e2[3], l, min_dot = 1.0f, dot;
+	const float *a, *b, *v;
+	unsigned int nr_normals = 0;
+
+	for (unsigned int t = 0; t < c->nr_triangles; t++) {
+		a = wf_mesh_position(m, vertices[triangles[t * 3]]);
+		b = wf_mesh_position(m, vertices[triangles[t * 3 + 1]]);
+		v = wf_mesh_position(m, vertices[triangles[t * 3 + 2]]);
+
+		for (int k = 0; k < 3; k++) {
+			e1[k] = b[k] - a[k];
+			e2[k] = v[k] - a[k];
+		}
+
+		float *n = normals[nr_normals];
+
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+		l = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (l == 0.0f)
+			continue;
+
+		for (int k = 0; k < 3; k++) {
+			n[k] /= l;
+			axis[k] += n[k];
+		}
+
+		nr_normals++;
+	}
+
+	l = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+	memset(c->cone_axis, 0, sizeof(c->cone_axis));
+	c->cone_cutoff = 1.0f;
+
+	if (!nr_normals || l == 0.0f)
+		return;
+
+	for (int k = 0; k < 3; k++)
+		axis[k] /= l;
+
+	for (unsigned int i = 0; i < nr_normals; i++) {
+		dot = normals[i][0] * axis[0] + normals[i][1] * axis[1] + normals[i][2] * axis[2];
+		min_dot = fminf(min_dot, dot);
+	}
+
+	memcpy(c->cone_axis, axis, sizeof(axis));
+
+	if (min_dot >= WF_MESHLET_MIN_CONE)
+		c->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+static void wf_meshlet_close(const struct wf_mesh *m, struct wf_meshlets *ml)
+{
+	struct wf_meshlet *c = &ml->meshlets[ml->nr_meshlets];
+
+	if (!c->nr_triangles)
+		return;
+
+	wf_meshlet_sphere(m, ml->vertices + c->vertex_offset, c);
+	wf_meshlet_cone(m, ml->vertices + c->vertex_offset, ml->triangles + (size_t)c->triangle_offset * 3, c);
+
+	ml->nr_meshlets++;
+	ml->meshlets[ml->nr_meshlets].vertex_offset = ml->nr_vertices;
+	ml->meshlets[ml->nr_meshlets].triangle_offset = ml->nr_triangles;
+}
+
+static int wf_meshlet_find(const unsigned int *vertices, unsigned int nr_vertices, unsigned int v)
+{
+	for (unsigned int i = 0; i < nr_vertices; i++) {
+		if (vertices[i] == v)
+			return i;
+	}
+
+	return -1;
+}
+
+static void wf_meshlet_block_build(struct wf_meshlet_block *b)
+{
+	const struct wf_mesh *m = b->m;
+	struct wf_meshlets *ml = &b->out;
+	struct wf_meshlet *c;
+	unsigned int v[3], *local;
+	unsigned int nr_new;
+	int l;
+
+	// worst case is a meshlet per triangle, one extra meshlet is the open one
+	ml->meshlets = calloc(b->count + 1, sizeof(*ml->meshlets));
+	ml->vertices = malloc(b->count * 3 * sizeof(*ml->vertices));
+	ml->triangles = malloc(b->count * 3);
+	if (!ml->meshlets || !ml->vertices || !ml->triangles) {
+		b->r = ENOMEM;
+		return;
+	}
+
+	for (size_t t = b->first; t < b->first + b->count; t++) {
+		c = &ml->meshlets[ml->nr_meshlets];
+		local = ml->vertices + c->vertex_offset;
+		nr_new = 0;
+
+		for (int k = 0; k < 3; k++) {
+			v[k] = wf_mesh_index(m, t * 3 + k);
+
+			if (wf_meshlet_find(local, c->nr_vertices, v[k]) < 0 && wf_meshlet_find(v, k, v[k]) < 0)
+				nr_new++;
+		}
+
+		if (c->nr_vertices + nr_new > WF_MESHLET_MAX_VERTICES || c->nr_triangles == WF_MESHLET_MAX_TRIANGLES) {
+			wf_meshlet_close(m, ml);
+			c = &ml->meshlets[ml->nr_meshlets];
+			local = ml->vertices + c->vertex_offset;
+		}
+
+		for (int k = 0; k < 3; k++) {
+			l = wf_meshlet_find(local, c->nr_vertices, v[k]);
+			if (l < 0) {
+				l = c->nr_vertices++;
+				local[l] = v[k];
+				ml->nr_vertices++;
+			}
+
+			ml->triangles[(size_t)ml->nr_triangles * 3 + k] = l;
+		}
+
+		c->nr_triangles++;
+		ml->nr_triangles++;
+	}
+
+	wf_meshlet_close(m, ml);
+}
+
+static void *wf_meshlet_worker(void *arg)
+{
+	struct wf_meshlet_worker *w = arg;
+
+	for (unsigned int i = w->first; i < w->nr_blocks; i += w->step)
+		wf_meshlet_block_build(&w->blocks[i]);
+
+	return NULL;
+}
+
+// run workers, the first one on the calling thread
+static void wf_meshlet_run(struct wf_meshlet_worker *workers, unsigned int nr_workers)
+{
+	pthread_t threads[nr_workers];
+	int started[nr_workers];
+
+	for (unsigned int i = 1; i < nr_workers; i++) {
+		started[i] = !pthread_create(&threads[i], NULL, wf_meshlet_worker, &workers[i]);
+		if (!started[i])
+			wf_meshlet_worker(&workers[i]);
+	}
+
+	wf_meshlet_worker(&workers[0]);
+
+	for (unsigned int i = 1; i < nr_workers; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+	}
+}
+
+// concatenate blocks in index order
+static int wf_meshlet_merge(struct wf_meshlet_block *blocks, unsigned int nr_blocks, struct wf_meshlets *ml)
+{
+	struct wf_meshlets *b;
+	struct wf_meshlet *c;
+
+	for (unsigned int i = 0; i < nr_blocks; i++) {
+		ml->nr_meshlets += blocks[i].out.nr_meshlets;
+		ml->nr_vertices += blocks[i].out.nr_vertices;
+		ml->nr_triangles += blocks[i].out.nr_triangles;
+	}
+
+	ml->meshlets = malloc(((size_t)ml->nr_meshlets + 1) * sizeof(*ml->meshlets));
+	ml->vertices = malloc(((size_t)ml->nr_vertices + 1) * sizeof(*ml->vertices));
+	ml->triangles = malloc((size_t)ml->nr_triangles * 3 + 1);
+	if (!ml->meshlets || !ml->vertices || !ml->triangles)
+		return ENOMEM;
+
+	ml->nr_meshlets = ml->nr_vertices = ml->nr_triangles = 0;
+
+	for (unsigned int i = 0; i < nr_blocks; i++) {
+		b = &blocks[i].out;
+
+		for (unsigned int j = 0; j < b->nr_meshlets; j++) {
+			c = &ml->meshlets[ml->nr_meshlets + j];
+			*c = b->meshlets[j];
+			c->vertex_offset += ml->nr_vertices;
+			c->triangle_offset += ml->nr_triangles;
+		}
+
+		memcpy(ml->vertices + ml->nr_vertices, b->vertices, (size_t)b->nr_vertices * sizeof(*ml->vertices));
+		memcpy(ml->triangles + (size_t)ml->nr_triangles * 3, b->triangles, (size_t)b->nr_triangles * 3);
+
+		ml->nr_meshlets += b->nr_meshlets;
+		ml->nr_vertices += b->nr_vertices;
+		ml->nr_triangles += b->nr_triangles;
+	}
+
+	return 0;
+}
+
+int wf_mesh_build_meshlets(const struct wf_mesh *m, unsigned int nr_threads, struct wf_meshlets *ml)
+{
+	size_t nr_triangles = m->nr_indices / 3;
+	unsigned int nr_blocks = (nr_triangles + WF_MESHLET_BLOCK - 1) / WF_MESHLET_BLOCK;
+	struct wf_meshlet_block *blocks;
+	int r = 0;
+
+	memset(ml, 0, sizeof(*ml));
+
+	if (!nr_blocks)
+		return 0;
+
+	if (nr_threads > nr_blocks)
+		nr_threads = nr_blocks;
+
+	if (!nr_threads)
+		nr_threads = 1;
+
+	blocks = calloc(nr_blocks, sizeof(*blocks));
+	if (!blocks) {
+		icg_log_error("malloc() fail\n");
+		return ENOMEM;
+	}
+
+	struct wf_meshlet_worker workers[nr_threads];
+
+	for (unsigned int i = 0; i < nr_blocks; i++) {
+		blocks[i].m = m;
+		blocks[i].first = (size_t)i * WF_MESHLET_BLOCK;
+		blocks[i].count = nr_triangles - blocks[i].first;
+		if (blocks[i].count > WF_MESHLET_BLOCK)
+			blocks[i].count = WF_MESHLET_BLOCK;
+	}
+
+	for (unsigned int i = 0; i < nr_threads; i++)
+		workers[i] = (struct wf_meshlet_worker){blocks, nr_blocks, i, nr_threads};
+
+	wf_meshlet_run(workers, nr_threads);
+
+	for (unsigned int i = 0; i < nr_blocks && !r; i++)
+		r = blocks[i].r;
+
+	if (!r)
+		r = wf_meshlet_merge(blocks, nr_blocks, ml);
+
+	for (unsigned int i = 0; i < nr_blocks; i++)
+		wf_meshlets_clean(&blocks[i].out);
+
+	free(blocks);
+
+	if (r) {
+		icg_log_error("malloc() fail\n");
+		wf_meshlets_clean(ml);
+	}
+
+	return r;
+}
+
+int wf_meshlet_cull(const struct wf_meshlet *c, const float camera[3], const float (*planes)[4], unsigned int nr_planes)
+{
+	float d[3], l, dot;
+
+	for (unsigned int i = 0; planes && i < nr_planes; i++) {
+		if (planes[i][0] * c->center[0] + planes[i][1] * c->center[1] + planes[i][2] * c->center[2] +
+		    planes[i][3] < -c->radius)
+			return 1;
+	}
+
+	if (!camera || c->cone_cutoff >= 1.0f)
+		return 0;
+
+	for (int k = 0; k < 3; k++)
+		d[k] = c->center[k] - camera[k];
+
+	l = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+	dot = d[0] * c->cone_axis[0] + d[1] * c->cone_axis[1] + d[2] * c->cone_axis[2];
+
+	// every triangle of the sphere faces away from the camera
+	return dot >= c->cone_cutoff * l + c->radius;
+}
+
+void wf_meshlets_clean(struct wf_meshlets *ml)
+{
+	free(ml->meshlets);
+	free(ml->vertices);
+	free(ml->triangles);
+	memset(ml, 0, sizeof(*ml));
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// parser internals shared by the loaders of the library
+
+#include <stddef.h>
+
+#include "wavefront_obj.h"
+
+// internal flag of a view, streams are slots of a block owned by someone else and never grow
+#define WF_OBJ_FIXED (1u << 31)
+
+// record counts of a text range, also used as a prefix of a chunk
+struct wf_obj_counts {
+	size_t nr_lines;
+	size_t nr_vertices;
+	size_t nr_texcoords;
+	size_t nr_normals;
+	size_t nr_corners;
+};
+
+// parse position, line is the number of the line at the cursor on return
+struct wf_obj_error {
+	size_t line;
+	const char *what;
+};
+
+// fast count pass, only line starts and face tokens are inspected
+void wf_obj_count(const char *p, const char *end, struct wf_obj_counts *c);
+
+// parse records of [*cursor, end) appending them to o, base is records before the cursor,
+// err->line must hold the line number of the cursor; on return the cursor is at the failed line,
+// a line which does not fit a fixed view is rolled back with EOVERFLOW so it can be parsed later
+int wf_obj_parse_range(const char **cursor, const char *end, struct wf_obj *o,
+		       const struct wf_obj_counts *base, struct wf_obj_error *err);
+
+void wf_obj_print_error(int r, const struct wf_obj_error *err);
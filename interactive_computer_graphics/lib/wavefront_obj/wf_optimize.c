@@ -0,0 +1,567 @@
+// index buffer optimizations
+//
+// vertex cache: Tipsify, Sander et al. "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+// overdraw: clusters of the Tipsify order sorted to draw outward facing ones first (same paper)
+// vertex fetch: vertices reordered by first use, indices remapped
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <icg/log.h>
+
+#include "wavefront_obj.h"
+#include "wf_mesh_internal.h"
+
+// cache line of the vertex fetch simulation, bytes
+#define WF_FETCH_LINE 64
+
+// lines of the vertex fetch simulation, fifo
+#define WF_FETCH_LINES 64
+
+// smallest cluster split at a soft boundary, triangles
+#define WF_OVERDRAW_MIN_CLUSTER 64
+
+// vertex to triangle adjacency
+struct wf_adjacency {
+	uint32_t *offsets;	// nr_vertices + 1
+	uint32_t *triangles;
+	uint32_t *live;		// not yet emitted triangles per vertex
+};
+
+static void wf_adjacency_clean(struct wf_adjacency *a)
+{
+	free(a->offsets);
+	free(a->triangles);
+	free(a->live);
+}
+
+static int wf_adjacency_build(const uint32_t *indices, size_t nr_indices, unsigned int nr_vertices, struct wf_adjacency *a)
+{
+	a->offsets = calloc((size_t)nr_vertices + 1, sizeof(*a->offsets));
+	a->triangles = malloc((nr_indices + 1) * sizeof(*a->triangles));
+	a->live = calloc((size_t)nr_vertices + 1, sizeof(*a->live));
+	if (!a->offsets || !a->triangles || !a->live) {
+		icg_log_error("malloc() fail\n");
+		wf_adjacency_clean(a);
+		return ENOMEM;
+	}
+
+	for (size_t i = 0; i < nr_indices; i++)
+		a->live[indices[i]]++;
+
+	for (unsigned int v = 0; v < nr_vertices; v++)
+		a->offsets[v + 1] = a->offsets[v] + a->live[v];
+
+	// offsets are used as fill cursors and shifted back after
+	for (size_t i = 0; i < nr_indices; i++)
+		a->triangles[a->offsets[indices[i]]++] = i / 3;
+
+	for (unsigned int v = nr_vertices; v > 0; v--)
+		a->offsets[v] = a->offsets[v - 1];
+
+	a->offsets[0] = 0;
+
+	return 0;
+}
+
+// next fanning vertex, the one which stays in cache after its remaining triangles are emitted
+static int64_t wf_tipsify_next(const uint32_t *candidates, unsigned int nr_candidates, const struct wf_adjacency *a,
+			       const uint32_t *timestamps, uint32_t time, unsigned int cache_size,
+			       uint32_t *dead_end, size_t *nr_dead_end, uint32_t *cursor, unsigned int nr_vertices,
+			       int *jump)
+{
+	int64_t best = -1;
+	int best_priority = -1, priority;
+	uint32_t v;
+
+	for (unsigned int i = 0; i < nr_candidates; i++) {
+		v = candidates[i];
+
+		if (!a->live[v])
+			continue;
+
+		priority = 0;
+		if (time - timestamps[v] + 2 * a->live[v] <= cache_size)
+			priority = time - timestamps[v];
+
+		if (priority > best_priority) {
+			best_priority = priority;
+			best = v;
+		}
+	}
+
+	*jump = best < 0;
+
+	if (best >= 0)
+		return best;
+
+	// dead end, recent vertices first then the input order
+	while (*nr_dead_end) {
+		v = dead_end[--*nr_dead_end];
+		if (a->live[v])
+			return v;
+	}
+
+	for (; *cursor < nr_vertices; (*cursor)++) {
+		if (a->live[*cursor])
+			return *cursor;
+	}
+
+	return -1;
+}
+
+// reorder triangles of indices into out, clusters receive first triangles of runs split by dead ends
+static int wf_tipsify(const uint32_t *indices, size_t nr_indices, unsigned int nr_vertices, unsigned int cache_size,
+		      uint32_t *out, uint32_t *clusters, size_t *nr_clusters)
+{
+	size_t nr_triangles = nr_indices / 3, nr_out = 0, nr_dead_end = 0;
+	uint32_t *timestamps, *dead_end, candidates[64], cursor = 0, time = cache_size + 1, v, t;
+	unsigned int nr_candidates;
+	struct wf_adjacency a;
+	unsigned char *emitted;
+	int64_t f = 0;
+	int r, jump = 1;
+
+	r = wf_adjacency_build(indices, nr_indices, nr_vertices, &a);
+	if (r)
+		return r;
+
+	timestamps = calloc((size_t)nr_vertices + 1, sizeof(*timestamps));
+	dead_end = malloc((nr_indices + 1) * sizeof(*dead_end));
+	emitted = calloc(nr_triangles + 1, 1);
+	if (!timestamps || !dead_end || !emitted) {
+		icg_log_error("malloc() fail\n");
+		r = ENOMEM;
+		goto out;
+	}
+
+	*nr_clusters = 0;
+
+	while (f >= 0) {
+		// a dead end jump flushes the cache, the next run is a new cluster
+		if (jump && (!*nr_clusters || clusters[*nr_clusters - 1] != nr_out / 3))
+			clusters[(*nr_clusters)++] = nr_out / 3;
+
+		nr_candidates = 0;
+
+		for (uint32_t i = a.offsets[f]; i < a.offsets[f + 1]; i++) {
+			t = a.triangles[i];
+			if (emitted[t])
+				continue;
+
+			for (int k = 0; k < 3; k++) {
+				v = indices[t * 3 + k];
+				out[nr_out++] = v;
+
+				dead_end[nr_dead_end++] = v;
+				if (nr_candidates < sizeof(candidates) / sizeof(candidates[0]))
+					candidates[nr_candidates++] = v;
+
+				a.live[v]--;
+
+				if (time - timestamps[v] > cache_size)
+					timestamps[v] = time++;
+			}
+
+			emitted[t] = 1;
+		}
+
+		f = wf_tipsify_next(candidates, nr_candidates, &a, timestamps, time, cache_size,
+				    dead_end, &nr_dead_end, &cursor, nr_vertices, &jump);
+	}
+
+out:
+	free(timestamps);
+	free(dead_end);
+	free(emitted);
+	wf_adjacency_clean(&a);
+	return r;
+}
+
+// fifo post transform cache simulation, \return number of transformed vertices
+static size_t wf_cache_misses(const uint32_t *indices, size_t nr_indices, unsigned int nr_vertices, unsigned int cache_size,
+			      uint32_t *timestamps, unsigned char *misses)
+{
+	uint32_t time = cache_size + 1;
+	size_t nr_misses = 0;
+
+	memset(timestamps, 0, ((size_t)nr_vertices + 1) * sizeof(*timestamps));
+
+	for (size_t i = 0; i < nr_indices; i++) {
+		uint32_t v = indices[i];
+		int miss = time - timestamps[v] > cache_size;
+
+		if (miss)
+			timestamps[v] = time++;
+
+		if (misses)
+			misses[i] = miss;
+
+		nr_misses += miss;
+	}
+
+	return nr_misses;
+}
+
+static void wf_mesh_put_indices(struct wf_mesh *m, const uint32_t *indices)
+{
+	for (size_t i = 0; i < m->nr_indices; i++)
+		wf_mesh_set_index(m, i, indices[i]);
+}
+
+int wf_mesh_optimize_vertex_cache(struct wf_mesh *m, unsigned int cache_size)
+{
+	uint32_t *indices, *out, *clusters;
+	size_t nr_clusters;
+	int r;
+
+	if (!m->nr_indices)
+		return 0;
+
+	r = wf_mesh_own(m);
+	if (r)
+		return r;
+
+	indices = wf_mesh_indices32(m);
+	out = malloc(((size_t)m->nr_indices + 1) * sizeof(*out));
+	clusters = malloc(((size_t)m->nr_indices / 3 + 1) * sizeof(*clusters));
+	if (!indices || !out || !clusters) {
+		icg_log_error("malloc() fail\n");
+		r = ENOMEM;
+		goto out;
+	}
+
+	r = wf_tipsify(indices, m->nr_indices, m->nr_vertices, cache_size, out, clusters, &nr_clusters);
+	if (!r)
+		wf_mesh_put_indices(m, out);
+
+out:
+	free(indices);
+	free(out);
+	free(clusters);
+	return r;
+}
+
+// cluster of triangles, sorted by the occlusion potential
+struct wf_cluster {
+	uint32_t first;		// triangle
+	uint32_t count;
+	float sort_key;
+};
+
+static int wf_cluster_cmp(const void *a, const void *b)
+{
+	const struct wf_cluster *x = a, *y = b;
+
+	if (x->sort_key != y->sort_key)
+		return x->sort_key < y->sort_key ? 1 : -1;
+
+	// stable for equal keys
+	return (x->first > y->first) - (x->first < y->first);
+}
+
+// area weighted centroid and normal of a cluster, key is the normal projection of the centroid
+// from the mesh center, outward facing clusters are drawn first and occlude the rest
+static float wf_cluster_key(const struct wf_mesh *m, const uint32_t *indices, const struct wf_cluster *c, const float center[3])
+{
+	float centroid[3] = {0}, normal[3] = {0}, area = 0, e1[3], e2[3], n[3], a, len;
+
+	for (uint32_t t = c->first; t < c->first + c->count; t++) {
+		const float *p0 = wf_mesh_position(m, indices[t * 3]);
+		const float *p1 = wf_mesh_position(m, indices[t * 3 + 1]);
+		const float *p2 = wf_mesh_position(m, indices[t * 3 + 2]);
+
+		for (int k = 0; k < 3; k++) {
+			e1[k] = p1[k] - p0[k];
+			e2[k] = p2[k] - p0[k];
+		}
+
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+		a = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+		for (int k = 0; k < 3; k++) {
+			centroid[k] += (p0[k] + p1[k] + p2[k]) * (a / 3.0f);
+			normal[k] += n[k];
+		}
+
+		area += a;
+	}
+
+	len = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+	if (area <= 0.0f || len <= 0.0f)
+		return 0.0f;
+
+	for (int k = 0; k < 3; k++) {
+		centroid[k] /= area;
+		normal[k] /= len;
+	}
+
+	return (centroid[0] - center[0]) * normal[0] + (centroid[1] - center[1]) * normal[1] + (centroid[2] - center[2]) * normal[2];
+}
+
+// split the clusters of hard (dead end) boundaries at soft ones: once a cluster has at least
+// WF_OVERDRAW_MIN_CLUSTER triangles and an acmr of limit or better. Clusters are simulated from an empty
+// cache, after sorting one may follow any other; advancing time by more than the cache size empties it
+// \return vertices transformed by all clusters
+static size_t wf_overdraw_clusters(const uint32_t *indices, const uint32_t *hard, size_t nr_hard, unsigned int nr_vertices,
+				   unsigned int cache_size, float limit, uint32_t *timestamps, struct wf_cluster *clusters,
+				   size_t *nr_clusters)
+{
+	size_t nr_misses = 0, cluster_misses;
+	uint32_t time = cache_size + 1, v;
+
+	memset(timestamps, 0, ((size_t)nr_vertices + 1) * sizeof(*timestamps));
+	*nr_clusters = 0;
+
+	for (size_t h = 0; h < nr_hard; h++) {
+		struct wf_cluster *c = &clusters[*nr_clusters];
+
+		c->first = hard[h];
+		cluster_misses = 0;
+		time += cache_size + 1;
+
+		for (uint32_t pos = hard[h]; pos < hard[h + 1]; pos++) {
+			uint32_t count = pos + 1 - c->first;
+
+			for (int k = 0; k < 3; k++) {
+				v = indices[pos * 3 + k];
+				if (time - timestamps[v] > cache_size) {
+					timestamps[v] = time++;
+					cluster_misses++;
+				}
+			}
+
+			if (pos + 1 < hard[h + 1] && count >= WF_OVERDRAW_MIN_CLUSTER && (float)cluster_misses / count <= limit) {
+				c->count = count;
+				nr_misses += cluster_misses;
+				(*nr_clusters)++;
+
+				c = &clusters[*nr_clusters];
+				c->first = pos + 1;
+				cluster_misses = 0;
+				time += cache_size + 1;
+			}
+		}
+
+		c->count = hard[h + 1] - c->first;
+		nr_misses += cluster_misses;
+		(*nr_clusters)++;
+	}
+
+	return nr_misses;
+}
+
+int wf_mesh_optimize_overdraw(struct wf_mesh *m, unsigned int cache_size, float threshold)
+{
+	size_t nr_triangles = m->nr_indices / 3, nr_hard, nr_clusters = 0, nr_misses, budget;
+	uint32_t *indices, *out = NULL, *hard = NULL, *timestamps = NULL;
+	struct wf_cluster *clusters = NULL;
+	float center[3], acmr, lo = 0, hi, limit;
+	int r;
+
+	if (!m->nr_indices)
+		return 0;
+
+	r = wf_mesh_own(m);
+	if (r)
+		return r;
+
+	indices = wf_mesh_indices32(m);
+	out = malloc(((size_t)m->nr_indices + 1) * sizeof(*out));
+	hard = malloc((nr_triangles + 2) * sizeof(*hard));
+	clusters = malloc((nr_triangles + 1) * sizeof(*clusters));
+	timestamps = malloc(((size_t)m->nr_vertices + 1) * sizeof(*timestamps));
+	if (!indices || !out || !hard || !clusters || !timestamps) {
+		icg_log_error("malloc() fail\n");
+		r = ENOMEM;
+		goto out;
+	}
+
+	r = wf_tipsify(indices, m->nr_indices, m->nr_vertices, cache_size, out, hard, &nr_hard);
+	if (r)
+		goto out;
+
+	hard[nr_hard] = nr_triangles;
+
+	// soft boundaries split clusters which are already close to the final cache efficiency,
+	// threshold 1.05 allows 5% worse acmr in exchange for finer sorting. Short clusters and their cold
+	// starts cost more than the split test sees, the per cluster limit is lowered until the sum fits
+	acmr = (float)wf_cache_misses(out, m->nr_indices, m->nr_vertices, cache_size, timestamps, NULL) / nr_triangles;
+	budget = acmr * threshold * nr_triangles;
+	hi = acmr * threshold;
+	limit = hi;
+
+	for (int i = 0; i < 8; i++) {
+		nr_misses = wf_overdraw_clusters(out, hard, nr_hard, m->nr_vertices, cache_size, limit, timestamps,
+						 clusters, &nr_clusters);
+		if (nr_misses <= budget) {
+			if (limit == hi)
+				break;
+			lo = limit;
+		} else {
+			hi = limit;
+		}
+
+		limit = (lo + hi) * 0.5f;
+	}
+
+	// the last try may be over budget, the best one within is taken
+	if (nr_misses > budget)
+		wf_overdraw_clusters(out, hard, nr_hard, m->nr_vertices, cache_size, lo, timestamps, clusters, &nr_clusters);
+
+	center[0] = (m->bounds_min.x + m->bounds_max.x) * 0.5f;
+	center[1] = (m->bounds_min.y + m->bounds_max.y) * 0.5f;
+	center[2] = (m->bounds_min.z + m->bounds_max.z) * 0.5f;
+
+	for (size_t c = 0; c < nr_clusters; c++)
+		clusters[c].sort_key = wf_cluster_key(m, out, &clusters[c], center);
+
+	qsort(clusters, nr_clusters, sizeof(*clusters), wf_cluster_cmp);
+
+	for (size_t c = 0, i = 0; c < nr_clusters; c++) {
+		memcpy(indices + i, out + (size_t)clusters[c].first * 3, (size_t)clusters[c].count * 3 * sizeof(*indices));
+		i += (size_t)clusters[c].count * 3;
+	}
+
+	wf_mesh_put_indices(m, indices);
+
+out:
+	free(indices);
+	free(out);
+	free(hard);
+	free(clusters);
+	free(timestamps);
+	return r;
+}
+
+int wf_mesh_optimize_vertex_fetch(struct wf_mesh *m)
+{
+	uint32_t *remap, next = 0, v;
+	char *vertices;
+	int r;
+
+	if (!m->nr_indices)
+		return 0;
+
+	r = wf_mesh_own(m);
+	if (r)
+		return r;
+
+	remap = malloc(((size_t)m->nr_vertices + 1) * sizeof(*remap));
+	vertices = malloc((size_t)m->nr_vertices * m->stride + 1);
+	if (!remap || !vertices) {
+		icg_log_error("malloc() fail\n");
+		free(remap);
+		free(vertices);
+		return ENOMEM;
+	}
+
+	memset(remap, 0xff, (size_t)m->nr_vertices * sizeof(*remap));
+
+	// order of first use, vertices never referenced are dropped
+	for (size_t i = 0; i < m->nr_indices; i++) {
+		v = wf_mesh_index(m, i);
+
+		if (remap[v] == UINT32_MAX) {
+			memcpy(vertices + (size_t)next * m->stride, wf_mesh_position(m, v), m->stride);
+			remap[v] = next++;
+		}
+
+		wf_mesh_set_index(m, i, remap[v]);
+	}
+
+	free(m->vertices);
+	m->vertices = (float *)vertices;
+	m->nr_vertices = next;
+
+	// dropped vertices may have spanned the bounds
+	wf_mesh_bounds(m);
+
+	free(remap);
+	return 0;
+}
+
+int wf_mesh_optimize(struct wf_mesh *m)
+{
+	int r;
+
+	r = wf_mesh_optimize_overdraw(m, WF_MESH_CACHE_SIZE, 1.05f);
+	if (r)
+		return r;
+
+	return wf_mesh_optimize_vertex_fetch(m);
+}
+
+void wf_mesh_analyze(const struct wf_mesh *m, unsigned int cache_size, struct wf_mesh_stats *s)
+{
+	uint64_t lines[WF_FETCH_LINES];
+	uint32_t *indices, *timestamps;
+	unsigned char *misses, *used;
+	size_t nr_misses, fetched = 0, head = 0, unique = 0;
+
+	memset(s, 0, sizeof(*s));
+
+	if (!m->nr_indices || !m->nr_vertices)
+		return;
+
+	indices = wf_mesh_indices32(m);
+	timestamps = malloc(((size_t)m->nr_vertices + 1) * sizeof(*timestamps));
+	misses = malloc((size_t)m->nr_indices + 1);
+	used = calloc(m->nr_vertices, 1);
+	if (!indices || !timestamps || !misses || !used) {
+		icg_log_error("malloc() fail\n");
+		goto out;
+	}
+
+	nr_misses = wf_cache_misses(indices, m->nr_indices, m->nr_vertices, cache_size, timestamps, misses);
+
+	// every transformed vertex is fetched through a small fifo of cache lines
+	memset(lines, 0xff, sizeof(lines));
+
+	for (size_t i = 0; i < m->nr_indices; i++) {
+		uint64_t first, last;
+
+		if (!misses[i])
+			continue;
+
+		first = (uint64_t)indices[i] * m->stride / WF_FETCH_LINE;
+		last = ((uint64_t)indices[i] * m->stride + m->stride - 1) / WF_FETCH_LINE;
+
+		for (uint64_t l = first; l <= last; l++) {
+			int hit = 0;
+
+			for (int k = 0; k < WF_FETCH_LINES && !hit; k++)
+				hit = lines[k] == l;
+
+			if (!hit) {
+				lines[head] = l;
+				head = (head + 1) % WF_FETCH_LINES;
+				fetched += WF_FETCH_LINE;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < m->nr_indices; i++) {
+		if (!used[indices[i]]) {
+			used[indices[i]] = 1;
+			unique++;
+		}
+	}
+
+	s->acmr = (float)nr_misses / (m->nr_indices / 3);
+	s->atvr = (float)nr_misses / unique;
+	s->overfetch = (float)fetched / ((double)unique * m->stride);
+
+out:
+	free(indices);
+	free(timestamps);
+	free(misses);
+	free(used);
+}
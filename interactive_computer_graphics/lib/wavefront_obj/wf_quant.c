@@ -0,0 +1,281 @@
+// vertex quantization
+//
+// position: 16 bit normalized integers relative to the mesh bounds, the w component pads to 8 bytes
+// texcoord: half floats
+// normal: octahedral mapping of the unit sphere to a square, 2 x snorm16 (Cigolle et al. "A Survey of
+// Efficient Representations for Independent Unit Vectors")
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <icg/log.h>
+
+#include "wavefront_obj.h"
+
+#define WF_QUANT_POSITION_SIZE (4 * sizeof(int16_t))
+#define WF_QUANT_TEXCOORD_SIZE (2 * sizeof(uint16_t))
+#define WF_QUANT_NORMAL_SIZE (2 * sizeof(int16_t))
+
+#define WF_SNORM16_MAX 32767.0f
+#define WF_UNORM16_MAX 65535.0f
+
+static inline float wf_quant_clamp(float v, float min, float max)
+{
+	return v < min ? min : v > max ? max : v;
+}
+
+static inline int16_t wf_snorm16(float v)
+{
+	return (int16_t)lrintf(wf_quant_clamp(v, -1.0f, 1.0f) * WF_SNORM16_MAX);
+}
+
+// decode as GL does for a normalized signed attribute
+static inline float wf_snorm16_float(int16_t q)
+{
+	float v = q / WF_SNORM16_MAX;
+
+	return v < -1.0f ? -1.0f : v;
+}
+
+static inline uint16_t wf_unorm16(float v)
+{
+	return (uint16_t)lrintf(wf_quant_clamp(v, 0.0f, 1.0f) * WF_UNORM16_MAX);
+}
+
+// round to nearest even, overflow gives infinity (F. Giesen, float_to_half_fast3_rtne)
+static uint16_t wf_half(float f)
+{
+	const uint32_t f32_inf = 255u << 23, f16_max = (127u + 16) << 23;
+	const uint32_t denorm_magic_bits = ((127u - 15) + (23 - 10) + 1) << 23;
+	uint32_t x, sign, o;
+	float denorm_magic;
+
+	memcpy(&x, &f, sizeof(x));
+	sign = x & 0x80000000u;
+	x ^= sign;
+
+	if (x >= f16_max) {
+		o = x > f32_inf ? 0x7e00 : 0x7c00;
+	} else if (x < (113u << 23)) {
+		// subnormal half, the addition does the rounding shift
+		memcpy(&denorm_magic, &denorm_magic_bits, sizeof(denorm_magic));
+		memcpy(&f, &x, sizeof(f));
+		f += denorm_magic;
+		memcpy(&x, &f, sizeof(x));
+		o = x - denorm_magic_bits;
+	} else {
+		o = (x >> 13) & 1;
+		x += ((uint32_t)(15 - 127) << 23) + 0xfff + o;
+		o = x >> 13;
+	}
+
+	return o | (sign >> 16);
+}
+
+static float wf_half_float(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16, e = (h >> 10) & 0x1f, m = h & 0x3ff, x;
+	float f;
+
+	if (!e) {
+		f = m * 0x1p-24f;
+		return sign ? -f : f;
+	}
+
+	if (e == 31)
+		x = sign | 0x7f800000u | (m << 13);
+	else
+		x = sign | ((e + 112) << 23) | (m << 13);
+
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+// project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the diagonals
+static void wf_oct_encode(const struct wf_normal *n, int16_t q[2])
+{
+	float l = fabsf(n->x) + fabsf(n->y) + fabsf(n->z), x, y, t;
+
+	if (l == 0.0f) {
+		q[0] = q[1] = 0;
+		return;
+	}
+
+	x = n->x / l;
+	y = n->y / l;
+
+	if (n->z < 0) {
+		t = x;
+		x = (1.0f - fabsf(y)) * (t >= 0 ? 1.0f : -1.0f);
+		y = (1.0f - fabsf(t)) * (y >= 0 ? 1.0f : -1.0f);
+	}
+
+	q[0] = wf_snorm16(x);
+	q[1] = wf_snorm16(y);
+}
+
+static void wf_oct_decode(const int16_t q[2], struct wf_normal *n)
+{
+	float x = wf_snorm16_float(q[0]), y = wf_snorm16_float(q[1]), z = 1.0f - fabsf(x) - fabsf(y), t, l;
+
+	if (z < 0) {
+		t = x;
+		x = (1.0f - fabsf(y)) * (t >= 0 ? 1.0f : -1.0f);
+		y = (1.0f - fabsf(t)) * (y >= 0 ? 1.0f : -1.0f);
+	}
+
+	l = sqrtf(x * x + y * y + z * z);
+	n->x = x / l;
+	n->y = y / l;
+	n->z = z / l;
+}
+
+// angle between source and decoded normal, degrees; atan2 keeps small angles which acos loses
+static float wf_normal_error(const struct wf_normal *n, const struct wf_normal *d)
+{
+	float cx = n->y * d->z - n->z * d->y;
+	float cy = n->z * d->x - n->x * d->z;
+	float cz = n->x * d->y - n->y * d->x;
+	float c = n->x * d->x + n->y * d->y + n->z * d->z;
+
+	return atan2f(sqrtf(cx * cx + cy * cy + cz * cz), c) * (180.0f / (float)M_PI);
+}
+
+static void wf_quant_bounds(const struct wf_mesh *m, unsigned int flags, struct wf_qmesh *q)
+{
+	const float *min = &m->bounds_min.x, *max = &m->bounds_max.x;
+	float extent;
+
+	for (int k = 0; k < 3; k++) {
+		extent = max[k] - min[k];
+
+		// a flat axis keeps every vertex at the offset
+		if (extent <= 0.0f)
+			extent = 1.0f;
+
+		if (flags & WF_QUANT_UNORM16) {
+			q->scale[k] = extent;
+			q->offset[k] = min[k];
+		} else {
+			q->scale[k] = extent * 0.5f;
+			q->offset[k] = (min[k] + max[k]) * 0.5f;
+		}
+	}
+}
+
+static void wf_quant_position(const float *p, struct wf_qmesh *q, char *dst)
+{
+	int16_t s[4] = {0};
+	uint16_t u[4] = {0};
+	float d, e;
+
+	for (int k = 0; k < 3; k++) {
+		if (q->flags & WF_QUANT_UNORM16) {
+			u[k] = wf_unorm16((p[k] - q->offset[k]) / q->scale[k]);
+			d = u[k] / WF_UNORM16_MAX * q->scale[k] + q->offset[k];
+		} else {
+			s[k] = wf_snorm16((p[k] - q->offset[k]) / q->scale[k]);
+			d = wf_snorm16_float(s[k]) * q->scale[k] + q->offset[k];
+		}
+
+		e = fabsf(d - p[k]);
+		if (e > q->position_error)
+			q->position_error = e;
+	}
+
+	if (q->flags & WF_QUANT_UNORM16)
+		memcpy(dst, u, sizeof(u));
+	else
+		memcpy(dst, s, sizeof(s));
+}
+
+static void wf_quant_texcoord(const struct wf_texcoord *t, struct wf_qmesh *q, char *dst)
+{
+	uint16_t h[2] = {wf_half(t->u), wf_half(t->v)};
+	float e;
+
+	e = fmaxf(fabsf(wf_half_float(h[0]) - t->u), fabsf(wf_half_float(h[1]) - t->v));
+	if (e > q->texcoord_error)
+		q->texcoord_error = e;
+
+	memcpy(dst, h, sizeof(h));
+}
+
+static void wf_quant_normal(const struct wf_normal *n, struct wf_qmesh *q, char *dst)
+{
+	struct wf_normal d;
+	int16_t o[2];
+	float e;
+
+	wf_oct_encode(n, o);
+	wf_oct_decode(o, &d);
+
+	e = wf_normal_error(n, &d);
+	if (e > q->normal_error)
+		q->normal_error = e;
+
+	memcpy(dst, o, sizeof(o));
+}
+
+int wf_mesh_quantize(const struct wf_mesh *m, unsigned int flags, struct wf_qmesh *q)
+{
+	const char *src;
+	struct wf_texcoord t;
+	struct wf_normal n;
+	float p[3];
+	char *dst;
+
+	memset(q, 0, sizeof(*q));
+	q->flags = flags;
+	q->attribs = m->attribs;
+	q->nr_vertices = m->nr_vertices;
+	q->stride = WF_QUANT_POSITION_SIZE;
+
+	if (m->attribs & WF_MESH_TEXCOORD) {
+		q->texcoord_offset = q->stride;
+		q->stride += WF_QUANT_TEXCOORD_SIZE;
+	}
+
+	if (m->attribs & WF_MESH_NORMAL) {
+		q->normal_offset = q->stride;
+		q->stride += WF_QUANT_NORMAL_SIZE;
+	}
+
+	wf_quant_bounds(m, flags, q);
+
+	q->vertices = malloc((size_t)m->nr_vertices * q->stride + 1);
+	if (!q->vertices) {
+		icg_log_error("malloc() fail\n");
+		return ENOMEM;
+	}
+
+	for (unsigned int i = 0; i < m->nr_vertices; i++) {
+		src = (const char *)m->vertices + (size_t)i * m->stride;
+		dst = (char *)q->vertices + (size_t)i * q->stride;
+
+		memcpy(p, src, sizeof(p));
+		wf_quant_position(p, q, dst);
+
+		if (m->attribs & WF_MESH_TEXCOORD) {
+			memcpy(&t, src + m->texcoord_offset, sizeof(t));
+			wf_quant_texcoord(&t, q, dst + q->texcoord_offset);
+		}
+
+		if (m->attribs & WF_MESH_NORMAL) {
+			memcpy(&n, src + m->normal_offset, sizeof(n));
+			wf_quant_normal(&n, q, dst + q->normal_offset);
+		}
+	}
+
+	return 0;
+}
+
+void wf_qmesh_clean(struct wf_qmesh *q)
+{
+	free(q->vertices);
+	memset(q, 0, sizeof(*q));
+}
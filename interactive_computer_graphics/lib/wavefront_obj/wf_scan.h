@@ -0,0 +1,152 @@
+#pragma once
+
+// in-place scanners for obj text, input is a [p, end) range and is not zero terminated
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// exact powers of ten representable by double (Clinger's fast path)
+static const double wf_scan_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static inline int wf_scan_is_digit(char c)
+{
+	return (unsigned char)(c - '0') < 10;
+}
+
+static inline int wf_scan_is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char *wf_scan_skip_blank(const char *p, const char *end)
+{
+	while (p < end && wf_scan_is_blank(*p))
+		p++;
+
+	return p;
+}
+
+// \return the first character of the next line or end
+static inline const char *wf_scan_next_line(const char *p, const char *end)
+{
+	p = memchr(p, '\n', end - p);
+	return p ? p + 1 : end;
+}
+
+// \return 1 if p is at the end of a token (blank, new line or end of input)
+static inline int wf_scan_is_token_end(const char *p, const char *end)
+{
+	return p == end || wf_scan_is_blank(*p) || *p == '\n';
+}
+
+// rare formats (inf, nan, hex, huge exponents, too many digits), copy token and use libc
+static inline const char *wf_scan_float_slow(const char *p, const char *end, float *val)
+{
+	char buf[64], *e;
+	size_t n = 0;
+
+	while (p + n < end && !wf_scan_is_token_end(p + n, end) && *(p + n) != '/') {
+		if (n == sizeof(buf) - 1)
+			return NULL;
+		n++;
+	}
+
+	if (!n)
+		return NULL;
+
+	memcpy(buf, p, n);
+	buf[n] = 0;
+
+	*val = strtof(buf, &e);
+	if (e != buf + n)
+		return NULL;
+
+	return p + n;
+}
+
+// \return pointer after the number or NULL if there is no valid number at p
+static inline const char *wf_scan_float(const char *p, const char *end, float *val)
+{
+	const char *s = p;
+	uint64_t m = 0;
+	int neg = 0, exp = 0, digits = 0, any = 0, e = 0, eneg = 0;
+	double d;
+
+	if (p < end && (*p == '-' || *p == '+'))
+		neg = *p++ == '-';
+
+	for (; p < end && wf_scan_is_digit(*p); p++, any = 1) {
+		if (digits < 19) {
+			m = m * 10 + (*p - '0');
+			digits += m != 0;
+		} else {
+			exp++;
+		}
+	}
+
+	if (p < end && *p == '.') {
+		for (p++; p < end && wf_scan_is_digit(*p); p++, any = 1) {
+			if (digits < 19) {
+				m = m * 10 + (*p - '0');
+				digits += m != 0;
+				exp--;
+			}
+		}
+	}
+
+	if (!any)
+		return wf_scan_float_slow(s, end, val);
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		if (p < end && (*p == '-' || *p == '+'))
+			eneg = *p++ == '-';
+
+		if (p == end || !wf_scan_is_digit(*p))
+			return NULL;
+
+		for (; p < end && wf_scan_is_digit(*p); p++) {
+			if (e < 10000)
+				e = e * 10 + (*p - '0');
+		}
+
+		exp += eneg ? -e : e;
+	}
+
+	if (m >> 53 || exp < -22 || exp > 22)
+		return wf_scan_float_slow(s, end, val);
+
+	d = (double)m;
+	d = exp < 0 ? d / wf_scan_pow10[-exp] : d * wf_scan_pow10[exp];
+	*val = (float)(neg ? -d : d);
+
+	return p;
+}
+
+// \return pointer after the integer or NULL if there is no valid integer at p
+static inline const char *wf_scan_int(const char *p, const char *end, long *val)
+{
+	const char *s;
+	long v = 0;
+	int neg = 0;
+
+	if (p < end && (*p == '-' || *p == '+'))
+		neg = *p++ == '-';
+
+	for (s = p; p < end && wf_scan_is_digit(*p); p++) {
+		if (v > 0x7fffffffL)
+			return NULL;
+
+		v = v * 10 + (*p - '0');
+	}
+
+	if (p == s)
+		return NULL;
+
+	*val = neg ? -v : v;
+	return p;
+}
@@ -0,0 +1,596 @@
+// mesh simplification
+//
+// quadric error metric edge collapse, Garland and Heckbert "Surface Simplification Using Quadric Error
+// Metrics". A vertex collapses onto a neighbor vertex, so every level of detail is an index buffer over
+// the vertices of the source mesh. Vertices of a position with several vertices (uv or normal seams) and
+// vertices of open or non manifold edges are locked, so seams and borders keep their exact shape.
+//
+// collapses run in passes: the cheapest edges are taken first and a pass skips edges near a vertex
+// which already moved in it, so the one ring of every collapse is exact when it is checked
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <icg/log.h>
+
+#include "wavefront_obj.h"
+#include "wf_mesh_internal.h"
+
+#define WF_SIMPLIFY_NONE UINT32_MAX
+
+// symmetric 4x4 matrix of the squared distance to planes, area weighted
+struct wf_quadric {
+	double a00, a11, a22, a01, a02, a12;
+	double b0, b1, b2;
+	double c;
+	double w;
+};
+
+struct wf_collapse {
+	uint32_t from;		// canonical vertex
+	uint32_t to;		// vertex of the edge triangle
+	float cost;		// squared distance
+};
+
+struct wf_simplify {
+	const struct wf_mesh *m;
+	uint32_t *indices;
+	size_t nr_indices;
+
+	uint32_t *canonical;	// first vertex of the same position
+	unsigned char *locked;	// by canonical vertex
+	struct wf_quadric *quadrics;
+
+	// one ring of canonical vertices over current triangles
+	uint32_t *offsets;
+	uint32_t *triangles;
+
+	struct wf_collapse *collapses;
+	uint32_t *target;	// collapse of the pass by canonical vertex
+	unsigned char *dirty;
+	uint32_t *mark;
+	uint32_t stamp;
+
+	float error;		// max collapse cost so far
+};
+
+static inline uint32_t wf_simplify_hash(const float *p)
+{
+	uint32_t x[3], h;
+
+	memcpy(x, p, sizeof(x));
+
+	h = x[0] * 0x9e3779b1u ^ x[1] * 0x85ebca77u ^ x[2] * 0xc2b2ae3du;
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+
+	return h;
+}
+
+static int wf_simplify_canonical(struct wf_simplify *s)
+{
+	const struct wf_mesh *m = s->m;
+	uint32_t *table, h, mask, slot, cap = 16;
+
+	while (cap < m->nr_vertices * 2ull)
+		cap *= 2;
+
+	mask = cap - 1;
+
+	table = calloc(cap, sizeof(*table));
+	if (!table)
+		return ENOMEM;
+
+	// slot keeps vertex index + 1, 0 is empty
+	for (uint32_t v = 0; v < m->nr_vertices; v++) {
+		for (h = wf_simplify_hash(wf_mesh_position(m, v)) & mask; ; h = (h + 1) & mask) {
+			slot = table[h];
+
+			if (!slot) {
+				table[h] = v + 1;
+				s->canonical[v] = v;
+				break;
+			}
+
+			if (!memcmp(wf_mesh_position(m, slot - 1), wf_mesh_position(m, v), 3 * sizeof(float))) {
+				s->canonical[v] = slot - 1;
+				break;
+			}
+		}
+	}
+
+	free(table);
+	return 0;
+}
+
+static void wf_quadric_add(struct wf_quadric *q, const struct wf_quadric *r)
+{
+	q->a00 += r->a00;
+	q->a11 += r->a11;
+	q->a22 += r->a22;
+	q->a01 += r->a01;
+	q->a02 += r->a02;
+	q->a12 += r->a12;
+	q->b0 += r->b0;
+	q->b1 += r->b1;
+	q->b2 += r->b2;
+	q->c += r->c;
+	q->w += r->w;
+}
+
+static double wf_quadric_eval(const struct wf_quadric *q, const float *p)
+{
+	double x = p[0], y = p[1], z = p[2];
+
+	return q->a00 * x * x + q->a11 * y * y + q->a22 * z * z +
+	       2 * (q->a01 * x * y + q->a02 * x * z + q->a12 * y * z) +
+	       2 * (q->b0 * x + q->b1 * y + q->b2 * z) + q->c;
+}
+
+static void wf_triangle_normal(const float *a, const float *b, const float *c, double n[3])
+{
+	double e1[3], e2[3];
+
+	for (int k = 0; k < 3; k++) {
+		e1[k] = (double)b[k] - a[k];
+		e2[k] = (double)c[k] - a[k];
+	}
+
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+static void wf_simplify_quadrics(struct wf_simplify *s)
+{
+	const float *p[3];
+	struct wf_quadric q;
+	double n[3], l, d;
+
+	for (size_t i = 0; i < s->nr_indices; i += 3) {
+		for (int k = 0; k < 3; k++)
+			p[k] = wf_mesh_position(s->m, s->indices[i + k]);
+
+		wf_triangle_normal(p[0], p[1], p[2], n);
+
+		// plane weight is the triangle area
+		l = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (l == 0)
+			continue;
+
+		for (int k = 0; k < 3; k++)
+			n[k] /= l;
+
+		d = -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]);
+		l *= 0.5;
+
+		q = (struct wf_quadric){
+			n[0] * n[0] * l, n[1] * n[1] * l, n[2] * n[2] * l, n[0] * n[1] * l, n[0] * n[2] * l, n[1] * n[2] * l,
+			n[0] * d * l, n[1] * d * l, n[2] * d * l, d * d * l, l,
+		};
+
+		for (int k = 0; k < 3; k++)
+			wf_quadric_add(&s->quadrics[s->canonical[s->indices[i + k]]], &q);
+	}
+}
+
+static void wf_simplify_adjacency(struct wf_simplify *s)
+{
+	unsigned int nr_vertices = s->m->nr_vertices;
+	uint32_t c;
+
+	memset(s->offsets, 0, ((size_t)nr_vertices + 1) * sizeof(*s->offsets));
+
+	for (size_t i = 0; i < s->nr_indices; i++)
+		s->offsets[s->canonical[s->indices[i]] + 1]++;
+
+	for (unsigned int v = 0; v < nr_vertices; v++)
+		s->offsets[v + 1] += s->offsets[v];
+
+	// offsets are used as fill cursors and shifted back after
+	for (size_t i = 0; i < s->nr_indices; i++) {
+		c = s->canonical[s->indices[i]];
+		s->triangles[s->offsets[c]++] = i / 3;
+	}
+
+	for (unsigned int v = nr_vertices; v > 0; v--)
+		s->offsets[v] = s->offsets[v - 1];
+
+	s->offsets[0] = 0;
+}
+
+// canonical corner k of triangle t
+static inline uint32_t wf_simplify_corner(const struct wf_simplify *s, uint32_t t, int k)
+{
+	return s->canonical[s->indices[(size_t)t * 3 + k]];
+}
+
+// every edge from a vertex must come back by a triangle in the opposite direction, otherwise the
+// vertex is on a border or on a non manifold edge
+static int wf_simplify_border(const struct wf_simplify *s, uint32_t v)
+{
+	uint32_t t, u, next, found;
+	int k;
+
+	for (uint32_t i = s->offsets[v]; i < s->offsets[v + 1]; i++) {
+		t = s->triangles[i];
+
+		for (k = 0; wf_simplify_corner(s, t, k) != v; k++)
+			;
+
+		next = wf_simplify_corner(s, t, (k + 1) % 3);
+		found = 0;
+
+		for (uint32_t j = s->offsets[v]; j < s->offsets[v + 1]; j++) {
+			u = s->triangles[j];
+
+			for (k = 0; wf_simplify_corner(s, u, k) != v; k++)
+				;
+
+			found += wf_simplify_corner(s, u, (k + 2) % 3) == next;
+		}
+
+		if (found != 1)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void wf_simplify_lock(struct wf_simplify *s)
+{
+	unsigned int nr_vertices = s->m->nr_vertices;
+	uint32_t *wedge = s->target, c;
+
+	for (unsigned int v = 0; v < nr_vertices; v++)
+		wedge[v] = WF_SIMPLIFY_NONE;
+
+	// a position used by two vertices is a seam
+	for (size_t i = 0; i < s->nr_indices; i++) {
+		c = s->canonical[s->indices[i]];
+
+		if (wedge[c] == WF_SIMPLIFY_NONE)
+			wedge[c] = s->indices[i];
+		else if (wedge[c] != s->indices[i])
+			s->locked[c] = 1;
+	}
+
+	for (unsigned int v = 0; v < nr_vertices; v++) {
+		wedge[v] = WF_SIMPLIFY_NONE;
+
+		if (s->canonical[v] == v && !s->locked[v] && wf_simplify_border(s, v))
+			s->locked[v] = 1;
+	}
+}
+
+static int wf_collapse_cmp(const void *a, const void *b)
+{
+	const struct wf_collapse *x = a, *y = b;
+
+	if (x->cost != y->cost)
+		return x->cost < y->cost ? -1 : 1;
+
+	if (x->from != y->from)
+		return x->from < y->from ? -1 : 1;
+
+	return x->to < y->to ? -1 : x->to > y->to;
+}
+
+static size_t wf_simplify_candidates(struct wf_simplify *s)
+{
+	struct wf_quadric q;
+	size_t nr = 0;
+	uint32_t a, b, to;
+	double cost;
+
+	// an unlocked vertex has only interior edges, so the other triangle of an edge gives the
+	// opposite direction and one direction per corner covers all collapses
+	for (size_t i = 0; i < s->nr_indices; i++) {
+		to = s->indices[i - i % 3 + (i + 1) % 3];
+		a = s->canonical[s->indices[i]];
+		b = s->canonical[to];
+		if (s->locked[a] || a == b)
+			continue;
+
+		q = s->quadrics[a];
+		wf_quadric_add(&q, &s->quadrics[b]);
+
+		cost = q.w > 0 ? wf_quadric_eval(&q, wf_mesh_position(s->m, b)) / q.w : 0;
+		s->collapses[nr++] = (struct wf_collapse){a, to, cost > 0 ? cost : 0};
+	}
+
+	qsort(s->collapses, nr, sizeof(*s->collapses), wf_collapse_cmp);
+	return nr;
+}
+
+// the edge must have exactly two common neighbors, otherwise the collapse pinches the surface
+static int wf_simplify_link(struct wf_simplify *s, uint32_t a, uint32_t b)
+{
+	uint32_t t, v, common = 0;
+
+	s->stamp += 2;
+
+	for (uint32_t i = s->offsets[a]; i < s->offsets[a + 1]; i++) {
+		t = s->triangles[i];
+
+		for (int k = 0; k < 3; k++)
+			s->mark[wf_simplify_corner(s, t, k)] = s->stamp;
+	}
+
+	for (uint32_t i = s->offsets[b]; i < s->offsets[b + 1]; i++) {
+		t = s->triangles[i];
+
+		for (int k = 0; k < 3; k++) {
+			v = wf_simplify_corner(s, t, k);
+			if (v != a && v != b && s->mark[v] == s->stamp) {
+				s->mark[v] = s->stamp + 1;
+				common++;
+			}
+		}
+	}
+
+	return common == 2;
+}
+
+// triangles of a which stay must not flip when a moves to b
+static int wf_simplify_flips(const struct wf_simplify *s, uint32_t a, uint32_t b)
+{
+	const float *p[3], *q[3];
+	uint32_t t, v;
+	double n0[3], n1[3];
+	int keep;
+
+	for (uint32_t i = s->offsets[a]; i < s->offsets[a + 1]; i++) {
+		t = s->triangles[i];
+		keep = 1;
+
+		for (int k = 0; k < 3; k++) {
+			v = wf_simplify_corner(s, t, k);
+			keep &= v != b;
+			p[k] = wf_mesh_position(s->m, v);
+			q[k] = v == a ? wf_mesh_position(s->m, b) : p[k];
+		}
+
+		if (!keep)
+			continue;
+
+		wf_triangle_normal(p[0], p[1], p[2], n0);
+		wf_triangle_normal(q[0], q[1], q[2], n1);
+
+		if (n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void wf_simplify_touch(struct wf_simplify *s, uint32_t a)
+{
+	uint32_t t;
+
+	for (uint32_t i = s->offsets[a]; i < s->offsets[a + 1]; i++) {
+		t = s->triangles[i];
+
+		for (int k = 0; k < 3; k++)
+			s->dirty[wf_simplify_corner(s, t, k)] = 1;
+	}
+}
+
+// drop triangles which collapsed to an edge
+static void wf_simplify_apply(struct wf_simplify *s)
+{
+	uint32_t c[3], *tri;
+	size_t nr = 0;
+
+	for (size_t i = 0; i < s->nr_indices; i += 3) {
+		tri = s->indices + nr;
+
+		for (int k = 0; k < 3; k++) {
+			tri[k] = s->indices[i + k];
+			if (s->target[s->canonical[tri[k]]] != WF_SIMPLIFY_NONE)
+				tri[k] = s->target[s->canonical[tri[k]]];
+
+			c[k] = s->canonical[tri[k]];
+		}
+
+		if (c[0] != c[1] && c[1] != c[2] && c[0] != c[2])
+			nr += 3;
+	}
+
+	s->nr_indices = nr;
+}
+
+// one pass of collapses, at most down to target triangles
+// \return number of collapses
+static size_t wf_simplify_pass(struct wf_simplify *s, size_t target)
+{
+	size_t nr_candidates, nr_collapses = 0, nr_triangles = s->nr_indices / 3;
+	struct wf_collapse *c;
+	uint32_t b;
+
+	wf_simplify_adjacency(s);
+	nr_candidates = wf_simplify_candidates(s);
+
+	memset(s->dirty, 0, s->m->nr_vertices);
+
+	for (size_t i = 0; i < nr_candidates; i++) {
+		// an interior collapse removes two triangles
+		if (nr_triangles - 2 * nr_collapses <= target)
+			break;
+
+		c = &s->collapses[i];
+		b = s->canonical[c->to];
+
+		if (s->dirty[c->from] || s->dirty[b])
+			continue;
+
+		if (!wf_simplify_link(s, c->from, b) || wf_simplify_flips(s, c->from, b))
+			continue;
+
+		s->target[c->from] = c->to;
+		wf_quadric_add(&s->quadrics[b], &s->quadrics[c->from]);
+		wf_simplify_touch(s, c->from);
+
+		if (c->cost > s->error)
+			s->error = c->cost;
+
+		nr_collapses++;
+	}
+
+	if (nr_collapses)
+		wf_simplify_apply(s);
+
+	for (size_t i = 0; i < nr_candidates; i++)
+		s->target[s->collapses[i].from] = WF_SIMPLIFY_NONE;
+
+	return nr_collapses;
+}
+
+static void wf_simplify_clean(struct wf_simplify *s)
+{
+	free(s->indices);
+	free(s->canonical);
+	free(s->locked);
+	free(s->quadrics);
+	free(s->offsets);
+	free(s->triangles);
+	free(s->collapses);
+	free(s->target);
+	free(s->dirty);
+	free(s->mark);
+}
+
+static int wf_simplify_init(struct wf_simplify *s, const struct wf_mesh *m)
+{
+	size_t nr_vertices = (size_t)m->nr_vertices + 1;
+
+	memset(s, 0, sizeof(*s));
+	s->m = m;
+	s->nr_indices = m->nr_indices;
+
+	s->indices = wf_mesh_indices32(m);
+	s->canonical = malloc(nr_vertices * sizeof(*s->canonical));
+	s->locked = calloc(nr_vertices, 1);
+	s->quadrics = calloc(nr_vertices, sizeof(*s->quadrics));
+	s->offsets = malloc((nr_vertices + 1) * sizeof(*s->offsets));
+	s->triangles = malloc(((size_t)m->nr_indices + 1) * sizeof(*s->triangles));
+	s->collapses = malloc(((size_t)m->nr_indices + 1) * sizeof(*s->collapses));
+	s->target = malloc(nr_vertices * sizeof(*s->target));
+	s->dirty = malloc(nr_vertices);
+	s->mark = calloc(nr_vertices, sizeof(*s->mark));
+	if (!s->indices || !s->canonical || !s->locked || !s->quadrics || !s->offsets || !s->triangles ||
+	    !s->collapses || !s->target || !s->dirty || !s->mark || wf_simplify_canonical(s)) {
+		icg_log_error("malloc() fail\n");
+		wf_simplify_clean(s);
+		return ENOMEM;
+	}
+
+	wf_simplify_quadrics(s);
+	wf_simplify_adjacency(s);
+	wf_simplify_lock(s);
+
+	return 0;
+}
+
+static int wf_lods_push(struct wf_lods *l, const struct wf_simplify *s)
+{
+	struct wf_lod *lod = &l->lods[l->nr_lods];
+
+	lod->indices = malloc(s->nr_indices * l->index_size + 1);
+	if (!lod->indices) {
+		icg_log_error("malloc() fail\n");
+		return ENOMEM;
+	}
+
+	for (size_t i = 0; i < s->nr_indices; i++) {
+		if (l->index_size == 2)
+			((uint16_t *)lod->indices)[i] = s->indices[i];
+		else
+			((uint32_t *)lod->indices)[i] = s->indices[i];
+	}
+
+	lod->nr_indices = s->nr_indices;
+	lod->error = sqrtf(s->error);
+	l->nr_lods++;
+
+	return 0;
+}
+
+int wf_mesh_build_lods(const struct wf_mesh *m, float ratio, unsigned int min_triangles, struct wf_lods *l)
+{
+	struct wf_simplify s;
+	size_t target, nr_triangles;
+	int r;
+
+	memset(l, 0, sizeof(*l));
+	l->index_size = m->index_size;
+
+	if (!m->nr_indices)
+		return 0;
+
+	r = wf_simplify_init(&s, m);
+	if (r)
+		return r;
+
+	for (unsigned int v = 0; v < m->nr_vertices; v++)
+		l->nr_locked += s.canonical[v] == v && s.locked[v];
+
+	// the source is the first level
+	r = wf_lods_push(l, &s);
+
+	while (!r && l->nr_lods < WF_LOD_MAX) {
+		nr_triangles = s.nr_indices / 3;
+		target = nr_triangles * ratio;
+		if (target < min_triangles)
+			break;
+
+		while (s.nr_indices / 3 > target && wf_simplify_pass(&s, target))
+			;
+
+		// nothing but locked vertices is left
+		if (s.nr_indices / 3 == nr_triangles)
+			break;
+
+		r = wf_lods_push(l, &s);
+	}
+
+	wf_simplify_clean(&s);
+
+	if (r)
+		wf_lods_clean(l);
+
+	return r;
+}
+
+unsigned int wf_lods_select(const struct wf_lods *l, float distance, float fov, unsigned int height, float pixel_error)
+{
+	float pixels_per_unit;
+	unsigned int i;
+
+	if (distance <= 0 || !l->nr_lods)
+		return 0;
+
+	pixels_per_unit = height / (2.0f * distance * tanf(fov * 0.5f));
+
+	for (i = l->nr_lods - 1; i > 0; i--) {
+		if (l->lods[i].error * pixels_per_unit <= pixel_error)
+			break;
+	}
+
+	return i;
+}
+
+void wf_lods_clean(struct wf_lods *l)
+{
+	for (unsigned int i = 0; i < l->nr_lods; i++)
+		free(l->lods[i].indices);
+
+	memset(l, 0, sizeof(*l));
+}
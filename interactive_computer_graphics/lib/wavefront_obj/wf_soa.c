@@ -0,0 +1,400 @@
+// structure of arrays positions and batch kernels
+//
+// x, y and z are separate 64 byte aligned streams, so a kernel loads 8 (avx) or 4 (sse) coordinates of one
+// axis by one instruction and no shuffles are needed. Large batches are split into contiguous ranges which
+// are processed by threads, the first range on the calling thread.
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <icg/log.h>
+
+#include "wavefront_obj.h"
+#include "wf_mesh_internal.h"
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// stream alignment and padding, a cache line
+#define WF_SOA_ALIGN 64
+
+// smallest range of a thread, smaller batches do not pay for thread creation
+#define WF_SOA_MIN_RANGE (1 << 16)
+
+#if defined(__AVX__)
+
+#define WF_SOA_WIDTH 8
+typedef __m256 wf_vf;
+#define wf_vf_load(p) _mm256_loadu_ps(p)
+#define wf_vf_store(p, v) _mm256_storeu_ps(p, v)
+#define wf_vf_set1(x) _mm256_set1_ps(x)
+#define wf_vf_add(a, b) _mm256_add_ps(a, b)
+#define wf_vf_sub(a, b) _mm256_sub_ps(a, b)
+#define wf_vf_mul(a, b) _mm256_mul_ps(a, b)
+#define wf_vf_min(a, b) _mm256_min_ps(a, b)
+#define wf_vf_max(a, b) _mm256_max_ps(a, b)
+
+#elif defined(__SSE2__)
+
+#define WF_SOA_WIDTH 4
+typedef __m128 wf_vf;
+#define wf_vf_load(p) _mm_loadu_ps(p)
+#define wf_vf_store(p, v) _mm_storeu_ps(p, v)
+#define wf_vf_set1(x) _mm_set1_ps(x)
+#define wf_vf_add(a, b) _mm_add_ps(a, b)
+#define wf_vf_sub(a, b) _mm_sub_ps(a, b)
+#define wf_vf_mul(a, b) _mm_mul_ps(a, b)
+#define wf_vf_min(a, b) _mm_min_ps(a, b)
+#define wf_vf_max(a, b) _mm_max_ps(a, b)
+
+#else
+
+#define WF_SOA_WIDTH 1
+typedef float wf_vf;
+#define wf_vf_load(p) (*(p))
+#define wf_vf_store(p, v) (*(p) = (v))
+#define wf_vf_set1(x) (x)
+#define wf_vf_add(a, b) ((a) + (b))
+#define wf_vf_sub(a, b) ((a) - (b))
+#define wf_vf_mul(a, b) ((a) * (b))
+#define wf_vf_min(a, b) ((a) < (b) ? (a) : (b))
+#define wf_vf_max(a, b) ((a) > (b) ? (a) : (b))
+
+#endif
+
+struct wf_soa_range;
+
+typedef void (*wf_soa_kernel)(struct wf_soa_range *r);
+
+// range of a thread, inputs and results of the kernel
+struct wf_soa_range {
+	wf_soa_kernel kernel;
+	const struct wf_soa *in;
+	struct wf_soa *out;
+	const float (*m)[4];
+	size_t first;
+	size_t count;
+
+	float center[3];
+	float min[3], max[3];
+	float r2;
+};
+
+static inline float wf_soa_minf(float a, float b)
+{
+	return a < b ? a : b;
+}
+
+static inline float wf_soa_maxf(float a, float b)
+{
+	return a > b ? a : b;
+}
+
+// x' = m * (x, y, z, w), w is 1 for points and 0 for directions, sums in the order of mat4x4_mul_vec4()
+static void wf_soa_transform(struct wf_soa_range *r, int w)
+{
+	const float *x = r->in->x, *y = r->in->y, *z = r->in->z;
+	float *ox = r->out->x, *oy = r->out->y, *oz = r->out->z;
+	const float (*m)[4] = r->m;
+	wf_vf mv[4][3], vx, vy, vz;
+	size_t i = r->first, end = r->first + r->count;
+
+	for (int c = 0; c < 4; c++) {
+		for (int k = 0; k < 3; k++)
+			mv[c][k] = wf_vf_set1(m[c][k]);
+	}
+
+	for (; i + WF_SOA_WIDTH <= end; i += WF_SOA_WIDTH) {
+		vx = wf_vf_load(x + i);
+		vy = wf_vf_load(y + i);
+		vz = wf_vf_load(z + i);
+
+		for (int k = 0; k < 3; k++) {
+			wf_vf v = wf_vf_mul(mv[0][k], vx);
+
+			v = wf_vf_add(v, wf_vf_mul(mv[1][k], vy));
+			v = wf_vf_add(v, wf_vf_mul(mv[2][k], vz));
+			if (w)
+				v = wf_vf_add(v, mv[3][k]);
+
+			wf_vf_store((k == 0 ? ox : k == 1 ? oy : oz) + i, v);
+		}
+	}
+
+	for (; i < end; i++) {
+		float p[3] = {x[i], y[i], z[i]}, v[3];
+
+		for (int k = 0; k < 3; k++) {
+			v[k] = m[0][k] * p[0] + m[1][k] * p[1] + m[2][k] * p[2];
+			if (w)
+				v[k] += m[3][k];
+		}
+
+		ox[i] = v[0];
+		oy[i] = v[1];
+		oz[i] = v[2];
+	}
+}
+
+static void wf_soa_points(struct wf_soa_range *r)
+{
+	wf_soa_transform(r, 1);
+}
+
+static void wf_soa_directions(struct wf_soa_range *r)
+{
+	wf_soa_transform(r, 0);
+}
+
+static void wf_soa_min_max(const float *v, size_t first, size_t end, float *min, float *max)
+{
+	wf_vf vmin = wf_vf_set1(INFINITY), vmax = wf_vf_set1(-INFINITY), t;
+	float lanes_min[WF_SOA_WIDTH], lanes_max[WF_SOA_WIDTH];
+	size_t i = first;
+
+	for (; i + WF_SOA_WIDTH <= end; i += WF_SOA_WIDTH) {
+		t = wf_vf_load(v + i);
+		vmin = wf_vf_min(vmin, t);
+		vmax = wf_vf_max(vmax, t);
+	}
+
+	wf_vf_store(lanes_min, vmin);
+	wf_vf_store(lanes_max, vmax);
+
+	*min = INFINITY;
+	*max = -INFINITY;
+
+	for (int j = 0; j < WF_SOA_WIDTH; j++) {
+		*min = wf_soa_minf(*min, lanes_min[j]);
+		*max = wf_soa_maxf(*max, lanes_max[j]);
+	}
+
+	for (; i < end; i++) {
+		*min = wf_soa_minf(*min, v[i]);
+		*max = wf_soa_maxf(*max, v[i]);
+	}
+}
+
+static void wf_soa_bounds_kernel(struct wf_soa_range *r)
+{
+	size_t end = r->first + r->count;
+
+	wf_soa_min_max(r->in->x, r->first, end, &r->min[0], &r->max[0]);
+	wf_soa_min_max(r->in->y, r->first, end, &r->min[1], &r->max[1]);
+	wf_soa_min_max(r->in->z, r->first, end, &r->min[2], &r->max[2]);
+}
+
+// max squared distance to the center
+static void wf_soa_radius_kernel(struct wf_soa_range *r)
+{
+	const float *x = r->in->x, *y = r->in->y, *z = r->in->z;
+	wf_vf cx = wf_vf_set1(r->center[0]), cy = wf_vf_set1(r->center[1]), cz = wf_vf_set1(r->center[2]);
+	wf_vf vmax = wf_vf_set1(0), dx, dy, dz;
+	float lanes[WF_SOA_WIDTH], d;
+	size_t i = r->first, end = r->first + r->count;
+
+	for (; i + WF_SOA_WIDTH <= end; i += WF_SOA_WIDTH) {
+		dx = wf_vf_sub(wf_vf_load(x + i), cx);
+		dy = wf_vf_sub(wf_vf_load(y + i), cy);
+		dz = wf_vf_sub(wf_vf_load(z + i), cz);
+		vmax = wf_vf_max(vmax, wf_vf_add(wf_vf_add(wf_vf_mul(dx, dx), wf_vf_mul(dy, dy)), wf_vf_mul(dz, dz)));
+	}
+
+	wf_vf_store(lanes, vmax);
+	r->r2 = 0;
+
+	for (int j = 0; j < WF_SOA_WIDTH; j++)
+		r->r2 = wf_soa_maxf(r->r2, lanes[j]);
+
+	for (; i < end; i++) {
+		d = (x[i] - r->center[0]) * (x[i] - r->center[0]) + (y[i] - r->center[1]) * (y[i] - r->center[1]) +
+		    (z[i] - r->center[2]) * (z[i] - r->center[2]);
+		r->r2 = wf_soa_maxf(r->r2, d);
+	}
+}
+
+static void *wf_soa_worker(void *arg)
+{
+	struct wf_soa_range *r = arg;
+
+	r->kernel(r);
+	return NULL;
+}
+
+// split count elements into ranges of whole cache lines and run kernel on them
+// \return number of ranges
+static unsigned int wf_soa_run(struct wf_soa_range *ranges, unsigned int nr_ranges, size_t count)
+{
+	const size_t line = WF_SOA_ALIGN / sizeof(float);
+	size_t step = ((count + nr_ranges - 1) / nr_ranges + line - 1) / line * line;
+	pthread_t threads[nr_ranges];
+	int started[nr_ranges];
+	unsigned int n = 0;
+
+	for (size_t first = 0; first < count || !n; first += step, n++) {
+		if (n)
+			ranges[n] = ranges[0];
+
+		ranges[n].first = first;
+		ranges[n].count = count - first < step ? count - first : step;
+	}
+
+	for (unsigned int i = 1; i < n; i++) {
+		started[i] = !pthread_create(&threads[i], NULL, wf_soa_worker, &ranges[i]);
+		if (!started[i])
+			wf_soa_worker(&ranges[i]);
+	}
+
+	wf_soa_worker(&ranges[0]);
+
+	for (unsigned int i = 1; i < n; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+	}
+
+	return n;
+}
+
+static unsigned int wf_soa_nr_ranges(size_t count, unsigned int nr_threads)
+{
+	size_t n = count / WF_SOA_MIN_RANGE;
+
+	if (n > nr_threads)
+		n = nr_threads;
+
+	return n ? n : 1;
+}
+
+int wf_soa_init(struct wf_soa *s, size_t count)
+{
+	// padded to whole cache lines, aligned_alloc() needs a multiple of the alignment
+	size_t size = ((count * sizeof(float) + WF_SOA_ALIGN - 1) / WF_SOA_ALIGN + 1) * WF_SOA_ALIGN;
+
+	memset(s, 0, sizeof(*s));
+
+	s->x = aligned_alloc(WF_SOA_ALIGN, size);
+	s->y = aligned_alloc(WF_SOA_ALIGN, size);
+	s->z = aligned_alloc(WF_SOA_ALIGN, size);
+	if (!s->x || !s->y || !s->z) {
+		icg_log_error("malloc() fail\n");
+		wf_soa_clean(s);
+		return ENOMEM;
+	}
+
+	s->count = count;
+	return 0;
+}
+
+int wf_obj_soa(const struct wf_obj *o, struct wf_soa *s)
+{
+	int r;
+
+	r = wf_soa_init(s, o->nr_vertices);
+	if (r)
+		return r;
+
+	for (size_t i = 0; i < s->count; i++) {
+		s->x[i] = o->vertices[i].x;
+		s->y[i] = o->vertices[i].y;
+		s->z[i] = o->vertices[i].z;
+	}
+
+	return 0;
+}
+
+int wf_mesh_soa(const struct wf_mesh *m, struct wf_soa *s)
+{
+	const float *p;
+	int r;
+
+	r = wf_soa_init(s, m->nr_vertices);
+	if (r)
+		return r;
+
+	for (size_t i = 0; i < s->count; i++) {
+		p = wf_mesh_position(m, i);
+		s->x[i] = p[0];
+		s->y[i] = p[1];
+		s->z[i] = p[2];
+	}
+
+	return 0;
+}
+
+void wf_soa_transform_points(const struct wf_soa *in, const float m[4][4], unsigned int nr_threads, struct wf_soa *out)
+{
+	unsigned int n = wf_soa_nr_ranges(in->count, nr_threads);
+	struct wf_soa_range ranges[n];
+
+	ranges[0] = (struct wf_soa_range){.kernel = wf_soa_points, .in = in, .out = out, .m = m};
+	wf_soa_run(ranges, n, in->count);
+}
+
+void wf_soa_transform_directions(const struct wf_soa *in, const float m[4][4], unsigned int nr_threads,
+				 struct wf_soa *out)
+{
+	unsigned int n = wf_soa_nr_ranges(in->count, nr_threads);
+	struct wf_soa_range ranges[n];
+
+	ranges[0] = (struct wf_soa_range){.kernel = wf_soa_directions, .in = in, .out = out, .m = m};
+	wf_soa_run(ranges, n, in->count);
+}
+
+void wf_soa_bounds(const struct wf_soa *s, unsigned int nr_threads, float min[3], float max[3])
+{
+	unsigned int n = wf_soa_nr_ranges(s->count, nr_threads);
+	struct wf_soa_range ranges[n];
+
+	ranges[0] = (struct wf_soa_range){.kernel = wf_soa_bounds_kernel, .in = s};
+	n = wf_soa_run(ranges, n, s->count);
+
+	for (int k = 0; k < 3; k++) {
+		min[k] = ranges[0].min[k];
+		max[k] = ranges[0].max[k];
+
+		for (unsigned int i = 1; i < n; i++) {
+			min[k] = wf_soa_minf(min[k], ranges[i].min[k]);
+			max[k] = wf_soa_maxf(max[k], ranges[i].max[k]);
+		}
+	}
+}
+
+void wf_soa_sphere(const struct wf_soa *s, unsigned int nr_threads, float center[3], float *radius)
+{
+	unsigned int n = wf_soa_nr_ranges(s->count, nr_threads);
+	struct wf_soa_range ranges[n];
+	float min[3], max[3], r2 = 0;
+
+	wf_soa_bounds(s, nr_threads, min, max);
+
+	if (!s->count) {
+		center[0] = center[1] = center[2] = 0;
+		*radius = 0;
+		return;
+	}
+
+	for (int k = 0; k < 3; k++)
+		center[k] = (min[k] + max[k]) * 0.5f;
+
+	ranges[0] = (struct wf_soa_range){.kernel = wf_soa_radius_kernel, .in = s};
+	memcpy(ranges[0].center, center, sizeof(ranges[0].center));
+	n = wf_soa_run(ranges, n, s->count);
+
+	for (unsigned int i = 0; i < n; i++)
+		r2 = wf_soa_maxf(r2, ranges[i].r2);
+
+	*radius = sqrtf(r2);
+}
+
+void wf_soa_clean(struct wf_soa *s)
+{
+	free(s->x);
+	free(s->y);
+	free(s->z);
+	memset(s, 0, sizeof(*s));
+}
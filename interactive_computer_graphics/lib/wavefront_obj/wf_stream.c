@@ -0,0 +1,263 @@
+// streaming obj loader, the file is read through a fixed buffer and parsed into fixed batches,
+// memory does not depend on the file size
+
+#define _GNU_SOURCE // memrchr()
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <icg/log.h>
+
+#include "wavefront_obj.h"
+#include "wf_obj_internal.h"
+
+// smallest read buffer, bytes; the longest line must fit it
+#define WF_STREAM_MIN_TEXT (64 * 1024)
+
+// smallest batch, elements of every stream
+#define WF_STREAM_MIN_BATCH 256
+
+// refill read buffer keeping not yet parsed bytes, \return 0 or an error
+static int wf_stream_read(struct wf_stream *s)
+{
+	size_t left = s->text_end - s->text_begin;
+	ssize_t n;
+
+	if (s->text_begin == 0 && s->text_end == s->text_size) {
+		icg_log_error("line %zu is longer than stream buffer %zu\n", s->line, s->text_size);
+		return E2BIG;
+	}
+
+	memmove(s->text, s->text + s->text_begin, left);
+	s->text_begin = 0;
+	s->text_end = left;
+
+	do {
+		n = read(s->fd, s->text + s->text_end, s->text_size - s->text_end);
+	} while (n < 0 && errno == EINTR);
+
+	if (n < 0) {
+		icg_log_error("read() fail: %s (%d)\n", strerror(errno), errno);
+		return errno;
+	}
+
+	s->text_end += n;
+	s->eof = n == 0;
+
+	return 0;
+}
+
+// end of the complete lines in the buffer, the whole rest at the end of file
+static size_t wf_stream_lines_end(const struct wf_stream *s)
+{
+	const char *nl;
+
+	if (s->eof)
+		return s->text_end;
+
+	nl = memrchr(s->text + s->text_begin, '\n', s->text_end - s->text_begin);
+	return nl ? (size_t)(nl + 1 - s->text) : s->text_begin;
+}
+
+static int wf_stream_count(struct wf_stream *s)
+{
+	struct wf_obj_counts c;
+	size_t end;
+	int r;
+
+	while (!s->eof) {
+		r = wf_stream_read(s);
+		if (r)
+			return r;
+
+		end = wf_stream_lines_end(s);
+		wf_obj_count(s->text + s->text_begin, s->text + end, &c);
+		s->text_begin = end;
+
+		s->nr_vertices += c.nr_vertices;
+		s->nr_texcoords += c.nr_texcoords;
+		s->nr_normals += c.nr_normals;
+		s->nr_corners += c.nr_corners;
+	}
+
+	if (lseek(s->fd, 0, SEEK_SET) < 0) {
+		icg_log_error("lseek() fail: %s (%d)\n", strerror(errno), errno);
+		return errno;
+	}
+
+	s->text_begin = s->text_end = 0;
+	s->eof = 0;
+
+	return 0;
+}
+
+int wf_stream_open(const char *filename, unsigned int flags, size_t memory_limit, struct wf_stream *s)
+{
+	struct wf_obj *b = &s->batch;
+	size_t text_size = memory_limit / 4, batch_size;
+	char *p;
+	int r;
+
+	memset(s, 0, sizeof(*s));
+	s->fd = -1;
+	s->flags = flags;
+	s->line = 1;
+
+	if (text_size < WF_STREAM_MIN_TEXT)
+		text_size = WF_STREAM_MIN_TEXT;
+
+	// a quarter of the rest per attribute stream
+	batch_size = memory_limit > text_size ? (memory_limit - text_size) / 4 : 0;
+
+	b->flags = WF_OBJ_FIXED;
+	b->cap_vertices = batch_size / sizeof(*b->vertices);
+	b->cap_texcoords = batch_size / sizeof(*b->texcoords);
+	b->cap_normals = batch_size / sizeof(*b->normals);
+	b->cap_corners = batch_size / sizeof(*b->corners);
+
+	if (b->cap_vertices < WF_STREAM_MIN_BATCH)
+		b->cap_vertices = WF_STREAM_MIN_BATCH;
+	if (b->cap_texcoords < WF_STREAM_MIN_BATCH)
+		b->cap_texcoords = WF_STREAM_MIN_BATCH;
+	if (b->cap_normals < WF_STREAM_MIN_BATCH)
+		b->cap_normals = WF_STREAM_MIN_BATCH;
+	if (b->cap_corners < WF_STREAM_MIN_BATCH)
+		b->cap_corners = WF_STREAM_MIN_BATCH;
+
+	// one block, every stream is a slot of it
+	p = malloc(text_size +
+		   b->cap_vertices * sizeof(*b->vertices) +
+		   b->cap_texcoords * sizeof(*b->texcoords) +
+		   b->cap_normals * sizeof(*b->normals) +
+		   b->cap_corners * sizeof(*b->corners));
+	if (!p) {
+		icg_log_error("malloc() fail\n");
+		return ENOMEM;
+	}
+
+	b->corners = (struct wf_index *)p;
+	b->vertices = (struct wf_vertex *)(b->corners + b->cap_corners);
+	b->normals = (struct wf_normal *)(b->vertices + b->cap_vertices);
+	b->texcoords = (struct wf_texcoord *)(b->normals + b->cap_normals);
+	s->text = (char *)(b->texcoords + b->cap_texcoords);
+	s->text_size = text_size;
+
+	s->fd = open(filename, O_RDONLY);
+	if (s->fd < 0) {
+		r = errno;
+		icg_log_error("open('%s') fail: %s (%d)\n", filename, strerror(r), r);
+		goto fail;
+	}
+
+	posix_fadvise(s->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	if (flags & WF_OBJ_PRESIZE) {
+		r = wf_stream_count(s);
+		if (r)
+			goto fail;
+	}
+
+	return 0;
+
+fail:
+	wf_stream_close(s);
+	return r;
+}
+
+int wf_stream_next(struct wf_stream *s)
+{
+	struct wf_obj *b = &s->batch;
+	struct wf_obj_counts base = {0};
+	struct wf_obj_error err;
+	const char *cursor;
+	size_t end;
+	int r;
+
+	s->first_vertex += b->nr_vertices;
+	s->first_texcoord += b->nr_texcoords;
+	s->first_normal += b->nr_normals;
+	s->first_corner += b->nr_corners;
+	b->nr_vertices = b->nr_texcoords = b->nr_normals = b->nr_corners = 0;
+
+	base.nr_vertices = s->first_vertex;
+	base.nr_texcoords = s->first_texcoord;
+	base.nr_normals = s->first_normal;
+	base.nr_corners = s->first_corner;
+
+	for (;;) {
+		end = wf_stream_lines_end(s);
+
+		if (end > s->text_begin) {
+			cursor = s->text + s->text_begin;
+			err.line = s->line;
+
+			r = wf_obj_parse_range(&cursor, s->text + end, b, &base, &err);
+
+			s->text_begin = cursor - s->text;
+			s->line = err.line;
+
+			// batch is full, the line is parsed by the next call
+			if (r == EOVERFLOW) {
+				if (b->nr_vertices || b->nr_texcoords || b->nr_normals || b->nr_corners)
+					return 0;
+
+				icg_log_error("line %zu does not fit stream batch\n", s->line);
+				return E2BIG;
+			}
+
+			if (r) {
+				wf_obj_print_error(r, &err);
+				return r;
+			}
+		}
+
+		if (s->eof)
+			break;
+
+		r = wf_stream_read(s);
+		if (r)
+			return r;
+	}
+
+	if (!b->nr_vertices && !b->nr_texcoords && !b->nr_normals && !b->nr_corners)
+		return ENODATA;
+
+	return 0;
+}
+
+void wf_stream_close(struct wf_stream *s)
+{
+	if (s->fd >= 0)
+		close(s->fd);
+
+	// the batch streams and the buffer are one block starting at corners
+	free(s->batch.corners);
+
+	memset(s, 0, sizeof(*s));
+	s->fd = -1;
+}
+
+int wf_stream_load(const char *filename, unsigned int flags, size_t memory_limit, wf_stream_fn on_batch, void *ctx)
+{
+	struct wf_stream s;
+	int r;
+
+	r = wf_stream_open(filename, flags, memory_limit, &s);
+	if (r)
+		return r;
+
+	while (!(r = wf_stream_next(&s))) {
+		r = on_batch(ctx, &s);
+		if (r)
+			break;
+	}
+
+	wf_stream_close(&s);
+
+	return r == ENODATA ? 0 : r;
+}